@@ -3,7 +3,7 @@
 %
 function AMICO_Fit()
 
-	global CONFIG niiSIGNAL niiMASK bMATRIX
+	global CONFIG niiSIGNAL niiMASK bMATRIX KERNELS
 
 	% Fit right model to each voxel
     % =============================
@@ -12,48 +12,73 @@ function AMICO_Fit()
         % fit the model to the data
         fprintf( '\n-> Fitting "%s" model to %d voxels:\n', CONFIG.model.name, nnz(niiMASK.img) );
         TIME = tic;
-        progress = ProgressBar( nnz(niiMASK.img) );
-        for iz = 1:niiSIGNAL.hdr.dime.dim(4)
-        for iy = 1:niiSIGNAL.hdr.dime.dim(3)
-        for ix = 1:niiSIGNAL.hdr.dime.dim(2)
-            if niiMASK.img(ix,iy,iz)==0, continue, end
-            progress.update();
+        if exist('amico_mex','file')==3 && strcmp(CONFIG.model.id,'NODDI')
+            % compiled engine: all voxels of the mask at once, grouped by
+            % direction, written into the maps below
+            nS   = size(niiSIGNAL.img,4);
+            mask = niiMASK.img(:)~=0;
+            Y    = reshape( niiSIGNAL.img, [], nS );
+            opts = struct( 'Exvivo', CONFIG.model.isExvivo, 'Lambda', CONFIG.OPTIMIZATION.SPAMS_param.lambda, ...
+                           'Lambda2', CONFIG.OPTIMIZATION.SPAMS_param.lambda2, 'TolX', CONFIG.OPTIMIZATION.LS_param.TolX );
+            [ vox_MAPs, vox_DIRs ] = amico_mex( double(Y(mask,:)), CONFIG.scheme, KERNELS, opts );
+            skipped = isnan( vox_DIRs(:,1) ); % b0 < 1e-3: left to 0, as in the loop
+            vox_MAPs(skipped,:) = 0;
+            vox_DIRs(skipped,:) = 0;
+            dim  = niiSIGNAL.hdr.dime.dim(2:4);
+            MAPs = zeros( [numel(mask) size(vox_MAPs,2)] );
+            DIRs = zeros( [numel(mask) 3] );
+            MAPs(mask,:) = vox_MAPs;
+            DIRs(mask,:) = vox_DIRs;
+            MAPs = reshape( MAPs, [dim size(vox_MAPs,2)] );
+            DIRs = reshape( DIRs, [dim 3] );
+            if ( CONFIG.model.isExvivo )
+                CONFIG.model.OUTPUT_names{4} = 'DOTVF';
+                CONFIG.model.OUTPUT_descriptions{4} = 'Dot volume fraction';
+            end
+        else
+            progress = ProgressBar( nnz(niiMASK.img) );
+            for iz = 1:niiSIGNAL.hdr.dime.dim(4)
+            for iy = 1:niiSIGNAL.hdr.dime.dim(3)
+            for ix = 1:niiSIGNAL.hdr.dime.dim(2)
+                if niiMASK.img(ix,iy,iz)==0, continue, end
+                progress.update();
             
-            try
-                % Read the signal
-                b0 = mean( squeeze( niiSIGNAL.img(ix,iy,iz,CONFIG.scheme.b0_idx) ) );
-                if ( b0 < 1e-3 ), continue, end
-                y = double( squeeze( niiSIGNAL.img(ix,iy,iz,:) ) ./ ( b0 + eps ) );
-                y( y < 0 ) = 0; % [NOTE] this should not happen!
-
-                % Find the MAIN DIFFUSION DIRECTIONS
-                if any(strcmp(properties(CONFIG.model), 'max_dirs'))==false || CONFIG.model.max_dirs>0
-                    % using DTI
-                    [ ~, ~, V ] = AMICO_FitTensor( y, bMATRIX );
-                    vox_DIRs = V(:,1);
-                    if ( vox_DIRs(2)<0 ), vox_DIRs = -vox_DIRs; end
-                    [ i1, i2 ] = AMICO_Dir2idx( vox_DIRs );
-                    DIRs(ix,iy,iz,:) = vox_DIRs;
-                else
-                    % not needed by the model
-                    DIRs(ix,iy,iz,:) = 0;
-                    i1 = 1;
-                    i2 = 1;
+                try
+                    % Read the signal
+                    b0 = mean( squeeze( niiSIGNAL.img(ix,iy,iz,CONFIG.scheme.b0_idx) ) );
+                    if ( b0 < 1e-3 ), continue, end
+                    y = double( squeeze( niiSIGNAL.img(ix,iy,iz,:) ) ./ ( b0 + eps ) );
+                    y( y < 0 ) = 0; % [NOTE] this should not happen!
+
+                    % Find the MAIN DIFFUSION DIRECTIONS
+                    if any(strcmp(properties(CONFIG.model), 'max_dirs'))==false || CONFIG.model.max_dirs>0
+                        % using DTI
+                        [ ~, ~, V ] = AMICO_FitTensor( y, bMATRIX );
+                        vox_DIRs = V(:,1);
+                        if ( vox_DIRs(2)<0 ), vox_DIRs = -vox_DIRs; end
+                        [ i1, i2 ] = AMICO_Dir2idx( vox_DIRs );
+                        DIRs(ix,iy,iz,:) = vox_DIRs;
+                    else
+                        % not needed by the model
+                        DIRs(ix,iy,iz,:) = 0;
+                        i1 = 1;
+                        i2 = 1;
+                    end
+
+                    % Dispatch to the right handler for each model
+                    vox_MAPs = CONFIG.model.Fit( y, i1, i2 );
+
+                    % Store results
+                    MAPs(ix,iy,iz,:) = vox_MAPs;
+                catch exception
+                    % set output maps to NaN in case of problems
+                    MAPs(ix,iy,iz,:) = NaN;
                 end
-
-                % Dispatch to the right handler for each model
-                vox_MAPs = CONFIG.model.Fit( y, i1, i2 );
-
-                % Store results
-                MAPs(ix,iy,iz,:) = vox_MAPs;
-            catch exception
-                % set output maps to NaN in case of problems
-                MAPs(ix,iy,iz,:) = NaN;
             end
+            end
+            end
+            progress.close();
         end
-        end
-        end
-        progress.close();
 
         TIME = toc(TIME);
         fprintf( '   [ %.0fh %.0fm %.0fs ]\n', floor(TIME/3600), floor(mod(TIME/60,60)), mod(TIME,60) )
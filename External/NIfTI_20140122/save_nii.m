@@ -102,6 +102,13 @@ function save_nii(nii, fileprefix, old_RGB)
       fileprefix(end-3:end)='';
    end
 
+   %  With qmr_nii_mex compiled (qMRbuildMex), a .nii.gz is compressed in
+   %  memory, in parallel, without writing the .nii first
+   %
+   if exist('gzFile', 'var') && filetype == 2 && write_nii_gz(nii, [fileprefix '.nii.gz'])
+      return
+   end
+
    write_nii(nii, filetype, fileprefix, old_RGB);
 
    %  gzip output file if requested
@@ -284,3 +291,38 @@ function write_nii(nii, filetype, fileprefix, old_RGB)
 
    return;					% write_nii
 
+
+%  Writes nii with qmr_nii_mex, if compiled and the image is of a
+%  supported (real, non-RGB) data type. Returns false otherwise.
+%
+function done = write_nii_gz(nii, filename)
+
+   types = {2 'uint8'; 4 'int16'; 8 'int32'; 16 'single'; 64 'double'; ...
+      256 'int8'; 512 'uint16'; 768 'uint32'; 1024 'int64'; 1280 'uint64'};
+   hdr = nii.hdr;
+   row = find([types{:,1}] == double(hdr.dime.datatype));
+   dim = double(hdr.dime.dim);
+   done = exist('qmr_nii_mex','file') == 3 && ~isempty(row) && isreal(nii.img) && ...
+      ~(isfield(nii,'ext') && ~isempty(nii.ext)) && ...
+      dim(1) >= 1 && dim(1) <= 7 && prod(dim(2:dim(1)+1)) == numel(nii.img);
+
+   if ~done
+      return;
+   end
+
+   hdr.dime.glmax = round(double(max(nii.img(:))));
+   hdr.dime.glmin = round(double(min(nii.img(:))));
+
+   %  Default sform, as save_nii_hdr
+   %
+   if hdr.hist.qform_code == 0 && hdr.hist.sform_code == 0
+      hdr.hist.sform_code = 1;
+      hdr.hist.srow_x = [hdr.dime.pixdim(2) 0 0 (1-hdr.hist.originator(1))*hdr.dime.pixdim(2)];
+      hdr.hist.srow_y = [0 hdr.dime.pixdim(3) 0 (1-hdr.hist.originator(2))*hdr.dime.pixdim(3)];
+      hdr.hist.srow_z = [0 0 hdr.dime.pixdim(4) (1-hdr.hist.originator(3))*hdr.dime.pixdim(4)];
+   end
+
+   qmr_nii_mex('save', filename, hdr, cast(nii.img, types{row,2}));
+
+   return;					% write_nii_gz
+
@@ -524,6 +524,9 @@ dict = dicm_dict('SIEMENS', flds); % dicm_hdr will update vendor if needed
 % read header for all files, use parpool if available and worthy
 if ~no_save, fprintf('Validating %g files ...\n', nFile); end
 hh = cell(1, nFile); errStr = cell(1, nFile);
+if exist('qmr_dicm_mex','file')==3 % qMRLab: native parser, in parallel
+    [hh, errStr, dict] = qMRdicmHdr(fnames, dict);
+else
 doParFor = pf.use_parfor && nFile>2000 && useParTool;
 for k = 1:nFile
     [hh{k}, errStr{k}, dict] = dicm_hdr(fnames{k}, dict);
@@ -534,6 +537,7 @@ for k = 1:nFile
         break; 
     end
 end
+end
 
 %% sort headers into cell h by SeriesInstanceUID, EchoTime and InstanceNumber
 h = {}; % in case of no dicom files at all
@@ -1046,15 +1050,20 @@ for i = 1:nRun
         h{i}{1}.LastFile = h{i}{nFile}; % store partial last header into 1st
     end
     
+    img = [];
+    if nFile>1 && exist('qmr_dicm_mex','file')==3 % qMRLab: all files at once
+        img = qmr_dicm_mex('img', h{i}); % [] if dicm_img is needed
+    end
+    native = ~isempty(img);
     for j = 1:nFile
         if j==1
-            img = dicm_img(s, 0); % initialize img with dicm data type
-            if ndims(img)>4 % err out, likely won't work for other series
+            if ~native, img = dicm_img(s, 0); end % initialize img with dicm data type
+            if ndims(img)>4+native % err out, likely won't work for other series
                 error('Image with 5 or more dim not supported: %s', s.NiftiName);
             end
             applyRescale = tryGetField(s, 'ApplyRescale', false);
             if applyRescale, img = single(img); end
-        else
+        elseif ~native
             if j==2, img(:,:,:,:,nFile) = 0; end % pre-allocate for speed
             img(:,:,:,:,j) = dicm_img(h{i}{j}, 0);
         end
@@ -1051,7 +1051,16 @@ valpix = para.valpix(ind);
 fname = nii_name(hdr.file_name, '.img'); % in case of .hdr/.img pair
 fid = fopen(fname);
 sig = fread(fid, 2, '*uint8')';
-if isequal(sig, [31 139]) % .gz
+if isequal(sig, [31 139]) && exist('qmr_nii_mex', 'file')==3 && ...
+        any(hdr.datatype == [2 4 8 16 64 256 512 768 1024 1280])
+    fclose(fid); % qMRLab: inflate in memory, no temp file
+    img = reshape(qmr_nii_mex('slab', fname), dim);
+    c = hdr.intent_code;
+    if (c == 2003 && dim(5) == 3) || (c == 2004  && dim(5) == 4)
+        img = permute(img, [1:4 6:8 5]);
+    end
+    return;
+elseif isequal(sig, [31 139]) % .gz
     fclose(fid);
     fname = gunzipOS(fname);
     cln = onCleanup(@() deleteFile(fname)); % delete gunzipped file
@@ -44,8 +44,12 @@ dict = dicm_dict('', {'PatientName' 'PatientID' 'StudyID'});
 h = struct;
 n = numel(fnames);
 nDicm = 0;
+native = exist('qmr_dicm_mex','file')==3; % qMRLab: read all headers in parallel
+if native, hh = qMRdicmHdr(fnames, dict, false); end
 for i = 1:n
-    s = dicm_hdr(fnames{i}, dict);
+    if native, s = hh{i};
+    else, s = dicm_hdr(fnames{i}, dict);
+    end
     if isempty(s), continue; end
 
     if isfield(s, 'PatientName'), subj = s.PatientName;
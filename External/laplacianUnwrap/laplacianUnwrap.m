@@ -48,50 +48,58 @@ function [phaseUnwrapped, phaseLaplacianFiltered] = laplacianUnwrap(phaseWrapped
             phaseWrapped = phaseWrappedNew; clear phaseWrappedNew;
     
     
-    %% Preparation:
-        % making the phaseWrapped data complex:
-        P = exp(1i*phaseWrapped); clear phaseWrapped;
-        N = size(P); 
-        dkx = 1/N(2); 
-        dky = 1/N(1); 
-        dkz = 1/N(3); 
-        
-    %% Prepare the inverse (and forward) Laplacian filter:
-    if DISCRETE_LAPACIAN
-        lap_x = 2 - 2*cos((0:(N(2)-1))*dkx*2*pi);
-        lap_y = 2 - 2*cos((0:(N(1)-1))*dky*2*pi);
-        lap_z = 2 - 2*cos((0:(N(3)-1))*dkz*2*pi);       
+    if DISCRETE_LAPACIAN && exist('qsm_mex','file')==3
+        % Compiled engine (qMRbuildMex): same discrete Laplacian, inverted
+        % with real transforms (the embedded matrix has even dimensions)
+        [phaseUnwrapped, phaseLaplacianFiltered] = qsm_mex('laplacian', double(phaseWrapped), 'gradient');
+        clear phaseWrapped;
     else
-        lap_x = (3/2)*(16)*ifftshift(((-N(2)/2:N(2)/2-1)*dkx).^2); 
-        lap_y = (3/2)*(16)*ifftshift(((-N(1)/2:N(1)/2-1)*dky).^2); 
-        lap_z = (3/2)*(16)*ifftshift(((-N(3)/2:N(3)/2-1)*dkz).^2);
-    end
-    [lap_x,lap_y,lap_z] = meshgrid(lap_x,lap_y,lap_z);
-    del_op = (lap_x + lap_y + lap_z)/7; clear lap_x lap_y lap_z;
-    del_inv = 1./del_op;
-    del_inv(1,1,1) = 0;    
+        %% Preparation:
+            % making the phaseWrapped data complex:
+            P = exp(1i*phaseWrapped); clear phaseWrapped;
+            N = size(P); 
+            dkx = 1/N(2); 
+            dky = 1/N(1); 
+            dkz = 1/N(3); 
+        
+        %% Prepare the inverse (and forward) Laplacian filter:
+        if DISCRETE_LAPACIAN
+            lap_x = 2 - 2*cos((0:(N(2)-1))*dkx*2*pi);
+            lap_y = 2 - 2*cos((0:(N(1)-1))*dky*2*pi);
+            lap_z = 2 - 2*cos((0:(N(3)-1))*dkz*2*pi);       
+        else
+            lap_x = (3/2)*(16)*ifftshift(((-N(2)/2:N(2)/2-1)*dkx).^2); 
+            lap_y = (3/2)*(16)*ifftshift(((-N(1)/2:N(1)/2-1)*dky).^2); 
+            lap_z = (3/2)*(16)*ifftshift(((-N(3)/2:N(3)/2-1)*dkz).^2);
+        end
+        [lap_x,lap_y,lap_z] = meshgrid(lap_x,lap_y,lap_z);
+        del_op = (lap_x + lap_y + lap_z)/7; clear lap_x lap_y lap_z;
+        del_inv = 1./del_op;
+        del_inv(1,1,1) = 0;    
         
     
-    %% Forward Laplacian phase filtering:
-    if DISCRETE_LAPACIAN
-        % Start with first order derivative (complex division)
-        grad_y = angle(P./circshift(P, [ 1  0  0]));
-        grad_x = angle(P./circshift(P, [ 0  1  0]));
-        grad_z = angle(P./circshift(P, [ 0  0  1])); clear P;
-        % From which the second order derivative is calculated:
-        Lap_Phase_y = grad_y - circshift(grad_y, [-1  0  0]); clear grad_y;
-        Lap_Phase_x = grad_x - circshift(grad_x, [ 0 -1  0]); clear grad_x;
-        Lap_Phase_z = grad_z - circshift(grad_z, [ 0  0 -1]); clear grad_x;
-        % Whose summation is the Laplacian: 
-        phaseLaplacianFiltered = (Lap_Phase_y+Lap_Phase_x+Lap_Phase_z)/7;
-        clear Lap_Phase_y Lap_Phase_x Lap_Phase_z;
-    else
-        phaseLaplacianFiltered = imag(conj(P) .* ifftn(del_op .* fftn(P)));
-    end
+        %% Forward Laplacian phase filtering:
+        if DISCRETE_LAPACIAN
+            % Start with first order derivative (complex division)
+            grad_y = angle(P./circshift(P, [ 1  0  0]));
+            grad_x = angle(P./circshift(P, [ 0  1  0]));
+            grad_z = angle(P./circshift(P, [ 0  0  1])); clear P;
+            % From which the second order derivative is calculated:
+            Lap_Phase_y = grad_y - circshift(grad_y, [-1  0  0]); clear grad_y;
+            Lap_Phase_x = grad_x - circshift(grad_x, [ 0 -1  0]); clear grad_x;
+            Lap_Phase_z = grad_z - circshift(grad_z, [ 0  0 -1]); clear grad_x;
+            % Whose summation is the Laplacian: 
+            phaseLaplacianFiltered = (Lap_Phase_y+Lap_Phase_x+Lap_Phase_z)/7;
+            clear Lap_Phase_y Lap_Phase_x Lap_Phase_z;
+        else
+            phaseLaplacianFiltered = imag(conj(P) .* ifftn(del_op .* fftn(P)));
+        end
     
-    %% Inverse Laplacian phase filtering:
-    phaseUnwrapped = real(ifftn(del_inv.*fftn(phaseLaplacianFiltered)));
+        %% Inverse Laplacian phase filtering:
+        phaseUnwrapped = real(ifftn(del_inv.*fftn(phaseLaplacianFiltered)));
     
+    end
+
     %% reembedding into original matrix size:
     phaseUnwrapped_2 = zeros(Nold);
     phaseUnwrapped_2(y1, x1, z1) = phaseUnwrapped(y2, x2, z2);
@@ -0,0 +1,376 @@
+/*
+ * smoothn.hh: robust discretized spline smoothing of N-D data (smoothn.m,
+ * Garcia, Comput. Stat. Data Anal. 2010), for one component.
+ *
+ * The penalized least squares problem is solved in the DCT-II basis,
+ * where the smoother is diagonal: z = idctn(Gamma .* dctn(y)) with
+ * Gamma = 1./(1 + s*Lambda.^m). Weighted and missing data go through the
+ * iterative scheme of smoothn, robust smoothing through its three
+ * re-weighting steps, and the automatic smoothness through the same
+ * fminbnd search of the GCV score, so the iterations and the selected s
+ * are those of smoothn.m.
+ *
+ * The DCT plans (qmr_dct.hh) are built once per call and reused by every
+ * iteration and GCV evaluation. Lambda.^m is computed once; Gamma is never
+ * stored but evaluated where it is used, fused with the GCV sums, the
+ * filtering of the spectrum and the update of z. Robust weights are
+ * computed in place. Sums go through fixed blocks, so results do not
+ * depend on the number of threads.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef SMOOTHN_HH
+#define SMOOTHN_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_dct.hh"
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace smoothn {
+
+enum WeightFunction { kBisquare, kTalworth, kCauchy };
+
+struct Options {
+    double tolZ;            // termination tolerance on z
+    int    maxIter;         // iterations per robust step
+    int    order;           // 0, 1 or 2
+    WeightFunction weight;  // robust weight function
+    bool   robust;          // three iteratively re-weighted steps
+    bool   lowPass;         // low-pass filter the initial guess (InitialGuess)
+    int    numThreads;      // 0: all hardware threads
+
+    Options() : tolZ(1e-3), maxIter(100), order(2), weight(kBisquare), robust(false), lowPass(false),
+                numThreads(0) {}
+};
+
+struct Result {
+    double s;        // smoothness parameter used last
+    bool converged;  // exitflag of smoothn
+};
+
+namespace detail {
+
+static const std::size_t kBlock = 4096;
+
+// sum_i f(b, e) over fixed blocks of [0, n), added in block order.
+template <class F>
+double blockSum(std::size_t n, int nthreads, F f)
+{
+    const std::size_t nb = (n + kBlock - 1) / kBlock;
+    std::vector<double> part(nb);
+    parallel_for(nb, std::max<std::size_t>(1, nb / (4 * (std::size_t)num_threads(nthreads))),
+                 [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t k = b; k < e; ++k) part[k] = f(k * kBlock, std::min(n, (k + 1) * kBlock));
+    }, nthreads);
+    double s = 0;
+    for (std::size_t k = 0; k < nb; ++k) s += part[k];
+    return s;
+}
+
+template <class F>
+void blockFor(std::size_t n, int nthreads, F f)
+{
+    parallel_for(n, kBlock, [&](std::size_t b, std::size_t e, int) { f(b, e); }, nthreads);
+}
+
+// Median as MATLAB's (mean of the two middle values), reorders v.
+inline double median(std::vector<double> &v)
+{
+    if (v.empty()) return std::numeric_limits<double>::quiet_NaN();
+    const std::size_t h = v.size() / 2;
+    std::nth_element(v.begin(), v.begin() + h, v.end());
+    const double hi = v[h];
+    if (v.size() % 2) return hi;
+    return 0.5 * (*std::max_element(v.begin(), v.begin() + h) + hi);
+}
+
+// fminbnd (golden section and parabolic interpolation) as in MATLAB, with
+// TolX = tol. f is left at its last evaluated point, which is what
+// smoothn keeps (s and Gamma are set by its nested gcv).
+template <class F>
+void fminbnd(F f, double ax, double bx, double tol)
+{
+    const double seps = std::sqrt(std::numeric_limits<double>::epsilon());
+    const double c = 0.5 * (3.0 - std::sqrt(5.0));
+    double a = ax, b = bx;
+    double v = a + c * (b - a), w = v, xf = v;
+    double d = 0, e = 0;
+    double fx = f(xf), fv = fx, fw = fx;
+    double xm = 0.5 * (a + b), tol1 = seps * std::fabs(xf) + tol / 3, tol2 = 2 * tol1;
+    for (int num = 1; num < 500 && std::fabs(xf - xm) > tol2 - 0.5 * (b - a); ++num) {
+        bool golden = true;
+        if (std::fabs(e) > tol1) {
+            golden = false;
+            double r = (xf - w) * (fx - fv), q = (xf - v) * (fx - fw), p = (xf - v) * q - (xf - w) * r;
+            q = 2 * (q - r);
+            if (q > 0) p = -p;
+            q = std::fabs(q);
+            r = e;
+            e = d;
+            if (std::fabs(p) < std::fabs(0.5 * q * r) && p > q * (a - xf) && p < q * (b - xf)) {
+                d = p / q;
+                const double x = xf + d;
+                if (x - a < tol2 || b - x < tol2) d = xm - xf >= 0 ? tol1 : -tol1;
+            } else {
+                golden = true;
+            }
+        }
+        if (golden) {
+            e = xf >= xm ? a - xf : b - xf;
+            d = c * e;
+        }
+        const double x = xf + (d >= 0 ? 1 : -1) * std::max(std::fabs(d), tol1);
+        const double fu = f(x);
+        if (fu <= fx) {
+            if (x >= xf) a = xf;
+            else b = xf;
+            v = w; fv = fw;
+            w = xf; fw = fx;
+            xf = x; fx = fu;
+        } else {
+            if (x < xf) a = x;
+            else b = x;
+            if (fu <= fw || w == xf) {
+                v = w; fv = fw;
+                w = x; fw = fu;
+            } else if (fu <= fv || v == xf || v == w) {
+                v = x; fv = fu;
+            }
+        }
+        xm = 0.5 * (a + b);
+        tol1 = seps * std::fabs(xf) + tol / 3;
+        tol2 = 2 * tol1;
+    }
+}
+
+} // namespace detail
+
+// Smooths y (column-major, dims), with weights W (normalized to max 1, 0
+// at the missing values) and finite the mask of the finite values of y.
+// spacing holds the relative spacing of each dimension (max 1). s <= 0
+// selects s by GCV. z holds the initial guess on input (used when a weight
+// is < 1) and the smoothed array on output.
+inline Result smooth(const std::vector<std::size_t> &dims, const double *spacing, const double *y,
+                     const double *W, const unsigned char *finite, double s, const Options &opt, double *z)
+{
+    using detail::blockFor;
+    using detail::blockSum;
+    const int nt = opt.numThreads, m = opt.order;
+    const std::size_t D = dims.size();
+    std::size_t n = 1, N = 0;
+    for (std::size_t d = 0; d < D; ++d) {
+        n *= dims[d];
+        N += dims[d] != 1;
+    }
+    const fft::Dct dct(dims, nt);
+
+    // Lambda.^m, summed over the per-dimension eigenvalues.
+    std::vector<std::vector<double> > lam(D);
+    for (std::size_t d = 0; d < D; ++d) {
+        lam[d].resize(dims[d]);
+        for (std::size_t k = 0; k < dims[d]; ++k)
+            lam[d][k] = (2 - 2 * std::cos(fft::kPi * k / dims[d])) / (spacing[d] * spacing[d]);
+    }
+    std::vector<double> Lm(n);
+    blockFor(n, nt, [&](std::size_t b, std::size_t e) {
+        std::vector<std::size_t> k(D);
+        for (std::size_t d = 0, r = b; d < D; ++d) {
+            k[d] = r % dims[d];
+            r /= dims[d];
+        }
+        for (std::size_t i = b; i < e; ++i) {
+            double L = 0;
+            for (std::size_t d = 0; d < D; ++d) L += lam[d][k[d]];
+            Lm[i] = m == 0 ? 1 : m == 1 ? L : L * L;
+            for (std::size_t d = 0; d < D && ++k[d] == dims[d]; ++d) k[d] = 0;
+        }
+    });
+
+    // Bounds of s from those of the leverage
+    const double hMin = 1e-6, hMax = 0.99, Nd = (double)N;
+    double sMin, sMax;
+    if (m == 0) {
+        sMin = 1 / std::pow(hMax, 1 / Nd) - 1;
+        sMax = 1 / std::pow(hMin, 1 / Nd) - 1;
+    } else if (m == 1) {
+        sMin = (1 / std::pow(hMax, 2 / Nd) - 1) / 4;
+        sMax = (1 / std::pow(hMin, 2 / Nd) - 1) / 4;
+    } else {
+        const double a = std::pow(hMax, 2 / Nd), b = std::pow(hMin, 2 / Nd);
+        sMin = (std::pow((1 + std::sqrt(1 + 8 * a)) / 4 / a, 2) - 1) / 16;
+        sMax = (std::pow((1 + std::sqrt(1 + 8 * b)) / 4 / b, 2) - 1) / 16;
+    }
+
+    std::size_t nof = 0;
+    bool weighted = false;
+    for (std::size_t i = 0; i < n; ++i) {
+        nof += finite[i] != 0;
+        weighted = weighted || W[i] < 1;
+    }
+    const bool autoS = !(s > 0);
+
+    std::vector<double> yv(n), Wtot(W, W + n), DCTy(n), tmp;
+    for (std::size_t i = 0; i < n; ++i) yv[i] = finite[i] ? y[i] : 0;
+
+    if (weighted) {
+        if (opt.lowPass) {
+            // InitialGuess: keep the first ceil(n/10) coefficients of each dimension
+            dct.forward(z);
+            std::vector<std::size_t> keep(D);
+            for (std::size_t d = 0; d < D; ++d) keep[d] = (dims[d] + 9) / 10;
+            blockFor(n, nt, [&](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; ++i) {
+                    std::size_t r = i;
+                    for (std::size_t d = 0; d < D; r /= dims[d], ++d)
+                        if (r % dims[d] >= keep[d]) {
+                            z[i] = 0;
+                            break;
+                        }
+                }
+            });
+            dct.inverse(z);
+        }
+    } else {
+        std::fill(z, z + n, 0.0);
+    }
+
+    const double RF = weighted ? 1.75 : 1;
+    double aow = 1, tol = 1;
+    int nit = 0;
+    Result res;
+    res.s = s;
+
+    // GCV score of s = 10^p; leaves res.s at p
+    auto gcv = [&](double p) {
+        const double sp = std::pow(10.0, p);
+        res.s = sp;
+        const double TrH = blockSum(n, nt, [&](std::size_t b, std::size_t e) {
+            double t = 0;
+            for (std::size_t i = b; i < e; ++i) t += 1 / (1 + sp * Lm[i]);
+            return t;
+        });
+        double RSS;
+        if (aow > 0.9) {
+            RSS = blockSum(n, nt, [&](std::size_t b, std::size_t e) {
+                double t = 0;
+                for (std::size_t i = b; i < e; ++i) {
+                    const double r = DCTy[i] * (1 / (1 + sp * Lm[i]) - 1);
+                    t += r * r;
+                }
+                return t;
+            });
+        } else {
+            tmp.resize(n);
+            blockFor(n, nt, [&](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; ++i) tmp[i] = DCTy[i] / (1 + sp * Lm[i]);
+            });
+            dct.inverse(tmp.data());
+            RSS = blockSum(n, nt, [&](std::size_t b, std::size_t e) {
+                double t = 0;
+                for (std::size_t i = b; i < e; ++i)
+                    if (finite[i]) {
+                        const double r = yv[i] - tmp[i];
+                        t += Wtot[i] * r * r;
+                    }
+                return t;
+            });
+        }
+        const double q = 1 - TrH / (double)n;
+        return RSS / (double)nof / (q * q);
+    };
+
+    for (int robustStep = 1;; ++robustStep) {
+        aow = blockSum(n, nt, [&](std::size_t b, std::size_t e) {
+            double t = 0;
+            for (std::size_t i = b; i < e; ++i) t += Wtot[i];
+            return t;
+        }) / (double)n;
+        while (tol > opt.tolZ && nit < opt.maxIter) {
+            ++nit;
+            blockFor(n, nt, [&](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; ++i) DCTy[i] = Wtot[i] * (yv[i] - z[i]) + z[i];
+            });
+            dct.forward(DCTy.data());
+            if (autoS && (nit & (nit - 1)) == 0)
+                detail::fminbnd(gcv, std::log10(sMin), std::log10(sMax), 0.1);
+            const double sc = res.s;
+            blockFor(n, nt, [&](std::size_t b, std::size_t e) {
+                for (std::size_t i = b; i < e; ++i) DCTy[i] /= 1 + sc * Lm[i];
+            });
+            dct.inverse(DCTy.data());
+            const double dz = blockSum(n, nt, [&](std::size_t b, std::size_t e) {
+                double t = 0;
+                for (std::size_t i = b; i < e; ++i) {
+                    const double zn = RF * DCTy[i] + (1 - RF) * z[i];
+                    t += (z[i] - zn) * (z[i] - zn);
+                    z[i] = zn;
+                }
+                return t;
+            });
+            const double nz = blockSum(n, nt, [&](std::size_t b, std::size_t e) {
+                double t = 0;
+                for (std::size_t i = b; i < e; ++i) t += z[i] * z[i];
+                return t;
+            });
+            tol = (weighted ? 1.0 : 0.0) * (std::sqrt(dz) / std::sqrt(nz));
+        }
+        res.converged = nit < opt.maxIter;
+        if (!opt.robust || robustStep >= 3) break;
+
+        // Robust weights from the studentized residuals
+        double h = 1;
+        for (std::size_t k = 0; k < N; ++k) {
+            const double dk = spacing[k];
+            double h0;
+            if (m == 0) {
+                h0 = 1 / (1 + res.s / dk);
+            } else if (m == 1) {
+                h0 = 1 / std::sqrt(1 + 4 * res.s / (dk * dk));
+            } else {
+                h0 = std::sqrt(1 + 16 * res.s / (dk * dk * dk * dk));
+                h0 = std::sqrt(1 + h0) / std::sqrt(2.0) / h0;
+            }
+            h *= h0;
+        }
+        tmp.clear();
+        for (std::size_t i = 0; i < n; ++i)
+            if (finite[i]) tmp.push_back(yv[i] - z[i]);
+        const double mmed = detail::median(tmp);
+        for (std::size_t i = 0; i < tmp.size(); ++i) tmp[i] = std::fabs(tmp[i] - mmed);
+        const double mad = detail::median(tmp);
+        const double scale = 1 / (1.4826 * mad) / std::sqrt(1 - h);
+        const WeightFunction wf = opt.weight;
+        blockFor(n, nt, [&](std::size_t b, std::size_t e) {
+            for (std::size_t i = b; i < e; ++i) {
+                const double u = std::fabs(yv[i] - z[i]) * scale;
+                double w;
+                if (wf == kCauchy) {
+                    const double t = u / 2.385;
+                    w = 1 / (1 + t * t);
+                } else if (wf == kTalworth) {
+                    w = u < 2.795;
+                } else {
+                    const double t = u / 4.685;
+                    w = (1 - t * t) * (1 - t * t) * (t < 1);
+                }
+                Wtot[i] = W[i] * (std::isnan(w) ? 0 : w);
+            }
+        });
+        weighted = true;
+        tol = 1;
+        nit = 0;
+    }
+    return res;
+}
+
+} // namespace smoothn
+} // namespace qmr
+
+#endif
@@ -367,6 +367,10 @@ isweighted = any(W(:)<1);
 %---
 % Automatic smoothing?
 isauto = isempty(s);
+%---
+% Compiled engine (qMRbuildMex) for non-cell data: same iterations, with
+% the DCT plans and the Lambda tensor built once.
+usemex = ~iscell(varargin{1}) && exist('smoothn_mex','file')==3;
 
 
 %% Create the Lambda tensor
@@ -374,14 +378,16 @@ isauto = isempty(s);
 % Lambda contains the eingenvalues of the difference matrix used in this
 % penalized least squares process (see CSDA paper for details)
 d = ndims(y{1});
-Lambda = zeros(sizy);
-for i = 1:d
-    siz0 = ones(1,d);
-    siz0(i) = sizy(i);
-    Lambda = bsxfun(@plus,Lambda,...
-        (2-2*cos(pi*(reshape(1:sizy(i),siz0)-1)/sizy(i)))/dI(i)^2);
+if ~usemex
+    Lambda = zeros(sizy);
+    for i = 1:d
+        siz0 = ones(1,d);
+        siz0(i) = sizy(i);
+        Lambda = bsxfun(@plus,Lambda,...
+            (2-2*cos(pi*(reshape(1:sizy(i),siz0)-1)/sizy(i)))/dI(i)^2);
+    end
+    if ~isauto, Gamma = 1./(1+s*Lambda.^m); end
 end
-if ~isauto, Gamma = 1./(1+s*Lambda.^m); end
 
 %% Upper and lower bound for the smoothness parameter
 % The average leverage (h) is by definition in [0 1]. Weak smoothing occurs
@@ -414,6 +420,8 @@ if isweighted
     %---
     if isinitial % an initial guess (z0) has been already given
         z = z0;
+    elseif usemex % the coarse smoothing is done by smoothn_mex
+        z = InitialGuess(y,IsFinite,false);
     else
         z = InitialGuess(y,IsFinite);
     end
@@ -423,6 +431,13 @@ else
 end
 %---
 z0 = z;
+if usemex
+    mexopts = struct('TolZ',OPTIONS.TolZ,'MaxIter',OPTIONS.MaxIter,'Order',m,...
+        'Weight',OPTIONS.Weight,'Robust',isrobust,'Spacing',dI,...
+        'Initial',z{1},'LowPass',isweighted && ~isinitial);
+    [z,s,exitflag] = smoothn_mex(y{1},double(W),s,mexopts);
+    z = {z};
+end
 for i = 1:ny
     y{i}(~IsFinite) = 0; % arbitrary values for missing y-data
 end
@@ -441,7 +456,7 @@ RF = 1 + 0.75*isweighted;
 
 %% Main iterative process
 %---
-while RobustIterativeProcess
+while RobustIterativeProcess && ~usemex
     %--- "amount" of weights (see the function GCVscore)
     aow = sum(Wtot(:))/noe; % 0 < aow <= 1
     %---
@@ -595,7 +610,8 @@ function W = RobustWeights(y,z,I,h,wstr)
 end
 
 %% Initial Guess with weighted/missing data
-function z = InitialGuess(y,I)
+function z = InitialGuess(y,I,lowpass)
+    if nargin<3, lowpass = true; end
     ny = numel(y);
     %-- nearest neighbor interpolation (in case of missing values)
     if any(~I(:))
@@ -623,6 +639,7 @@ function z = InitialGuess(y,I)
     else
         z = y;
     end
+    if ~lowpass, return, end
     %-- coarse fast smoothing using one-tenth of the DCT coefficients
     siz = size(z{1});
     z = cellfun(@(x) dctn(x),z,'UniformOutput',0);
@@ -0,0 +1,147 @@
+/*
+ * [z, s, exitflag] = smoothn_mex(y, W, s, opts)
+ *
+ * Robust spline smoothing of one N-D array (see smoothn.hh). Use through
+ * smoothn.m, which calls it for non-cell data.
+ *
+ *   y     real double array; non-finite values are missing
+ *   W     weights (>= 0, size of y), or [] for uniform weights
+ *   s     smoothness parameter (> 0), or [] to select it by GCV
+ *   opts  optional struct:
+ *           TolZ        termination tolerance on z (1e-3)
+ *           MaxIter     iterations per robust step (100)
+ *           Order       0, 1 or 2 (2)
+ *           Weight      'bisquare' (default), 'talworth' or 'cauchy'
+ *           Robust      robust smoothing (false)
+ *           Spacing     spacing of each dimension of y (ones)
+ *           Initial     initial guess (size of y); by default y, with the
+ *                       missing values set to the mean, low-pass filtered
+ *           LowPass     low-pass filter Initial as smoothn's InitialGuess
+ *                       (false when Initial is given)
+ *           NumThreads  0: all cores
+ *
+ * z has the size of y, s is the smoothness parameter used last and
+ * exitflag is false if MaxIter was reached, as in smoothn.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "smoothn.hh"
+
+static const char *kName = "smoothn_mex";
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 3 || nrhs > 4)
+        qmr::mex::fail(kName, "wrongNumInputs", "smoothn_mex(y, W, s, opts).");
+    qmr::mex::requireDouble(kName, prhs[0], "y");
+    const std::size_t nd = mxGetNumberOfDimensions(prhs[0]);
+    const std::vector<std::size_t> dims = qmr::mex::dims(prhs[0], nd);
+    const std::size_t n = mxGetNumberOfElements(prhs[0]);
+    const double *y = mxGetPr(prhs[0]);
+    const mxArray *opts = nrhs > 3 ? prhs[3] : NULL;
+
+    // Weights, normalized as in smoothn
+    std::vector<unsigned char> finite(n);
+    for (std::size_t i = 0; i < n; ++i) finite[i] = std::isfinite(y[i]);
+    std::vector<double> W(n, 1.0);
+    if (!mxIsEmpty(prhs[1])) {
+        qmr::mex::requireDouble(kName, prhs[1], "W");
+        if (mxGetNumberOfElements(prhs[1]) != n)
+            qmr::mex::fail(kName, "invalidInputSize", "W must have the size of y.");
+        std::copy(mxGetPr(prhs[1]), mxGetPr(prhs[1]) + n, W.begin());
+    }
+    double wMax = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        W[i] = finite[i] ? W[i] : 0;
+        if (!(W[i] >= 0)) qmr::mex::fail(kName, "invalidInput", "Weights must all be >= 0.");
+        wMax = std::max(wMax, W[i]);
+    }
+    if (wMax > 0)
+        for (std::size_t i = 0; i < n; ++i) W[i] /= wMax;
+
+    double s = 0;
+    if (!mxIsEmpty(prhs[2])) {
+        s = qmr::mex::scalar(kName, prhs[2], "s");
+        if (!(s > 0)) qmr::mex::fail(kName, "invalidInput", "The smoothing parameter s must be > 0.");
+    }
+
+    qmr::smoothn::Options opt;
+    opt.tolZ = qmr::mex::option(opts, "TolZ", opt.tolZ);
+    if (!(opt.tolZ > 0 && opt.tolZ < 1))
+        qmr::mex::fail(kName, "invalidInput", "TolZ must be in ]0,1[.");
+    const double maxIter = qmr::mex::option(opts, "MaxIter", (double)opt.maxIter);
+    if (!(maxIter >= 1 && maxIter == std::floor(maxIter)))
+        qmr::mex::fail(kName, "invalidInput", "MaxIter must be an integer >= 1.");
+    opt.maxIter = (int)std::min(maxIter, 2147483647.0);
+    const double order = qmr::mex::option(opts, "Order", (double)opt.order);
+    if (order != 0 && order != 1 && order != 2)
+        qmr::mex::fail(kName, "invalidInput", "Order must be 0, 1 or 2.");
+    opt.order = (int)order;
+    std::string weight = qmr::mex::option(opts, "Weight", std::string("bisquare"));
+    std::transform(weight.begin(), weight.end(), weight.begin(), ::tolower);
+    if (weight == "bisquare") opt.weight = qmr::smoothn::kBisquare;
+    else if (weight == "talworth") opt.weight = qmr::smoothn::kTalworth;
+    else if (weight == "cauchy") opt.weight = qmr::smoothn::kCauchy;
+    else qmr::mex::fail(kName, "invalidInput", "Weight must be 'bisquare', 'talworth' or 'cauchy'.");
+    opt.robust = qmr::mex::option(opts, "Robust", 0.0) != 0;
+    opt.numThreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    std::vector<double> spacing(nd, 1.0);
+    const mxArray *sp = opts && mxIsStruct(opts) ? mxGetField(opts, 0, "Spacing") : NULL;
+    if (sp && !mxIsEmpty(sp)) {
+        spacing = qmr::mex::toVector(sp);
+        if (spacing.size() != nd)
+            qmr::mex::fail(kName, "invalidInput", "Spacing must have one value per dimension of y.");
+        const double spMax = *std::max_element(spacing.begin(), spacing.end());
+        for (std::size_t d = 0; d < nd; ++d) {
+            if (!(spacing[d] > 0)) qmr::mex::fail(kName, "invalidInput", "Spacing must be > 0.");
+            spacing[d] /= spMax;
+        }
+    }
+
+    plhs[0] = mxCreateNumericArray(nd, mxGetDimensions(prhs[0]), mxDOUBLE_CLASS, mxREAL);
+    double *z = mxGetPr(plhs[0]);
+    qmr::smoothn::Result res;
+    res.s = s;
+    res.converged = true;
+    if (n == 1) {
+        z[0] = y[0];
+    } else {
+        const mxArray *z0 = opts && mxIsStruct(opts) ? mxGetField(opts, 0, "Initial") : NULL;
+        if (z0 && !mxIsEmpty(z0)) {
+            qmr::mex::requireDouble(kName, z0, "opts.Initial");
+            if (mxGetNumberOfElements(z0) != n)
+                qmr::mex::fail(kName, "invalidInputSize", "opts.Initial must have the size of y.");
+            std::copy(mxGetPr(z0), mxGetPr(z0) + n, z);
+            opt.lowPass = qmr::mex::option(opts, "LowPass", 0.0) != 0;
+        } else {
+            double mean = 0;
+            std::size_t nof = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                if (finite[i]) {
+                    mean += y[i];
+                    ++nof;
+                }
+            mean /= (double)nof;
+            for (std::size_t i = 0; i < n; ++i) z[i] = finite[i] ? y[i] : mean;
+            opt.lowPass = true;
+        }
+        res = qmr::smoothn::smooth(dims, spacing.data(), y, W.data(), finite.data(), s, opt, z);
+    }
+
+    mxArray *all[3] = {plhs[0], res.s > 0 ? mxCreateDoubleScalar(res.s) : mxCreateDoubleMatrix(0, 0, mxREAL),
+                       mxCreateLogicalScalar(res.converged)};
+    for (int i = 1; i < 3; ++i) {
+        if (i < nlhs) plhs[i] = all[i];
+        else mxDestroyArray(all[i]);
+    }
+}
@@ -0,0 +1,224 @@
+/*
+ * sunwrap.hh: magnitude-sorted list, multi-clustering phase unwrapping
+ * (sunwrap.m, Maier et al., Magn. Reson. Med. 2014).
+ *
+ * Pixels are visited from the highest to the lowest magnitude. A pixel
+ * with no unwrapped neighbour starts a cluster; otherwise it is unwrapped
+ * against the neighbour of highest magnitude in the heaviest neighbouring
+ * cluster (weight: sum of magnitudes) and every other neighbouring
+ * cluster is shifted by a multiple of 2 pi and merged into it. Clusters
+ * are linked lists of pixels, so a merge only walks the absorbed clusters.
+ *
+ * The visiting order is that of sunwrap (magnitude descending, then phase
+ * ascending, then linear index), built with a bucket queue: pixels above
+ * the threshold are spread into buckets of equal magnitude range, in
+ * descending order, and each bucket is sorted on its own. Pixels below
+ * the threshold never enter the queue. Neighbours come from a flat table
+ * of index offsets over the grid (26 or 6 in 3D, 8 or 4 in 2D), in the
+ * order of the dz, dy, dx loops of sunwrap, so the result is that of
+ * sunwrap.m. Pixels that are not visited (below the threshold or NaN)
+ * are 0.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef SUNWRAP_HH
+#define SUNWRAP_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+namespace qmr {
+namespace sunwrap {
+
+static const double kPi = 3.14159265358979323846;
+
+// Multiple of 2 pi bringing phase within pi of fixed (estimatePhaseOffset).
+inline double phaseOffset(double phase, double fixed)
+{
+    double offset = 0;
+    while (phase + offset - fixed < -kPi) offset += 2 * kPi;
+    while (phase + offset - fixed > kPi) offset -= 2 * kPi;
+    return offset;
+}
+
+// Linear indices of the pixels with magnitude >= threshold * max, in
+// sunwrap order.
+inline std::vector<std::size_t> visitOrder(const double *mag, const double *phase, std::size_t n, double threshold)
+{
+    double top = 0;
+    bool any = false;
+    for (std::size_t i = 0; i < n; ++i)
+        if (mag[i] == mag[i] && (!any || mag[i] > top)) {
+            top = mag[i];
+            any = true;
+        }
+    std::vector<std::size_t> order;
+    if (!any) return order;
+    const double low = threshold * top;
+
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n; ++i) count += mag[i] >= low;
+    const std::size_t buckets = std::max<std::size_t>(1, count / 8);
+    const double scale = top > low ? buckets / (top - low) : 0;
+    std::vector<std::size_t> start(buckets + 1, 0), bucketOf(n);
+    for (std::size_t i = 0; i < n; ++i)
+        if (mag[i] >= low) {
+            bucketOf[i] = std::min(buckets - 1, (std::size_t)((top - mag[i]) * scale));
+            ++start[bucketOf[i] + 1];
+        }
+    for (std::size_t b = 0; b < buckets; ++b) start[b + 1] += start[b];
+    order.resize(count);
+    std::vector<std::size_t> fill(start.begin(), start.end() - 1);
+    for (std::size_t i = 0; i < n; ++i)
+        if (mag[i] >= low) order[fill[bucketOf[i]]++] = i;
+
+    for (std::size_t b = 0; b < buckets; ++b)
+        std::sort(order.begin() + start[b], order.begin() + start[b + 1], [&](std::size_t p, std::size_t q) {
+            if (mag[p] != mag[q]) return mag[p] > mag[q];
+            if (phase[p] != phase[q]) return phase[p] < phase[q];
+            return p < q;
+        });
+    return order;
+}
+
+// Unwraps the phase of an n[0] x n[1] x n[2] image with magnitude mag
+// into out. connectivity is 26 (all neighbours, as sunwrap) or 6 (faces).
+inline void unwrap(const double *mag, const double *phase, const std::size_t n[3], double threshold,
+                   int connectivity, double *out)
+{
+    const std::size_t nx = n[0], ny = n[1], nz = n[2], numel = nx * ny * nz;
+    const std::vector<std::size_t> order = visitOrder(mag, phase, numel, threshold);
+
+    // Neighbour offsets, in the order of the dz, dy, dx loops of sunwrap.
+    int dxs[26], dys[26], dzs[26];
+    std::ptrdiff_t step[26];
+    int nn = 0;
+    for (int dz = -1; dz <= 1; ++dz)
+        for (int dy = -1; dy <= 1; ++dy)
+            for (int dx = -1; dx <= 1; ++dx) {
+                const int manhattan = std::abs(dx) + std::abs(dy) + std::abs(dz);
+                if (manhattan == 0 || (connectivity == 6 && manhattan > 1)) continue;
+                dxs[nn] = dx;
+                dys[nn] = dy;
+                dzs[nn] = dz;
+                step[nn] = dx + (std::ptrdiff_t)nx * (dy + (std::ptrdiff_t)ny * dz);
+                ++nn;
+            }
+
+    // Per-pixel state, packed so that a neighbourhood is a few cache lines:
+    // magnitude, unwrapped phase and label (0: not visited yet).
+    struct Pixel {
+        double mag, phase;
+        int label;
+    };
+    std::vector<Pixel> px(numel);
+    for (std::size_t i = 0; i < numel; ++i) px[i].mag = mag[i], px[i].phase = 0, px[i].label = 0;
+
+    // Cluster lists: head and tail pixel of each label, next pixel of each
+    // pixel (-1 ends a list), and the total magnitude of each label.
+    const std::ptrdiff_t kNone = -1;
+    std::vector<std::ptrdiff_t> head(1, kNone), tail(1, kNone), next(numel, kNone);
+    std::vector<double> weight(1, 0.0);
+
+    struct Pending {
+        int label;
+        double mag, phase;
+        int count;
+    };
+    Pending pending[26];
+
+    for (std::size_t o = 0; o < order.size(); ++o) {
+        const std::size_t p = order[o];
+        const std::size_t x = p % nx, y = (p / nx) % ny, z = p / (nx * ny);
+        const bool interior = x > 0 && x + 1 < nx && y > 0 && y + 1 < ny && z > 0 && z + 1 < nz;
+
+        int np = 0, maxLabel = 0;
+        double maxMag = 0;
+        for (int k = 0; k < nn; ++k) {
+            if (!interior) {
+                if ((dxs[k] < 0 && x == 0) || (dxs[k] > 0 && x + 1 == nx) || (dys[k] < 0 && y == 0) ||
+                    (dys[k] > 0 && y + 1 == ny) || (dzs[k] < 0 && z == 0) || (dzs[k] > 0 && z + 1 == nz))
+                    continue;
+            }
+            const Pixel &q = px[p + step[k]];
+            const int l = q.label;
+            if (l == 0) continue;
+            if (q.mag > maxMag) {
+                maxMag = q.mag;
+                maxLabel = l;
+            }
+            int j = 0;
+            while (j < np && pending[j].label != l) ++j;
+            if (j == np) {
+                Pending e = {l, q.mag, q.phase, 1};
+                pending[np++] = e;
+            } else if (pending[j].mag < q.mag) {
+                pending[j].mag = q.mag;
+                pending[j].phase = q.phase;
+                pending[j].count = 1;
+            } else if (pending[j].mag == q.mag) {
+                pending[j].phase += q.phase;
+                ++pending[j].count;
+            }
+        }
+        for (int j = 0; j < np; ++j)
+            if (pending[j].count > 1) {
+                pending[j].phase /= pending[j].count;
+                pending[j].count = 1;
+            }
+
+        if (maxLabel == 0) {
+            // New cluster
+            const int l = (int)head.size();
+            head.push_back((std::ptrdiff_t)p);
+            tail.push_back((std::ptrdiff_t)p);
+            weight.push_back(mag[p]);
+            px[p].label = l;
+            px[p].phase = phase[p];
+            continue;
+        }
+
+        if (np > 1) {
+            // Heaviest cluster first, then lowest phase (sortrows(.., [-2 3]))
+            // (stable insertion sort: a handful of entries)
+            for (int j = 0; j < np; ++j) pending[j].mag = weight[pending[j].label];
+            for (int j = 1; j < np; ++j) {
+                const Pending e = pending[j];
+                int i = j;
+                for (; i > 0 && (pending[i - 1].mag < e.mag || (pending[i - 1].mag == e.mag && pending[i - 1].phase > e.phase)); --i)
+                    pending[i] = pending[i - 1];
+                pending[i] = e;
+            }
+        }
+        const int l = pending[0].label;
+        const double ph = phase[p] + phaseOffset(phase[p], pending[0].phase);
+        px[p].phase = ph;
+        px[p].label = l;
+        next[tail[l]] = (std::ptrdiff_t)p;
+        tail[l] = (std::ptrdiff_t)p;
+        weight[l] += mag[p];
+
+        for (int j = 1; j < np; ++j) {
+            const int m = pending[j].label;
+            const double offset = phaseOffset(pending[j].phase, ph);
+            for (std::ptrdiff_t c = head[m]; c != kNone; c = next[c]) {
+                px[c].label = l;
+                px[c].phase += offset;
+            }
+            next[tail[l]] = head[m];
+            tail[l] = tail[m];
+            weight[l] += weight[m];
+            head[m] = tail[m] = kNone;
+        }
+    }
+    for (std::size_t i = 0; i < numel; ++i) out[i] = px[i].phase;
+}
+
+} // namespace sunwrap
+} // namespace qmr
+
+#endif
@@ -46,6 +46,12 @@ function unwrappedPhaseImage = sunwrap( complexImage, relativeMagnitudeThreshold
         error('Relative magnitude threshold is %f. It must be in the interval [0, 1].', relativeMagnitudeThreshold);
     end
 
+    % Compiled engine (qMRbuildMex): same algorithm and result.
+    if exist('sunwrap_mex','file')==3
+        unwrappedPhaseImage = sunwrap_mex(abs(double(complexImage)), angle(double(complexImage)), double(relativeMagnitudeThreshold));
+        return;
+    end
+
     %% Initialization.
     % Get magnitude and phase data.
     magnitudeImage = abs(complexImage);
@@ -0,0 +1,61 @@
+/*
+ * unwrapped = sunwrap_mex(magnitude, phase, threshold, opts)
+ *
+ * Magnitude-sorted list, multi-clustering phase unwrapping (see
+ * sunwrap.hh). Use through sunwrap.m, which passes abs and angle of the
+ * complex image.
+ *
+ *   magnitude  real double image, 1D to 3D, or a stack of images along
+ *              the 4th dimension (echoes), each unwrapped on its own
+ *   phase      wrapped phase [rad], same size
+ *   threshold  relative magnitude threshold in [0, 1]
+ *   opts       optional struct: Connectivity (26: all neighbours, as
+ *              sunwrap.m; 6: faces only, 4 neighbours for 2D images),
+ *              NumThreads (0: all cores; images of a stack run in
+ *              parallel)
+ *
+ * unwrapped has the size of phase.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "qmr_parallel.hh"
+#include "sunwrap.hh"
+
+static const char *kName = "sunwrap_mex";
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    (void)nlhs;
+    if (nrhs < 3 || nrhs > 4)
+        qmr::mex::fail(kName, "wrongNumInputs", "sunwrap_mex(magnitude, phase, threshold, opts).");
+    qmr::mex::requireDouble(kName, prhs[0], "magnitude");
+    qmr::mex::requireDouble(kName, prhs[1], "phase");
+    const std::vector<std::size_t> d = qmr::mex::dims(prhs[1], 4);
+    if (d.size() > 4)
+        qmr::mex::fail(kName, "invalidInputSize", "phase must have at most 4 dimensions.");
+    if (mxGetNumberOfElements(prhs[0]) != mxGetNumberOfElements(prhs[1]))
+        qmr::mex::fail(kName, "invalidInputSize", "magnitude and phase must have the same size.");
+    const double threshold = qmr::mex::scalar(kName, prhs[2], "threshold");
+    if (!(threshold >= 0 && threshold <= 1))
+        qmr::mex::fail(kName, "invalidInput", "threshold must be in the interval [0, 1].");
+    const mxArray *opts = nrhs > 3 ? prhs[3] : NULL;
+    const int connectivity = (int)qmr::mex::option(opts, "Connectivity", 26.0);
+    if (connectivity != 26 && connectivity != 6)
+        qmr::mex::fail(kName, "invalidInput", "Connectivity must be 6 or 26.");
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    plhs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(prhs[1]), mxGetDimensions(prhs[1]), mxDOUBLE_CLASS, mxREAL);
+    const std::size_t n[3] = {d[0], d[1], d[2]}, numel = d[0] * d[1] * d[2];
+    const double *mag = mxGetPr(prhs[0]), *phase = mxGetPr(prhs[1]);
+    double *out = mxGetPr(plhs[0]);
+    qmr::parallel_for(d[3], 1, [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t v = b; v < e; ++v)
+            qmr::sunwrap::unwrap(mag + v * numel, phase + v * numel, n, threshold, connectivity, out + v * numel);
+    }, nthreads);
+}
@@ -0,0 +1,101 @@
+classdef (TestTags = {'Unit'}) Sim_MonteCarlo_Diffusion_batch_Test < matlab.unittest.TestCase
+    % Checks the compiled Monte Carlo diffusion engine (mc_diffusion_mex)
+    % against free diffusion, impermeable axons and a search over all
+    % axons (cell-list collisions), and the headless
+    % Sim_MonteCarlo_Diffusion_batch wrapper on a saved packing.
+    % Skipped when mc_diffusion_mex is not compiled (see qMRbuildMex).
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('mc_diffusion_mex','file')==3, 'mc_diffusion_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_free_diffusion_matches_stejskal_tanner(testCase)
+            % PGSE, delta = 10 ms, DELTA = 20 ms, TE = 40 ms
+            D = 1.5; steptime = 0.5; G = [0; 50; 100];
+            scheme = [repmat([1 0 0],3,1) G*1e-3 repmat([0.02 0.01 0.04],3,1)];
+            [Gs, Gd, ~, bv] = Sim_MonteCarlo_PGSE(scheme, steptime, 40);
+            Gvec = bsxfun(@times, Gd, permute(Gs,[1 3 2]));
+            rng(0);
+            pos = (rand(20000,3)-0.5)*10;
+
+            [signal, ~, ~, msd] = mc_diffusion_mex(pos, sqrt(4*D*steptime), steptime, Gvec, zeros(0,2), zeros(0,1), 0, struct('Seed',1));
+
+            testCase.verifySize(signal, [81 3]);
+            testCase.verifyEqual(signal(1,:), [1 1 1]);
+            testCase.verifyEqual(signal(end,:), exp(-bv'*D*1e-3), 'AbsTol', 0.02);
+            testCase.verifyEqual(msd(end), 4*D*40*1e-6, 'RelTol', 0.03);
+        end
+
+        function test_impermeable_axons_keep_particles(testCase)
+            rng(1);
+            pos = [(rand(5000,2)-0.5)*10 zeros(5000,1)];
+            cen = [0 0; 6 1]; R = [3; 2];
+            Gvec = zeros(20,3,1);
+            [~, ~, ~, ~, P] = mc_diffusion_mex(pos, 1, 0.5, Gvec, cen, R, 0, struct('SnapshotEvery',5));
+
+            testCase.verifySize(P, [5000 3 4]);
+            for k = 1:2
+                in0 = sum(bsxfun(@minus, pos(:,1:2), cen(k,:)).^2, 2) < R(k)^2;
+                for s = 1:size(P,3)
+                    in = sum(bsxfun(@minus, P(:,1:2,s), cen(k,:)).^2, 2) < R(k)^2;
+                    testCase.verifyEqual(in, in0);
+                end
+            end
+        end
+
+        function test_result_does_not_depend_on_threads(testCase)
+            rng(2);
+            pos = (rand(3000,3)-0.5)*10;
+            Gvec = zeros(40,3,2); Gvec(5:15,:,1) = 80; Gvec(25:35,:,1) = -80; Gvec(5:15,2,2) = 40; Gvec(25:35,2,2) = -40;
+            args = {pos, 0.8, 0.5, Gvec, [0 0; 5 5], [2; 1.5], 0.1};
+            [s1, i1, e1, ~, P1] = mc_diffusion_mex(args{:}, struct('Seed',3,'NumThreads',1));
+            [s4, i4, e4, ~, P4] = mc_diffusion_mex(args{:}, struct('Seed',3,'NumThreads',4));
+            testCase.verifyEqual(P4, P1);
+            testCase.verifyEqual(s4, s1, 'AbsTol', 1e-12);
+            testCase.verifyEqual([i4 e4], [i1 e1], 'AbsTol', 1e-12);
+        end
+
+        function test_grid_matches_all_axons_search(testCase)
+            % Impermeable walls draw no random numbers: identical walks
+            rng(4);
+            [ix, iy] = ind2sub([15 15], 1:225);
+            cen = [ix(:) iy(:)]*4 + 0.5*rand(225,2) - 30;
+            R = 1 + 0.7*rand(225,1);
+            pos = [(rand(2000,2)-0.5)*50 zeros(2000,1)];
+            Gvec = zeros(50,3);
+            opts = struct('Seed',5,'SnapshotEvery',10);
+            [~, ~, ~, ~, Pgrid] = mc_diffusion_mex(pos, 1.7, 0.5, Gvec, cen, R, 0, setfield(opts,'UseGrid',true)); %#ok<SFLD>
+            [~, ~, ~, ~, Pall] = mc_diffusion_mex(pos, 1.7, 0.5, Gvec, cen, R, 0, setfield(opts,'UseGrid',false)); %#ok<SFLD>
+            testCase.verifyEqual(Pgrid, Pall);
+        end
+
+        function test_batch_runs_on_saved_packing(testCase)
+            load('pack_testing.mat', 'packing', 'axons');
+            Model = charmed;
+            scheme = Model.Prot.DiffusionData.Mat;
+            rng(3);
+            [signal, signal_intra, signal_extra, msd, positions, inisitu] = ...
+                Sim_MonteCarlo_Diffusion_batch(200, 0, 1.5, scheme, packing, axons, struct('SignalEvery',4));
+
+            testCase.verifySize(signal_intra, [1 size(scheme,1)]);
+            testCase.verifySize(signal_extra, [1 size(scheme,1)]);
+            testCase.verifyEqual(size(signal,1), numel(msd));
+            testCase.verifySize(positions, [200 3]);
+            testCase.verifySize(inisitu, [200 1]);
+            testCase.verifyTrue(all(signal(:) >= 0 & signal(:) <= 1 + 1e-12));
+        end
+
+        function test_num_steps_shortens_the_walk(testCase)
+            load('pack_testing.mat', 'packing', 'axons');
+            Model = charmed;
+            scheme = Model.Prot.DiffusionData.Mat;
+            [signal, ~, ~, msd] = Sim_MonteCarlo_Diffusion_batch(20, 0, 1.5, scheme, packing, axons, struct('NumSteps',5));
+            testCase.verifySize(signal, [6 size(scheme,1)]);
+            testCase.verifySize(msd, [6 1]);
+        end
+    end
+end
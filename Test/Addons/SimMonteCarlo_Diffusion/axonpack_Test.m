@@ -0,0 +1,71 @@
+classdef (TestTags = {'Unit'}) axonpack_Test < matlab.unittest.TestCase
+    % Checks the compiled disk packing engine (axonpack_mex) against the
+    % migrations of process_packing (compute_grad). Skipped when
+    % axonpack_mex is not compiled (see qMRbuildMex).
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('axonpack_mex','file')==3, 'axonpack_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_matches_compute_grad(testCase)
+            rng(0);
+            N = 60; gap = 0.5; side = 60;
+            R = 0.5 + rand(N,1);
+            x0 = reshape(((rand(N,2)*0.5 + 0.25)*side)', [], 1);
+
+            final = axonpack_mex(x0, R, gap, side, 200, 20);
+
+            x = x0;
+            for iter = 1:200
+                x = x + migration(x, R+gap/2, side);
+            end
+            testCase.verifyEqual(final, reshape(x,2,N), 'AbsTol', 1e-9);
+        end
+
+        function test_outputs_and_threads(testCase)
+            rng(1);
+            N = 2000; gap = 0.3; side = 150;
+            R = 0.5 + rand(N,1);
+            x0 = reshape((rand(N,2)*side)', [], 1);
+
+            [p1, ov1, fvf1] = axonpack_mex(x0, R, gap, side, 100, 10, struct('NumThreads',1));
+            [p4, ov4, fvf4] = axonpack_mex(x0, R, gap, side, 100, 10, struct('NumThreads',4));
+
+            testCase.verifySize(p1, [2 N]);
+            testCase.verifySize(fvf1, [1 11]);
+            testCase.verifyEqual(p4, p1);
+            testCase.verifyEqual([ov4 fvf4], [ov1 fvf1]);
+            testCase.verifyTrue(all(fvf1 > 0 & fvf1 < 1));
+        end
+
+        function test_overlap_of_two_disks(testCase)
+            % Two unit disks one radius apart: lens area 2*acos(1/2) - sqrt(3)/2
+            [~, ov] = axonpack_mex([0; 0; 1; 0], [1; 1], 0, 10, 0, 1);
+            testCase.verifyEqual(ov, 2*acos(0.5) - sqrt(3)/2, 'AbsTol', 1e-12);
+        end
+    end
+end
+
+function g = migration(x, D, side)
+% compute_grad of process_packing, one disk at a time
+pts = reshape(x,2,[]);
+N = size(pts,2);
+g = zeros(2,N);
+for i = 1:N
+    d = bsxfun(@minus, pts(:,i), pts);
+    dist = sqrt(sum(d.^2,1));
+    ov = dist < D(i) + D' & (1:N) ~= i;
+    a = side/2 - pts(:,i); a = a/norm(a);
+    if any(ov)
+        u = sum(d(:,ov),2); nu = norm(u); if nu == 0, nu = 1; end
+        g(:,i) = 0.1*u/nu;
+    else
+        g(:,i) = 0.01*a;
+    end
+end
+g = g(:);
+end
@@ -0,0 +1,49 @@
+function results = batchLM_benchmark(nVox, nRef)
+% batchLM_benchmark   Native batched LM versus lsqcurvefit on mono-exponential T2
+%
+%   results = batchLM_benchmark(nVox, nRef)
+%
+%   Fits nVox (default 1e6) noisy mono-exponential decays (32 echoes, as in
+%   the mono_t2 default protocol) with batchLM, and nRef (default 2000)
+%   of them with a per-voxel lsqcurvefit loop, as FitData does. The
+%   lsqcurvefit time is extrapolated to nVox. Pass nRef = nVox to time the
+%   full loop (hours for 1e6 voxels).
+%
+%   Requires qmr_lm_mex (see qMRbuildMex) and the Optimization Toolbox.
+
+if ~exist('nVox','var'), nVox = 1e6; end
+if ~exist('nRef','var'), nRef = min(2000, nVox); end
+
+rng(0);
+TE = (12.8:12.8:384)';
+T2 = 20 + 180*rand(nVox,1);
+M0 = 500 + 1000*rand(nVox,1);
+Y  = M0.*exp(-TE'./T2);
+Y  = Y + 0.02*max(Y,[],2).*randn(size(Y));
+lb = [1 1]; ub = [1e5 300];
+P0 = [1.5*max(Y,[],2), 30*ones(nVox,1)];
+
+tic;
+P = batchLM('monoexp', P0, Y, TE, lb, ub);
+tBatch = toc;
+
+opts = optimoptions('lsqcurvefit','Display','off');
+model = @(a,x) a(1)*exp(-x/a(2));
+Pref = zeros(nRef,2);
+tic;
+for ii = 1:nRef
+    Pref(ii,:) = lsqcurvefit(model, P0(ii,:), TE, Y(ii,:)', lb, ub, opts);
+end
+tRef = toc*nVox/nRef;
+
+results = struct('nVox', nVox, ...
+                 'batchLM_s', tBatch, ...
+                 'lsqcurvefit_s', tRef, ...
+                 'speedup', tRef/tBatch, ...
+                 'maxRelDiffT2', max(abs(P(1:nRef,2)-Pref(:,2))./Pref(:,2)), ...
+                 'medianRelErrT2', median(abs(P(:,2)-T2)./T2));
+
+fprintf('%d voxels: batchLM %.1f s, lsqcurvefit %.1f s (extrapolated from %d), speedup x%.0f\n', ...
+        nVox, tBatch, tRef, nRef, results.speedup);
+fprintf('max relative T2 difference vs lsqcurvefit: %.2e\n', results.maxRelDiffT2);
+end
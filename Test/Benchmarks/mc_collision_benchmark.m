@@ -0,0 +1,47 @@
+function results = mc_collision_benchmark(nAxons, nParticles, nSteps)
+% mc_collision_benchmark   Wall collision cost of the Monte Carlo diffusion engine
+%
+%   results = mc_collision_benchmark(nAxons, nParticles, nSteps)
+%
+%   Walks nParticles (default 4096) particles for nSteps (default 100)
+%   steps through square packings of nAxons axons (default
+%   [100 1000 10000 100000], radius 1-1.7 um, 4 um apart), spread over the
+%   whole packing, with the cell-list collision queries of mc_diffusion_mex
+%   (UseGrid = true) and with a test against every axon (UseGrid = false,
+%   as func_findhitobj190511; skipped above 10000 axons). The grid time per
+%   particle step stays flat in the number of axons, the brute-force time
+%   grows linearly. Walls are impermeable, so both walks are identical.
+%
+%   Requires mc_diffusion_mex (see qMRbuildMex).
+
+if ~exist('nAxons','var') || isempty(nAxons), nAxons = [100 1000 10000 100000]; end
+if ~exist('nParticles','var') || isempty(nParticles), nParticles = 4096; end
+if ~exist('nSteps','var') || isempty(nSteps), nSteps = 100; end
+
+rng(0);
+G = zeros(nSteps,3); % no gradient: collisions only
+opts = struct('NumThreads',1,'Seed',1,'SignalEvery',nSteps);
+results = struct('nAxons', num2cell(nAxons), 'grid_ns', NaN, 'brute_ns', NaN, 'maxDiff', NaN);
+
+for ii = 1:numel(nAxons)
+    side = ceil(sqrt(nAxons(ii)));
+    [ix, iy] = ind2sub([side side], 1:nAxons(ii));
+    cen = [ix(:) iy(:)]*4 + 0.5*rand(nAxons(ii),2) - 2*side;
+    R = 1 + 0.7*rand(nAxons(ii),1);
+    pos = [(rand(nParticles,2)-0.5)*3.6*side zeros(nParticles,1)];
+
+    tic;
+    [~, ~, ~, ~, Pgrid] = mc_diffusion_mex(pos, 1.7, 0.5, G, cen, R, 0, setfield(opts,'UseGrid',true)); %#ok<SFLD>
+    results(ii).grid_ns = toc/nParticles/nSteps*1e9;
+
+    if nAxons(ii) <= 10000
+        tic;
+        [~, ~, ~, ~, Pbrute] = mc_diffusion_mex(pos, 1.7, 0.5, G, cen, R, 0, setfield(opts,'UseGrid',false)); %#ok<SFLD>
+        results(ii).brute_ns = toc/nParticles/nSteps*1e9;
+        results(ii).maxDiff = max(abs(Pgrid(:)-Pbrute(:)));
+    end
+
+    fprintf('%6d axons: grid %6.0f ns/particle step, all axons %8.0f ns/particle step\n', ...
+            nAxons(ii), results(ii).grid_ns, results(ii).brute_ns);
+end
+end
@@ -0,0 +1,100 @@
+classdef (TestTags = {'Unit'}) batchLM_Test < matlab.unittest.TestCase
+    % Covers the native batched Levenberg-Marquardt solver. Skipped when
+    % qmr_lm_mex is not compiled (see qMRbuildMex).
+
+    properties
+        TE = (12.8:12.8:384)';
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('qmr_lm_mex','file')==3, 'qmr_lm_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_noiseless_monoexp_recovers_parameters(testCase)
+            T2 = [20; 45; 80; 150; 250];
+            M0 = [500; 1000; 1500; 800; 2000];
+            Y = M0.*exp(-testCase.TE'./T2);
+
+            P = batchLM('monoexp', [1 30], Y, testCase.TE, [0 1], [1e5 300]);
+
+            testCase.verifyEqual(P(:,2), T2, 'RelTol', 1e-6);
+            testCase.verifyEqual(P(:,1), M0, 'RelTol', 1e-6);
+        end
+
+        function test_matches_lsqnonlin_on_noisy_data(testCase)
+            rng(0);
+            T2 = 40 + 100*rand(20,1);
+            Y = 1000*exp(-testCase.TE'./T2) + 10*randn(20,numel(testCase.TE));
+            lb = [1 1]; ub = [1e4 300];
+
+            P = batchLM('monoexp', [1500 30], Y, testCase.TE, lb, ub);
+
+            opts = optimoptions('lsqnonlin','Display','off','FunctionTolerance',1e-12,'StepTolerance',1e-12);
+            for ii = 1:size(Y,1)
+                ref = lsqnonlin(@(a) a(1)*exp(-testCase.TE'/a(2)) - Y(ii,:), [1500 30], lb, ub, opts);
+                testCase.verifyEqual(P(ii,:), ref, 'RelTol', 1e-4);
+            end
+        end
+
+        function test_bounds_are_enforced(testCase)
+            Y = 1000*exp(-testCase.TE'./200);
+            P = batchLM('monoexp', [1500 30], Y, testCase.TE, [1 1], [1e4 100]);
+            testCase.verifyEqual(P(2), 100, 'AbsTol', 1e-10);
+        end
+
+        function test_missing_data_returns_nan_and_exitflag(testCase)
+            Y = [1000*exp(-testCase.TE'./60); nan(1,numel(testCase.TE))];
+            Y(1,3) = NaN;
+            [P, ~, exitflag] = batchLM('monoexp', [1500 30], Y, testCase.TE);
+            testCase.verifyEqual(P(1,2), 60, 'RelTol', 1e-6);
+            testCase.verifyTrue(all(isnan(P(2,:))));
+            testCase.verifyEqual(exitflag(2), -1);
+        end
+
+        function test_function_handle_kernel_matches_compiled_kernel(testCase)
+            rng(1);
+            Y = 1000*exp(-testCase.TE'./(40 + 100*rand(50,1))) + 5*randn(50,numel(testCase.TE));
+            fun = @(P,x) batchLM_Test.monoexp(P,x);
+
+            Pc = batchLM('monoexp', [1500 30], Y, testCase.TE, [1 1], [1e4 300]);
+            Ph = batchLM(fun, [1500 30], Y, testCase.TE, [1 1], [1e4 300]);
+            Pfd = batchLM(fun, [1500 30], Y, testCase.TE, [1 1], [1e4 300], struct('Jacobian',false));
+
+            testCase.verifyEqual(Ph, Pc, 'RelTol', 1e-8);
+            testCase.verifyEqual(Pfd, Pc, 'RelTol', 1e-4);
+        end
+
+        function test_mono_t2_fitBatch_matches_voxelwise_fit(testCase)
+            Model = mono_t2;
+            T2 = [30; 60; 90];
+            data.SEdata = 1000*exp(-Model.Prot.SEdata.Mat'./T2);
+
+            batch = Model.fitBatch(data);
+            for ii = 1:numel(T2)
+                ref = Model.fit(struct('SEdata', data.SEdata(ii,:)'));
+                testCase.verifyEqual(batch.T2(ii), ref.T2, 'RelTol', 1e-4);
+                testCase.verifyEqual(batch.M0(ii), ref.M0, 'RelTol', 1e-4);
+            end
+        end
+
+        function test_mono_t2_FitData_batched_maps(testCase)
+            Model = mono_t2;
+            T2 = [30; 60; 90];
+            verifyFitDataBatch(testCase, Model, 1000*exp(-Model.Prot.SEdata.Mat'./T2), {}, 'RelTol', 1e-4);
+        end
+    end
+
+    methods (Static)
+        function [F, J] = monoexp(P, x)
+            E = exp(-x./P(2,:));
+            F = P(1,:).*E;
+            if nargout > 1
+                J = permute(cat(3, E, P(1,:).*E.*x./P(2,:).^2), [1 3 2]);
+            end
+        end
+    end
+end
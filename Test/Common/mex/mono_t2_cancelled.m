@@ -0,0 +1,29 @@
+classdef mono_t2_cancelled < mono_t2
+    % mono_t2 that presses Cancel on the FitData waitbar once CancelAfter
+    % voxels are fitted, like a user interrupting the fit. Used by
+    % qmr_store_Test; reset the voxel count with
+    % mono_t2_cancelled.count('reset') before each fit.
+
+    properties
+        CancelAfter = Inf;
+    end
+
+    methods
+        function FitResults = fit(obj, data)
+            FitResults = fit@mono_t2(obj, data);
+            if mono_t2_cancelled.count() >= obj.CancelAfter
+                setappdata(findall(0, 'Type', 'figure', 'Tag', 'TMWWaitbar'), 'canceling', 1);
+            end
+        end
+    end
+
+    methods (Static)
+        function n = count(reset)
+            % Number of voxels fitted since the last reset.
+            persistent fitted
+            if isempty(fitted) || nargin, fitted = 0; end
+            if ~nargin, fitted = fitted + 1; end
+            n = fitted;
+        end
+    end
+end
@@ -0,0 +1,98 @@
+classdef (TestTags = {'Unit'}) qmr_dicm_Test < matlab.unittest.TestCase
+    % Checks the native DICOM reader (qmr_dicm_mex, qMRdicmHdr) against
+    % dicm_hdr and dicm_img on small explicit VR files written here.
+    % Skipped when qmr_dicm_mex is not compiled.
+
+    properties
+        folder
+        fnames
+        flds = {'Columns' 'Rows' 'BitsAllocated' 'SeriesInstanceUID' 'SeriesNumber' ...
+            'ImagePositionPatient' 'PixelRepresentation' 'BitsStored' 'HighBit' ...
+            'InstanceNumber' 'B_value' 'CodeValue' 'ProcedureCodeSequence'};
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('qmr_dicm_mex','file')==3, 'qmr_dicm_mex is not compiled.');
+        end
+
+        function makeFiles(testCase)
+            testCase.folder = tempname;
+            mkdir(testCase.folder);
+            testCase.addTeardown(@() rmdir(testCase.folder, 's'));
+            testCase.fnames = {};
+            for k = 1:4
+                testCase.fnames{end+1} = testCase.write(sprintf('im%d.dcm', k), k, k == 3);
+            end
+            testCase.fnames{end+1} = fullfile(testCase.folder, 'notes.txt');
+            fid = fopen(testCase.fnames{end}, 'w'); fprintf(fid, '%s', repmat('not dicom ', 1, 30)); fclose(fid);
+        end
+    end
+
+    methods (Test)
+
+        function test_headers_match_dicm_hdr(testCase)
+            % Few tags: dicm_hdr searches them; with a sequence it walks the tags
+            for fields = {testCase.flds(1:6), testCase.flds}
+                dict = dicm_dict('SIEMENS', fields{1});
+                [hh, errStr, dict2] = qMRdicmHdr(testCase.fnames, dict);
+                for k = 1:numel(testCase.fnames)
+                    [s, err] = dicm_hdr(testCase.fnames{k}, dict);
+                    testCase.verifyEqual(hh{k}, s, testCase.fnames{k});
+                    testCase.verifyEqual(errStr{k}, err, testCase.fnames{k});
+                end
+                testCase.verifyEqual(dict2, dict);
+            end
+        end
+
+        function test_other_vendor_is_read_by_dicm_hdr(testCase)
+            % A GE private field makes dicm_hdr check the Manufacturer
+            dict = dicm_dict('GE', [testCase.flds(1:6) {'SeriesPlane'}]);
+            [hh, ~, dict2] = qMRdicmHdr(testCase.fnames(1:2), dict);
+            [s1, ~, ref] = dicm_hdr(testCase.fnames{1}, dict);
+            s2 = dicm_hdr(testCase.fnames{2}, ref);
+            testCase.verifyEqual(hh, {s1 s2});
+            testCase.verifyEqual(dict2, ref);
+        end
+
+        function test_img_matches_dicm_img(testCase)
+            hh = qMRdicmHdr(testCase.fnames(1:4), dicm_dict('SIEMENS', testCase.flds));
+            img = qmr_dicm_mex('img', hh);
+            for k = 1:4
+                testCase.verifyEqual(img(:,:,:,:,k), dicm_img(hh{k}, 0));
+            end
+            hh{2}.PixelData.Bytes = hh{2}.PixelData.Bytes / 2; % files differ: dicm_img reads them
+            testCase.verifyEmpty(qmr_dicm_mex('img', hh));
+        end
+
+    end
+
+    methods
+        % Explicit VR little endian file of 4x3 signed pixels, optionally
+        % with a sequence before the series tags.
+        function fname = write(testCase, name, instance, withSequence)
+            el = @(g, e, vr, v) [typecast(uint16([g e]), 'uint8') uint8(vr) typecast(uint16(numel(v)), 'uint8') uint8(v)];
+            pad = @(v) [v repmat(' ', 1, mod(numel(v), 2))];
+            meta = el(2, 16, 'UI', [uint8('1.2.840.10008.1.2.1') 0]);
+            body = el(8, 112, 'LO', pad('SIEMENS'));
+            if withSequence
+                item = [el(8, 256, 'SH', pad('CODE')) el(8, 260, 'LO', pad('Meaning'))];
+                body = [body typecast(uint16([8 4146]), 'uint8') uint8('SQ') 0 0 typecast(uint32(4294967295), 'uint8') ...
+                    typecast(uint16([65534 57344]), 'uint8') typecast(uint32(numel(item)), 'uint8') item ...
+                    typecast(uint16([65534 57565]), 'uint8') 0 0 0 0];
+            end
+            pix = typecast(int16((1:12) * 100 - 600 + instance), 'uint8');
+            body = [body el(25, 4108, 'IS', pad('1000')) el(32, 14, 'UI', pad('1.2.3.4')) ...
+                el(32, 17, 'IS', pad('7')) el(32, 19, 'IS', pad(num2str(instance))) ...
+                el(32, 50, 'DS', pad(sprintf('0.5\\-1\\%g', 2.5 * instance))) ...
+                el(40, 16, 'US', typecast(uint16(4), 'uint8')) el(40, 17, 'US', typecast(uint16(3), 'uint8')) ...
+                el(40, 256, 'US', typecast(uint16(16), 'uint8')) el(40, 257, 'US', typecast(uint16(12), 'uint8')) ...
+                el(40, 258, 'US', typecast(uint16(11), 'uint8')) el(40, 259, 'US', typecast(uint16(1), 'uint8')) ...
+                typecast(uint16([32736 16]), 'uint8') uint8('OW') 0 0 typecast(uint32(numel(pix)), 'uint8') pix];
+            fname = fullfile(testCase.folder, name);
+            fid = fopen(fname, 'w');
+            fwrite(fid, [zeros(1, 128, 'uint8') uint8('DICM') meta body]);
+            fclose(fid);
+        end
+    end
+end
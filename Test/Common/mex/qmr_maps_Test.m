@@ -0,0 +1,101 @@
+classdef (TestTags = {'Unit'}) qmr_maps_Test < matlab.unittest.TestCase
+    % Checks the compiled closed-form map kernels (qmr_maps_mex) against
+    % the formulas of Compute_M0_T1_OnSPGR, MTSAT_exec, b1_afi and b1_dam.
+    % Skipped when qmr_maps_mex is not compiled (see qMRbuildMex).
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('qmr_maps_mex','file')==3, 'qmr_maps_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_vfa_matches_linear_fit(testCase)
+            rng(0);
+            fa = [3 20]; TR = 0.015;
+            T1 = 0.5 + 2*rand(8,8,3); M0 = 1000 + 500*rand(8,8,3);
+            b1 = 0.8 + 0.4*rand(8,8,3);
+            roi = rand(8,8,3) > 0.2;
+            data = zeros([size(T1) numel(fa)]);
+            for ii = 1:numel(fa)
+                a = deg2rad(fa(ii))*b1;
+                data(:,:,:,ii) = M0.*(1-exp(-TR./T1)).*sin(a)./(1-exp(-TR./T1).*cos(a));
+            end
+            data = data + randn(size(data));
+
+            [T1m, M0m] = qmr_maps_mex('vfa', data, fa, TR, b1, roi);
+
+            [T1ref, M0ref] = deal(zeros(size(T1)));
+            for v = find(roi)'
+                [ix,iy,iz] = ind2sub(size(T1), v);
+                S = squeeze(data(ix,iy,iz,:))';
+                a = deg2rad(fa)*b1(v);
+                p = polyfit(S./tan(a), S./sin(a), 1);
+                T1ref(v) = -TR/log(p(1));
+                M0ref(v) = p(2)/(1-p(1));
+            end
+            testCase.verifyEqual(T1m, T1ref, 'RelTol', 1e-8);
+            testCase.verifyEqual(M0m, M0ref, 'RelTol', 1e-8);
+        end
+
+        function test_vfa_weighted_recovers_noiseless_T1(testCase)
+            fa = [3 10 20]; TR = 0.015; T1 = [0.6 1.2 2.4]; M0 = 1000;
+            E1 = exp(-TR./T1');
+            a = deg2rad(fa);
+            data = permute(M0*(1-E1).*sin(a)./(1-E1.*cos(a)), [1 3 4 2]);
+
+            T1m = qmr_maps_mex('vfa', data, fa, TR, [], [], struct('Weighted',true));
+
+            testCase.verifyEqual(T1m(:), T1', 'RelTol', 1e-9);
+        end
+
+        function test_mtsat_matches_MTSAT_formula(testCase)
+            rng(1);
+            sz = [6 6 2];
+            data.MTw = 500 + 100*rand(sz); data.T1w = 800 + 100*rand(sz); data.PDw = 900 + 100*rand(sz);
+            data.MTw(1) = 0;
+            data.B1map = 0.8 + 0.4*rand(sz);
+            MT = [6 0.028]; PD = [6 0.028]; T1 = [20 0.018]; f = 0.4;
+
+            [MTsat, R1] = qmr_maps_mex('mtsat', data.MTw, data.T1w, data.PDw, data.B1map, [], MT, PD, T1, f);
+
+            aMT = deg2rad(MT(1)); aPD = deg2rad(PD(1)); aT1 = deg2rad(T1(1));
+            R1ref = (0.5*data.B1map.^2).*((aT1/T1(2))*data.T1w - (aPD/PD(2))*data.PDw)./(data.PDw/aPD - data.T1w/aT1);
+            A = data.B1map.^(-1).*(PD(2)*aT1/aPD - T1(2)*aPD/aT1).*((data.PDw.*data.T1w)./(PD(2)*aT1*data.T1w - T1(2)*aPD*data.PDw));
+            ref = 100*(MT(2)*(aMT*(A./data.MTw) - 1).*R1ref - aMT^2/2);
+            ref(1) = 0; R1ref(1) = 0;
+            ref = ref.*(1-f)./(1-f*data.B1map);
+            testCase.verifyEqual(MTsat, ref, 'RelTol', 1e-10);
+            testCase.verifyEqual(R1, R1ref, 'RelTol', 1e-10);
+        end
+
+        function test_afi_and_dam_match_fit_formulas(testCase)
+            rng(2);
+            S1 = 100 + 50*rand(10,10); S2 = 100*rand(10,10);
+            nomFA = 60; n = 5;
+            r = abs(S2./S1);
+            c = ((r*n-1)./(n-r)).*(r<=1) + (r>1);
+            ref = real(acos(c))*180/pi/nomFA;
+            [raw, spurious, nospur] = qmr_maps_mex('afi', S1, S2, nomFA, n);
+            testCase.verifyEqual(raw, ref, 'AbsTol', 1e-10);
+            testCase.verifyEqual(spurious, double(ref<0.5));
+            ref(ref<0.6 | isnan(ref)) = 0.6;
+            testCase.verifyEqual(nospur, ref, 'AbsTol', 1e-10);
+
+            % DAM keeps abs() of the complex acos for |S2a/(2 Sa)| > 1
+            Sa = 100*rand(10,10); S2a = 300*rand(10,10) - 100;
+            ref = abs(acos(S2a./(2*Sa))./deg2rad(nomFA));
+            raw = qmr_maps_mex('dam', Sa, S2a, nomFA);
+            testCase.verifyEqual(raw, ref, 'AbsTol', 1e-10);
+        end
+
+        function test_single_input_gives_single_output(testCase)
+            S1 = single(100 + 50*rand(5,5)); S2 = single(100*rand(5,5));
+            raw = qmr_maps_mex('afi', S1, S2, 60, 5);
+            ref = qmr_maps_mex('afi', double(S1), double(S2), 60, 5);
+            testCase.verifyClass(raw, 'single');
+            testCase.verifyEqual(double(raw), ref, 'AbsTol', 1e-5);
+        end
+    end
+end
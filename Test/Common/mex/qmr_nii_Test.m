@@ -0,0 +1,105 @@
+classdef (TestTags = {'Unit'}) qmr_nii_Test < matlab.unittest.TestCase
+    % Checks the native NIfTI reader and writer (qmr_nii_mex, qMRniiRead,
+    % save_nii to .nii.gz) against the MATLAB NIfTI toolbox. Skipped when
+    % qmr_nii_mex is not compiled.
+
+    properties
+        folder
+        img
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('qmr_nii_mex','file')==3, 'qmr_nii_mex is not compiled.');
+        end
+
+        function makeData(testCase)
+            testCase.folder = tempname;
+            mkdir(testCase.folder);
+            testCase.addTeardown(@() rmdir(testCase.folder, 's'));
+            testCase.img = int16(reshape(0:9*8*7*5-1, [9 8 7 5]) - 1000);
+        end
+    end
+
+    methods (Test)
+
+        function test_slab_matches_load_untouch_nii(testCase)
+            fname = testCase.save(testCase.img, 4);
+            slab = qmr_nii_mex('slab', fname, [2 5 6], [4 1]);
+            nii = load_untouch_nii(fname, [4 1], [], [], [], [], [2 5 6]);
+            testCase.verifyClass(slab, 'int16');
+            testCase.verifyEqual(slab, nii.img);
+        end
+
+        function test_voxels_match_masked_volume(testCase)
+            fname = testCase.save(single(testCase.img) / 3, 16);
+            mask = false(9, 8, 7);
+            mask([3 17 100 504]) = true;
+            vals = qMRniiRead(fname, 'voxels', mask, 2:5);
+            ref = reshape(single(testCase.img(:,:,:,2:5)) / 3, [], 4);
+            testCase.verifyClass(vals, 'single');
+            testCase.verifyEqual(vals, ref(mask(:), :));
+            testCase.verifyEqual(qmr_nii_mex('voxels', fname, [3 17 100 504]', 2:5), vals);
+        end
+
+        function test_info_matches_header(testCase)
+            fname = testCase.save(testCase.img, 4);
+            info = qMRniiRead(fname);
+            hdr = load_untouch_header_only(fname);
+            testCase.verifyEqual(info.dim, double(hdr.dime.dim));
+            testCase.verifyEqual(info.datatype, double(hdr.dime.datatype));
+            testCase.verifyEqual(info.vox_offset, double(hdr.dime.vox_offset));
+        end
+
+        function test_gz_is_written_and_read_in_memory(testCase)
+            nii = make_nii(testCase.img, [1 1 2], [0 0 0], 4);
+            plain = fullfile(testCase.folder, 'plain.nii');
+            packed = fullfile(testCase.folder, 'packed.nii.gz');
+            save_nii(nii, plain);
+            save_nii(nii, packed);
+            gunzip(packed, fullfile(testCase.folder, 'unpacked'));
+            fid = fopen(plain); ref = fread(fid, inf, '*uint8'); fclose(fid);
+            fid = fopen(fullfile(testCase.folder, 'unpacked', 'packed.nii')); out = fread(fid, inf, '*uint8'); fclose(fid);
+            testCase.verifyEqual(out, ref);
+            testCase.verifyEqual(qMRniiRead(packed, 'slab', [], 3), testCase.img(:,:,:,3));
+            testCase.verifyEqual(qMRniiRead(packed, 'voxels', [5; 60], 1:2), qMRniiRead(plain, 'voxels', [5; 60], 1:2));
+        end
+
+        function test_header_range_of_maps_with_inf_and_nan(testCase)
+            % glmax/glmin are int32: saturated, and 0 for NaN, as fwrite does
+            map = single(reshape(1:9*8*7, [9 8 7]));
+            map(1) = Inf;
+            map(2) = -1e12;
+            maps = {map, nan(9, 8, 7, 'single')};
+            expected = [intmax('int32') intmin('int32'); 0 0];
+            for ii = 1:numel(maps)
+                nii = make_nii(maps{ii}, [1 1 1], [0 0 0], 16);
+                plain = fullfile(testCase.folder, sprintf('map%d.nii', ii));
+                packed = fullfile(testCase.folder, sprintf('map%d.nii.gz', ii));
+                save_nii(nii, plain);
+                save_nii(nii, packed);
+                hdr = load_untouch_header_only(packed);
+                testCase.verifyEqual(double([hdr.dime.glmax hdr.dime.glmin]), double(expected(ii,:)));
+                gunzip(packed, fullfile(testCase.folder, 'unpacked'));
+                fid = fopen(plain); ref = fread(fid, inf, '*uint8'); fclose(fid);
+                fid = fopen(fullfile(testCase.folder, 'unpacked', sprintf('map%d.nii', ii))); out = fread(fid, inf, '*uint8'); fclose(fid);
+                testCase.verifyEqual(out, ref);
+            end
+        end
+
+        function test_out_of_range_index_is_rejected(testCase)
+            fname = testCase.save(testCase.img, 4);
+            testCase.verifyError(@() qmr_nii_mex('slab', fname, 8), 'qMRLab:qmr_nii_mex:invalidIndex');
+            testCase.verifyError(@() qmr_nii_mex('slab', [fname '.gz']), 'qMRLab:qmr_nii_mex:cannotRead');
+            testCase.verifyError(@() qmr_nii_mex('save', fname, load_untouch_header_only(fname), single(testCase.img)), ...
+                'qMRLab:qmr_nii_mex:invalidInputType');
+        end
+    end
+
+    methods
+        function fname = save(testCase, img, datatype)
+            fname = fullfile(testCase.folder, sprintf('img%d.nii', datatype));
+            save_nii(make_nii(img, [1 1 1], [0 0 0], datatype), fname);
+        end
+    end
+end
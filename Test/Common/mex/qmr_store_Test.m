@@ -0,0 +1,199 @@
+classdef (TestTags = {'Unit'}) qmr_store_Test < matlab.unittest.TestCase
+    % Checks the chunked result store (qmr_store_mex) used for the
+    % temporary results of FitData and ParFitData, that an interrupted fit
+    % resumed from it equals an uninterrupted one, and its export to NIfTI
+    % (FitResultsExport_nii). Skipped when qmr_store_mex is not compiled.
+
+    properties
+        folder
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('qmr_store_mex','file')==3, 'qmr_store_mex is not compiled.');
+        end
+
+        function makeFolder(testCase)
+            testCase.folder = tempname;
+            mkdir(testCase.folder);
+            testCase.addTeardown(@() rmdir(testCase.folder, 's'));
+        end
+    end
+
+    methods (Test)
+
+        function test_written_voxels_are_read_back(testCase)
+            dims = [4 3 2];
+            qmr_store_mex('create', testCase.folder, dims, {'T1','M0'}, [1 2]);
+            % Two chunks, committed out of order
+            qmr_store_mex('write', testCase.folder, [7 2], [10 1 2; 20 3 4]);
+            qmr_store_mex('write', testCase.folder, 24, [30 5 6], struct('Level', 9));
+
+            testCase.verifyEqual(qmr_store_mex('computed', testCase.folder), [2; 7; 24]);
+            info = qmr_store_mex('info', testCase.folder);
+            testCase.verifyEqual(info.dims, dims);
+            testCase.verifyEqual(info.fields, {'T1','M0'});
+            testCase.verifyEqual(info.channels, [1 2]);
+
+            Fit = qmr_store_mex('read', testCase.folder);
+            T1 = nan(dims); T1([7 2 24]) = [10 20 30];
+            M0 = nan([dims 2]); M0([7 2 24]) = [1 3 5]; M0([7 2 24] + 24) = [2 4 6];
+            computed = zeros(dims); computed([2 7 24]) = 1;
+            testCase.verifyEqual(Fit.T1, T1);
+            testCase.verifyEqual(Fit.M0, M0);
+            testCase.verifyEqual(Fit.fields, {'T1','M0'});
+            testCase.verifyEqual(Fit.computed, computed);
+
+            Fit = qmr_store_mex('read', testCase.folder, 'M0');
+            testCase.verifyFalse(isfield(Fit, 'T1'));
+            testCase.verifyEqual(Fit.M0, M0);
+        end
+
+        function test_resuming_needs_the_same_layout(testCase)
+            qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1);
+            qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1);
+            testCase.verifyError(@() qmr_store_mex('create', testCase.folder, [4 3 2], {'T2'}, 1), ...
+                'qMRLab:qmr_store_mex:storeMismatch');
+            testCase.verifyError(@() qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1, 'abc'), ...
+                'qMRLab:qmr_store_mex:storeMismatch');
+        end
+
+        function test_resuming_needs_the_same_fingerprint(testCase)
+            key = qmr_store_mex('fingerprint', magic(4), struct('FitType','Linear'));
+            qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1, key);
+            qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1, key);
+            info = qmr_store_mex('info', testCase.folder);
+            testCase.verifyEqual(info.fingerprint, key);
+            testCase.verifyError(@() qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1), ...
+                'qMRLab:qmr_store_mex:storeMismatch');
+            other = qmr_store_mex('fingerprint', magic(4), struct('FitType','Exponential'));
+            testCase.verifyError(@() qmr_store_mex('create', testCase.folder, [4 3 2], {'T1'}, 1, other), ...
+                'qMRLab:qmr_store_mex:storeMismatch');
+        end
+
+        function test_fingerprint_follows_contents(testCase)
+            A = struct('SEdata', reshape(1:24, [2 3 4]), 'Mask', true(2,3), 'opts', {{'Linear', 1}});
+            key = qmr_store_mex('fingerprint', A, 'mono_t2');
+            testCase.verifyEqual(qmr_store_mex('fingerprint', A, 'mono_t2'), key);
+            B = A; B.SEdata(5) = 5.5;
+            testCase.verifyNotEqual(qmr_store_mex('fingerprint', B, 'mono_t2'), key);
+            B = A; B.SEdata = single(B.SEdata);
+            testCase.verifyNotEqual(qmr_store_mex('fingerprint', B, 'mono_t2'), key);
+            B = A; B.SEdata = reshape(B.SEdata, [6 4]);
+            testCase.verifyNotEqual(qmr_store_mex('fingerprint', B, 'mono_t2'), key);
+            B = A; B.Mask(2) = false;
+            testCase.verifyNotEqual(qmr_store_mex('fingerprint', B, 'mono_t2'), key);
+            B = A; B.opts{1} = 'Exponential';
+            testCase.verifyNotEqual(qmr_store_mex('fingerprint', B, 'mono_t2'), key);
+            testCase.verifyNotEqual(qmr_store_mex('fingerprint', A, 'mwf'), key);
+        end
+
+        function test_interrupted_FitData_resumes(testCase)
+            [data, Model] = monoT2Data(mono_t2_cancelled);
+            here = pwd;
+            cd(testCase.folder);
+            testCase.addTeardown(@() cd(here));
+            testCase.addTeardown(@() delete(findall(0, 'Type', 'figure', 'Tag', 'TMWWaitbar')));
+            ci = getenv('ISCITEST');
+            testCase.addTeardown(@() setenv('ISCITEST', ci));
+            setenv('ISCITEST', '0');
+            storeDir = fullfile(testCase.folder, 'FitTempResults');
+
+            Full = FitData(data, Model, 0);
+            testCase.verifyFalse(exist(storeDir, 'dir') == 7);
+
+            % Cancelled from the waitbar after 3 voxels: they are kept
+            Model.CancelAfter = 3;
+            mono_t2_cancelled.count('reset');
+            FitData(data, Model, 1);
+            testCase.verifyEqual(numel(qmr_store_mex('computed', storeDir)), 3);
+            Model.CancelAfter = Inf;
+
+            other = data;
+            other.SEdata(1) = other.SEdata(1) + 1;
+            testCase.verifyError(@() FitData(other, Model, 0, storeDir), 'qMRLab:FitData:storeMismatch');
+            Exponential = Model;
+            Exponential.options.FitType = 'Exponential';
+            testCase.verifyError(@() FitData(data, Exponential, 0, storeDir), 'qMRLab:FitData:storeMismatch');
+
+            Resumed = FitData(data, Model, 0, storeDir);
+            testCase.verifyEqual(Resumed.fields, Full.fields);
+            for ff = 1:length(Full.fields)
+                testCase.verifyEqual(Resumed.(Full.fields{ff}), Full.(Full.fields{ff}), Full.fields{ff});
+            end
+            testCase.verifyEqual(Resumed.computed, Full.computed);
+            testCase.verifyFalse(exist(storeDir, 'dir') == 7);
+        end
+
+        function test_CI_runs_leave_no_store(testCase)
+            [data, Model] = monoT2Data(mono_t2);
+            here = pwd;
+            cd(testCase.folder);
+            testCase.addTeardown(@() cd(here));
+            ci = getenv('ISCITEST');
+            testCase.addTeardown(@() setenv('ISCITEST', ci));
+            setenv('ISCITEST', '1');
+            FitData(data, Model, 0);
+            testCase.verifyFalse(exist(fullfile(testCase.folder, 'FitTempResults'), 'dir') == 7);
+        end
+
+        function test_interrupted_ParFitData_resumes(testCase)
+            testCase.assumeTrue(~moxunit_util_platform_is_octave && license('test','Distrib_Computing_Toolbox') ...
+                && ~isempty(ver('parallel')), 'ParFitData needs the Parallel Computing Toolbox.');
+            [data, Model] = monoT2Data(mono_t2);
+            here = pwd;
+            cd(testCase.folder);
+            testCase.addTeardown(@() cd(here));
+
+            Full = ParFitData(data, Model, 'AutosaveEnabled', true, 'RemoveTmpOnSuccess', false);
+            tmp = dir(fullfile(testCase.folder, 'ParFitTempResults_*'));
+            recoveryDir = fullfile(testCase.folder, 'recover');
+            movefile(fullfile(testCase.folder, tmp(1).name), recoveryDir);
+
+            % Interrupted before every other chunk was committed
+            chunks = dir(fullfile(recoveryDir, 'chunk_*.gz'));
+            testCase.assumeGreaterThan(numel(chunks), 1);
+            for ii = 1:2:numel(chunks)
+                delete(fullfile(recoveryDir, chunks(ii).name));
+            end
+            testCase.verifyLessThan(numel(qmr_store_mex('computed', recoveryDir)), nnz(data.Mask));
+
+            Resumed = ParFitData(data, Model, 'RecoverDirectory', recoveryDir, 'RemoveTmpOnSuccess', true);
+            for ff = 1:length(Full.fields)
+                testCase.verifyEqual(Resumed.(Full.fields{ff}), Full.(Full.fields{ff}), Full.fields{ff});
+            end
+
+            % The store of another dataset is not used: all voxels are fitted
+            other = data;
+            other.SEdata = 2*other.SEdata;
+            Other = ParFitData(other, Model, 'RecoverDirectory', recoveryDir, 'RemoveTmpOnSuccess', true);
+            testCase.verifyEqual(Other.T2, Full.T2, 'AbsTol', 1e-9);
+            testCase.verifyEqual(Other.M0, 2*Full.M0, 'RelTol', 1e-9);
+        end
+
+        function test_export_writes_one_file_per_field(testCase)
+            qmr_store_mex('create', testCase.folder, [4 3 2], {'T1','M0'}, [1 1]);
+            qmr_store_mex('write', testCase.folder, 1:24, [(1:24)' -(1:24)']);
+            out = fullfile(testCase.folder, 'FitResults');
+            FitResultsExport_nii(testCase.folder, [], out);
+            Fit = qmr_store_mex('read', testCase.folder);
+            testCase.verifyEqual(double(load_nii_data(fullfile(out, 'T1.nii.gz'))), Fit.T1);
+            testCase.verifyEqual(double(load_nii_data(fullfile(out, 'M0.nii.gz'))), Fit.M0);
+        end
+
+    end
+end
+
+function [data, Model] = monoT2Data(Model)
+% Small mono-exponential T2 dataset for Model (mono_t2 or a subclass),
+% fitted voxelwise (log-linear fit, no batched path).
+rng(0);
+Model.options.FitType = 'Linear';
+TE = Model.Prot.SEdata.Mat(:)';
+dims = [6 5 2];
+T2 = 40 + 60*rand(dims);
+M0 = 1000*(0.5 + rand(dims));
+data.SEdata = bsxfun(@times, M0(:), exp(-bsxfun(@rdivide, TE, T2(:))));
+data.SEdata = reshape(data.SEdata .* (1 + 0.01*randn(size(data.SEdata))), [dims length(TE)]);
+data.Mask = double(rand(dims) > 0.3);
+end
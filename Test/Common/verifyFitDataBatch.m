@@ -0,0 +1,41 @@
+function verifyFitDataBatch(testCase, Model, data, fields, varargin)
+% verifyFitDataBatch(testCase, Model, data, fields, tolerance...)
+% Runs FitData through the batched path of Model (fitBatch) and checks
+% that its maps hold, voxel by voxel, the outputs of Model.fit: same
+% fields, each value in its voxel and channel, NaN outside the mask.
+%
+% data      [nVoxels x nT] data of the first MRIinput of Model, fitted as
+%           an [nVoxels 1 1 nT] volume; voxel 2 is left out of the mask
+% fields    outputs whose values are compared ({}: all), e.g. to leave
+%           out the residue where the batched estimator differs
+% tolerance passed to verifyEqual, e.g. 'RelTol', 1e-6
+%
+% Used by the fitBatch tests of the batched models.
+
+name = Model.MRIinputs{1};
+nV = size(data,1);
+testCase.verifyNotEmpty(Model.fitBatch(struct(name, data)), 'fitBatch did not take the batched path.');
+
+ci = getenv('ISCITEST');
+restore = onCleanup(@() setenv('ISCITEST', ci));
+setenv('ISCITEST', '0'); % FitData skips fitBatch on CI
+mask = ones(nV,1);
+mask(2) = 0;
+Fit = FitData(struct(name, reshape(data, [nV 1 1 size(data,2)]), 'Mask', mask), Model, 0);
+
+for ii = 1:nV
+    if ~mask(ii)
+        for ff = 1:length(Fit.fields)
+            testCase.verifyTrue(all(isnan(Fit.(Fit.fields{ff})(ii,:))), sprintf('%s outside the mask', Fit.fields{ff}));
+        end
+        continue
+    end
+    ref = Model.fit(struct(name, data(ii,:)', 'Mask', 1));
+    testCase.verifyEqual(sort(Fit.fields(:)), sort(fieldnames(ref)));
+    if isempty(fields), fields = fieldnames(ref)'; end
+    for ff = 1:length(fields)
+        testCase.verifyEqual(reshape(Fit.(fields{ff})(ii,1,1,:), 1, []), double(ref.(fields{ff})(:)'), varargin{:}, ...
+            sprintf('%s, voxel %d', fields{ff}, ii));
+    end
+end
+end
@@ -0,0 +1,55 @@
+classdef (TestTags = {'Unit'}) smoothn_mex_Test < matlab.unittest.TestCase
+    % Checks that smoothn gives the same result with the compiled engine
+    % (smoothn_mex, used for arrays) as with the MATLAB code (used for cell
+    % inputs). Skipped when smoothn_mex is not compiled.
+
+    properties
+        y
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('smoothn_mex','file')==3, 'smoothn_mex is not compiled.');
+        end
+
+        function makeData(testCase)
+            rng(0);
+            [x, y, z] = ndgrid(linspace(-1,1,24), linspace(-1,1,20), linspace(-1,1,9));
+            testCase.y = 1 + 0.3*x - 0.2*y.^2 + 0.1*z + 0.05*randn(size(x));
+        end
+    end
+
+    methods (Test)
+
+        function test_auto_smoothness(testCase)
+            Y = testCase.y(:,:,4);
+            [z, s] = smoothn(Y);
+            [zRef, sRef] = smoothn({Y});
+            testCase.verifyEqual(s, sRef, 'RelTol', 1e-10);
+            testCase.verifyEqual(z, zRef, 'AbsTol', 1e-10);
+        end
+
+        function test_fixed_smoothness(testCase)
+            z = smoothn(testCase.y, 2);
+            testCase.verifyEqual(z, smoothn({testCase.y}, 2), 'AbsTol', 1e-10);
+        end
+
+        function test_robust_with_missing_data(testCase)
+            Y = testCase.y;
+            Y(5:7:end) = Y(5:7:end) + 2;  % outliers
+            Y(3:11:end) = NaN;
+            opts = struct('Spacing', [1 1 2], 'MaxIter', 10);
+            [z, s, exitflag] = smoothn(Y, 'robust', opts);
+            [zRef, sRef, exitflagRef] = smoothn({Y}, 'robust', opts);
+            testCase.verifyEqual(s, sRef, 'RelTol', 1e-8);
+            testCase.verifyEqual(z, zRef, 'AbsTol', 1e-8);
+            testCase.verifyEqual(exitflag, exitflagRef);
+        end
+
+        function test_weights(testCase)
+            W = 0.2 + rand(size(testCase.y));
+            z = smoothn(testCase.y, W, 0.5, struct('Weight', 'cauchy'));
+            testCase.verifyEqual(z, smoothn({testCase.y}, W, 0.5, struct('Weight', 'cauchy')), 'AbsTol', 1e-8);
+        end
+    end
+end
@@ -0,0 +1,149 @@
+classdef (TestTags = {'Unit'}) sunwrap_mex_Test < matlab.unittest.TestCase
+    % Checks the compiled sunwrap engine (sunwrap_mex) on smooth phase
+    % ramps, for 2D and 3D images and stacks of echoes, and against the
+    % MATLAB code of sunwrap (reference, below) on noisy images that form
+    % several clusters. Skipped when sunwrap_mex is not compiled.
+
+    properties
+        magnitude
+        phase
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('sunwrap_mex','file')==3, 'sunwrap_mex is not compiled.');
+        end
+
+        function makeData(testCase)
+            [x, y, z] = ndgrid(((1:32)-16.5)/8, ((1:28)-14.5)/7, ((1:12)-6.5)/3);
+            testCase.magnitude = exp(-(x.^2 + y.^2 + z.^2)/4);
+            testCase.phase = 1.5*x.^2 + 4*y - 0.5*z.^2;
+        end
+    end
+
+    methods (Test)
+
+        function test_3d_ramp_is_recovered(testCase)
+            wrapped = angle(exp(1i * testCase.phase));
+            for connectivity = [26 6]
+                unwrapped = sunwrap_mex(testCase.magnitude, wrapped, 0, struct('Connectivity', connectivity));
+                offset = unwrapped - testCase.phase;
+                testCase.verifyEqual(offset, repmat(offset(1), size(offset)), 'AbsTol', 1e-9);
+                testCase.verifyEqual(offset(1)/(2*pi), round(offset(1)/(2*pi)), 'AbsTol', 1e-9);
+            end
+        end
+
+        function test_matches_sunwrap_interface(testCase)
+            complexImage = testCase.magnitude(:,:,6) .* exp(1i * testCase.phase(:,:,6));
+            unwrapped = sunwrap(complexImage, 0.2);
+            keep = abs(complexImage) >= 0.2 * max(abs(complexImage(:)));
+            testCase.verifySize(unwrapped, size(complexImage));
+            testCase.verifyEqual(unwrapped(~keep), zeros(nnz(~keep), 1));
+            offset = unwrapped(keep) - testCase.phase(keep);
+            testCase.verifyEqual(offset, repmat(offset(1), size(offset)), 'AbsTol', 1e-9);
+        end
+
+        function test_clusters_match_matlab_code(testCase)
+            % Noisy magnitude: pixels seed many clusters that are merged as
+            % the visit proceeds; the threshold leaves holes between them.
+            rng(0);
+            mag = testCase.magnitude(:,:,4:9) .* (0.2 + rand(32,28,6));
+            ph = angle(exp(1i * (testCase.phase(:,:,4:9) + 0.5*randn(32,28,6))));
+            for threshold = [0.15 0.4]
+                testCase.verifyEqual(sunwrap_mex(mag, ph, threshold), reference(mag, ph, threshold), 'AbsTol', 1e-9);
+            end
+            % Equal magnitudes: merged by mean phase, visited by phase
+            mag = 1 + round(3*rand(20,24));
+            ph = angle(exp(1i * (3*testCase.phase(1:20,1:24,6) + randn(20,24))));
+            testCase.verifyEqual(sunwrap_mex(mag, ph, 0.3), reference(mag, ph, 0.3), 'AbsTol', 1e-9);
+        end
+
+        function test_echoes_are_unwrapped_independently(testCase)
+            echoes = cat(4, testCase.phase, 2*testCase.phase, -testCase.phase);
+            wrapped = angle(exp(1i * echoes));
+            mag = repmat(testCase.magnitude, [1 1 1 3]);
+            unwrapped = sunwrap_mex(mag, wrapped, 0.1, struct('NumThreads', 3));
+            for e = 1:3
+                testCase.verifyEqual(unwrapped(:,:,:,e), sunwrap_mex(testCase.magnitude, wrapped(:,:,:,e), 0.1));
+            end
+        end
+
+        function test_invalid_threshold_is_rejected(testCase)
+            testCase.verifyError(@() sunwrap_mex(testCase.magnitude, testCase.phase, 2), 'qMRLab:sunwrap_mex:invalidInput');
+        end
+    end
+end
+
+function unwrapped = reference(mag, ph, threshold)
+% The MATLAB loop of sunwrap (External/sunwrap/sunwrap.m), condensed.
+[nx, ny, nz] = size(mag);
+N = numel(mag);
+[X, Y, Z] = ndgrid(1:nx, 1:ny, 1:nz);
+list = sortrows([mag(:) ph(:) X(:) Y(:) Z(:)], [-1 2]);
+labels = zeros(nx, ny, nz);
+unwrapped = zeros(nx, ny, nz);
+[head, tail, next, weight] = deal(zeros(1, N));
+nLabels = 0;
+for i = 1:N
+    m = list(i,1); p = list(i,2); x = list(i,3); y = list(i,4); z = list(i,5);
+    if m < threshold * list(1,1), break; end
+    % Neighbouring clusters: label, magnitude, phase (sum), pixels
+    pending = zeros(0,4);
+    maxMag = 0; maxLabel = 0;
+    for dz = -1:1
+        for dy = -1:1
+            for dx = -1:1
+                xx = x+dx; yy = y+dy; zz = z+dz;
+                if ~(dx || dy || dz) || xx < 1 || xx > nx || yy < 1 || yy > ny || zz < 1 || zz > nz || ~labels(xx,yy,zz)
+                    continue
+                end
+                l = labels(xx,yy,zz); mn = mag(xx,yy,zz); pn = unwrapped(xx,yy,zz);
+                if mn > maxMag, maxMag = mn; maxLabel = l; end
+                j = find(pending(:,1) == l, 1);
+                if isempty(j)
+                    pending(end+1,:) = [l mn pn 1]; %#ok<AGROW>
+                elseif pending(j,2) < mn
+                    pending(j,2:4) = [mn pn 1];
+                elseif pending(j,2) == mn
+                    pending(j,3:4) = pending(j,3:4) + [pn 1];
+                end
+            end
+        end
+    end
+    pending(:,3) = pending(:,3) ./ pending(:,4);
+    node = sub2ind([nx ny nz], x, y, z);
+    if ~maxLabel
+        nLabels = nLabels + 1;
+        unwrapped(node) = p; labels(node) = nLabels;
+        head(nLabels) = node; tail(nLabels) = node; weight(nLabels) = m;
+        continue
+    end
+    if size(pending,1) > 1
+        pending(:,2) = weight(pending(:,1))';
+        pending = sortrows(pending, [-2 3]);
+    end
+    L = pending(1,1);
+    p = p + phaseOffset(p, pending(1,3));
+    unwrapped(node) = p; labels(node) = L;
+    next(tail(L)) = node; tail(L) = node; weight(L) = weight(L) + m;
+    for j = 2:size(pending,1)
+        l = pending(j,1);
+        offset = phaseOffset(pending(j,3), p);
+        n = head(l);
+        while n
+            labels(n) = L;
+            unwrapped(n) = unwrapped(n) + offset;
+            n = next(n);
+        end
+        next(tail(L)) = head(l); tail(L) = tail(l);
+        weight(L) = weight(L) + weight(l);
+        head(l) = 0; tail(l) = 0;
+    end
+end
+end
+
+function offset = phaseOffset(phase, fixed)
+offset = 0;
+while phase + offset - fixed < -pi, offset = offset + 2*pi; end
+while phase + offset - fixed > pi, offset = offset - 2*pi; end
+end
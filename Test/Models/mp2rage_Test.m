@@ -75,5 +75,21 @@ classdef (TestTags = {'Unit'}) mp2rage_Test < matlab.unittest.TestCase
             end
         end
 
+        function test_voxels_without_T1_have_zero_R1(testCase)
+            %% Prep
+            % UNI values outside the lookup table give T1 = 0.
+            uni = testCase.volume(0);
+            uni(1) = 2048;
+            data = struct('MP2RAGE', uni);
+
+            %% Fit
+            FitResult = testCase.quietFit(data);
+
+            %% Verify
+            testCase.verifyTrue(all(isfinite(FitResult.R1(:))), 'R1 should never be Inf or NaN.');
+            testCase.verifyEqual(FitResult.R1(FitResult.T1==0), zeros(nnz(FitResult.T1==0),1), ...
+                'Voxels without a T1 should have R1 = 0.');
+        end
+
     end
 end
@@ -0,0 +1,63 @@
+classdef (TestTags = {'Unit'}) amico_fitBatch_Test < matlab.unittest.TestCase
+    % Checks that the compiled AMICO engine (amico_mex) reproduces
+    % amico.fit voxel by voxel. Skipped when amico_mex is not compiled or
+    % the NODDI toolbox (kernel generation) is not installed.
+
+    properties
+        Model
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('amico_mex','file')==3, 'amico_mex is not compiled.');
+            testCase.assumeTrue(exist('MakeModel.m','file')==2, 'The NODDI toolbox is not installed.');
+            testCase.Model = amico;
+            testCase.Model = testCase.Model.Precompute();
+        end
+    end
+
+    methods (Test)
+
+        function test_fitBatch_matches_fit(testCase)
+            Model = testCase.Model;
+            rng(0);
+            nV = 20;
+            nS = size(Model.Prot.DiffusionData.Mat,1);
+            data = zeros(nV,nS);
+            for ii = 1:nV
+                x = Model.st;
+                x(1) = 0.3 + 0.5*rand;                        % ficvf
+                x(strcmp(Model.xnames,'kappa')) = 0.5 + 3*rand;
+                x(strcmp(Model.xnames,'theta')) = pi*rand;
+                x(strcmp(Model.xnames,'phi')) = pi*rand;
+                S = 1000*Model.equation(x);
+                data(ii,:) = abs(S(:)' + 10*(randn(1,nS) + 1i*randn(1,nS)));
+            end
+            data(end,:) = 0; % no b0 signal
+
+            FitBatch = Model.fitBatch(struct('DiffusionData',data));
+            fields = {'ficvf','ODI','fiso','kappa','b0','theta','phi','fr'};
+            for ii = 1:nV
+                Fit = Model.fit(struct('DiffusionData',data(ii,:)'));
+                for ff = 1:length(fields)
+                    testCase.verifyEqual(FitBatch.(fields{ff})(ii), double(Fit.(fields{ff})), ...
+                        'AbsTol', 1e-5, sprintf('%s, voxel %d', fields{ff}, ii));
+                end
+            end
+        end
+
+        function test_FitData_batched_maps(testCase)
+            Model = testCase.Model;
+            rng(1);
+            nS = size(Model.Prot.DiffusionData.Mat,1);
+            data = zeros(3,nS);
+            for ii = 1:3
+                x = Model.st;
+                x(1) = 0.3 + 0.5*rand;
+                S = 1000*Model.equation(x);
+                data(ii,:) = abs(S(:)' + 10*(randn(1,nS) + 1i*randn(1,nS)));
+            end
+            verifyFitDataBatch(testCase, Model, data, {'ficvf','ODI','fiso','kappa','b0','theta','phi','fr'}, 'AbsTol', 1e-5);
+        end
+    end
+end
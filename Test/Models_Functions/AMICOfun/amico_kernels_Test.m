@@ -0,0 +1,60 @@
+classdef (TestTags = {'Unit'}) amico_kernels_Test < matlab.unittest.TestCase
+    % Checks that amico_kernels_mex rotates and resamples zonal kernels as
+    % AMICO_RotateKernel + AMICO_ResampleKernel, and its cache round trip.
+    % Skipped when amico_kernels_mex is not compiled.
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('amico_kernels_mex','file')==3, 'amico_kernels_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_resample_matches_rotation(testCase)
+            rng(0);
+            lmax = 12; nShells = 2; nA = 3; nS = 12;
+            Z = randn(lmax/2+1, nShells, nA);
+            dirs = randn(nS, 3);
+            dirs(:,2) = abs(dirs(:,2));
+            shell = [0; 0; repmat([1;2], (nS-2)/2, 1)];
+            A = amico_kernels_mex('resample', Z, dirs, shell, struct('NumThreads',1));
+            testCase.verifyClass(A, 'single');
+            testCase.verifyEqual(size(A), [nS nA 181 181]);
+
+            g = bsxfun(@rdivide, dirs, sqrt(sum(dirs.^2,2)));
+            [colatitude, longitude] = AMICO_Cart2sphere(g(:,1), g(:,2), g(:,3));
+            Yg = AMICO_CreateYlm(lmax, colatitude, longitude);
+            for o = [1 1; 46 91; 181 181; 120 7]'
+                Yu = AMICO_CreateYlm(lmax, (o(1)-1)/180*pi, (o(2)-1)/180*pi);
+                for a = 1:nA
+                    ref = ones(nS,1);
+                    for s = 1:nShells
+                        Rlm = zeros(size(Yu));
+                        idx = 1;
+                        for l = 0:2:lmax
+                            for m = -l:l
+                                Rlm(idx) = sqrt(4*pi/(2*l+1)) * Z(l/2+1,s,a) * Yu(idx);
+                                idx = idx+1;
+                            end
+                        end
+                        ref(shell==s) = Yg(shell==s,:) * Rlm(:);
+                    end
+                    testCase.verifyEqual(double(A(:,a,o(1),o(2))), ref, 'AbsTol', 1e-5);
+                end
+            end
+        end
+
+        function test_cache_roundtrip(testCase)
+            dir = tempname;
+            mkdir(dir);
+            cleanup = onCleanup(@() rmdir(dir,'s'));
+            key = [12 1.7e-3 3e-3 1000 2000];
+            testCase.verifyEmpty(amico_kernels_mex('load', dir, key));
+            blob = randn(50,1);
+            testCase.verifyTrue(amico_kernels_mex('store', dir, key, blob));
+            testCase.verifyEqual(amico_kernels_mex('load', dir, key), blob);
+            testCase.verifyEmpty(amico_kernels_mex('load', dir, key+1));
+        end
+    end
+end
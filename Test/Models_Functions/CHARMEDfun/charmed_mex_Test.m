@@ -0,0 +1,96 @@
+classdef (TestTags = {'Unit'}) charmed_mex_Test < matlab.unittest.TestCase
+    % Checks the compiled CHARMED kernel (charmed_mex) against
+    % scd_model_CHARMED, its Jacobian against finite differences, and the
+    % batched fit of charmed on noiseless data. Skipped when charmed_mex is
+    % not compiled.
+
+    properties
+        Model = charmed;
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('charmed_mex','file')==3, 'charmed_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_signal_matches_scd_model(testCase)
+            scheme = ConvertSchemeUnits(testCase.Model.Prot.DiffusionData.Mat,0);
+            Ax = struct('scheme',scheme,'index',1:size(scheme,1)); % index: MATLAB code path
+            X = [0.5 0.7 6 0 0.1 0   3 1.4
+                 0.3 1.2 3 0 0   4   3 1.4
+                 0.7 0.5 9 0 0.2 2.5 3 2.0];
+            S = charmed_mex('signal',X,scheme);
+            for ii = 1:size(X,1)
+                testCase.verifyEqual(S(ii,:), scd_model_CHARMED(X(ii,:),Ax)', 'AbsTol', 1e-12);
+            end
+        end
+
+        function test_distribution_matches_scd_model(testCase)
+            scheme = ConvertSchemeUnits(testCase.Model.Prot.DiffusionData.Mat,0);
+            Ax = struct('scheme',scheme,'onediam',0);
+            X = [0.5 0.7 4 1.5 0.1 0 3 1.4]; % node of the (mean, std) table
+            S = charmed_mex('signal',X,scheme);
+            testCase.verifyEqual(S, scd_model_CHARMED(X,Ax)', 'AbsTol', 1e-10);
+        end
+
+        function test_jacobian_matches_finite_differences(testCase)
+            scheme = ConvertSchemeUnits(testCase.Model.Prot.DiffusionData.Mat,0);
+            x = [0.5 0.7 6 0 0.1 2 3 1.4];
+            [~,J] = charmed_mex('signal',x,scheme);
+            h = 1e-6;
+            for k = [1 2 3 5 6 7 8]
+                dx = zeros(1,8); dx(k) = h;
+                Jfd = (charmed_mex('signal',x+dx,scheme) - charmed_mex('signal',x-dx,scheme))/(2*h);
+                testCase.verifyEqual(J(1,:,k), Jfd, 'AbsTol', 1e-5, sprintf('parameter %d',k));
+            end
+        end
+
+        function test_fitBatch_recovers_noiseless_parameters(testCase)
+            Model = testCase.Model;
+            Model.options.Riciannoisebias_Method = 'fix sigma';
+            Model.options.Riciannoisebias_value = 0;
+            rng(0);
+            nV = 20;
+            truth = [0.3+0.4*rand(nV,1) 0.5+rand(nV,1) 3+6*rand(nV,1)];
+            data = zeros(nV,size(Model.Prot.DiffusionData.Mat,1));
+            for ii = 1:nV
+                data(ii,:) = 1000*Model.equation([truth(ii,:) Model.st(4:end)])';
+            end
+            FitBatch = Model.fitBatch(struct('DiffusionData',data));
+            testCase.verifyEqual([FitBatch.fr FitBatch.Dh], truth(:,1:2), 'AbsTol', 1e-3);
+            testCase.verifyEqual(FitBatch.diameter_mean, truth(:,3), 'AbsTol', 0.05);
+            testCase.verifyEqual(FitBatch.fh, 1 - truth(:,1), 'AbsTol', 1e-3);
+            % Same outputs as fit, fixed parameters at their start value
+            Fit = Model.fit(struct('DiffusionData',data(1,:)'));
+            testCase.verifyEqual(sort(fieldnames(FitBatch)), sort(fieldnames(Fit)));
+            for name = {'fcsf','lc','Dcsf','Dintra'}
+                testCase.verifyEqual(FitBatch.(name{1}), repmat(Fit.(name{1}),nV,1), name{1});
+            end
+        end
+
+        function test_FitData_batched_maps(testCase)
+            Model = testCase.Model;
+            Model.options.Riciannoisebias_Method = 'fix sigma';
+            Model.options.Riciannoisebias_value = 0;
+            truth = [0.4 0.7 4; 0.5 1.0 6; 0.6 1.3 8];
+            data = zeros(3,size(Model.Prot.DiffusionData.Mat,1));
+            for ii = 1:3
+                data(ii,:) = 1000*Model.equation([truth(ii,:) Model.st(4:end)])';
+            end
+            % noiseless data: both fits land on the truth
+            verifyFitDataBatch(testCase, Model, data, {}, 'AbsTol', 0.05, 'RelTol', 1e-3);
+        end
+
+        function test_fitBatch_leaves_rician_likelihood_to_fit(testCase)
+            Model = testCase.Model;
+            Model.options.Riciannoisebias_Method = 'fix sigma';
+            Model.options.Riciannoisebias_value = 10;
+            testCase.assumeFalse(moxunit_util_platform_is_octave, 'fit has no Rician step on Octave.');
+            data = 1000*repmat(Model.equation(Model.st)',3,1);
+            testCase.verifyEmpty(Model.fitBatch(struct('DiffusionData',data)));
+        end
+    end
+end
@@ -0,0 +1,97 @@
+classdef (TestTags = {'Unit'}) dti_fit_batch_Test < matlab.unittest.TestCase
+    % Checks that the compiled tensor fit (dti_mex) reproduces dti.fit
+    % (scd_model_dti) voxel by voxel. Skipped when dti_mex is not compiled.
+
+    properties
+        Model = dti;
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('dti_mex','file')==3, 'dti_mex is not compiled.');
+        end
+    end
+
+    methods (Access = private)
+        function [data, D] = simulate(testCase, nV, sigma)
+            rng(0);
+            Model = testCase.Model;
+            data = zeros(nV, size(Model.Prot.DiffusionData.Mat,1));
+            D = zeros(nV, 9);
+            for ii = 1:nV
+                [R,~] = qr(randn(3));
+                Dii = R*diag([1.5+rand 0.2+0.5*rand 0.2+0.3*rand])*R';
+                D(ii,:) = Dii(:)';
+                S = 1000*Model.equation(Dii(:))';
+                data(ii,:) = abs(S + sigma*(randn(size(S)) + 1i*randn(size(S))));
+            end
+        end
+    end
+
+    methods (Test)
+
+        function test_linear_matches_fit(testCase)
+            Model = testCase.Model;
+            Model.options.fittingtype = 'linear';
+            data = testCase.simulate(50, 20);
+            FitBatch = Model.fitBatch(struct('DiffusionData',data));
+            fields = fieldnames(FitBatch);
+            for ii = 1:size(data,1)
+                Fit = Model.fit(struct('DiffusionData',data(ii,:)'));
+                for ff = 1:length(fields)
+                    testCase.verifyEqual(FitBatch.(fields{ff})(ii,:), Fit.(fields{ff})(:)', ...
+                        'AbsTol', 1e-9*max(1,max(abs(Fit.(fields{ff})(:)))), fields{ff});
+                end
+            end
+        end
+
+        function test_rician_likelihood_is_left_to_fit(testCase)
+            Model = testCase.Model;
+            Model.options.fittingtype = 'non-linear (Rician Likelihood)';
+            Model.options.Riciannoisebias_Method = 'fix sigma';
+            data = testCase.simulate(5, 20);
+            Model.options.Riciannoisebias_value = 20;
+            testCase.verifyEmpty(Model.fitBatch(struct('DiffusionData',data)));
+            % SigmaNoise = 0: fit skips the likelihood step
+            Model.options.Riciannoisebias_value = 0;
+            FitBatch = Model.fitBatch(struct('DiffusionData',data));
+            Fit = Model.fit(struct('DiffusionData',data(1,:)'));
+            testCase.verifyEqual(FitBatch.D(1,:), Fit.D(:)', 'AbsTol', 1e-9*max(abs(Fit.D)));
+            testCase.verifyEqual(FitBatch.residue(1), Fit.residue);
+        end
+
+        function test_FitData_batched_maps(testCase)
+            Model = testCase.Model;
+            Model.options.fittingtype = 'linear';
+            verifyFitDataBatch(testCase, Model, testCase.simulate(3, 20), {}, 'AbsTol', 1e-9, 'RelTol', 1e-9);
+        end
+
+        function test_eigen_decomposition(testCase)
+            data = testCase.simulate(100, 10);
+            [D,L,~,~,V1] = dti_fit_batch(data, testCase.Model.Prot.DiffusionData.Mat);
+            for ii = 1:size(D,1)
+                Dii = reshape(D(ii,:),3,3);
+                testCase.verifyEqual(L(ii,:), sort(eig(Dii),'descend')', 'AbsTol', 1e-12);
+                testCase.verifyEqual(Dii*V1(ii,:)', L(ii,1)*V1(ii,:)', 'AbsTol', 1e-12);
+                testCase.verifyEqual(norm(V1(ii,:)), 1, 'AbsTol', 1e-12);
+            end
+        end
+
+        function test_refinements_recover_noiseless_tensors(testCase)
+            [data, Dtrue] = testCase.simulate(20, 0);
+            for method = {'linear','wls','nlls'}
+                D = dti_fit_batch(data, testCase.Model.Prot.DiffusionData.Mat, method{1});
+                testCase.verifyEqual(D, Dtrue, 'AbsTol', 1e-8, method{1});
+            end
+        end
+
+        function test_rician_bias_correction_reduces_bias(testCase)
+            [data, Dtrue] = testCase.simulate(200, 40);
+            Prot = testCase.Model.Prot.DiffusionData.Mat;
+            D  = dti_fit_batch(data, Prot, 'nlls');
+            Dc = dti_fit_batch(data, Prot, 'nlls', 40);
+            tr = @(D) D(:,1) + D(:,5) + D(:,9);
+            testCase.verifyLessThan(abs(mean(tr(Dc) - tr(Dtrue))), abs(mean(tr(D) - tr(Dtrue))));
+        end
+    end
+end
@@ -0,0 +1,65 @@
+classdef (TestTags = {'Unit'}) polyfit3d_mex_Test < matlab.unittest.TestCase
+    % Checks polyfit3d_mex against a least-squares fit with the explicit
+    % design matrix of polynomial terms. Skipped when polyfit3d_mex is not
+    % compiled.
+
+    properties
+        data
+        mask
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('polyfit3d_mex','file')==3, 'polyfit3d_mex is not compiled.');
+        end
+
+        function makeData(testCase)
+            rng(0);
+            [x, y, z] = ndgrid(linspace(-1,1,17), linspace(-1,1,13), linspace(-1,1,9));
+            testCase.data = 1 + 0.3*x - 0.2*y.^2 + 0.1*x.*z + 0.05*randn(size(x));
+            testCase.mask = x.^2 + y.^2 + z.^2 < 0.8;
+        end
+    end
+
+    methods (Test)
+
+        function test_tensor_terms(testCase)
+            F = polyfit3d_mex(testCase.data, testCase.mask, 0:2, 'tensor');
+            testCase.verifyEqual(F, reference(testCase.data, testCase.mask, 0:2, 'tensor'), 'AbsTol', 1e-10);
+        end
+
+        function test_total_degree(testCase)
+            F = polyfit3d_mex(testCase.data, testCase.mask, 0:4, 'total', struct('NumThreads', 2));
+            testCase.verifyEqual(F, reference(testCase.data, testCase.mask, 0:4, 'total'), 'AbsTol', 1e-10);
+        end
+
+        function test_2D_with_missing_data(testCase)
+            D = testCase.data(:,:,5);
+            D(3:7:end) = NaN;
+            M = testCase.mask(:,:,5);
+            F = polyfit3d_mex(D, M, [0 1 3], 'tensor');
+            testCase.verifyEqual(F, reference(D, M & isfinite(D), [0 1 3], 'tensor'), 'AbsTol', 1e-10);
+        end
+
+        function test_polyfit_3D_output(testCase)
+            [output, output_all] = polyfit_3D(testCase.data, 2, testCase.mask);
+            testCase.verifyEqual(output_all, reference(testCase.data, testCase.mask, 0:2, 'tensor'), 'AbsTol', 1e-10);
+            testCase.verifyEqual(output, output_all.*testCase.mask);
+        end
+    end
+end
+
+function F = reference(data, mask, orders, terms)
+[n1, n2, n3] = size(data);
+[x, y, z] = ndgrid(linspace(-1,1,n1), linspace(-1,1,n2), linspace(-1,1,n3));
+if n3 == 1, z(:) = 1; end
+[a, b, c] = ndgrid(orders, orders, orders);
+if strcmp(terms, 'total'), keep = a+b+c <= max(orders); else, keep = true(size(a)); end
+if n3 == 1, keep = keep & c == orders(1); end
+a = a(keep); b = b(keep); c = c(keep);
+A = zeros(numel(data), numel(a));
+for t = 1:numel(a)
+    A(:,t) = x(:).^a(t) .* y(:).^b(t) .* z(:).^c(t);
+end
+F = reshape(A * (A(mask(:),:) \ data(mask(:))), size(data));
+end
@@ -0,0 +1,62 @@
+classdef (TestTags = {'Unit'}) fitT1_IR_batch_Test < matlab.unittest.TestCase
+    % Checks that the compiled IR grid search (rdNls_mex) reproduces
+    % fitT1_IR voxel by voxel. Skipped when rdNls_mex is not compiled.
+
+    properties
+        TI = [350 500 650 800 950 1100 1250 1400 1700]';
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('rdNls_mex','file')==3, 'rdNls_mex is not compiled.');
+        end
+    end
+
+    methods (Access = private)
+        function data = simulate(testCase, nV)
+            rng(0);
+            T1 = 300 + 2000*rand(nV,1);
+            data = 500 - 1000*exp(-testCase.TI'./T1) + 5*randn(nV,numel(testCase.TI));
+        end
+
+        function verifyMatchesVoxelwise(testCase, data, TI, method)
+            [T1,b,a,res,idx] = fitT1_IR_batch(data, TI, method);
+            for ii = 1:size(data,1)
+                [T1r,br,ar,resr,idxr] = fitT1_IR(data(ii,:), TI, method);
+                testCase.verifyEqual(T1(ii), T1r, 'AbsTol', 1e-9);
+                testCase.verifyEqual(b(ii), br, 'RelTol', 1e-9);
+                testCase.verifyEqual(a(ii), ar, 'RelTol', 1e-9);
+                testCase.verifyEqual(res(ii), resr, 'RelTol', 1e-9);
+                if strcmp(method,'Magnitude'), testCase.verifyEqual(idx(ii), idxr); end
+            end
+        end
+    end
+
+    methods (Test)
+
+        function test_magnitude_matches_rdNlsPr(testCase)
+            testCase.verifyMatchesVoxelwise(abs(testCase.simulate(200)), testCase.TI, 'Magnitude');
+        end
+
+        function test_unsorted_protocol_matches_rdNlsPr(testCase)
+            order = [3 1 2 9 5 4 8 7 6];
+            data = abs(testCase.simulate(50));
+            testCase.verifyMatchesVoxelwise(data(:,order), testCase.TI(order), 'Magnitude');
+        end
+
+        function test_real_complex_method_matches_rdNls(testCase)
+            testCase.verifyMatchesVoxelwise(testCase.simulate(200), testCase.TI, 'Complex');
+        end
+
+        function test_complex_data_matches_rdNls(testCase)
+            data = testCase.simulate(100)*exp(1i*pi/5);
+            testCase.verifyMatchesVoxelwise(data, testCase.TI, 'Complex');
+        end
+
+        function test_FitData_batched_maps(testCase)
+            Model = inversion_recovery;
+            Model.Prot.IRData.Mat = testCase.TI;
+            verifyFitDataBatch(testCase, Model, abs(testCase.simulate(3)), {}, 'AbsTol', 1e-9, 'RelTol', 1e-9);
+        end
+    end
+end
@@ -0,0 +1,57 @@
+classdef (TestTags = {'Unit'}) MP2RAGE_lookupT1_Test < matlab.unittest.TestCase
+    % Checks that the compiled MP2RAGE lookup engine (mp2rage_lut_mex)
+    % reproduces T1B1correctpackageTFL, T1estimateMP2RAGE and
+    % T1M0estimateMP2RAGE. Skipped when mp2rage_lut_mex is not compiled.
+
+    properties
+        MP2RAGE = struct('B0',7,'TR',6,'TRFLASH',6.7e-3,'TIs',[800e-3 2700e-3], ...
+                         'NZslices',[35 72],'FlipDegrees',[4 5]);
+        invEFF = 0.96;
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('mp2rage_lut_mex','file')==3, 'mp2rage_lut_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_B1_correction_matches_T1B1correctpackageTFL(testCase)
+            rng(0);
+            UNI = round(4095*rand(20,20,4));
+            B1 = 0.6 + 0.8*rand(20,20,4);
+            B1(1:3) = 0; % masked voxels
+            [T1, MP2RAGEcor] = MP2RAGE_lookupT1(UNI, testCase.MP2RAGE, testCase.invEFF, B1);
+            [T1ref, MP2RAGEref] = T1B1correctpackageTFL(B1, struct('img',UNI), [], testCase.MP2RAGE, [], testCase.invEFF);
+            testCase.verifyEqual(T1, T1ref.img, 'AbsTol', 1e-9);
+            testCase.verifyEqual(MP2RAGEcor, MP2RAGEref.img, 'AbsTol', 1);
+        end
+
+        function test_T1_matches_T1estimateMP2RAGE(testCase)
+            rng(1);
+            UNI = round(4095*rand(30,30));
+            T1 = MP2RAGE_lookupT1(UNI, testCase.MP2RAGE, testCase.invEFF);
+            T1ref = T1estimateMP2RAGE(struct('img',UNI), testCase.MP2RAGE, testCase.invEFF);
+            testCase.verifyEqual(T1, T1ref.img, 'AbsTol', 1e-9);
+        end
+
+        function test_M0_matches_T1M0estimateMP2RAGE(testCase)
+            rng(2);
+            UNI = rand(30,30) - 0.5;
+            INV2 = 1000*rand(30,30);
+            [T1, ~, M0] = MP2RAGE_lookupT1(UNI, testCase.MP2RAGE, testCase.invEFF, [], INV2);
+            [T1ref, M0ref] = T1M0estimateMP2RAGE(struct('img',UNI), struct('img',INV2), testCase.MP2RAGE, testCase.invEFF);
+            testCase.verifyEqual(T1, T1ref.img, 'AbsTol', 1e-9);
+            testCase.verifyEqual(M0, M0ref.img, 'RelTol', 1e-9);
+        end
+
+        function test_single_input_is_accepted(testCase)
+            UNI = single(rand(10,10) - 0.5);
+            T1 = MP2RAGE_lookupT1(UNI, testCase.MP2RAGE, testCase.invEFF);
+            T1ref = MP2RAGE_lookupT1(double(UNI), testCase.MP2RAGE, testCase.invEFF);
+            testCase.verifyClass(T1, 'double');
+            testCase.verifyEqual(T1, T1ref);
+        end
+    end
+end
@@ -0,0 +1,60 @@
+classdef (TestTags = {'Unit'}) ordfilt3D_mex_Test < matlab.unittest.TestCase
+    % Checks ordfilt3D_mex against a sort over the padded neighbourhood, as
+    % done by the MATLAB code of ordfilt3D. Skipped when ordfilt3D_mex is
+    % not compiled.
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('ordfilt3D_mex','file')==3, 'ordfilt3D_mex is not compiled.');
+        end
+    end
+
+    methods (Test)
+
+        function test_default_neighbourhood(testCase)
+            rng(0);
+            V = rand(9,8,6);
+            V(4:9:end) = NaN;
+            for pad = {'replicate','symmetric','circular',0}
+                testCase.verifyEqual(ordfilt3D(V,[1 14 27],pad{1}), ...
+                    single(reference(V,[1 14 27],pad{1},true(3,3,3))));
+            end
+        end
+
+        function test_uint8_sphere(testCase)
+            rng(1);
+            V = uint8(randi(255,10,9,7));
+            [x,y,z] = ndgrid(-2:2);
+            kernel = x.^2+y.^2+z.^2<=4;
+            testCase.verifyEqual(ordfilt3D(V,17,'symmetric',kernel), reference(V,17,'symmetric',kernel));
+        end
+
+        function test_int16_large_kernel(testCase)
+            rng(2);
+            V = int16(randi([-3000 3000],12,7,6));
+            kernel = true(5,5,5);
+            testCase.verifyEqual(ordfilt3D_mex(V,[1 63 125],kernel,-5), reference(V,[1 63 125],-5,kernel));
+        end
+
+        function test_logical_2D(testCase)
+            % As used by mtv_mrQ_Seg_kmeans_simple
+            rng(3);
+            CSF = rand(20,15)>0.6;
+            testCase.verifyEqual(ordfilt3D(CSF,6), single(reference(CSF,6,'replicate',true(3,3,3))));
+        end
+    end
+end
+
+function Vr = reference(V0,ord,pad,kernel)
+m = [size(kernel,1) size(kernel,2) size(kernel,3)];
+r = (m-1)/2;
+V = padarray(V0,r,pad);
+[n1,n2,n3] = size(V0);
+[di,dj,dk] = ind2sub(m,find(kernel));
+Vn = repmat(V0(1),[n1 n2 n3 numel(di)]);
+for q = 1:numel(di)
+    Vn(:,:,:,q) = V(di(q)-1+(1:n1), dj(q)-1+(1:n2), dk(q)-1+(1:n3));
+end
+Vn = sort(Vn,4);
+Vr = Vn(:,:,:,ord);
+end
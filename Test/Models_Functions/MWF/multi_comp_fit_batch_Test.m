@@ -0,0 +1,60 @@
+classdef (TestTags = {'Unit'}) multi_comp_fit_batch_Test < matlab.unittest.TestCase
+    % Checks that the compiled regularized NNLS (mwf_nnls_mex) reproduces
+    % multi_comp_fit_v2 voxel by voxel. Skipped when mwf_nnls_mex is not
+    % compiled.
+
+    properties
+        Model = mwf;
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('mwf_nnls_mex','file')==3, 'mwf_nnls_mex is not compiled.');
+        end
+    end
+
+    methods (Access = private)
+        function data = simulate(testCase, nV)
+            rng(0);
+            Opt = button2opts(testCase.Model.Sim_Single_Voxel_Curve_buttons);
+            data = zeros(nV, length(testCase.Model.Prot.MET2data.Mat));
+            for ii = 1:nV
+                x = [5+25*rand 10+20*rand 60+60*rand];
+                data(ii,:) = 1000*testCase.Model.equation(x,Opt)' + 5*randn(1,size(data,2));
+            end
+        end
+    end
+
+    methods (Test)
+
+        function test_matches_multi_comp_fit_v2(testCase)
+            data = testCase.simulate(30);
+            Model = testCase.Model;
+            FitBatch = Model.fitBatch(struct('MET2data',data));
+            for ii = 1:size(data,1)
+                Fit = Model.fit(struct('MET2data',data(ii,:),'Mask',[]));
+                testCase.verifyEqual(FitBatch.MWF(ii), Fit.MWF, 'AbsTol', 1e-6);
+                testCase.verifyEqual(FitBatch.T2MW(ii), Fit.T2MW, 'RelTol', 1e-6);
+                testCase.verifyEqual(FitBatch.T2IEW(ii), Fit.T2IEW, 'RelTol', 1e-6);
+            end
+        end
+
+        function test_warm_start_does_not_change_result(testCase)
+            data = testCase.simulate(50);
+            EchoTimes   = testCase.Model.Prot.MET2data.Mat;
+            T2          = getT2(testCase.Model,EchoTimes);
+            DecayMatrix = getDecayMatrix(EchoTimes,T2.vals);
+            cutoffs = [find_cutoff_index(1.5*EchoTimes(1), T2.vals) ...
+                       find_cutoff_index(testCase.Model.options.Cutoffms, T2.vals) ...
+                       find_cutoff_index(testCase.Model.ub(3), T2.vals)];
+            [MWFw,~,~,Sw] = mwf_nnls_mex(data, DecayMatrix, T2.vals, 20, cutoffs, struct('WarmStart',true));
+            [MWFc,~,~,Sc] = mwf_nnls_mex(data, DecayMatrix, T2.vals, 20, cutoffs, struct('WarmStart',false));
+            testCase.verifyEqual(MWFw, MWFc, 'AbsTol', 1e-9);
+            testCase.verifyEqual(Sw, Sc, 'AbsTol', 1e-9*max(abs(Sc(:))));
+        end
+
+        function test_FitData_batched_maps(testCase)
+            verifyFitDataBatch(testCase, testCase.Model, testCase.simulate(3), {}, 'AbsTol', 1e-6, 'RelTol', 1e-6);
+        end
+    end
+end
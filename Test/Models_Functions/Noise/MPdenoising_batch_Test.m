@@ -0,0 +1,54 @@
+classdef (TestTags = {'Unit'}) MPdenoising_batch_Test < matlab.unittest.TestCase
+    % Checks that the compiled MP-PCA engine (mppca_mex) reproduces
+    % MPdenoising. Skipped when mppca_mex is not compiled.
+
+    properties
+        data
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('mppca_mex','file')==3, 'mppca_mex is not compiled.');
+        end
+
+        function makeData(testCase)
+            % rank-3 signal + unit gaussian noise
+            rng(0);
+            sz = [14 12 9]; M = 30;
+            basis = randn(3, M);
+            coef = [100 + 10*randn(prod(sz),1), 20*randn(prod(sz),1), 5*randn(prod(sz),1)];
+            testCase.data = reshape(coef*basis, [sz M]) + randn([sz M]);
+        end
+    end
+
+    methods (Test)
+
+        function test_full_sampling_matches_MPdenoising(testCase)
+            [Signal, Sigma] = MPdenoising_batch(testCase.data, [], [5 5 5], 'full');
+            [SignalRef, SigmaRef] = MPdenoising(testCase.data, [], [5 5 5], 'full');
+            testCase.verifyEqual(Signal, SignalRef, 'AbsTol', 1e-8);
+            testCase.verifyEqual(Sigma, SigmaRef, 'AbsTol', 1e-8);
+        end
+
+        function test_fast_sampling_matches_MPdenoising(testCase)
+            mask = false(size(testCase.data(:,:,:,1)));
+            mask(2:13, 2:11, 2:8) = true;
+            Signal = MPdenoising_batch(testCase.data, mask, [3 3 3], 'fast');
+            SignalRef = MPdenoising(testCase.data, mask, [3 3 3], 'fast');
+            testCase.verifyEqual(Signal, SignalRef, 'AbsTol', 1e-8);
+        end
+
+        function test_more_volumes_than_patch_voxels(testCase)
+            [Signal, Sigma] = MPdenoising_batch(testCase.data, [], [3 3 1], 'full');
+            [SignalRef, SigmaRef] = MPdenoising(testCase.data, [], [3 3 1], 'full');
+            testCase.verifyEqual(Signal, SignalRef, 'AbsTol', 1e-8);
+            testCase.verifyEqual(Sigma, SigmaRef, 'AbsTol', 1e-8);
+        end
+
+        function test_single_data_stays_single(testCase)
+            [Signal, Sigma] = MPdenoising_batch(single(testCase.data), [], [5 5 5], 'full');
+            testCase.verifyClass(Signal, 'single');
+            testCase.verifyClass(Sigma, 'single');
+        end
+    end
+end
@@ -0,0 +1,59 @@
+classdef (TestTags = {'Unit'}) MPdenoising_stream_Test < matlab.unittest.TestCase
+    % Checks that slab-by-slab denoising of a NIfTI file (MPdenoising_stream)
+    % gives the in-memory result of MPdenoising_batch. Skipped when mppca_mex
+    % is not compiled.
+
+    properties
+        data
+        tmpDir
+        dataFile
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('mppca_mex','file')==3, 'mppca_mex is not compiled.');
+        end
+
+        function writeData(testCase)
+            rng(0);
+            sz = [12 10 16]; M = 20;
+            basis = randn(3, M);
+            coef = [100 + 10*randn(prod(sz),1), 20*randn(prod(sz),1), 5*randn(prod(sz),1)];
+            testCase.data = single(reshape(coef*basis, [sz M]) + randn([sz M]));
+            testCase.tmpDir = tempname;
+            mkdir(testCase.tmpDir);
+            testCase.dataFile = fullfile(testCase.tmpDir, 'dwi.nii.gz');
+            save_nii(make_nii(testCase.data), testCase.dataFile);
+        end
+    end
+
+    methods (TestMethodTeardown)
+        function removeData(testCase)
+            rmdir(testCase.tmpDir, 's');
+        end
+    end
+
+    methods (Test)
+
+        function test_full_sampling_matches_in_memory(testCase)
+            outFile = fullfile(testCase.tmpDir, 'den.nii.gz');
+            sigmaFile = fullfile(testCase.tmpDir, 'sigma.nii');
+            MPdenoising_stream(testCase.dataFile, outFile, sigmaFile, [], [3 3 3], 'full', 2);
+            [Signal, Sigma] = MPdenoising_batch(testCase.data, [], [3 3 3], 'full');
+            out = load_untouch_nii(outFile);
+            sig = load_untouch_nii(sigmaFile);
+            testCase.verifyEqual(out.img, Signal, 'AbsTol', single(1e-3));
+            testCase.verifyEqual(sig.img, Sigma, 'AbsTol', single(1e-4));
+        end
+
+        function test_fast_sampling_matches_in_memory(testCase)
+            mask = false(12, 10, 16);
+            mask(2:11, 2:9, 2:15) = true;
+            outFile = fullfile(testCase.tmpDir, 'den.nii');
+            MPdenoising_stream(testCase.dataFile, outFile, [], mask, [3 3 3], 'fast', 1);
+            Signal = MPdenoising_batch(testCase.data, mask, [3 3 3], 'fast');
+            out = load_untouch_nii(outFile);
+            testCase.verifyEqual(out.img, Signal, 'AbsTol', single(1e-3));
+        end
+    end
+end
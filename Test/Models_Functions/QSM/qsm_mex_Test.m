@@ -0,0 +1,205 @@
+classdef (TestTags = {'Unit'}) qsm_mex_Test < matlab.unittest.TestCase
+    % Checks the compiled QSM engine (qsm_mex) against the fftn
+    % formulation of unwrapPhaseLaplacian, laplacianUnwrap, qsmSplitBregman,
+    % calcSBLambdaL1, calcLambdaL2 and backgroundRemovalSharp. Skipped when qsm_mex is not compiled.
+
+    properties
+        phase
+        mask
+        res = [0.6 0.7 0.8];
+    end
+
+    methods (TestMethodSetup)
+        function requireMex(testCase)
+            testCase.assumeTrue(exist('qsm_mex','file')==3, 'qsm_mex is not compiled.');
+        end
+
+        function makeData(testCase)
+            rng(0);
+            [x, y, z] = ndgrid(((1:24)-12.5)/9, ((1:20)-10.5)/8, ((1:18)-9.5)/7);
+            testCase.mask = x.^2 + y.^2 + z.^2 < 1;
+            testCase.phase = (sin(4*x) + 0.3*cos(5*y + z) + 0.05*rand(size(x))) .* testCase.mask;
+        end
+    end
+
+    methods (Test)
+
+        function test_splitbregman_matches_fftn_iterations(testCase)
+            [chi, resChange] = qsm_mex('splitbregman', testCase.phase, testCase.mask, 2e-3, 0.03, 'forward', testCase.res, [2 2 2]);
+            [chiRef, resRef] = testCase.splitBregman(2e-3, 0.03, 'forward', 20);
+            chiRef = real(chiRef) .* testCase.mask;
+            testCase.verifyEqual(chi, chiRef(3:end-2,3:end-2,3:end-2), 'AbsTol', 1e-10);
+            testCase.verifyEqual(resChange, resRef, 'RelTol', 1e-8);
+        end
+
+        function test_lcurve_matches_fftn_sweep(testCase)
+            Lambda = logspace(-4, -2.5, 4);
+            [cons, reg] = qsm_mex('lcurvel1', testCase.phase, Lambda, 0.03, testCase.res, 'backward', struct('NumThreads', 2));
+            for h = 1:numel(Lambda)
+                [~, ~, consRef, regRef] = testCase.splitBregman(Lambda(h), 0.03, 'backward', 10);
+                testCase.verifyEqual(cons(h), consRef, 'RelTol', 1e-8);
+                testCase.verifyEqual(reg(h), regRef, 'RelTol', 1e-8);
+            end
+        end
+
+        function test_lcurve_independent_of_threads(testCase)
+            Lambda = logspace(-4, -2.5, 5);
+            [c1, r1] = qsm_mex('lcurvel1', testCase.phase, Lambda, 0.03, testCase.res, 'forward', struct('NumThreads', 1));
+            % lambdas solved concurrently, then one at a time with threaded FFTs
+            [c4, r4] = qsm_mex('lcurvel1', testCase.phase, Lambda, 0.03, testCase.res, 'forward', struct('NumThreads', 4));
+            [cf, rf] = qsm_mex('lcurvel1', testCase.phase, Lambda, 0.03, testCase.res, 'forward', struct('NumThreads', 4, 'MaxMemory', 1));
+            testCase.verifyEqual(c4, c1);
+            testCase.verifyEqual(r4, r1);
+            testCase.verifyEqual(cf, c1);
+            testCase.verifyEqual(rf, r1);
+        end
+
+        function test_lcurvel2_matches_fftn_sweep(testCase)
+            Lambda = logspace(-3, 0, 6);
+            [cons, reg] = qsm_mex('lcurvel2', testCase.phase, Lambda, testCase.res, 'backward', struct('NumThreads', 3));
+            N = size(testCase.phase);
+            [fdx, fdy, fdz] = calcFdr(N, 'backward');
+            D = fftshift(kspaceKernel(N .* testCase.res, N));
+            E2 = abs(fdx).^2 + abs(fdy).^2 + abs(fdz).^2;
+            for t = 1:numel(Lambda)
+                Chi_L2 = D ./ (eps + abs(D).^2 + Lambda(t) * E2) .* fftn(testCase.phase);
+                dx = fdx .* Chi_L2; dy = fdy .* Chi_L2; dz = fdz .* Chi_L2;
+                residual = testCase.phase - ifftn(D .* Chi_L2);
+                testCase.verifyEqual(reg(t), sqrt((norm(dx(:))^2 + norm(dy(:))^2 + norm(dz(:))^2) / prod(N)), 'RelTol', 1e-10);
+                testCase.verifyEqual(cons(t), norm(residual(:)), 'RelTol', 1e-10);
+            end
+        end
+
+        function test_warm_start_path(testCase)
+            % a single lambda solved from zero is the cold solve
+            [c1, r1, it1] = qsm_mex('lcurvel1', testCase.phase, 1e-3, 0.03, testCase.res, 'forward', struct('WarmStart', true, 'MinIter', 1));
+            [c0, r0, it0] = qsm_mex('lcurvel1', testCase.phase, 1e-3, 0.03, testCase.res, 'forward');
+            testCase.verifyEqual([c1 r1 it1], [c0 r0 it0], 'RelTol', 1e-12);
+            % lambdas skipped after the corner come first (smallest values)
+            Lambda = logspace(-5, -2, 10);
+            [cons, reg, iters] = qsm_mex('lcurvel1', testCase.phase, Lambda, 0.03, testCase.res, 'forward', struct('WarmStart', true, 'Bracket', 3));
+            solved = ~isnan(cons);
+            testCase.verifyTrue(solved(end));
+            testCase.verifyEqual(solved, cumsum(solved) > 0);
+            testCase.verifyEqual(isnan(reg), ~solved);
+            testCase.verifyEqual(iters(~solved), zeros(1, nnz(~solved)));
+            testCase.verifyGreaterThanOrEqual(iters(solved), 3);
+            testCase.verifyError(@() qsm_mex('lcurvel1', testCase.phase, fliplr(Lambda), 0.03, testCase.res, 'forward', struct('WarmStart', true)), 'qMRLab:qsm_mex:invalidInput');
+        end
+
+        function test_sharp_iterative_matches_fftn_chain(testCase)
+            testCase.assumeTrue(exist('imerode','file')==2, 'imerode is not available.');
+            [sharp, maskSharp] = qsm_mex('sharp', testCase.phase, testCase.mask, 'iterative');
+            N = size(testCase.mask);
+            phaseDel = zeros(N);
+            maskPrev = zeros(N);
+            for k = 9:-2:3
+                del = testCase.delKernel(k, N);
+                if k == 9
+                    delInv = zeros(N);
+                    delInv(abs(del) > .05) = 1 ./ del(abs(del) > .05);
+                end
+                maskK = imerode(testCase.mask, strel('line', k+1, 0));
+                maskK = imerode(maskK, strel('line', k+1, 90));
+                maskK = permute(imerode(permute(maskK, [1 3 2]), strel('line', k+1, 0)), [1 3 2]);
+                phaseDel = phaseDel + ifftn(fftn(testCase.phase) .* del) .* (maskK - maskPrev);
+                maskPrev = maskK;
+            end
+            ref = real(ifftn(fftn(phaseDel) .* delInv) .* maskK);
+            testCase.verifyEqual(maskSharp, logical(maskK));
+            testCase.verifyEqual(sharp, ref, 'AbsTol', 1e-12);
+        end
+
+        function test_laplacian_sincos_matches_fftn(testCase)
+            wrapped = angle(exp(1i * 6 * testCase.phase));
+            unwrapped = qsm_mex('laplacian', wrapped, 'sincos', struct('NumThreads', 3));
+            N = size(wrapped);
+            del_op = testCase.laplacianSpectrum(N);
+            del_inv = zeros(N);
+            del_inv(del_op ~= 0) = 1 ./ del_op(del_op ~= 0);
+            del_phase = cos(wrapped) .* ifftn(fftn(sin(wrapped)) .* del_op) - sin(wrapped) .* ifftn(fftn(cos(wrapped)) .* del_op);
+            ref = real(ifftn(fftn(del_phase) .* del_inv));
+            testCase.verifyEqual(unwrapped, ref, 'AbsTol', 1e-11);
+        end
+
+        function test_laplacian_gradient_matches_fftn(testCase)
+            wrapped = angle(exp(1i * 6 * testCase.phase));
+            [unwrapped, lap] = qsm_mex('laplacian', wrapped, 'gradient');
+            P = exp(1i * wrapped);
+            lapRef = zeros(size(P));
+            for k = 1:3
+                s = zeros(1, 3); s(k) = 1;
+                grad = angle(P ./ circshift(P, s));
+                lapRef = lapRef + grad - circshift(grad, -s);
+            end
+            lapRef = lapRef / 7;
+            del_inv = 7 ./ testCase.laplacianSpectrum(size(P));
+            del_inv(1,1,1) = 0;
+            testCase.verifyEqual(lap, lapRef, 'AbsTol', 1e-12);
+            testCase.verifyEqual(unwrapped, real(ifftn(del_inv .* fftn(lapRef))), 'AbsTol', 1e-11);
+        end
+
+        function test_laplacian_echoes_share_the_plan(testCase)
+            echoes = angle(exp(1i * cat(4, 3 * testCase.phase, 6 * testCase.phase, 9 * testCase.phase)));
+            unwrapped = qsm_mex('laplacian', echoes, 'sincos');
+            testCase.verifySize(unwrapped, size(echoes));
+            for e = 1:3
+                testCase.verifyEqual(unwrapped(:,:,:,e), qsm_mex('laplacian', echoes(:,:,:,e), 'sincos'));
+            end
+        end
+
+        function test_odd_dimensions_are_rejected(testCase)
+            testCase.verifyError(@() qsm_mex('sharp', zeros(5,4,4), true(5,4,4), 'once'), 'qMRLab:qsm_mex:invalidInputSize');
+        end
+    end
+
+    methods
+        % qsmSplitBregman / calcSBLambdaL1 iterations with complex fftn.
+        function [chi, resChange, consistency, regularization] = splitBregman(testCase, lambda, mu, direction, maxIter)
+            N = size(testCase.phase);
+            [fdx, fdy, fdz] = calcFdr(N, direction);
+            D = fftshift(kspaceKernel(N .* testCase.res, N));
+            DFy = conj(D) .* fftn(testCase.phase);
+            SB_reg = 1 ./ (eps + abs(D).^2 + mu * (abs(fdx).^2 + abs(fdy).^2 + abs(fdz).^2));
+            vx = zeros(N); vy = zeros(N); vz = zeros(N);
+            nx = zeros(N); ny = zeros(N); nz = zeros(N);
+            Fu = zeros(N);
+            resChange = [];
+            for t = 1:maxIter
+                Fu_prev = Fu;
+                Fu = (DFy + mu * (conj(fdx).*fftn(vx - nx) + conj(fdy).*fftn(vy - ny) + conj(fdz).*fftn(vz - nz))) .* SB_reg;
+                rox = ifftn(fdx .* Fu) + nx; roy = ifftn(fdy .* Fu) + ny; roz = ifftn(fdz .* Fu) + nz;
+                vx = max(abs(rox) - lambda/mu, 0) .* sign(rox);
+                vy = max(abs(roy) - lambda/mu, 0) .* sign(roy);
+                vz = max(abs(roz) - lambda/mu, 0) .* sign(roz);
+                nx = rox - vx; ny = roy - vy; nz = roz - vz;
+                resChange(t) = 100 * norm(Fu(:) - Fu_prev(:)) / norm(Fu(:)); %#ok<AGROW>
+                if resChange(t) < 1, break; end
+            end
+            chi = ifftn(Fu);
+            residual = ifftn(D .* Fu) - testCase.phase;
+            consistency = norm(residual(:));
+            regularization = sum(abs(vx(:))) + sum(abs(vy(:))) + sum(abs(vz(:)));
+        end
+    end
+
+    methods (Static)
+        % fftn of the periodic 7-point stencil (del_op of unwrapPhaseLaplacian)
+        function del = laplacianSpectrum(N)
+            [k1, k2, k3] = ndgrid(0:N(1)-1, 0:N(2)-1, 0:N(3)-1);
+            del = 6 - 2*cos(2*pi*k1/N(1)) - 2*cos(2*pi*k2/N(2)) - 2*cos(2*pi*k3/N(3));
+        end
+
+        % calc_del_kernel of backgroundRemovalSharp
+        function del = delKernel(k, N)
+            h = (k-1)/2;
+            [a, b, c] = meshgrid(-h:h, -h:h, -h:h);
+            kernel = (a.^2 + b.^2 + c.^2) / h^2 <= 1;
+            kernel = -kernel / sum(kernel(:));
+            kernel(h+1,h+1,h+1) = 1 + kernel(h+1,h+1,h+1);
+            K = zeros(N);
+            K(1+N(1)/2-h:1+N(1)/2+h, 1+N(2)/2-h:1+N(2)/2+h, 1+N(3)/2-h:1+N(3)/2+h) = -kernel;
+            del = fftn(fftshift(K));
+        end
+    end
+end
@@ -38,40 +38,11 @@ TE = max(TE);
 totalsteps = max(TE)/steptime;
 
 %% define MPG
-% MPG is defined by one vector (G_strength) and one matrix (G_direction).
-% length and size are "totalsteps", and ["totalsteps",2]
 % here a PGSE MPG is defined for example.
-
-Ndwi = size(scheme,1); % number of DWI data
-Sindex = 1:Ndwi;
-delta = scheme(Sindex,6)*1e3;%(TE-margin*3)/2; %ms
-DELTA = scheme(Sindex,5)*1e3;%delta + margin; %ms
-
-larmor = 2*pi*42.58*10^6; %[(Hz)/(T.s)]
-G = scheme(Sindex,4)*1e3; %sqrt( (bv*10^21)/(larmor^2 * delta^2 * (DELTA - delta/3)) ); % Gradient strength [mT/m]
+[G_strength, G_direction, G, bv] = Sim_MonteCarlo_PGSE(scheme, steptime, TE);
 fprintf('gradient strength: %2g mT/m\n', G(end))
-bv = G.^2.*(larmor^2 * delta.^2 .* (DELTA - delta./3))*10^(-21);
 fprintf('bvalue: %2g mm2/ms\n', bv(end))
-
-G_direction = zeros(totalsteps,3,Ndwi);
-G_strength = zeros(totalsteps,Ndwi);
-
-margin = TE/2-delta-(DELTA-delta)/2; % [ms]. Time between RF and the first MPG lobe, and time between the 2nd MPG lobe to spin-echo.
-marginsteps = round(margin/steptime);
-MPGsteps = round(delta/steptime); % duration of the 1rst and 2nd lobes
-MPGsep = DELTA - delta; % [ms].  time between the 1rst and the 2nd MPG lobe 
-MPGsepsteps = round(MPGsep/steptime);
-
-ax = scheme(Sindex,1:3); % [1 0 0] --> MPG parallel to x-axis.
-%ax = ax./(norm(ax)+eps);
-
-for idir = 1:Ndwi
-    G_direction(marginsteps(idir)+1 : marginsteps(idir) + MPGsteps(idir), :,idir) = repmat(ax(idir,:),MPGsteps(idir),1); % 1st MPG lobe.
-    G_strength(marginsteps(idir)+1 : marginsteps(idir) + MPGsteps(idir),idir) = G(idir);
-    
-    G_direction(marginsteps(idir) + MPGsteps(idir) + MPGsepsteps(idir) + 1: marginsteps(idir) + MPGsteps(idir)*2 + MPGsepsteps(idir), :,idir) = repmat(ax(idir,:),MPGsteps(idir),1); % 2nd MPG lobe.
-    G_strength(marginsteps(idir) + MPGsteps(idir) + MPGsepsteps(idir) + 1: marginsteps(idir) + MPGsteps(idir)*2 + MPGsepsteps(idir),idir) = -G(idir); % inverted.
-end
+Ndwi = size(scheme,1); % number of DWI data
 
 subplot(a3)
 X = 0:steptime:TE(end); Y = [0; G_strength(:,end)];
@@ -120,6 +91,32 @@ end
 axis equal tight
 xlabel x(\mum)
 ylabel y(\mum)
+%% compiled engine: simulate all steps, then draw the final state
+if exist('mc_diffusion_mex','file')==3
+    tic
+    opts = struct;
+    if str2double(getenv('ISDISPLAY')) == 0
+        disp('Total steps is set to 5 for testing.');
+        opts.NumSteps = 5;
+    end
+    [signal, signal_intra, signal_extra, msd, positions, inisitu] = Sim_MonteCarlo_Diffusion_batch(numelparticle, trans_mean, D, scheme, packing, axons, opts);
+    tsteps = steptime*(0:size(signal,1)-1);
+    subplot(a1);
+    scatter3(positions(inisitu==1,1),positions(inisitu==1,2),positions(inisitu==1,3),1,[1 0 0]);
+    scatter3(positions(inisitu==0,1),positions(inisitu==0,2),positions(inisitu==0,3),1,[0 0 1]);
+    subplot(a2);
+    plot(tsteps, msd,'b'); xlim([0 TE]);
+    subplot(a4);
+    delete(bar2);
+    plot([0,TE],[signal(end,end),signal(end,end)],'r','linestyle',':');
+    plot(tsteps, signal(:,end),'b'); xlim([0 TE]); ylim([0 1.2])
+    fprintf('S/S0 = %1.3g\n', (signal(end,end)));
+    fprintf('ADC = %1.3g x10-3[mm2/sec]\n', (log(signal(end,end))./(-bv(end)))*1000);
+    fprintf('D = %1.3g x10-3[mm2/sec]\n', flight_mean^2/steptime/2/(mode3D+2))
+    toc
+    return
+end
+
 %% starting position
 inipos = (rand(numelparticle,3)-0.5) * starting_range;
 inisitu= zeros(numelparticle,1); % starts from intra / extra object
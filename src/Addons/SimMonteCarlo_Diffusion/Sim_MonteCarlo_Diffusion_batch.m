@@ -0,0 +1,70 @@
+function [signal, signal_intra, signal_extra, msd, positions, inisitu] = Sim_MonteCarlo_Diffusion_batch(numelparticle, trans_mean, D, scheme, packing, axons, opts)
+% [signal, signal_intra, signal_extra, msd, positions, inisitu] = ...
+%     Sim_MonteCarlo_Diffusion_batch(numelparticle, trans_mean, D, scheme, packing, axons, opts)
+%
+% Headless Monte Carlo diffusion simulation: same sequence, geometry and
+% random walk as Sim_MonteCarlo_Diffusion (2D walk among the axons, PGSE
+% gradients of the protocol), computed by the compiled engine
+% mc_diffusion_mex. Particles are walked in parallel on all cores and the
+% phase of every DWI is accumulated in the walk; nothing is drawn.
+%
+% opts (optional struct)
+%   NumThreads     number of threads (0: all cores)
+%   Seed           seed of the random walk (default: drawn from rand, so
+%                  rng() makes runs reproducible)
+%   SignalEvery    record signal and msd every N steps (default 1). The
+%                  final signal is always recorded; set it larger for
+%                  big runs, where evaluating the signal dominates.
+%   SnapshotEvery  save positions every N steps (default 0: final only)
+%   NumSteps       walk only the first N steps of the sequence (default:
+%                  all of them, up to TE); for quick tests
+%   UseGrid        find wall collisions through a cell list over the axons
+%                  (default true); false tests every axon at every flight
+%
+% signal        [nRec x Ndwi] S/S0 at steps 0, SignalEvery, 2*SignalEvery...
+%               and the last step (every 0.5 ms step by default)
+% signal_intra  [1 x Ndwi] final signal of particles starting in an axon
+% signal_extra  [1 x Ndwi] final signal of particles starting outside
+% msd           [nRec x 1] mean square displacement [mm2]
+% positions     [numelparticle x 3 x nSnap] positions [um]
+% inisitu       [numelparticle x 1] number of axons containing the start
+%
+% Needs the compiled mc_diffusion_mex (qMRbuildMex).
+
+if exist('mc_diffusion_mex','file')~=3
+    error('qMRLab:Sim_MonteCarlo_Diffusion_batch:noMex','Sim_MonteCarlo_Diffusion_batch needs mc_diffusion_mex. Compile it with qMRbuildMex(''mc_diffusion_mex'').');
+end
+if ~exist('opts','var') || isempty(opts), opts = struct; end
+if ~isfield(opts,'Seed'), opts.Seed = randi(2^31-1); end
+
+%%% simulator parameters (as Sim_MonteCarlo_Diffusion)
+TE = max(scheme(:,7))*1e3;
+starting_range = 10; % the area where the molecules ditributes initially [um]
+steptime = 0.5; % each iteration (step) corresponds to "steptime"[ms].
+steptime = TE/round(TE/steptime);
+flight_mean = sqrt(2*2*D*steptime); % mean displacement distance (if free diffusivity) at each step [um]
+
+[G_strength, G_direction] = Sim_MonteCarlo_PGSE(scheme, steptime, TE);
+Gvec = bsxfun(@times, G_direction, permute(G_strength,[1 3 2])); % [mT/m]
+if isfield(opts,'NumSteps')
+    Gvec = Gvec(1:min(opts.NumSteps,end),:,:);
+    opts = rmfield(opts,'NumSteps');
+end
+
+%% setup objects
+cen = packing.final_positions{1}'; cen=cen(:,[2 1]); cen=cen-repmat([mean(cen(:,1)) mean(cen(:,2))],[size(cen,1) 1]); % center position of the cells
+R = axons.d{1}(:)/2; % external radius [um]
+
+%% starting position
+inipos = (rand(numelparticle,3)-0.5) * starting_range;
+inisitu = zeros(numelparticle,1); % starts from intra / extra object
+for k = 1:size(cen,1)
+    inisitu = inisitu + ((inipos(:,1)-cen(k,1)).^2 + (inipos(:,2)-cen(k,2)).^2 - R(k)^2 < 0);
+end
+
+if nargout > 4
+    [signal, signal_intra, signal_extra, msd, positions] = mc_diffusion_mex(inipos, flight_mean, steptime, Gvec, cen, R, trans_mean, opts);
+else
+    [signal, signal_intra, signal_extra, msd] = mc_diffusion_mex(inipos, flight_mean, steptime, Gvec, cen, R, trans_mean, opts);
+end
+end
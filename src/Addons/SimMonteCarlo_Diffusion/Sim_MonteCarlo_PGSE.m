@@ -0,0 +1,38 @@
+function [G_strength, G_direction, G, bv] = Sim_MonteCarlo_PGSE(scheme, steptime, TE)
+% [G_strength, G_direction, G, bv] = Sim_MonteCarlo_PGSE(scheme, steptime, TE)
+% PGSE gradient waveform of Sim_MonteCarlo_Diffusion, sampled every
+% steptime [ms] up to TE [ms].
+%
+% MPG is defined by one vector (G_strength) and one matrix (G_direction).
+% size are ["totalsteps",Ndwi] and ["totalsteps",3,Ndwi]
+% G: gradient strength [mT/m], bv: b-value [mm2/ms], one per DWI.
+
+totalsteps = round(TE/steptime);
+Ndwi = size(scheme,1); % number of DWI data
+Sindex = 1:Ndwi;
+delta = scheme(Sindex,6)*1e3;%(TE-margin*3)/2; %ms
+DELTA = scheme(Sindex,5)*1e3;%delta + margin; %ms
+
+larmor = 2*pi*42.58*10^6; %[(Hz)/(T.s)]
+G = scheme(Sindex,4)*1e3; %sqrt( (bv*10^21)/(larmor^2 * delta^2 * (DELTA - delta/3)) ); % Gradient strength [mT/m]
+bv = G.^2.*(larmor^2 * delta.^2 .* (DELTA - delta./3))*10^(-21);
+
+G_direction = zeros(totalsteps,3,Ndwi);
+G_strength = zeros(totalsteps,Ndwi);
+
+margin = TE/2-delta-(DELTA-delta)/2; % [ms]. Time between RF and the first MPG lobe, and time between the 2nd MPG lobe to spin-echo.
+marginsteps = round(margin/steptime);
+MPGsteps = round(delta/steptime); % duration of the 1rst and 2nd lobes
+MPGsep = DELTA - delta; % [ms].  time between the 1rst and the 2nd MPG lobe 
+MPGsepsteps = round(MPGsep/steptime);
+
+ax = scheme(Sindex,1:3); % [1 0 0] --> MPG parallel to x-axis.
+%ax = ax./(norm(ax)+eps);
+
+for idir = 1:Ndwi
+    G_direction(marginsteps(idir)+1 : marginsteps(idir) + MPGsteps(idir), :,idir) = repmat(ax(idir,:),MPGsteps(idir),1); % 1st MPG lobe.
+    G_strength(marginsteps(idir)+1 : marginsteps(idir) + MPGsteps(idir),idir) = G(idir);
+    
+    G_direction(marginsteps(idir) + MPGsteps(idir) + MPGsepsteps(idir) + 1: marginsteps(idir) + MPGsteps(idir)*2 + MPGsepsteps(idir), :,idir) = repmat(ax(idir,:),MPGsteps(idir),1); % 2nd MPG lobe.
+    G_strength(marginsteps(idir) + MPGsteps(idir) + MPGsepsteps(idir) + 1: marginsteps(idir) + MPGsteps(idir)*2 + MPGsepsteps(idir),idir) = -G(idir); % inverted.
+end
@@ -0,0 +1,243 @@
+/*
+ * axonpack.hh: disk packing engine of axonpacking (process_packing.m).
+ *
+ * Disks migrate toward the centre of the packing area; every iteration each
+ * disk that overlaps no other (centre distance below the sum of radii plus
+ * gap) moves 0.01 um toward the centre, and each overlapping disk moves
+ * 0.1 um along the normalized sum of the vectors from the disks it
+ * overlaps, all computed from the positions of the previous iteration
+ * (compute_grad).
+ *
+ * Overlaps are found through a cell list rebuilt every iteration (cells of
+ * twice the largest interaction radius, so only the 3 x 3 neighbouring
+ * cells are searched) instead of the N x N distance matrix. Workers own
+ * fixed slices of disks and iterate in lockstep; worker 0 rebuilds the cell
+ * list between iterations, in buffers allocated before the workers start so
+ * that this step cannot throw while the others wait at the barrier. The
+ * result depends only on the input, not on the number of threads.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef AXONPACK_HH
+#define AXONPACK_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace axonpack {
+
+static const double kPi = 3.14159265358979323846;
+
+// Cell list over disk centres x (2 x N, interleaved), cells of at least h.
+// build does not allocate for up to the n disks passed to reserve.
+class CellList {
+public:
+    void reserve(std::size_t n)
+    {
+        start_.reserve(maxCells(n) + 1);
+        fill_.reserve(maxCells(n));
+        cellOf_.reserve(n);
+        items_.reserve(n);
+    }
+
+    void build(const double *x, std::size_t n, double h)
+    {
+        h_ = h;
+        x0_ = y0_ = std::numeric_limits<double>::max();
+        double x1 = -x0_, y1 = -y0_;
+        for (std::size_t i = 0; i < n; ++i) {
+            x0_ = std::min(x0_, x[2 * i]);
+            y0_ = std::min(y0_, x[2 * i + 1]);
+            x1 = std::max(x1, x[2 * i]);
+            y1 = std::max(y1, x[2 * i + 1]);
+        }
+        // Larger cells when the disks are spread out (at most ~4 cells per disk)
+        h_ = std::max(h_, std::sqrt((x1 - x0_) * (y1 - y0_) / (4.0 * n + 16)));
+        nx_ = (int)std::floor((x1 - x0_) / h_) + 1;
+        ny_ = (int)std::floor((y1 - y0_) / h_) + 1;
+        // At most maxCells(n) cells, also when the disks lie along a line
+        if ((double)nx_ * ny_ > maxCells(n)) {
+            const int k = (int)std::sqrt((double)maxCells(n));
+            h_ = std::max(h_, std::max(x1 - x0_, y1 - y0_) / (k - 1));
+            nx_ = std::min(k, (int)std::floor((x1 - x0_) / h_) + 1);
+            ny_ = std::min(k, (int)std::floor((y1 - y0_) / h_) + 1);
+        }
+        start_.assign((std::size_t)nx_ * ny_ + 1, 0);
+        cellOf_.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            cellOf_[i] = cell(cellX(x[2 * i]), cellY(x[2 * i + 1]));
+            ++start_[cellOf_[i] + 1];
+        }
+        for (std::size_t c = 0; c + 1 < start_.size(); ++c) start_[c + 1] += start_[c];
+        items_.resize(n);
+        fill_.assign(start_.begin(), start_.end() - 1);
+        for (std::size_t i = 0; i < n; ++i) items_[fill_[cellOf_[i]]++] = (int)i;
+    }
+
+    // Calls f(j) for every disk in the 3 x 3 cells around (px, py).
+    template <class F>
+    void forNeighbours(double px, double py, F f) const
+    {
+        const int ci = cellX(px), cj = cellY(py);
+        for (int j = std::max(0, cj - 1); j <= std::min(ny_ - 1, cj + 1); ++j)
+            for (int i = std::max(0, ci - 1); i <= std::min(nx_ - 1, ci + 1); ++i) {
+                const std::size_t c = cell(i, j);
+                for (std::size_t k = start_[c]; k < start_[c + 1]; ++k) f(items_[k]);
+            }
+    }
+
+private:
+    static std::size_t maxCells(std::size_t n) { return 8 * n + 64; }
+    std::size_t cell(int i, int j) const { return (std::size_t)j * nx_ + i; }
+    int cellX(double x) const { return std::min(nx_ - 1, std::max(0, (int)std::floor((x - x0_) / h_))); }
+    int cellY(double y) const { return std::min(ny_ - 1, std::max(0, (int)std::floor((y - y0_) / h_))); }
+
+    double x0_, y0_, h_;
+    int nx_, ny_;
+    std::vector<std::size_t> start_, cellOf_, fill_;
+    std::vector<int> items_;
+};
+
+// Fraction of the square of side Ls centred on the mean disk position that
+// is covered by the disks (radius R), on a grid of `resolution` um pixels:
+// the FVF convergence measure of process_packing. The pixel mask is kept in
+// `mask`, whose size only depends on R and gap.
+inline double fiberFraction(const double *x, const std::vector<double> &R, double gap, double resolution,
+                            std::vector<char> &mask)
+{
+    const std::size_t n = R.size();
+    double mx = 0, my = 0, a = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        mx += x[2 * i];
+        my += x[2 * i + 1];
+        a += kPi * (R[i] + gap / 2) * (R[i] + gap / 2);
+    }
+    mx /= n;
+    my /= n;
+    const double Ls = std::sqrt(a) * 4 / 5;
+    const int m = std::max(1, (int)std::ceil(Ls / resolution));
+    const double ox = mx - Ls / 2, oy = my - Ls / 2;
+    mask.assign((std::size_t)m * m, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        const double cx = (x[2 * i] - ox) / resolution - 0.5, cy = (x[2 * i + 1] - oy) / resolution - 0.5;
+        const double r = R[i] / resolution;
+        const int j0 = std::max(0, (int)std::ceil(cy - r)), j1 = std::min(m - 1, (int)std::floor(cy + r));
+        for (int j = j0; j <= j1; ++j) {
+            const double w = std::sqrt(std::max(0.0, r * r - (j - cy) * (j - cy)));
+            const int i0 = std::max(0, (int)std::ceil(cx - w)), i1 = std::min(m - 1, (int)std::floor(cx + w));
+            if (i0 <= i1) std::fill(&mask[(std::size_t)j * m + i0], &mask[(std::size_t)j * m + i1] + 1, 1);
+        }
+    }
+    std::size_t covered = 0;
+    for (std::size_t k = 0; k < mask.size(); ++k) covered += mask[k];
+    return covered * (resolution * resolution) / (Ls * Ls);
+}
+
+// Intersection area of two disks (areaIntersect of process_packing).
+inline double lensArea(double r1, double r2, double a)
+{
+    if (a == 0 || a <= std::fabs(r1 - r2)) return a >= r1 + r2 ? 0 : kPi * std::min(r1, r2) * std::min(r1, r2);
+    if (a >= r1 + r2) return 0;
+    const double x = 0.5 * (a + (r1 * r1 - r2 * r2) / a);
+    const double y = std::sqrt(std::max(0.0, r1 * r1 - x * x));
+    return std::atan2(y, x) * r1 * r1 - x * y + std::atan2(y, a - x) * r2 * r2 - (a - x) * y;
+}
+
+// Sum of the pairwise intersection areas of the disks (final_overlap).
+inline double totalOverlap(const double *x, const std::vector<double> &R)
+{
+    const std::size_t n = R.size();
+    if (n < 2) return 0;
+    const double h = 2 * *std::max_element(R.begin(), R.end());
+    CellList cells;
+    cells.build(x, n, h > 0 ? h : 1);
+    double overlap = 0;
+    for (std::size_t i = 0; i < n; ++i)
+        cells.forNeighbours(x[2 * i], x[2 * i + 1], [&](int j) {
+            if ((std::size_t)j <= i) return;
+            const double dx = x[2 * j] - x[2 * i], dy = x[2 * j + 1] - x[2 * i + 1];
+            overlap += lensArea(R[i], R[j], std::sqrt(dx * dx + dy * dy));
+        });
+    return overlap;
+}
+
+// Runs iterMax migrations of the disks x (2 x N interleaved, updated in
+// place) with radii R in a square of side `side`. fvf receives
+// fiberFraction at iteration 1 and every iterFvf iterations.
+inline void pack(std::vector<double> &x, const std::vector<double> &R, double gap, double side, int iterMax,
+                 double iterFvf, std::vector<double> &fvf, int nthreads = 0)
+{
+    const double kCenter0 = 0.01, kCenter1 = 0, kRep = 0.1;
+    const double resolution = 0.05;
+    const std::size_t n = R.size();
+    fvf.clear();
+    if (n == 0) return;
+
+    std::vector<double> D(n);
+    for (std::size_t i = 0; i < n; ++i) D[i] = R[i] + gap / 2;
+    const double h = std::max(2 * *std::max_element(D.begin(), D.end()), 1e-6);
+
+    // Everything worker 0 touches between the barriers is allocated here
+    std::vector<double> next(2 * n);
+    CellList cells;
+    cells.reserve(n);
+    cells.build(&x[0], n, h);
+    std::vector<char> mask;
+    fiberFraction(&x[0], R, gap, resolution, mask);
+    std::size_t nFvf = 0;
+    for (int iter = 1; iter <= iterMax; ++iter) nFvf += iter == 1 || std::fmod(iter, iterFvf) == 0;
+    fvf.reserve(nFvf);
+
+    const int width = parallel_width(n, 512, nthreads);   // at least 512 disks per worker
+    Barrier barrier(width);
+    parallel_for((std::size_t)width, 1, [&](std::size_t w, std::size_t, int) {
+        const std::size_t begin = n * w / width, end = n * (w + 1) / width;
+        for (int iter = 1; iter <= iterMax; ++iter) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const double px = x[2 * i], py = x[2 * i + 1];
+                double ux = 0, uy = 0;
+                bool overlaps = false;
+                cells.forNeighbours(px, py, [&](int j) {
+                    if ((std::size_t)j == i) return;
+                    const double dx = px - x[2 * j], dy = py - x[2 * j + 1];
+                    if (dx * dx + dy * dy < (D[i] + D[j]) * (D[i] + D[j])) {
+                        ux += dx;
+                        uy += dy;
+                        overlaps = true;
+                    }
+                });
+                double ax = side / 2 - px, ay = side / 2 - py;
+                const double an = std::sqrt(ax * ax + ay * ay);
+                if (an > 0) {
+                    ax /= an;
+                    ay /= an;
+                }
+                const double k = overlaps ? kCenter1 : kCenter0;
+                double un = std::sqrt(ux * ux + uy * uy);
+                if (un == 0) un = 1;
+                next[2 * i] = px + k * ax + (overlaps ? kRep * ux / un : 0);
+                next[2 * i + 1] = py + k * ay + (overlaps ? kRep * uy / un : 0);
+            }
+            barrier.wait();
+            if (w == 0) {
+                x.swap(next);
+                if (iter == 1 || std::fmod(iter, iterFvf) == 0)
+                    fvf.push_back(fiberFraction(&x[0], R, gap, resolution, mask));
+                cells.build(&x[0], n, h);
+            }
+            barrier.wait();
+        }
+    }, nthreads);
+}
+
+} // namespace axonpack
+} // namespace qmr
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * [final_positions, final_overlap, fvf_historic] =
+ *     axonpack_mex(x0, R, gap, side, iter_max, iter_fvf, opts)
+ *
+ * Disk migration of axonpacking (see axonpack.hh). Called by
+ * process_packing.m, with the same inputs and outputs.
+ *
+ *   x0        2N x 1 initial positions [x1 y1 x2 y2 ...] (um)
+ *   R         N x 1 disk radii (um)
+ *   gap       gap between disk edges (um)
+ *   side      side of the packing area (um); disks migrate to its centre
+ *   iter_max  number of migrations
+ *   iter_fvf  the disk density is evaluated at iteration 1 and every
+ *             iter_fvf iterations
+ *   opts      optional struct: NumThreads (0: all cores)
+ *
+ * final_positions is 2 x N, final_overlap the summed pairwise overlap area
+ * and fvf_historic (1 x nFvf) the disk density in the central square.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "axonpack.hh"
+
+static const char *kName = "axonpack_mex";
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 6 || nrhs > 7)
+        qmr::mex::fail(kName, "wrongNumInputs", "axonpack_mex expects 6 or 7 input arguments.");
+
+    std::vector<double> x = qmr::mex::toVector(prhs[0]);
+    std::vector<double> R = qmr::mex::toVector(prhs[1]);
+    if (x.size() != 2 * R.size())
+        qmr::mex::fail(kName, "invalidInputSize", "x0 must hold 2 coordinates per radius.");
+    const double gap = qmr::mex::scalar(kName, prhs[2], "gap");
+    const double side = qmr::mex::scalar(kName, prhs[3], "side");
+    const double iterMax = qmr::mex::scalar(kName, prhs[4], "iter_max");
+    const double iterFvf = qmr::mex::scalar(kName, prhs[5], "iter_fvf");
+    if (!(iterMax >= 0))
+        qmr::mex::fail(kName, "invalidInput", "iter_max must be >= 0.");
+    const int nthreads = (int)qmr::mex::option(nrhs > 6 ? prhs[6] : NULL, "NumThreads", 0.0);
+
+    std::vector<double> fvf;
+    qmr::axonpack::pack(x, R, gap, side, (int)iterMax, iterFvf, fvf, nthreads);
+
+    plhs[0] = mxCreateDoubleMatrix(2, R.size(), mxREAL);
+    std::copy(x.begin(), x.end(), mxGetPr(plhs[0]));
+    if (nlhs > 1) plhs[1] = mxCreateDoubleScalar(qmr::axonpack::totalOverlap(x.empty() ? NULL : &x[0], R));
+    if (nlhs > 2) {
+        plhs[2] = mxCreateDoubleMatrix(1, fvf.size(), mxREAL);
+        std::copy(fvf.begin(), fvf.end(), mxGetPr(plhs[2]));
+    }
+}
@@ -6,6 +6,14 @@ disp(' ')
 disp('Packing in process...')
 disp(' ')
 
+% compiled engine (same migrations, cell-list overlap search, no display)
+if exist('axonpack_mex','file')==3
+    [final_positions, overlap, fvf_historic] = axonpack_mex(x0, R, gap, side, iter_max, iter_fvf);
+    disp(' ')
+    disp(['overlap area ratio regarding total disk areas in the packing:   ', num2str(overlap / sum(pi*R.^2) * 100), ' %'])
+    return
+end
+
 N = length(R);
 fvf_historic = [];
 x = x0;
@@ -1,4 +1,4 @@
-function [axons,packing] = func_axonpack_main(numelobj, d_mean, d_var, gap, iter_max)
+function [axons,packing] = func_axonpack_main(numelobj, d_mean, d_var, gap, iter_max, seed)
 
 
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -11,6 +11,10 @@ function [axons,packing] = func_axonpack_main(numelobj, d_mean, d_var, gap, iter
 %                       CHANGE INPUTS BELOW
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
+% seed: optional, makes the packing reproducible (diameters and initial
+% positions are random, the migrations are deterministic)
+if exist('seed','var') && ~isempty(seed), rng(seed); end
+
 % MAIN INPUTS
 N = numelobj;            % number of axons i.e disks to pack  
 %d_mean = 3;         % theoretical mean of axon diameters in um
@@ -0,0 +1,475 @@
+/*
+ * mc_diffusion.hh: Monte Carlo diffusion engine (Sim_MonteCarlo_Diffusion.m).
+ *
+ * Particles walk in the xy plane among impermeable or partly permeable
+ * cylinders (axons, parallel to z). Every step a particle flies `flight` um
+ * in its current direction; as in func_simulstep190511 the flight is cut
+ * at the nearest wall it does not pass through (each crossed wall lets it
+ * through with probability trans), the particle stops sn short of the wall,
+ * is reflected specularly and flies the rest of the step. A flight that
+ * hits no wall ends with a new random direction. Walls are found through a
+ * uniform grid over the cylinders (Grid), so a flight only tests the
+ * cylinders listed in the cells it crosses.
+ *
+ * The phase of every diffusion direction is accumulated in the walk: each
+ * sub-flight adds gamma * (G . centre) * steptime * (fraction of the step)
+ * as func_phaseshift190511, so only the flight-weighted mean position of
+ * the step is needed and the gradient table is applied once per step.
+ *
+ * Particles are processed in fixed chunks, each with its own random stream
+ * seeded from (seed, chunk), so results do not depend on the thread count
+ * (up to rounding of the signal sums). Each chunk walks all its particles
+ * through all steps, which keeps its phases in cache and needs no
+ * synchronization between steps.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef MC_DIFFUSION_HH
+#define MC_DIFFUSION_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace mcdiff {
+
+static const double kPi = 3.14159265358979323846;
+
+// Cylinders: centres (um), radii (um) and probability of passing through
+// the wall.
+struct Geometry {
+    std::vector<double> cx, cy, r, trans;
+    std::size_t size() const { return r.size(); }
+};
+
+// Gradient waveform: nSteps x nDwi x 3 phase factors g (rad/um, gradient
+// times gamma * steptime) so that a particle at x during a whole step gains
+// g . x. active[s] is false for steps without gradient.
+struct Sequence {
+    int nSteps, nDwi;
+    std::vector<double> g;
+    std::vector<char> active;
+    const double *at(int s, int d) const { return &g[3 * ((std::size_t)s * nDwi + d)]; }
+};
+
+struct Settings {
+    double flight;          // displacement per step [um]
+    double sn;              // stop distance before a wall [um]
+    std::uint64_t seed;
+    int signalEvery;        // record the signal every N steps (and the last)
+    int snapshotEvery;      // save positions every N steps (and the last), 0: never
+    bool useGrid;           // cell list for the collision queries (else all cylinders)
+};
+
+// Output buffers (column-major, allocated by the caller). signal is
+// nRec x nDwi, msd nRec x 1 [mm^2], intra/extra 1 x nDwi, positions
+// n x 3 x nSnap (or NULL).
+struct Output {
+    double *signal, *msd, *intra, *extra, *positions;
+};
+
+// Steps at which the signal (every > 0) or the positions are recorded:
+// multiples of every and the last step. withZero adds step 0.
+inline std::vector<int> recordedSteps(int nSteps, int every, bool withZero)
+{
+    std::vector<int> steps;
+    if (withZero) steps.push_back(0);
+    if (every <= 0) return steps;
+    for (int s = every; s <= nSteps; s += every) steps.push_back(s);
+    if (nSteps > 0 && (steps.empty() || steps.back() != nSteps)) steps.push_back(nSteps);
+    return steps;
+}
+
+// xoshiro256** seeded through splitmix64.
+class Rng {
+public:
+    Rng(std::uint64_t seed, std::uint64_t stream)
+    {
+        std::uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+        for (int i = 0; i < 4; ++i) s_[i] = splitmix(x);
+    }
+
+    std::uint64_t next()
+    {
+        const std::uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        const std::uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0]; s_[3] ^= s_[1]; s_[1] ^= s_[2]; s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, 1).
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    static std::uint64_t splitmix(std::uint64_t &x)
+    {
+        std::uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    std::uint64_t s_[4];
+};
+
+struct Walker {
+    double x, y, z;
+    double ux, uy;          // unit direction in the xy plane
+};
+
+// Tests the flight of w against cylinder k: if it reaches the wall before
+// t and does not pass through, sets t to the distance along the flight.
+inline bool hitWall(const Geometry &geo, std::size_t k, const Walker &w, Rng &rng, double &t)
+{
+    const double px = w.x - geo.cx[k], py = w.y - geo.cy[k], R = geo.r[k];
+    const double pp = px * px + py * py;
+    if (pp > (R + t) * (R + t)) return false;
+    const double b = px * w.ux + py * w.uy;
+    const double disc = b * b - (pp - R * R);
+    if (disc <= 0) return false;
+    const double sq = std::sqrt(disc);
+    double tk = -b - sq;
+    if (tk <= 0) tk = -b + sq;
+    if (tk <= 0 || tk >= t) return false;
+    if (geo.trans[k] > 0 && rng.uniform() < geo.trans[k]) return false;
+    t = tk;
+    return true;
+}
+
+// Cylinders already tested by the current query (a cylinder is listed in
+// every cell it overlaps but must draw its crossing probability once).
+struct Visits {
+    std::vector<unsigned> mark;
+    unsigned query;
+    explicit Visits(std::size_t nCylinders) : mark(nCylinders, 0), query(0) {}
+    void next()
+    {
+        if (++query == 0) {
+            std::fill(mark.begin(), mark.end(), 0u);
+            query = 1;
+        }
+    }
+    bool first(std::size_t k)
+    {
+        if (mark[k] == query) return false;
+        mark[k] = query;
+        return true;
+    }
+};
+
+// Uniform grid (cell list) over the cylinders, built once per packing.
+// Each cell lists the cylinders whose bounding square overlaps it; a
+// flight only visits the cells it crosses (2D DDA), nearest first, and
+// stops as soon as the nearest wall found lies before the next cell, so
+// the cost of a query does not grow with the number of cylinders.
+class Grid {
+public:
+    // cellSize <= 0 picks about one cylinder centre per cell; a single
+    // cell (brute force over all cylinders) when useGrid is false.
+    Grid(const Geometry &geo, bool useGrid = true, double cellSize = 0) : nx_(0), ny_(0)
+    {
+        const std::size_t n = geo.size();
+        if (n == 0) return;
+        x0_ = y0_ = std::numeric_limits<double>::max();
+        double x1 = -x0_, y1 = -y0_;
+        for (std::size_t k = 0; k < n; ++k) {
+            x0_ = std::min(x0_, geo.cx[k] - geo.r[k]);
+            y0_ = std::min(y0_, geo.cy[k] - geo.r[k]);
+            x1 = std::max(x1, geo.cx[k] + geo.r[k]);
+            y1 = std::max(y1, geo.cy[k] + geo.r[k]);
+        }
+        const double W = std::max(x1 - x0_, 1e-12), H = std::max(y1 - y0_, 1e-12);
+        const double kMaxCells = 4e6;
+        h_ = useGrid ? (cellSize > 0 ? cellSize : std::sqrt(W * H / n)) : std::max(W, H);
+        h_ = std::max(h_, std::sqrt(W * H / kMaxCells));
+        nx_ = std::max(1, (int)std::ceil(W / h_));
+        ny_ = std::max(1, (int)std::ceil(H / h_));
+        if (!useGrid) h_ = std::max(W, H) * (1 + 1e-12);
+
+        // Compressed cell lists: count, prefix sum, fill
+        std::vector<int> lo(2 * n), hi(2 * n);
+        start_.assign((std::size_t)nx_ * ny_ + 1, 0);
+        for (std::size_t k = 0; k < n; ++k) {
+            lo[2 * k] = cellX(geo.cx[k] - geo.r[k]);
+            hi[2 * k] = cellX(geo.cx[k] + geo.r[k]);
+            lo[2 * k + 1] = cellY(geo.cy[k] - geo.r[k]);
+            hi[2 * k + 1] = cellY(geo.cy[k] + geo.r[k]);
+            for (int j = lo[2 * k + 1]; j <= hi[2 * k + 1]; ++j)
+                for (int i = lo[2 * k]; i <= hi[2 * k]; ++i) ++start_[cell(i, j) + 1];
+        }
+        for (std::size_t c = 0; c + 1 < start_.size(); ++c) start_[c + 1] += start_[c];
+        items_.resize(start_.back());
+        std::vector<std::size_t> fill(start_.begin(), start_.end() - 1);
+        for (std::size_t k = 0; k < n; ++k)
+            for (int j = lo[2 * k + 1]; j <= hi[2 * k + 1]; ++j)
+                for (int i = lo[2 * k]; i <= hi[2 * k]; ++i) items_[fill[cell(i, j)]++] = (int)k;
+    }
+
+    int nx() const { return nx_; }
+    int ny() const { return ny_; }
+    double cellSize() const { return h_; }
+
+    // Number of cylinders containing (x, y) (inisitu of
+    // Sim_MonteCarlo_Diffusion).
+    int insideCount(const Geometry &geo, double x, double y) const
+    {
+        if (!nx_ || x < x0_ || y < y0_ || x > x0_ + nx_ * h_ || y > y0_ + ny_ * h_) return 0;
+        const std::size_t c = cell(cellX(x), cellY(y));
+        int n = 0;
+        for (std::size_t i = start_[c]; i < start_[c + 1]; ++i) {
+            const int k = items_[i];
+            const double dx = geo.cx[k] - x, dy = geo.cy[k] - y;
+            n += dx * dx + dy * dy - geo.r[k] * geo.r[k] < 0;
+        }
+        return n;
+    }
+
+    // Nearest wall that w would reflect on within `reach` um (-1 if none):
+    // sets t to the distance along the flight. Walls the particle passes
+    // through are skipped, so a farther wall can still stop it.
+    long nearestWall(const Geometry &geo, const Walker &w, double reach, Rng &rng, double &t,
+                     Visits &visits) const
+    {
+        t = reach;
+        if (!nx_) return -1;
+        const double inf = std::numeric_limits<double>::infinity();
+        const double ox = w.x - x0_, oy = w.y - y0_;
+        const double W = nx_ * h_, H = ny_ * h_;
+
+        // Part of the flight inside the grid
+        double t0 = 0, t1 = reach;
+        if (!clip(ox, w.ux, W, t0, t1) || !clip(oy, w.uy, H, t0, t1)) return -1;
+
+        int i = std::min(nx_ - 1, std::max(0, (int)std::floor((ox + t0 * w.ux) / h_)));
+        int j = std::min(ny_ - 1, std::max(0, (int)std::floor((oy + t0 * w.uy) / h_)));
+        const int si = w.ux > 0 ? 1 : -1, sj = w.uy > 0 ? 1 : -1;
+        double tx = w.ux != 0 ? ((i + (w.ux > 0)) * h_ - ox) / w.ux : inf;
+        double ty = w.uy != 0 ? ((j + (w.uy > 0)) * h_ - oy) / w.uy : inf;
+        const double dtx = w.ux != 0 ? h_ / std::fabs(w.ux) : inf, dty = w.uy != 0 ? h_ / std::fabs(w.uy) : inf;
+
+        visits.next();
+        long hit = -1;
+        for (;;) {
+            const std::size_t c = cell(i, j);
+            for (std::size_t n = start_[c]; n < start_[c + 1]; ++n) {
+                const int k = items_[n];
+                if (visits.first(k) && hitWall(geo, k, w, rng, t)) hit = k;
+            }
+            const double exit = std::min(tx, ty);
+            if (t <= exit || exit >= t1) break;
+            if (tx < ty) {
+                i += si;
+                tx += dtx;
+            } else {
+                j += sj;
+                ty += dty;
+            }
+            if (i < 0 || j < 0 || i >= nx_ || j >= ny_) break;
+        }
+        return hit;
+    }
+
+private:
+    std::size_t cell(int i, int j) const { return (std::size_t)j * nx_ + i; }
+    int cellX(double x) const { return std::min(nx_ - 1, std::max(0, (int)std::floor((x - x0_) / h_))); }
+    int cellY(double y) const { return std::min(ny_ - 1, std::max(0, (int)std::floor((y - y0_) / h_))); }
+
+    // Restricts [t0, t1] to the flight part where o + t*u is in [0, L].
+    static bool clip(double o, double u, double L, double &t0, double &t1)
+    {
+        if (u == 0) return o >= 0 && o <= L;
+        double a = -o / u, b = (L - o) / u;
+        if (a > b) std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+        return t0 <= t1;
+    }
+
+    double x0_, y0_, h_;
+    int nx_, ny_;
+    std::vector<std::size_t> start_;
+    std::vector<int> items_;
+};
+
+inline void randomDirection(Rng &rng, Walker &w)
+{
+    const double th = rng.uniform() * 2 * kPi;
+    w.ux = std::cos(th);
+    w.uy = std::sin(th);
+}
+
+// One step of func_simulstep190511. m receives the flight-weighted mean
+// position of the step (sum of sub-flight centres times their fraction of
+// the flight).
+inline void step(const Geometry &geo, const Grid &grid, const Settings &set, Rng &rng, Visits &visits,
+                 Walker &w, double m[3])
+{
+    const int kMaxBounces = 10000;   // guards against particles stuck on a wall
+    const double total = set.flight;
+    double rest = total;
+    m[0] = m[1] = m[2] = 0;
+    for (int bounce = 0; rest > set.sn && bounce < kMaxBounces; ++bounce) {
+        const double fl = rest;
+        double t;
+        const long k = grid.nearestWall(geo, w, fl, rng, t, visits);
+        double len;
+        if (k >= 0) {
+            len = t - set.sn;
+            rest = fl - t;
+        } else {
+            len = fl;
+            rest = 0;
+        }
+        const double dx = len * w.ux, dy = len * w.uy;
+        const double frac = (fl - rest) / (total + std::numeric_limits<double>::epsilon());
+        m[0] += frac * (w.x + 0.5 * dx);
+        m[1] += frac * (w.y + 0.5 * dy);
+        m[2] += frac * w.z;
+        if (k >= 0) {
+            // Specular reflection on the wall normal at the hit point
+            const double R = geo.r[k];
+            const double nx = (w.x - geo.cx[k] + t * w.ux) / R, ny = (w.y - geo.cy[k] + t * w.uy) / R;
+            const double dot = w.ux * nx + w.uy * ny;
+            const double ux = w.ux - 2 * dot * nx, uy = w.uy - 2 * dot * ny;
+            const double norm = std::sqrt(ux * ux + uy * uy);
+            w.ux = ux / norm;
+            w.uy = uy / norm;
+        } else {
+            randomDirection(rng, w);
+        }
+        w.x += dx;
+        w.y += dy;
+    }
+}
+
+// Walks n particles from pos0 (n x 3, column-major, um) through
+// seq.nSteps steps and fills out (see Output).
+inline void simulate(const Geometry &geo, const Sequence &seq, const Settings &set, const double *pos0,
+                     std::size_t n, const Output &out, int nthreads = 0)
+{
+    const std::size_t kChunk = 256;
+    const Grid grid(geo, set.useGrid);
+    const int nDwi = seq.nDwi;
+    const std::vector<int> rec = recordedSteps(seq.nSteps, set.signalEvery, true);
+    const std::vector<int> snap = recordedSteps(seq.nSteps, set.snapshotEvery, false);
+    const std::size_t nRec = rec.size(), nSnap = out.positions ? snap.size() : 0;
+    std::vector<int> recRow(seq.nSteps + 1, -1), snapIdx(seq.nSteps + 1, -1);
+    for (std::size_t r = 0; r < nRec; ++r) recRow[rec[r]] = (int)r;
+    for (std::size_t i = 0; i < nSnap; ++i) snapIdx[snap[i]] = (int)i;
+
+    // Per-thread sums: cos/sin per recorded row and direction, squared
+    // displacements, and final cos/sin of intra (1 wall) / extra particles.
+    const std::size_t accSize = nRec * nDwi * 2 + nRec + 4 * nDwi + 2;
+    const int width = parallel_width(n, kChunk, nthreads);
+    std::vector<std::vector<double> > acc(width, std::vector<double>(accSize, 0.0));
+
+    parallel_for(n, kChunk, [&](std::size_t begin, std::size_t end, int tid) {
+        const std::size_t P = end - begin;
+        Rng rng(set.seed, begin / kChunk);
+        Visits visits(geo.size());
+        std::vector<Walker> w(P);
+        std::vector<int> inside(P);
+        std::vector<double> phase(P * nDwi, 0.0), sums(2 * nDwi, 0.0);
+        for (std::size_t p = 0; p < P; ++p) {
+            w[p].x = pos0[begin + p];
+            w[p].y = pos0[begin + p + n];
+            w[p].z = pos0[begin + p + 2 * n];
+            inside[p] = grid.insideCount(geo, w[p].x, w[p].y);
+            randomDirection(rng, w[p]);
+        }
+        double *a = &acc[tid][0];
+        double *sigAcc = a, *msdAcc = a + nRec * nDwi * 2, *fin = msdAcc + nRec;
+        bool changed = true;   // phases changed since the last recorded row
+
+        for (int s = 0; s < seq.nSteps; ++s) {
+            const bool active = seq.active[s] != 0;
+            for (std::size_t p = 0; p < P; ++p) {
+                double m[3];
+                step(geo, grid, set, rng, visits, w[p], m);
+                if (!active) continue;
+                double *ph = &phase[p * nDwi];
+                for (int d = 0; d < nDwi; ++d) {
+                    const double *g = seq.at(s, d);
+                    ph[d] += g[0] * m[0] + g[1] * m[1] + g[2] * m[2];
+                }
+            }
+            changed = changed || active;
+
+            const int r = recRow[s + 1];
+            if (r >= 0) {
+                if (changed) {
+                    std::fill(sums.begin(), sums.end(), 0.0);
+                    for (std::size_t p = 0; p < P; ++p)
+                        for (int d = 0; d < nDwi; ++d) {
+                            sums[2 * d] += std::cos(phase[p * nDwi + d]);
+                            sums[2 * d + 1] += std::sin(phase[p * nDwi + d]);
+                        }
+                    changed = false;
+                }
+                double *row = sigAcc + (std::size_t)r * nDwi * 2;
+                for (int i = 0; i < 2 * nDwi; ++i) row[i] += sums[i];
+                double d2 = 0;
+                for (std::size_t p = 0; p < P; ++p) {
+                    const double dx = w[p].x - pos0[begin + p], dy = w[p].y - pos0[begin + p + n];
+                    d2 += dx * dx + dy * dy;
+                }
+                msdAcc[r] += d2 * 1e-6;
+            }
+            const int k = snapIdx[s + 1];
+            if (k >= 0) {
+                double *dst = out.positions + 3 * n * (std::size_t)k;
+                for (std::size_t p = 0; p < P; ++p) {
+                    dst[begin + p] = w[p].x;
+                    dst[begin + p + n] = w[p].y;
+                    dst[begin + p + 2 * n] = w[p].z;
+                }
+            }
+        }
+
+        for (std::size_t p = 0; p < P; ++p) {
+            if (inside[p] > 1) continue;
+            double *f = fin + (inside[p] ? 0 : 2 * nDwi);
+            for (int d = 0; d < nDwi; ++d) {
+                f[2 * d] += std::cos(phase[p * nDwi + d]);
+                f[2 * d + 1] += std::sin(phase[p * nDwi + d]);
+            }
+            fin[4 * nDwi + (inside[p] ? 0 : 1)] += 1;
+        }
+    }, nthreads);
+
+    for (int t = 1; t < width; ++t)
+        for (std::size_t i = 0; i < accSize; ++i) acc[0][i] += acc[t][i];
+    const double *a = &acc[0][0];
+    const double *fin = a + nRec * nDwi * 2 + nRec;
+
+    // Magnitude of the mean transverse magnetization (func_integphase190511)
+    for (std::size_t r = 0; r < nRec; ++r) {
+        out.msd[r] = a[nRec * nDwi * 2 + r] / n;
+        for (int d = 0; d < nDwi; ++d) {
+            const double X = a[(r * nDwi + d) * 2] / n, Y = a[(r * nDwi + d) * 2 + 1] / n;
+            out.signal[r + nRec * d] = r == 0 ? 1.0 : std::sqrt(X * X + Y * Y);
+        }
+    }
+    const double nIntra = fin[4 * nDwi], nExtra = fin[4 * nDwi + 1];
+    for (int d = 0; d < nDwi; ++d) {
+        double X = fin[2 * d] / nIntra, Y = fin[2 * d + 1] / nIntra;
+        out.intra[d] = std::sqrt(X * X + Y * Y);
+        X = fin[2 * nDwi + 2 * d] / nExtra;
+        Y = fin[2 * nDwi + 2 * d + 1] / nExtra;
+        out.extra[d] = std::sqrt(X * X + Y * Y);
+    }
+}
+
+} // namespace mcdiff
+} // namespace qmr
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * [signal, signalIntra, signalExtra, msd, positions] =
+ *     mc_diffusion_mex(positions0, flight, steptime, G, centres, radii, trans, opts)
+ *
+ * Monte Carlo diffusion among cylinders (see mc_diffusion.hh). Use through
+ * Sim_MonteCarlo_Diffusion_batch.m, which builds the PGSE gradients and the
+ * axon geometry as Sim_MonteCarlo_Diffusion.m does.
+ *
+ *   positions0  n x 3 starting positions [um]
+ *   flight      displacement per step [um]
+ *   steptime    duration of a step [ms]
+ *   G           nSteps x 3 x nDwi gradient vectors [mT/m]
+ *   centres     nAxons x 2 cylinder centres [um]
+ *   radii       nAxons x 1 radii [um]
+ *   trans       probability of crossing a wall (scalar or nAxons x 1)
+ *   opts        optional struct: NumThreads (0: all cores), Seed (0),
+ *               SignalEvery (record the signal every N steps, 1),
+ *               SnapshotEvery (save positions every N steps, 0: final only),
+ *               UseGrid (cell list for the wall collisions, true; false
+ *               tests every cylinder, for benchmarking)
+ *
+ * signal is nRec x nDwi (step 0, multiples of SignalEvery and the last
+ * step), msd the mean square displacement [mm^2] at the same steps,
+ * signalIntra/signalExtra (1 x nDwi) the final signal of particles that
+ * start in exactly one / no cylinder, positions n x 3 x nSnap.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "mc_diffusion.hh"
+
+static const char *kName = "mc_diffusion_mex";
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 7 || nrhs > 8)
+        qmr::mex::fail(kName, "wrongNumInputs", "mc_diffusion_mex expects 7 or 8 input arguments.");
+
+    qmr::mex::requireDouble(kName, prhs[0], "positions0");
+    const std::size_t n = mxGetM(prhs[0]);
+    if (n == 0 || mxGetN(prhs[0]) != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "positions0 must be n x 3 with n > 0.");
+
+    qmr::mcdiff::Settings set;
+    set.flight = qmr::mex::scalar(kName, prhs[1], "flight");
+    const double steptime = qmr::mex::scalar(kName, prhs[2], "steptime");
+    if (!(set.flight >= 0) || !(steptime > 0))
+        qmr::mex::fail(kName, "invalidInput", "flight must be >= 0 and steptime > 0.");
+    set.sn = 1e-9;
+
+    qmr::mex::requireDouble(kName, prhs[3], "G");
+    std::vector<std::size_t> gd = qmr::mex::dims(prhs[3], 3);
+    if (gd.size() > 3 || gd[1] != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "G must be nSteps x 3 x nDwi.");
+    qmr::mcdiff::Sequence seq;
+    seq.nSteps = (int)gd[0];
+    seq.nDwi = (int)gd[2];
+
+    // Phase factors of func_phaseshift190511: 2*pi*42.58 rad/(mT ms), um*mT/m = 1e-6 mT
+    const double k = 2 * qmr::mcdiff::kPi * 42.58 * 1e-6 * steptime;
+    const double *G = mxGetPr(prhs[3]);
+    seq.g.resize((std::size_t)seq.nSteps * seq.nDwi * 3);
+    seq.active.assign(seq.nSteps, 0);
+    for (int s = 0; s < seq.nSteps; ++s)
+        for (int d = 0; d < seq.nDwi; ++d)
+            for (int a = 0; a < 3; ++a) {
+                const double v = G[s + gd[0] * (a + 3 * (std::size_t)d)];
+                seq.g[3 * ((std::size_t)s * seq.nDwi + d) + a] = k * v;
+                if (v != 0) seq.active[s] = 1;
+            }
+
+    qmr::mex::requireDouble(kName, prhs[4], "centres");
+    const std::size_t nAxons = mxGetM(prhs[4]);
+    if (nAxons && mxGetN(prhs[4]) != 2)
+        qmr::mex::fail(kName, "invalidInputSize", "centres must be nAxons x 2.");
+    std::vector<double> radii = qmr::mex::toVector(prhs[5]);
+    std::vector<double> trans = qmr::mex::toVector(prhs[6]);
+    if (radii.size() != nAxons)
+        qmr::mex::fail(kName, "invalidInputSize", "radii must have one value per centre.");
+    if (trans.size() == 1) trans.assign(nAxons, trans[0]);
+    if (trans.size() != nAxons)
+        qmr::mex::fail(kName, "invalidInputSize", "trans must be a scalar or have one value per centre.");
+
+    qmr::mcdiff::Geometry geo;
+    const double *c = mxGetPr(prhs[4]);
+    geo.cx.assign(c, c + nAxons);
+    geo.cy.assign(c + nAxons, c + 2 * nAxons);
+    geo.r = radii;
+    geo.trans = trans;
+
+    const mxArray *opts = nrhs > 7 ? prhs[7] : NULL;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+    set.seed = (std::uint64_t)qmr::mex::option(opts, "Seed", 0.0);
+    set.signalEvery = (int)qmr::mex::option(opts, "SignalEvery", 1.0);
+    set.snapshotEvery = (int)qmr::mex::option(opts, "SnapshotEvery", 0.0);
+    set.useGrid = qmr::mex::option(opts, "UseGrid", 1.0) != 0;
+    if (set.signalEvery < 1 || set.snapshotEvery < 0)
+        qmr::mex::fail(kName, "invalidOption", "SignalEvery must be >= 1 and SnapshotEvery >= 0.");
+    if (set.snapshotEvery == 0) set.snapshotEvery = seq.nSteps;
+
+    const std::size_t nRec = qmr::mcdiff::recordedSteps(seq.nSteps, set.signalEvery, true).size();
+    const std::size_t nSnap = qmr::mcdiff::recordedSteps(seq.nSteps, set.snapshotEvery, false).size();
+    plhs[0] = mxCreateDoubleMatrix(nRec, seq.nDwi, mxREAL);
+    mxArray *intra = mxCreateDoubleMatrix(1, seq.nDwi, mxREAL);
+    mxArray *extra = mxCreateDoubleMatrix(1, seq.nDwi, mxREAL);
+    mxArray *msd = mxCreateDoubleMatrix(nRec, 1, mxREAL);
+    mwSize pd[3] = {n, 3, nSnap};
+    mxArray *positions = nlhs > 4 ? mxCreateNumericArray(3, pd, mxDOUBLE_CLASS, mxREAL) : NULL;
+
+    qmr::mcdiff::Output out;
+    out.signal = mxGetPr(plhs[0]);
+    out.intra = mxGetPr(intra);
+    out.extra = mxGetPr(extra);
+    out.msd = mxGetPr(msd);
+    out.positions = positions ? mxGetPr(positions) : NULL;
+    qmr::mcdiff::simulate(geo, seq, set, mxGetPr(prhs[0]), n, out, nthreads);
+
+    mxArray *rest[4] = {intra, extra, msd, positions};
+    for (int i = 0; i < 4; ++i) {
+        if (nlhs > i + 1) plhs[i + 1] = rest[i];
+        else if (rest[i]) mxDestroyArray(rest[i]);
+    }
+}
@@ -17,11 +17,21 @@ function Fit = FitData(data, Model, wait , Fittmp)
 %                                          data points for each voxel
 %     Model                      [class]  Model object
 %     wait                       [binary] display a wait bar?
-%     FitTempResults_filename    [string] filename of a temporary fitting file
+%     FitTempResults_filename    [string] filename of a temporary fitting file,
+%                                          or folder of a temporary result store
+%                                          (FitTempResults, see below)
 %
 % Output
 %     Fit                        [struct] with fitted parameters
 %
+% Voxelwise fits save their progress while running: with qmr_store_mex
+% compiled (qMRbuildMex), the voxels fitted are committed every 30 s as
+% compressed chunks to the folder ./FitTempResults, otherwise the whole
+% Fit is saved to ./FitTempResults.mat every 5 min. Pass either to resume
+% an interrupted fit; FitResultsExport_nii writes the maps of a store. A
+% store records a fingerprint of the data and model options, and is only
+% resumed with the same ones; a new fit replaces ./FitTempResults.
+%
 % ----------------------------------------------------------------------------------------------------
 % Written by: Jean-Fran??ois Cabana, 2016
 % ----------------------------------------------------------------------------------------------------
@@ -83,13 +93,38 @@ if Model.voxelwise % process voxelwise
     end
 
     % Load FitTempResults
+    storeDir = fullfile(pwd,'FitTempResults');
+    useStore = exist('qmr_store_mex','file')==3;
+    if useStore
+        % Fingerprint of the data and model options, recorded in the store:
+        % only the same fit can resume it
+        storeKey = qmr_store_mex('fingerprint', data, Model.ModelName, Model.Prot, Model.options);
+    end
     if exist('Fittmp','var')
-        Fit = load(Fittmp);
+        if exist(Fittmp,'dir')
+            if ~useStore
+                error('qMRLab:FitData:missingMex', ...
+                    '%s is a result store folder, resuming it needs qmr_store_mex (see qMRbuildMex).', Fittmp);
+            end
+            storeDir = Fittmp;
+            store = qmr_store_mex('info', Fittmp);
+            if ~strcmp(store.fingerprint, storeKey)
+                error('qMRLab:FitData:storeMismatch', ...
+                    'The results in %s were fitted from other data or model options and cannot be resumed.', Fittmp);
+            end
+            Fit = qmr_store_mex('read', Fittmp);
+        else
+            Fit = load(Fittmp);
+        end
         computed = Fit.computed(:);
         fields = Fit.fields;
     else
         computed = false(nV,1);
     end
+    if useStore && ~(exist('Fittmp','var') && exist(Fittmp,'dir')) && exist(fullfile(storeDir,'store.txt'),'file')
+        % Left by an earlier fit that is not resumed: start over
+        rmdir(storeDir,'s');
+    end
 
 
    
@@ -123,6 +158,37 @@ if Model.voxelwise % process voxelwise
     % Travis?
     if isempty(getenv('ISCITEST')) || ~str2double(getenv('ISCITEST')), ISCITEST=false; else ISCITEST=true; end
 
+    % ############################# BATCHED FIT ################################
+    % Models implementing fitBatch fit all remaining voxels in one call
+    % (e.g. with the native batched LM solver, see batchLM). fitBatch
+    % receives [nVoxels x nT] inputs and returns [nVoxels x k] fields, or []
+    % if the batched path is not available for the current options.
+    if numVox && ~ISCITEST && ~moxunit_util_platform_is_octave && ismethod(Model,'fitBatch')
+        for iii = 1:length(MRIinputs)
+            M.(MRIinputs{iii}) = data.(MRIinputs{iii})(Voxels,:);
+        end
+        if isfield(data,'hdr'), M.hdr = data.hdr; end
+        batchFit = Model.fitBatch(M);
+        clear M
+        if ~isempty(batchFit)
+            if ~exist('fields','var'), fields = fieldnames(batchFit)'; end
+            for ff = 1:length(fields)
+                nK = size(batchFit.(fields{ff}),2);
+                if ~exist('Fit','var') || ~isfield(Fit,fields{ff})
+                    Fit.(fields{ff}) = nan(x,y,z,nK);
+                end
+                for kk = 1:nK
+                    Fit.(fields{ff})(Voxels + nV*(kk-1)) = batchFit.(fields{ff})(:,kk);
+                end
+            end
+            Fit.fields = fields;
+            if ~isfield(Fit,'computed'), Fit.computed = zeros(x,y,z); end
+            Fit.computed(Voxels) = 1;
+            % Nothing left for the voxelwise loop below
+            Voxels = []; numVox = 0;
+        end
+    end
+
     % ############################# FITTING LOOP ###############################
     % Create waitbar
     if exist('wait','var') && (wait)
@@ -136,7 +202,9 @@ if Model.voxelwise % process voxelwise
         disp(['Operation has been started: ' Model.ModelName]);
     end
     fitFailedCounter = 0;
-    firstHit = false;
+    firstHit = exist('fields','var')==1; % resumed
+    pending = zeros(1,0); % voxels not committed to the store yet
+    cancelled = false;
     tic;
     for ii = 1:numVox
         vox = Voxels(ii);
@@ -203,10 +271,17 @@ if Model.voxelwise % process voxelwise
         end
         
         Fit.computed(vox) = 1;
+        pending(end+1) = vox;
         
-        %  save temp file every 5min
+        %  commit to the store every 30s, or save temp file every 5min
         telapsed = toc(tStart);
-        if (mod(floor(telapsed/60),5) == 0 && (telapsed-tsaved)/60>5) %
+        if useStore
+            if firstHit && (telapsed-tsaved)>30
+                tsaved = telapsed;
+                commitToStore(storeDir, Fit, pending, [x y z], storeKey);
+                pending = zeros(1,0);
+            end
+        elseif (mod(floor(telapsed/60),5) == 0 && (telapsed-tsaved)/60>5) %
             tsaved = telapsed;
             save('FitTempResults.mat', '-struct','Fit');
         end
@@ -217,7 +292,7 @@ if Model.voxelwise % process voxelwise
             %            fprintf('Fitting voxel %d/%d\r',ii,l);
 
         else
-            if getappdata(h,'canceling');  break;  end  % Allows user to cancel
+            if getappdata(h,'canceling'); cancelled = true; break;  end  % Allows user to cancel
             if (telapsed-tsavedwb)>1 % Update waitbar every sec
                 tsavedwb = telapsed; 
                 waitbar(ii/numVox, h, sprintf('Fitting voxel %d/%d (%d errors)', ii, numVox, fitFailedCounter));
@@ -232,6 +307,14 @@ if Model.voxelwise % process voxelwise
             break;
         end
     end
+    if useStore && firstHit
+        if cancelled
+            % Keep what was fitted, to resume with FitData(data,Model,wait,storeDir)
+            commitToStore(storeDir, Fit, pending, [x y z], storeKey);
+        elseif exist(storeDir,'dir')
+            rmdir(storeDir,'s');
+        end
+    end
     toc;
     disp(['Operation has been completed: ' Model.ModelName]);
     disp('==================================================')
@@ -321,3 +404,20 @@ if exist(fullfile('.','FitTempResults.mat'),'file')
     delete FitTempResults.mat
 end
 end
+
+function commitToStore(storeDir, Fit, vox, dims, key)
+% Commits the fitted values of voxels vox (linear indices) to the chunked
+% result store storeDir, created on first use with the fingerprint key.
+if isempty(vox), return; end
+if ~exist(storeDir,'dir'), mkdir(storeDir); end
+nV = prod(dims);
+nK = cellfun(@(f) size(Fit.(f),4), Fit.fields);
+qmr_store_mex('create', storeDir, dims, Fit.fields, nK, key);
+values = zeros(numel(vox), sum(nK));
+col = 0;
+for ff = 1:length(Fit.fields)
+    values(:,col+(1:nK(ff))) = Fit.(Fit.fields{ff})(bsxfun(@plus, vox(:), nV*(0:nK(ff)-1)));
+    col = col + nK(ff);
+end
+qmr_store_mex('write', storeDir, vox, values);
+end
@@ -0,0 +1,35 @@
+function FitResultsExport_nii(storeDir,fname_copyheader,folder)
+% Export the maps of a chunked result store to NIfTI files
+% FitResultsExport_nii(storeDir)
+% FitResultsExport_nii(storeDir,fname_copyheader)
+% FitResultsExport_nii(storeDir,fname_copyheader,folder)
+%
+% storeDir is the folder written by FitData or ParFitData while fitting
+% (FitTempResults, ParFitTempResults_<date>), with qmr_store_mex compiled
+% (qMRbuildMex). Each field is read from the store and written to
+% <folder>/<field>.nii.gz, one at a time, so the whole FitResults never
+% has to be in memory. Voxels that were not fitted are NaN. Headers are
+% copied from fname_copyheader, as FitResultsSave_nii.
+%
+% Example:
+%   FitResultsExport_nii('FitTempResults','dwi.nii.gz','FitResults')
+%
+% Written by: qMRLab contributors, 2026
+
+if ~exist('folder','var'), folder = 'FitResults'; end
+if exist('qmr_store_mex','file')~=3
+    error('qMRLab:FitResultsExport_nii:missingMex','qmr_store_mex is not compiled (see qMRbuildMex).');
+end
+if ~exist(folder,'dir'), mkdir(folder); end
+
+store = qmr_store_mex('info', storeDir);
+for i = 1:length(store.fields)
+    map = store.fields{i};
+    maps = qmr_store_mex('read', storeDir, map);
+    file = fullfile(folder,[map '.nii.gz']);
+    if ~exist('fname_copyheader','var') || isempty(fname_copyheader)
+        save_nii_v2(make_nii(maps.(map)),file,[],64);
+    else
+        save_nii_v2(maps.(map),file,fname_copyheader,64);
+    end
+end
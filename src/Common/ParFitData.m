@@ -203,6 +203,13 @@ if Model.voxelwise % process voxelwise
     end
     
     
+    % Fingerprint of the data and model options, recorded in the result
+    % store so that it is only recovered by the same fit.
+    storeKey = '';
+    if exist('qmr_store_mex','file')==3
+        storeKey = qmr_store_mex('fingerprint', data, Model.ModelName, Model.Prot, Model.options);
+    end
+    
     % Reduce the data (nV) based on the presence of a Mask.
     if isfield(data,'Mask') && (~isempty(data.Mask))
         
@@ -238,7 +245,7 @@ if Model.voxelwise % process voxelwise
             % First, reduce data from the WHOLE list of linearized indexes
             % (1:nV). This will also validate whether the loaded data is 
             % compatible with the current process.
-            [Voxels_reduced, bypassLoad] = rmAutoSavedIndexes(recoveryDir,1:nV, Model);
+            [Voxels_reduced, bypassLoad] = rmAutoSavedIndexes(recoveryDir,1:nV, Model, storeKey);
             
             % Now we have the linearized indexes of the remaining data.
             % From this remaining data, we will discard those intersecting
@@ -297,7 +304,7 @@ if Model.voxelwise % process voxelwise
         % we have no reduction in data by Masks.
         if ~isempty(recoveryDir)
             
-            [Voxels, bypassLoad] = rmAutoSavedIndexes(recoveryDir,Voxels, Model);
+            [Voxels, bypassLoad] = rmAutoSavedIndexes(recoveryDir,Voxels, Model, storeKey);
             
             if ~bypassLoad
                 for iii = 1:length(MRIinputs)
@@ -345,6 +352,15 @@ if Model.voxelwise % process voxelwise
     % Sending data by parallel.pool.Constant() won't make it faster for 
     % this application. The data is already sliced per core.
     
+    % With qmr_store_mex compiled, autosaved voxels are committed as
+    % compressed chunks of a result store in tmpFolderName (only the voxels
+    % fitted since the previous save), instead of .mat parts.
+    useStore = isAutosave && exist('qmr_store_mex','file')==3;
+    if useStore
+        if ~exist(tmpFolderName, 'dir'), mkdir(tmpFolderName); end
+        qmr_store_mex('create', tmpFolderName, [x y z], xnames, ones(1,fLen), storeKey);
+    end
+    
     tStart = tic;
     parfor itPar = 1:nW*granularity
         %Par.tic;
@@ -440,7 +456,11 @@ if Model.voxelwise % process voxelwise
                     % save function cannot be called from parfor directly.
                     % it is really critical to keep these idx sliced during
                     % save!
-                    parSaveTemp(parM(itPar).Fit,parM(itPar).computedIdx,parM(itPar).fields,tmpFolderName,itPar,parM(itPar).finished);
+                    if useStore
+                        parM(itPar).stored = parStoreTemp(parM(itPar).Fit,parM(itPar).computedIdx,parM(itPar).fields,tmpFolderName,parM(itPar).stored);
+                    else
+                        parSaveTemp(parM(itPar).Fit,parM(itPar).computedIdx,parM(itPar).fields,tmpFolderName,itPar,parM(itPar).finished);
+                    end
                     parM(itPar).tsaved = telapsed;
                 end
             end
@@ -590,6 +610,7 @@ for iii = 1:length(MRIinputs)
         parM(jjj).tempFit = [];
         parM(jjj).tsaved = [];
         parM(jjj).finished = false;
+        parM(jjj).stored = 0;
         parM(jjj).fitFailed = [];
         parM(jjj).fields = Model.xnames;
         parM(jjj).computedIdx = nan(1,length(parM(jjj).NativeIdx));
@@ -704,9 +725,28 @@ end
 
 end
 
-function [Voxels,bypass] = rmAutoSavedIndexes(recoveryDir,Voxels,Model)
+function stored = parStoreTemp(payload,computedIdx,fields,folder,stored)
+% Commits the voxels computed since the previous call (after the first
+% `stored` entries of computedIdx) to the result store in folder, as one
+% chunk. Returns the new number of committed entries.
+
+last = find(~isnan(computedIdx), 1, 'last');
+if isempty(last) || last <= stored
+    return;
+end
+range = stored+1:last;
+values = zeros(length(range), length(fields));
+for ii = 1:length(fields)
+    values(:,ii) = payload.(fields{ii})(range);
+end
+qmr_store_mex('write', folder, computedIdx(range), values);
+stored = last;
+
+end
+
+function [Voxels,bypass] = rmAutoSavedIndexes(recoveryDir,Voxels,Model,storeKey)
 % Read autosaved data and drop those proccesed ones from the
-% data.
+% data. A result store is only used if its fingerprint is storeKey.
 
 % This whole thing will bypassed if there is protocol mismatch.
 try
@@ -738,10 +778,11 @@ catch
     bypass = true;
 end
 
-% Load ParIdxTempResults* files that store
+% Load ParIdxTempResults* files (or the result store) that store
 % linearized indexes of the voxels which have been solved for.
 files = dir(fullfile(recoveryDir,'ParIdxTempResults*.mat'));
-if isempty(files)
+isStore = exist(fullfile(recoveryDir,'store.txt'),'file') && exist('qmr_store_mex','file')==3;
+if isempty(files) && ~isStore
     cprintf('blue','<< %s >> --------------------------------------------------','!');
     cprintf('red','<< WARNING >> Autosaved data cannot be find at %s',recoveryDir);
     cprintf('red','              The whole dataset will be %s','processed');
@@ -749,9 +790,24 @@ if isempty(files)
     bypass =  true;
 end
 
+if isStore && ~bypass
+    store = qmr_store_mex('info', recoveryDir);
+    if ~strcmp(store.fingerprint, storeKey)
+        cprintf('blue','<< %s >> --------------------------------------------------','!');
+        cprintf('red','<< WARNING >> Autosaved %s data cannot be used:',Model.ModelName);
+        cprintf('red','              They were fitted from other %s','data or model options');
+        cprintf('blue','<< %s >> --------------------------------------------------','!');
+        pause(3); % Make sure that this is seen
+        bypass = true;
+    end
+end
+
 if ~bypass
     fulLen = length(Voxels);
     those = [];
+    if isStore
+        those = qmr_store_mex('computed', recoveryDir)';
+    end
     for ii=1:length(files)
         this = load([recoveryDir filesep files(ii).name]);
         % Get native indexes only
@@ -776,6 +832,17 @@ function Fit = patchData(Fit,recoveryDir)
     filesFit = dir(fullfile(recoveryDir,'ParFitTempResults*.mat'));
     filesIdx = dir(fullfile(recoveryDir,'ParIdxTempResults*.mat'));
 
+    if exist(fullfile(recoveryDir,'store.txt'),'file') && exist('qmr_store_mex','file')==3
+        saved = qmr_store_mex('read', recoveryDir);
+        done = saved.computed==1;
+        for jj=1:length(saved.fields)
+            cur_field = saved.fields{jj};
+            if isfield(Fit,cur_field)
+                Fit.(cur_field)(done) = saved.(cur_field)(done);
+            end
+        end
+    end
+
     for ii=1:length(filesFit)
         thisf = load([recoveryDir filesep filesFit(ii).name]);
         thisIdx = load([recoveryDir filesep filesIdx(ii).name]);
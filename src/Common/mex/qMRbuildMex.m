@@ -0,0 +1,81 @@
+function qMRbuildMex(targets)
+% qMRbuildMex   Compile qMRLab native (MEX) engines
+%
+%   qMRbuildMex          compiles every engine listed below
+%   qMRbuildMex(names)   compiles only the listed engines (char or cellstr)
+%
+%   Each engine is a C++11 gateway (*_mex.cc) living next to the MATLAB
+%   code it accelerates. The MATLAB callers check exist(name,'file')==3
+%   and fall back to their MATLAB implementation when the engine is not
+%   compiled, so building is optional.
+%
+%   Shared headers (threading, argument parsing, solvers) are in
+%   src/Common/mex. Engines use std::thread, hence -pthread on unix.
+%   qmr_nii_mex and qmr_store_mex link with zlib (headers and library on
+%   the compiler path).
+%
+% Example:
+%   qMRbuildMex('qmr_lm_mex')
+%
+% Written by: qMRLab contributors, 2026
+
+root   = fileparts(fileparts(fileparts(fileparts(mfilename('fullpath')))));
+common = fullfile(root,'src','Common','mex');
+
+% {name, folder (relative to root), extra sources, extra libraries}
+engines = {
+    'qmr_lm_mex', fullfile('src','Common','mex'), {}, {}
+    'qmr_maps_mex', fullfile('src','Common','mex'), {}, {}
+    'qmr_nii_mex', fullfile('src','Common','mex'), {}, {'z'}
+    'qmr_store_mex', fullfile('src','Common','mex'), {}, {'z'}
+    'qmr_dicm_mex', fullfile('src','Common','mex'), {}, {}
+    'rdNls_mex', fullfile('src','Models_Functions','IRfun'), {}, {}
+    'mwf_nnls_mex', fullfile('src','Models_Functions','MWF'), {}, {}
+    'mp2rage_lut_mex', fullfile('src','Models_Functions','MP2RAGE','func'), {}, {}
+    'mppca_mex', fullfile('src','Models_Functions','Noise'), {}, {}
+    'mc_diffusion_mex', fullfile('src','Addons','SimMonteCarlo_Diffusion'), {}, {}
+    'axonpack_mex', fullfile('src','Addons','SimMonteCarlo_Diffusion'), {}, {}
+    'qsm_mex', fullfile('src','Models_Functions','QSM'), {}, {}
+    'sunwrap_mex', fullfile('External','sunwrap'), {}, {}
+    'smoothn_mex', fullfile('External','smoothn'), {}, {}
+    'dti_mex', fullfile('src','Models_Functions','DTIfun'), {}, {}
+    'charmed_mex', fullfile('src','Models_Functions','CHARMEDfun'), {}, {}
+    'amico_mex', fullfile('src','Models_Functions','AMICOfun'), {}, {}
+    'amico_kernels_mex', fullfile('src','Models_Functions','AMICOfun'), {}, {}
+    'ordfilt3D_mex', fullfile('src','Models_Functions','MTVfun'), {}, {}
+    'polyfit3d_mex', fullfile('src','Models_Functions','Filter'), {}, {}
+    };
+
+if nargin>0
+    targets = cellstr(targets);
+    unknown = setdiff(targets, engines(:,1));
+    if ~isempty(unknown), error('qMRLab:qMRbuildMex:unknownTarget','Unknown MEX target(s): %s', strjoin(unknown,', ')); end
+    engines = engines(ismember(engines(:,1),targets),:);
+end
+
+if moxunit_util_platform_is_octave
+    setenv('CXXFLAGS',[getenv('CXXFLAGS') ' -std=c++11 -O3 -pthread']);
+    setenv('LDFLAGS',[getenv('LDFLAGS') ' -pthread']);
+    flags = {};
+elseif isunix
+    flags = {'CXXFLAGS=$CXXFLAGS -std=c++11 -O3 -pthread','LDFLAGS=$LDFLAGS -pthread'};
+else
+    flags = {'COMPFLAGS=$COMPFLAGS /O2'};
+end
+
+for ii = 1:size(engines,1)
+    name   = engines{ii,1};
+    folder = fullfile(root, engines{ii,2});
+    srcs   = [{fullfile(folder,[name '.cc'])}, cellfun(@(s) fullfile(folder,s), engines{ii,3}, 'uni', 0)];
+    libs   = cellfun(@(l) ['-l' l], engines{ii,4}, 'uni', 0);
+
+    if moxunit_util_platform_is_octave
+        out = {'-o', fullfile(folder,name)};
+    else
+        out = {'-outdir', folder};
+    end
+
+    fprintf('Compiling %s...\n', name);
+    mex('-O', out{:}, ['-I' common], ['-I' folder], srcs{:}, libs{:}, flags{:});
+end
+end
@@ -0,0 +1,137 @@
+/*
+ * qmr_cache.hh: on-disk cache of precomputed tables (lookup tables,
+ * dictionaries, kernels) shared by the qMRLab MEX engines.
+ *
+ * A table is a flat array of doubles stored under a 64-bit key, the FNV-1a
+ * hash of everything it depends on (protocol values, grid definitions and
+ * a format version chosen by the engine). Files are named
+ * <dir>/<prefix>_<key in hex>.bin and start with a small header repeating
+ * the key and the length, so a stale or truncated file is never used.
+ *
+ * The cache is best effort: a missing, unreadable or read-only directory
+ * only means the table is recomputed. Writes go to a temporary file that
+ * is renamed into place, so concurrent MATLAB sessions never read a
+ * partially written table.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_CACHE_HH
+#define QMR_CACHE_HH
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace qmr {
+namespace cache {
+
+// Incremental 64-bit FNV-1a hash.
+class Hash {
+public:
+    Hash() : h_(1469598103934665603ULL) {}
+
+    Hash &bytes(const void *p, std::size_t n)
+    {
+        const unsigned char *c = static_cast<const unsigned char *>(p);
+        for (std::size_t i = 0; i < n; ++i) {
+            h_ ^= c[i];
+            h_ *= 1099511628211ULL;
+        }
+        return *this;
+    }
+    Hash &value(double v)
+    {
+        if (v == 0) v = 0;   // +0 and -0 describe the same protocol
+        return bytes(&v, sizeof v);
+    }
+    Hash &values(const double *v, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i) value(v[i]);
+        return *this;
+    }
+    Hash &text(const std::string &s) { return bytes(s.data(), s.size()).bytes("", 1); }
+
+    uint64_t key() const { return h_; }
+
+private:
+    uint64_t h_;
+};
+
+namespace detail {
+
+static const char kMagic[8] = {'q', 'M', 'R', 'c', 'a', 'c', 'h', 'e'};
+
+inline std::string path(const std::string &dir, const std::string &prefix, uint64_t key)
+{
+    char hex[17];
+    std::sprintf(hex, "%016llx", static_cast<unsigned long long>(key));
+#ifdef _WIN32
+    const char sep = '\\';
+#else
+    const char sep = '/';
+#endif
+    std::string p = dir;
+    if (!p.empty() && p[p.size() - 1] != '/' && p[p.size() - 1] != sep) p += sep;
+    return p + prefix + "_" + hex + ".bin";
+}
+
+} // namespace detail
+
+// Reads the table stored under `key`. Returns false (and leaves `data`
+// untouched) if there is none or it does not match the key.
+inline bool load(const std::string &dir, const std::string &prefix, uint64_t key,
+                 std::vector<double> &data)
+{
+    if (dir.empty()) return false;
+    std::FILE *f = std::fopen(detail::path(dir, prefix, key).c_str(), "rb");
+    if (!f) return false;
+    char magic[8];
+    uint64_t k = 0, n = 0;
+    bool ok = std::fread(magic, 1, 8, f) == 8 && !std::memcmp(magic, detail::kMagic, 8) &&
+              std::fread(&k, sizeof k, 1, f) == 1 && k == key &&
+              std::fread(&n, sizeof n, 1, f) == 1 && n < (uint64_t(1) << 40);
+    if (ok) {
+        std::vector<double> buf(static_cast<std::size_t>(n));
+        ok = std::fread(buf.data(), sizeof(double), buf.size(), f) == buf.size() &&
+             std::fgetc(f) == EOF;
+        if (ok) data.swap(buf);
+    }
+    std::fclose(f);
+    return ok;
+}
+
+// Stores `data` under `key`. Returns false if the table could not be written.
+inline bool store(const std::string &dir, const std::string &prefix, uint64_t key,
+                  const std::vector<double> &data)
+{
+    if (dir.empty()) return false;
+    const std::string target = detail::path(dir, prefix, key);
+    char tag[32];
+    std::sprintf(tag, ".%p.tmp", static_cast<const void *>(&data));
+    const std::string tmp = target + tag;
+    std::FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    const uint64_t n = data.size();
+    bool ok = std::fwrite(detail::kMagic, 1, 8, f) == 8 &&
+              std::fwrite(&key, sizeof key, 1, f) == 1 &&
+              std::fwrite(&n, sizeof n, 1, f) == 1 &&
+              std::fwrite(data.data(), sizeof(double), data.size(), f) == data.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (ok) {
+#ifdef _WIN32
+        std::remove(target.c_str());   // rename does not replace on Windows
+#endif
+        ok = std::rename(tmp.c_str(), target.c_str()) == 0;
+    }
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
+}
+
+} // namespace cache
+} // namespace qmr
+
+#endif
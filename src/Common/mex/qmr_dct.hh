@@ -0,0 +1,160 @@
+/*
+ * qmr_dct.hh: orthonormal N-D discrete cosine transforms shared by the
+ * qMRLab MEX engines.
+ *
+ * Dct is the DCT-II of a column-major array along each of its dimensions,
+ * as dctn of smoothn.m, and its inverse (DCT-III), as idctn. Each axis
+ * holds a complex Plan1d of its length (qmr_fft.hh) built once, so a Dct
+ * can be reused for any number of transforms of that size.
+ *
+ * Lines go through Makhoul's reordering: the even samples followed by the
+ * odd ones reversed, whose FFT gives the DCT after a quarter-sample
+ * twiddle. Two real lines share one complex FFT (one as the real part,
+ * the other as the imaginary part), so a line costs half a complex FFT.
+ * Strided axes gather neighbouring lines in batches, as RealFft3d does,
+ * and batches run in parallel.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_DCT_HH
+#define QMR_DCT_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "qmr_fft.hh"
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace fft {
+
+class Dct {
+public:
+    explicit Dct(const std::vector<std::size_t> &dims, int nthreads = 0) : dims_(dims), size_(1), nthreads_(nthreads)
+    {
+        std::size_t stride = 1;
+        for (std::size_t d = 0; d < dims_.size(); ++d) {
+            const std::size_t n = dims_[d];
+            size_ *= n;
+            if (n > 1) {
+                Axis a;
+                a.n = n;
+                a.stride = stride;
+                a.plan = Plan1d(n);
+                a.w.resize(n);
+                for (std::size_t k = 0; k < n; ++k)
+                    a.w[k] = cplx(std::cos(kPi * k / (2.0 * n)), -std::sin(kPi * k / (2.0 * n)));
+                axes_.push_back(a);
+            }
+            stride *= n;
+        }
+    }
+
+    const std::vector<std::size_t> &dims() const { return dims_; }
+    std::size_t size() const { return size_; }
+    int threads() const { return nthreads_; }
+
+    // x = dctn(x), in place.
+    void forward(double *x) const
+    {
+        for (std::size_t i = 0; i < axes_.size(); ++i) transform(x, axes_[i], false);
+    }
+
+    // x = idctn(x), in place.
+    void inverse(double *x) const
+    {
+        for (std::size_t i = 0; i < axes_.size(); ++i) transform(x, axes_[i], true);
+    }
+
+private:
+    static const std::size_t kBatch = 8;
+
+    struct Axis {
+        std::size_t n, stride;
+        Plan1d plan;
+        std::vector<cplx> w;   // exp(-i*pi*k/(2n))
+    };
+
+    void transform(double *x, const Axis &a, bool inverse) const
+    {
+        const std::size_t n = a.n, lines = size_ / n, nb = (lines + kBatch - 1) / kBatch;
+        const std::size_t grain = std::max<std::size_t>(1, nb / (4 * (std::size_t)num_threads(nthreads_)));
+        parallel_for(nb, grain, [&](std::size_t b, std::size_t e, int) {
+            std::vector<double> buf(kBatch * n);
+            std::vector<cplx> z(n), work(a.plan.workSize());
+            std::size_t off[kBatch];
+            for (std::size_t t = b; t < e; ++t) {
+                const std::size_t l0 = t * kBatch, nl = std::min(kBatch, lines - l0);
+                for (std::size_t i = 0; i < nl; ++i)
+                    off[i] = (l0 + i) / a.stride * a.stride * n + (l0 + i) % a.stride;
+                for (std::size_t j = 0; j < n; ++j)
+                    for (std::size_t i = 0; i < nl; ++i) buf[i * n + j] = x[off[i] + j * a.stride];
+                for (std::size_t i = 0; i < nl; i += 2) {
+                    double *p = &buf[i * n], *q = i + 1 < nl ? &buf[(i + 1) * n] : NULL;
+                    if (inverse) dct3Pair(a, p, q, &z[0], &work[0]);
+                    else dct2Pair(a, p, q, &z[0], &work[0]);
+                }
+                for (std::size_t j = 0; j < n; ++j)
+                    for (std::size_t i = 0; i < nl; ++i) x[off[i] + j * a.stride] = buf[i * n + j];
+            }
+        }, nthreads_);
+    }
+
+    // Orthonormal DCT-II of the lines p and q (q may be NULL), in place.
+    static void dct2Pair(const Axis &a, double *p, double *q, cplx *z, cplx *work)
+    {
+        const std::size_t n = a.n, h = (n + 1) / 2;
+        for (std::size_t j = 0; j < h; ++j) z[j] = cplx(p[2 * j], q ? q[2 * j] : 0);
+        for (std::size_t j = 0; j < n / 2; ++j) z[n - 1 - j] = cplx(p[2 * j + 1], q ? q[2 * j + 1] : 0);
+        a.plan.forward(z, work);
+        const double s0 = std::sqrt(1.0 / n), s = std::sqrt(2.0 / n);
+        for (std::size_t k = 0; k < n; ++k) {
+            const cplx zk = z[k], zc = std::conj(z[(n - k) % n]);
+            const cplx va = 0.5 * (zk + zc), d = zk - zc;
+            const cplx vb(0.5 * d.imag(), -0.5 * d.real());   // d / (2i)
+            const cplx &w = a.w[k];
+            const double c = k ? s : s0;
+            p[k] = c * (w.real() * va.real() - w.imag() * va.imag());
+            if (q) q[k] = c * (w.real() * vb.real() - w.imag() * vb.imag());
+        }
+    }
+
+    // Orthonormal DCT-III (inverse of dct2Pair) of the lines p and q.
+    static void dct3Pair(const Axis &a, double *p, double *q, cplx *z, cplx *work)
+    {
+        const std::size_t n = a.n;
+        const double s0 = std::sqrt((double)n), s = std::sqrt(n / 2.0);
+        z[0] = cplx(s0 * p[0], q ? s0 * q[0] : 0);
+        for (std::size_t k = 1; k < n; ++k) {
+            // V_k = conj(w_k) * (C_k - i*C_{n-k}) for each line, packed as Va + i*Vb.
+            const cplx wc = std::conj(a.w[k]);
+            const cplx va = mul(wc, cplx(s * p[k], -s * p[n - k]));
+            const cplx vb = q ? mul(wc, cplx(s * q[k], -s * q[n - k])) : cplx(0, 0);
+            z[k] = cplx(va.real() - vb.imag(), va.imag() + vb.real());
+        }
+        a.plan.inverse(z, work);
+        const double scale = 1.0 / n;
+        const std::size_t h = (n + 1) / 2;
+        for (std::size_t j = 0; j < h; ++j) {
+            p[2 * j] = z[j].real() * scale;
+            if (q) q[2 * j] = z[j].imag() * scale;
+        }
+        for (std::size_t j = 0; j < n / 2; ++j) {
+            p[2 * j + 1] = z[n - 1 - j].real() * scale;
+            if (q) q[2 * j + 1] = z[n - 1 - j].imag() * scale;
+        }
+    }
+
+    std::vector<std::size_t> dims_;
+    std::size_t size_;
+    int nthreads_;
+    std::vector<Axis> axes_;
+};
+
+} // namespace fft
+} // namespace qmr
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * DICOM headers and pixel data of many files, read in parallel (see
+ * qmr_dicom.hh). Use through qMRdicmHdr.m, which dicm2nii.m and
+ * sort_dicm.m call to validate a folder of files.
+ *
+ *   [hh, errStr, redo] = qmr_dicm_mex('headers', fnames, dict, opts)
+ *   img                = qmr_dicm_mex('img', hdrs, opts)
+ *
+ * 'headers' reads every file of fnames (cellstr) as dicm_hdr(fname,
+ * dict) does, dict being a partial dictionary from dicm_dict(vendor,
+ * fields): hh{k} and errStr{k} are the header struct ([] if none) and
+ * the error information ('' if none). redo(k) is true for files left to
+ * dicm_hdr (then hh{k} is [] and errStr{k} ''): files that are not DICOM,
+ * whose Manufacturer is not that of dict, or whose header dicm_hdr
+ * decodes further (multi-frame, CSA).
+ *
+ * 'img' reads the uncompressed pixel data of the headers hdrs (cell, as
+ * returned by dicm_hdr) as dicm_img(hdrs{k}, 0) does, into one
+ * [Columns Rows SamplesPerPixel frames numel(hdrs)] array. It returns []
+ * if any file needs dicm_img: compressed data, or files that differ in
+ * size or data type.
+ *
+ * opts is an optional struct with NumThreads (0: all cores).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "mex.h"
+#include "qmr_dicom.hh"
+#include "qmr_mex.hh"
+#include "qmr_parallel.hh"
+
+static const char *kName = "qmr_dicm_mex";
+
+namespace {
+
+std::vector<std::string> fileNames(const mxArray *a)
+{
+    if (!mxIsCell(a)) qmr::mex::fail(kName, "invalidInputType", "fnames must be a cell array of file names.");
+    std::vector<std::string> out(mxGetNumberOfElements(a));
+    for (std::size_t k = 0; k < out.size(); ++k) {
+        const mxArray *c = mxGetCell(a, k);
+        if (!c || !mxIsChar(c)) qmr::mex::fail(kName, "invalidInputType", "fnames must be a cell array of file names.");
+        out[k] = qmr::mex::string(kName, c, "fnames");
+    }
+    return out;
+}
+
+qmr::dicom::Dict dictionary(const mxArray *a)
+{
+    static const char *fields[] = {"vendor", "tag", "group", "element", "vr", "name"};
+    if (!mxIsStruct(a) || mxGetNumberOfElements(a) != 1)
+        qmr::mex::fail(kName, "invalidInputType", "dict must be a dictionary from dicm_dict.");
+    for (std::size_t f = 0; f < sizeof fields / sizeof fields[0]; ++f)
+        if (!mxGetField(a, 0, fields[f]))
+            qmr::mex::fail(kName, "invalidInputType", std::string("dict has no field ") + fields[f] + ".");
+
+    qmr::dicom::Dict dict;
+    const mxArray *vendor = mxGetField(a, 0, "vendor");
+    if (mxIsChar(vendor) && !mxIsEmpty(vendor)) dict.vendor = qmr::mex::string(kName, vendor, "dict.vendor");
+    const std::vector<double> tag = qmr::mex::toVector(mxGetField(a, 0, "tag"));
+    const std::vector<double> group = qmr::mex::toVector(mxGetField(a, 0, "group"));
+    const std::vector<double> element = qmr::mex::toVector(mxGetField(a, 0, "element"));
+    const mxArray *vr = mxGetField(a, 0, "vr"), *name = mxGetField(a, 0, "name");
+    const std::size_t n = tag.size();
+    if (group.size() != n || element.size() != n || !mxIsCell(vr) || !mxIsCell(name) ||
+        mxGetNumberOfElements(vr) != n || mxGetNumberOfElements(name) != n)
+        qmr::mex::fail(kName, "invalidInputSize", "dict fields tag, group, element, vr and name must match.");
+    dict.entries.resize(n);
+    for (std::size_t k = 0; k < n; ++k) {
+        qmr::dicom::Entry &e = dict.entries[k];
+        e.tag = (uint32_t)tag[k];
+        e.group = (uint16_t)group[k];
+        e.element = (uint16_t)element[k];
+        e.vr = qmr::mex::string(kName, mxGetCell(vr, k), "dict.vr");
+        e.name = qmr::mex::string(kName, mxGetCell(name, k), "dict.name");
+    }
+    return dict;
+}
+
+mxClassID classOf(const std::string &cls)
+{
+    if (cls == "uint8") return mxUINT8_CLASS;
+    if (cls == "uint16") return mxUINT16_CLASS;
+    if (cls == "int16") return mxINT16_CLASS;
+    if (cls == "uint32") return mxUINT32_CLASS;
+    if (cls == "int32") return mxINT32_CLASS;
+    if (cls == "single") return mxSINGLE_CLASS;
+    return mxDOUBLE_CLASS;
+}
+
+// Characters as char(uint8): one byte per character, no decoding.
+mxArray *charRow(const std::string &s)
+{
+    const mwSize dims[2] = {(mwSize)(s.empty() ? 0 : 1), (mwSize)s.size()};
+    mxArray *a = mxCreateCharArray(2, dims);
+    mxChar *c = mxGetChars(a);
+    for (std::size_t k = 0; k < s.size(); ++k) c[k] = (mxChar)(unsigned char)s[k];
+    return a;
+}
+
+mxArray *toArray(const qmr::dicom::Header &h, std::size_t index)
+{
+    const qmr::dicom::Value &v = h.values[index];
+    switch (v.kind) {
+    case qmr::dicom::Value::kText:
+        return charRow(v.bytes);
+    case qmr::dicom::Value::kNumbers: {
+        mxArray *a = mxCreateDoubleMatrix(v.numbers.size(), 1, mxREAL);
+        std::copy(v.numbers.begin(), v.numbers.end(), mxGetPr(a));
+        return a;
+    }
+    case qmr::dicom::Value::kBinary: {
+        const std::size_t n = v.bytes.size() / qmr::dicom::detail::classBytes(v.cls);
+        mxArray *a = mxCreateNumericMatrix(n, 1, classOf(v.cls), mxREAL);
+        if (n) std::memcpy(mxGetData(a), v.bytes.data(), v.bytes.size());
+        return a;
+    }
+    default: {
+        mxArray *s = mxCreateStructMatrix(1, 1, 0, NULL);
+        for (std::size_t f = 0; f < v.fields.size(); ++f) {
+            const int k = mxAddField(s, v.fields[f].first.c_str());
+            mxSetFieldByNumber(s, 0, k, toArray(h, v.fields[f].second));
+        }
+        return s;
+    }
+    }
+}
+
+void headers(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 3 || nrhs > 4)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_dicm_mex('headers', fnames, dict, opts).");
+    const std::vector<std::string> fnames = fileNames(prhs[1]);
+    const qmr::dicom::Dict dict = dictionary(prhs[2]);
+    const int nthreads = (int)qmr::mex::option(nrhs > 3 ? prhs[3] : NULL, "NumThreads", 0.0);
+
+    std::vector<qmr::dicom::Header> hh(fnames.size());
+    qmr::parallel_for(fnames.size(), 8, [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t k = b; k < e; ++k) qmr::dicom::parse(fnames[k], dict, hh[k]);
+    }, nthreads);
+
+    plhs[0] = mxCreateCellMatrix(1, fnames.size());
+    mxArray *info = mxCreateCellMatrix(1, fnames.size());
+    mxArray *redo = mxCreateLogicalMatrix(1, fnames.size());
+    for (std::size_t k = 0; k < fnames.size(); ++k) {
+        const qmr::dicom::Header &h = hh[k];
+        mxSetCell(plhs[0], k, h.empty || h.redo ? mxCreateDoubleMatrix(0, 0, mxREAL) : toArray(h, 0));
+        mxSetCell(info, k, charRow(h.redo ? std::string() : h.info));
+        mxGetLogicals(redo)[k] = h.redo;
+    }
+    if (nlhs > 1) plhs[1] = info;
+    else mxDestroyArray(info);
+    if (nlhs > 2) plhs[2] = redo;
+    else mxDestroyArray(redo);
+}
+
+// Numeric scalar field of a struct; false if missing or not a scalar.
+bool field(const mxArray *s, const char *name, double &value)
+{
+    const mxArray *f = mxGetField(s, 0, name);
+    if (!f || mxGetNumberOfElements(f) != 1 || !(mxIsNumeric(f) || mxIsLogical(f))) return false;
+    value = mxGetScalar(f);
+    return true;
+}
+
+// Layout of the pixels of one header, following dicm_img. False if
+// dicm_img is needed.
+bool pixelsOf(const mxArray *s, qmr::dicom::Pixels &p, std::string &cls, std::string &path)
+{
+    if (!mxIsStruct(s) || mxGetNumberOfElements(s) != 1) return false;
+    const mxArray *px = mxGetField(s, 0, "PixelData"), *name = mxGetField(s, 0, "Filename");
+    double rows, columns;
+    if (!px || !mxIsStruct(px) || !name || !mxIsChar(name) || !field(s, "Rows", rows) ||
+        !field(s, "Columns", columns))
+        return false;
+    path = qmr::mex::string(kName, name, "Filename");
+    static const char *scalars[] = {"SamplesPerPixel", "BitsAllocated", "PlanarConfiguration", "PixelRepresentation"};
+    for (std::size_t k = 0; k < sizeof scalars / sizeof scalars[0]; ++k) {
+        double ignored;
+        if (mxGetField(s, 0, scalars[k]) && !field(s, scalars[k], ignored)) return false;
+    }
+    double spp = 1, bpp = 0, start, bytes;
+    field(s, "SamplesPerPixel", spp);
+    if (!field(px, "Start", start) || !field(px, "Bytes", bytes)) return false;
+
+    const bool hasBits = field(s, "BitsAllocated", bpp);
+    const mxArray *format = mxGetField(px, 0, "Format");
+    if (format) {
+        if (!mxIsChar(format) || mxIsEmpty(format)) return false;
+        cls = qmr::mex::string(kName, format, "Format");
+        if (cls[0] == '*') cls.erase(0, 1);
+        if (hasBits) {
+            if (bpp == 8 && cls == "uint16") cls = "uint8";    // ugly fix
+            else if (bpp == 16 && cls == "uint8") cls = "uint16";
+        } else {
+            bpp = 8.0 * qmr::dicom::detail::classBytes(cls);
+        }
+    } else if (hasBits) {
+        char c[32];
+        std::sprintf(c, "uint%g", bpp);
+        cls = c;
+    } else {
+        return false;
+    }
+    if (cls != "uint8" && cls != "uint16" && cls != "uint32" && cls != "single" && cls != "double") return false;
+    p.bytes = qmr::dicom::detail::classBytes(cls);
+    if (bpp != 8.0 * p.bytes) return false;
+
+    std::string ts = "1.2.840.10008.1.2.1";    // files other than dicom
+    const mxArray *uid = mxGetField(s, 0, "TransferSyntaxUID");
+    if (uid) {
+        if (!mxIsChar(uid)) return false;
+        ts = qmr::mex::string(kName, uid, "TransferSyntaxUID");
+    }
+    if (ts != "1.2.840.10008.1.2.1" && ts != "1.2.840.10008.1.2.2" && ts != "1.2.840.10008.1.2") return false;
+    p.swap = ts == "1.2.840.10008.1.2.2";
+
+    const double n = bytes / p.bytes, frames = n / spp / columns / rows;
+    if (n != std::floor(n) || !(frames >= 1) || frames != std::floor(frames) || start < 0) return false;
+    p.start = (int64_t)start;
+    p.count = (int64_t)n;
+    p.columns = (int64_t)columns;
+    p.rows = (int64_t)rows;
+    p.spp = (int64_t)spp;
+    p.frames = (int64_t)frames;
+    double planar = 0;
+    p.planar = field(s, "PlanarConfiguration", planar) && planar != 0;
+
+    // bitshift(img, BitsStored-HighBit-1), in the class of the fields
+    p.shift = 0;
+    const mxArray *stored = mxGetField(s, 0, "BitsStored"), *high = mxGetField(s, 0, "HighBit"),
+                  *allocated = mxGetField(s, 0, "BitsAllocated");
+    if (stored && high && allocated) {
+        double bs, hb, ba;
+        if (!field(s, "BitsStored", bs) || !field(s, "HighBit", hb) || !field(s, "BitsAllocated", ba)) return false;
+        const mxClassID c = mxGetClassID(stored);
+        if (mxGetClassID(high) != c || mxGetClassID(allocated) != c) return false;
+        double hb1 = hb + 1, shift = bs - hb - 1;
+        if (c == mxUINT16_CLASS) {    // saturating integer arithmetic
+            hb1 = std::min(hb1, 65535.0);
+            shift = std::max(std::max(bs - hb, 0.0) - 1, 0.0);
+        } else if (c != mxDOUBLE_CLASS) {
+            return false;
+        }
+        if (bs != hb1 && bs != ba && shift != 0) {
+            if (cls[0] != 'u' || std::fabs(shift) >= 8.0 * p.bytes) return false;
+            p.shift = (int)shift;
+        }
+    }
+
+    double signedData = 0;
+    if (field(s, "PixelRepresentation", signedData) && signedData > 0) {
+        if (cls[0] != 'u') return false;
+        cls.erase(0, 1);    // typecast to int*
+    }
+    return true;
+}
+
+void img(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 2 || nrhs > 3) qmr::mex::fail(kName, "wrongNumInputs", "qmr_dicm_mex('img', hdrs, opts).");
+    if (!mxIsCell(prhs[1])) qmr::mex::fail(kName, "invalidInputType", "hdrs must be a cell array of headers.");
+    const int nthreads = (int)qmr::mex::option(nrhs > 2 ? prhs[2] : NULL, "NumThreads", 0.0);
+    const std::size_t nFile = mxGetNumberOfElements(prhs[1]);
+
+    std::vector<qmr::dicom::Pixels> pixels(nFile);
+    std::vector<std::string> paths(nFile);
+    std::string cls;
+    bool ok = nFile > 0;
+    for (std::size_t k = 0; ok && k < nFile; ++k) {
+        std::string c;
+        const mxArray *s = mxGetCell(prhs[1], k);
+        ok = s && pixelsOf(s, pixels[k], c, paths[k]);
+        if (ok && k) {
+            const qmr::dicom::Pixels &a = pixels[0], &b = pixels[k];
+            ok = c == cls && a.columns == b.columns && a.rows == b.rows && a.spp == b.spp && a.frames == b.frames;
+        }
+        if (k == 0) cls = c;
+    }
+    if (!ok) {
+        plhs[0] = mxCreateDoubleMatrix(0, 0, mxREAL);
+        return;
+    }
+
+    const qmr::dicom::Pixels &p = pixels[0];
+    const mwSize dims[5] = {(mwSize)p.columns, (mwSize)p.rows, (mwSize)p.spp, (mwSize)p.frames, (mwSize)nFile};
+    plhs[0] = mxCreateNumericArray(5, dims, classOf(cls), mxREAL);
+    unsigned char *out = static_cast<unsigned char *>(mxGetData(plhs[0]));
+    const std::size_t perFile = (std::size_t)p.count * p.bytes;
+    std::vector<char> failed(nFile, 0);
+    qmr::parallel_for(nFile, 1, [&](std::size_t b, std::size_t e, int) {
+        std::string error;
+        for (std::size_t k = b; k < e; ++k)
+            failed[k] = !qmr::dicom::readPixels(paths[k], pixels[k], out + k * perFile, error);
+    }, nthreads);
+    for (std::size_t k = 0; k < nFile; ++k)
+        if (failed[k]) {    // dicm_img reports it
+            mxDestroyArray(plhs[0]);
+            plhs[0] = mxCreateDoubleMatrix(0, 0, mxREAL);
+            return;
+        }
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 2)
+        qmr::mex::fail(kName, "wrongNumInputs", "Usage: qmr_dicm_mex(command, ...), command 'headers' or 'img'.");
+    const std::string cmd = qmr::mex::string(kName, prhs[0], "command");
+    if (cmd == "headers") headers(nlhs, plhs, nrhs, prhs);
+    else if (cmd == "img") img(plhs, nrhs, prhs);
+    else qmr::mex::fail(kName, "unknownCommand", "Unknown command '" + cmd + "' (use 'headers' or 'img').");
+}
@@ -0,0 +1,810 @@
+/*
+ * qmr_dicom.hh: DICOM header parser and pixel reader mirroring dicm_hdr.m
+ * and dicm_img.m (External/dicm2nii), for reading many files in parallel.
+ *
+ * parse() follows dicm_hdr step by step for a partial dictionary (as
+ * returned by dicm_dict(vendor, fields)): the same search for the
+ * transfer syntax and the pixel data (over the same growing prefix of
+ * the file), the same tag search for short headers and the same walk
+ * through the tags and sequences otherwise, and the same value decoding
+ * (DS/IS as numbers, text deblanked, binary values typecast). The file
+ * is mapped (qmr_mapped.hh) rather than read, so a header costs the
+ * pages it touches. What dicm_hdr does beyond that is not repeated: a
+ * file is marked `redo`, for dicm_hdr to read, when it is not DICOM
+ * (PAR, HEAD, ...), when its Manufacturer would make dicm_hdr switch
+ * dictionaries, when it holds a per-frame functional group sequence, a
+ * Siemens CSA or GE protocol header to decode, or when dicm_hdr would
+ * index past what it has read.
+ *
+ * readPixels() copies the uncompressed pixel data of a file, laid out as
+ * dicm_img(s, 0) returns it.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_DICOM_HH
+#define QMR_DICOM_HH
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include "qmr_mapped.hh"
+
+namespace qmr {
+namespace dicom {
+
+// One entry of a dicm_dict dictionary.
+struct Entry {
+    uint32_t tag;
+    uint16_t group, element;
+    std::string vr, name;
+};
+
+struct Dict {
+    std::string vendor;
+    std::vector<Entry> entries;    // in dicm_dict order (sorted by tag)
+
+    const Entry *find(uint32_t tag) const
+    {
+        for (std::size_t k = 0; k < entries.size(); ++k)
+            if (entries[k].tag == tag) return &entries[k];
+        return NULL;
+    }
+    bool hasVR(const char *vr) const
+    {
+        for (std::size_t k = 0; k < entries.size(); ++k)
+            if (entries[k].vr == vr) return true;
+        return false;
+    }
+    bool hasPrivate() const
+    {
+        for (std::size_t k = 0; k < entries.size(); ++k)
+            if (entries[k].group % 2) return true;
+        return false;
+    }
+};
+
+// A decoded value: text, numbers from DS/IS, typecast binary data (a
+// column of class `cls`, host byte order) or a struct whose fields are
+// other values of the header.
+struct Value {
+    enum Kind { kText, kNumbers, kBinary, kStruct };
+    Kind kind;
+    std::string bytes;                                          // kText, kBinary
+    std::string cls;                                            // kBinary
+    std::vector<double> numbers;                                // kNumbers
+    std::vector<std::pair<std::string, std::size_t> > fields;   // kStruct: name, index in Header::values
+
+    static Value text(const std::string &s)
+    {
+        Value v;
+        v.kind = kText;
+        v.bytes = s;
+        return v;
+    }
+    static Value number(double x)
+    {
+        Value v;
+        v.kind = kNumbers;
+        v.numbers.assign(1, x);
+        return v;
+    }
+};
+
+// What dicm_hdr returns for a file: the header struct (values[0], unless
+// `empty`) and the error information. `redo` marks files left to dicm_hdr.
+struct Header {
+    std::vector<Value> values;
+    std::string info;
+    bool empty, redo;
+
+    Header() : empty(true), redo(false) {}
+
+    std::size_t newStruct()
+    {
+        Value v;
+        v.kind = Value::kStruct;
+        values.push_back(v);
+        return values.size() - 1;
+    }
+    // s.(name) = values[index], keeping the position of an existing field.
+    void link(std::size_t node, const std::string &name, std::size_t index)
+    {
+        std::vector<std::pair<std::string, std::size_t> > &f = values[node].fields;
+        for (std::size_t k = 0; k < f.size(); ++k)
+            if (f[k].first == name) {
+                f[k].second = index;
+                return;
+            }
+        f.push_back(std::make_pair(name, index));
+    }
+    void set(std::size_t node, const std::string &name, const Value &v)
+    {
+        values.push_back(v);
+        link(node, name, values.size() - 1);
+    }
+    const Value *get(std::size_t node, const std::string &name) const
+    {
+        const std::vector<std::pair<std::string, std::size_t> > &f = values[node].fields;
+        for (std::size_t k = 0; k < f.size(); ++k)
+            if (f[k].first == name) return &values[f[k].second];
+        return NULL;
+    }
+};
+
+namespace detail {
+
+static const uint32_t kItem = 4294893568u;        // FFFE E000
+static const uint32_t kItemEnd = 4294893581u;     // FFFE E00D
+static const uint32_t kPerFrameSQ = 1375769136u;  // 5200 9230
+static const int64_t kUndefined = 4294967295LL;   // 0xFFFF FFFF
+
+// Trailing whitespace and NUL removed, as deblank.
+inline std::string deblank(const unsigned char *p, std::size_t n)
+{
+    while (n) {
+        const unsigned char c = p[n - 1];
+        if (c == 0 || c == ' ' || (c >= 9 && c <= 13) || c == 133 || c == 160) --n;
+        else break;
+    }
+    return std::string(reinterpret_cast<const char *>(p), n);
+}
+
+// sscanf(s, '%f\\'): numbers separated by backslashes, up to the first
+// that does not parse.
+inline std::vector<double> scanNumbers(const std::string &s)
+{
+    std::vector<double> out;
+    const char *p = s.c_str();
+    for (;;) {
+        char *end = NULL;
+        double x = std::strtod(p, &end);
+        if (end == p) break;
+        const char *x0 = std::find(p, (const char *)end, 'x'), *X0 = std::find(p, (const char *)end, 'X');
+        if (x0 != end || X0 != end) {
+            // sscanf stops at the x of hexadecimal notation
+            out.push_back(std::strtod(std::string(p, std::min(x0, X0)).c_str(), NULL));
+            break;
+        }
+        out.push_back(x);
+        if (*end != '\\') break;
+        p = end + 1;
+    }
+    return out;
+}
+
+inline bool strncmpi2(const std::string &a, const std::string &b)
+{
+    if (a.size() < 2 || b.size() < 2) {
+        if (a.size() != b.size()) return false;
+        for (std::size_t k = 0; k < a.size(); ++k)
+            if (std::tolower((unsigned char)a[k]) != std::tolower((unsigned char)b[k])) return false;
+        return true;
+    }
+    return std::tolower((unsigned char)a[0]) == std::tolower((unsigned char)b[0]) &&
+           std::tolower((unsigned char)a[1]) == std::tolower((unsigned char)b[1]);
+}
+
+// str2double of a whole string (NaN unless it is one number).
+inline double str2double(const std::string &s)
+{
+    const char *p = s.c_str();
+    char *end = NULL;
+    const double x = std::strtod(p, &end);
+    if (end == p || s.find_first_of("xX") != std::string::npos) return std::numeric_limits<double>::quiet_NaN();
+    while (*end == ' ' || (*end >= 9 && *end <= 13)) ++end;
+    return end == p + s.size() ? x : std::numeric_limits<double>::quiet_NaN();
+}
+
+// Numeric class of a VR, as vr2fmt; empty if none.
+inline std::string vr2fmt(const std::string &vr)
+{
+    static const char *table[][2] = {{"US", "uint16"}, {"OB", "uint8"},  {"FD", "double"}, {"SS", "int16"},
+                                     {"UL", "uint32"}, {"SL", "int32"},  {"FL", "single"}, {"AT", "uint16"},
+                                     {"OW", "uint16"}, {"OF", "single"}, {"OD", "double"}, {"UN", "uint8"}};
+    for (std::size_t k = 0; k < sizeof table / sizeof table[0]; ++k)
+        if (vr == table[k][0]) return table[k][1];
+    return "";
+}
+
+inline std::size_t classBytes(const std::string &cls)
+{
+    if (cls == "uint8" || cls == "int8") return 1;
+    if (cls == "uint16" || cls == "int16") return 2;
+    if (cls == "uint32" || cls == "int32" || cls == "single") return 4;
+    return 8;
+}
+
+// strfind of a two-character VR in one of dicm_hdr's VR lists.
+inline bool inList(const char *list, const std::string &vr)
+{
+    return vr.size() == 2 && std::strstr(list, vr.c_str()) != NULL;
+}
+
+// Follows dicm_hdr on one file. Indices are 1-based, as in dicm_hdr.
+class Parser {
+public:
+    Parser(const unsigned char *data, int64_t size, const Dict &dict, Header &h)
+        : data_(data), fSize_(size), len_(0), bcLen_(0), dict_(dict), h_(h), expl_(false), be_(false),
+          iPixelData_(0), bytes_(0), hasVR_(false), hasFrames_(false), nFrames_(0)
+    {}
+
+    void run(const std::string &fname)
+    {
+        if (fSize_ < 140) {    // 132 + one empty tag, ignore truncated
+            h_.info = "Invalid file: " + fname;
+            return;
+        }
+        int64_t requested = 130000;
+        len_ = std::min(requested, fSize_);
+
+        int64_t iTagStart = 132;
+        bool isDicm = std::memcmp(data_ + 128, "DICM", 4) == 0;
+        if (!isDicm) {
+            const double group = b(1) + b(2) * 256.0;
+            isDicm = group == 2 || group == 8;
+            iTagStart = 0;
+        }
+        if (!isDicm) {
+            notDicom(fname);
+            return;
+        }
+
+        // Transfer syntax first, so the pixel data can be found
+        static const unsigned char uid[6] = {2, 0, 16, 0, 'U', 'I'};
+        std::string tsUID;
+        const std::vector<int64_t> at = find(uid, 6, len_, false);
+        if (!at.empty()) {
+            const int64_t i = at[0] + 6;
+            const int64_t n = (int64_t)int16(i, false);
+            std::string t;
+            for (int64_t k = 1; k <= n; ++k) t += (char)b(i + 1 + k);
+            tsUID = deblank((const unsigned char *)t.data(), t.size());
+            expl_ = tsUID != "1.2.840.10008.1.2";
+            be_ = tsUID == "1.2.840.10008.1.2.2";
+        }
+
+        // Pixel data: the last candidate whose length ends the file, looking
+        // at a growing prefix as dicm_hdr does
+        unsigned char tg[4] = {224, 127, 16, 0};
+        if (be_) swapPairs(tg);
+        static const double more[4] = {0, 2e6, 20e6, -1};
+        bool found = false, eof = requested > fSize_;
+        for (int s = 0; s < 4 && !h_.redo; ++s) {
+            requested += more[s] < 0 ? fSize_ : (int64_t)more[s];
+            len_ = std::min(requested, fSize_);
+            eof = requested > fSize_;
+            std::vector<int64_t> i = find(tg, 4, len_, true);
+            if (i.empty() && eof) {
+                unsigned char sd[4] = {0, 86, 32, 0};    // SpectroscopyData
+                if (be_) swapPairs(sd);
+                i = find(sd, 4, len_, true);
+            }
+            for (std::size_t c = i.size(); c-- > 0;) {
+                const int64_t k = i[c];
+                if (expl_) {
+                    pixelVR_ = std::string(1, (char)b(k + 4)) + (char)b(k + 5);
+                    hasVR_ = true;
+                }
+                iPixelData_ = k + (expl_ ? 4 : 0) + 7;
+                if (len_ < iPixelData_) {
+                    requested += 12;
+                    len_ = std::min(requested, fSize_);
+                    eof = requested > fSize_;
+                }
+                bytes_ = int32(iPixelData_ - 3, be_);
+                if (bytes_ == kUndefined && eof) break;    // compressed
+                const double d = (double)fSize_ - iPixelData_ - bytes_;
+                if (d >= 0 && d < 16) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found) break;
+            if (eof) {
+                if (i.empty()) iPixelData_ = fSize_ + 1;    // no PixelData
+                break;
+            }
+        }
+        if (h_.redo) return;
+
+        h_.empty = false;
+        h_.values.clear();
+        h_.newStruct();
+        h_.set(0, "Filename", Value::text(fname));
+        h_.set(0, "FileSize", Value::number((double)fSize_));
+
+        const std::size_t nTag = dict_.entries.size();
+        bool toSearch = nTag < 2 || (nTag < 30 && !dict_.hasVR("SQ") && iPixelData_ < 1000000);
+        if (toSearch) {
+            if (!tsUID.empty()) h_.set(0, "TransferSyntaxUID", Value::text(tsUID));
+            toSearch = search();
+            if (h_.redo) return;
+        }
+
+        int64_t i = iTagStart + 1, iPre = 0;
+        bool haveName = false;
+        std::string name;
+        while (!toSearch && !h_.redo) {
+            if (i >= iPixelData_) {
+                if (!haveName) h_.redo = true;    // dicm_hdr would fail
+                else if (name == "PixelData") {    // iPixelData might be in img
+                    iPixelData_ = iPre + (expl_ ? 4 : 0) + 7;
+                    bytes_ = int32(iPixelData_ - 3, be_);
+                } else if (iPixelData_ < fSize_) {
+                    h_.info = "End of file reached: likely error: " + fname;
+                }
+                break;
+            }
+            iPre = i;
+            Item it = readItem(i);
+            haveName = true;
+            name = it.named ? it.name : std::string();
+            if (h_.redo || !it.info.empty()) {
+                h_.info = it.info;
+                break;
+            }
+            h_.info = it.info;
+            if (nTag && it.tag > dict_.entries[nTag - 1].tag) break;    // done for partial hdr
+            if (!it.hasValue || !it.named) continue;
+            h_.link(0, it.name, it.value);
+            const Value &v = h_.values[it.value];
+            if (it.name == "Manufacturer") {
+                updateVendor(v);
+            } else if (it.tag >= 2621697 && !hasFrames_) {    // BitsAllocated
+                // get_nFrames: only needs the pixel data size
+                hasFrames_ = true;
+                if (!h_.get(0, "NumberOfFrames") && h_.get(0, "Columns") && h_.get(0, "Rows") &&
+                    h_.get(0, "BitsAllocated") && iPixelData_ == fSize_ + 1)
+                    h_.redo = true;
+            }
+        }
+        if (h_.redo) return;
+
+        if (iPixelData_ < fSize_ + 1) {
+            if (h_.get(0, "PixelData")) {
+                h_.redo = true;
+                return;
+            }
+            const std::size_t px = h_.newStruct();
+            h_.set(px, "Start", Value::number((double)iPixelData_));
+            h_.set(px, "Bytes", Value::number((double)bytes_));
+            if (hasVR_) h_.set(px, "Format", Value::text(vr2fmt(pixelVR_)));
+            h_.link(0, "PixelData", px);
+        }
+        if (h_.get(0, "CSAImageHeaderInfo") || h_.get(0, "CSASeriesHeaderInfo") || h_.get(0, "ProtocolDataBlock"))
+            h_.redo = true;
+    }
+
+private:
+    struct Item {
+        uint32_t tag;
+        bool named, hasValue;
+        std::string name, info;
+        std::size_t value;
+
+        Item() : tag(0), named(false), hasValue(false), value(0) {}
+    };
+
+    // b8(i) and bc(i): bytes dicm_hdr has read, and the header before the
+    // pixel data. Indexing past them is an error in dicm_hdr.
+    unsigned b(int64_t i)
+    {
+        if (i < 1 || i > len_) {
+            h_.redo = true;
+            return 0;
+        }
+        return data_[i - 1];
+    }
+    unsigned bc(int64_t i)
+    {
+        if (i > bcLen_) h_.redo = true;
+        return b(i);
+    }
+    double int16(int64_t i, bool swap)
+    {
+        const double d0 = b(i), d1 = b(i + 1);
+        return swap ? d1 + d0 * 256 : d0 + d1 * 256;
+    }
+    int64_t int32(int64_t i, bool swap)
+    {
+        int64_t d[4];
+        for (int k = 0; k < 4; ++k) d[k] = b(i + (swap ? 3 - k : k));
+        return d[0] + d[1] * 256 + d[2] * 65536 + d[3] * 16777216;
+    }
+    static double mod(double a, double m) { return m == 0 ? a : a - std::floor(a / m) * m; }
+    static void swapPairs(unsigned char *t)
+    {
+        std::swap(t[0], t[1]);
+        std::swap(t[2], t[3]);
+    }
+
+    // strfind(char(b8(1:n)), pattern), optionally only at odd positions.
+    std::vector<int64_t> find(const unsigned char *pattern, std::size_t m, int64_t n, bool odd) const
+    {
+        std::vector<int64_t> out;
+        const unsigned char *p = data_, *end = data_ + n;
+        while (end - p >= (std::ptrdiff_t)m) {
+            p = static_cast<const unsigned char *>(std::memchr(p, pattern[0], (end - p) - m + 1));
+            if (!p) break;
+            if (std::memcmp(p, pattern, m) == 0 && (!odd || (p - data_) % 2 == 0)) out.push_back(p - data_ + 1);
+            ++p;
+        }
+        return out;
+    }
+
+    // val_len: value length and the bytes taken by VR and length.
+    int64_t valLen(const std::string &vr, int64_t i, bool hasVR, bool swap, int &nvr)
+    {
+        b(i + 5);
+        int64_t n;
+        if (!hasVR) {
+            n = int32(i, swap);
+            nvr = 4;
+        } else if (inList("AE AS AT CS DA DS DT FD FL IS LO LT PN SH SL SS ST TM UI UL US", vr)) {
+            n = (int64_t)int16(i, swap);
+            nvr = 2;
+        } else {
+            n = int32(i + 2, swap);
+            nvr = 6;
+        }
+        if (n == 13) n = 10;    // ugly bug fix for some old dicom file
+        return n;
+    }
+
+    // read_val of n bytes at i. Returns false if the value is empty.
+    bool readVal(int64_t i, int64_t n, const std::string &vr, bool swap, Value &v, std::string &info)
+    {
+        info.clear();
+        b(i);
+        b(i + n - 1);
+        if (h_.redo) return false;
+        const unsigned char *p = data_ + i - 1;
+        if (vr == "DS" || vr == "IS") {
+            v.kind = Value::kNumbers;
+            v.numbers = scanNumbers(std::string(reinterpret_cast<const char *>(p), (std::size_t)n));
+            return !v.numbers.empty();
+        }
+        if (inList("AE AS CS DA DT LO LT PN SH ST TM UI UT", vr)) {
+            v.kind = Value::kText;
+            v.bytes = deblank(p, (std::size_t)n);
+            return !v.bytes.empty();
+        }
+        const std::string fmt = vr2fmt(vr);
+        if (fmt.empty()) {
+            char s[64];
+            std::sprintf(s, "Given up: Invalid VR (%d %d)", vr.size() > 0 ? (int)(unsigned char)vr[0] : 0,
+                         vr.size() > 1 ? (int)(unsigned char)vr[1] : 0);
+            info = s;
+            return false;
+        }
+        v.kind = Value::kBinary;
+        v.bytes.assign(reinterpret_cast<const char *>(p), (std::size_t)n);
+        const std::size_t w = classBytes(fmt);
+        v.cls = n % w ? "uint8" : fmt;    // keep bytes if typecast fails
+        if (swap && n % w == 0)
+            for (std::size_t k = 0; k < (std::size_t)n; k += w) std::reverse(&v.bytes[k], &v.bytes[k] + w);
+        return true;
+    }
+
+    // The search method of dicm_hdr for short headers and few tags.
+    // Returns false to fall back to the regular way.
+    bool search()
+    {
+        bcLen_ = std::min(len_, iPixelData_);
+        if (!dict_.vendor.empty() && dict_.hasPrivate()) {
+            std::vector<unsigned char> tg;
+            pattern(8, 112, "LO", tg);
+            const std::vector<int64_t> at = find(&tg[0], tg.size(), bcLen_, true);
+            if (!at.empty()) {
+                int nvr = 0;
+                int64_t i = at[0] + 4 + (expl_ ? 2 : 0);    // Manufacturer should be the earliest one
+                const int64_t n = valLen("LO", i, expl_, be_, nvr);
+                i += nvr;
+                if (i + n < iPixelData_) {
+                    std::string s;
+                    for (int64_t k = 0; k < n; ++k) s += (char)bc(i + k);
+                    updateVendor(Value::text(deblank((const unsigned char *)s.data(), s.size())));
+                }
+            }
+            if (h_.redo) return true;
+        }
+        {
+            std::vector<unsigned char> tg;
+            pattern(40, 8, "IS", tg);    // NumberOfFrames
+            const std::vector<int64_t> at = find(&tg[0], tg.size(), bcLen_, true);
+            if (!at.empty()) {
+                int nvr = 0;
+                int64_t i = at[0] + 4 + (expl_ ? 2 : 0);
+                const int64_t n = valLen("IS", i, expl_, be_, nvr);
+                i += nvr;
+                if (i + n < iPixelData_) {
+                    std::string s;
+                    for (int64_t k = 0; k < n; ++k) s += (char)bc(i + k);
+                    hasFrames_ = true;
+                    nFrames_ = str2double(s);
+                }
+            }
+            if (h_.redo) return true;
+        }
+
+        for (std::size_t k = 0; k < dict_.entries.size(); ++k) {
+            const Entry &e = dict_.entries[k];
+            const bool swap = be_ && e.group != 2;
+            const bool hasVR = expl_ || e.group == 2;
+            unsigned char tg[6] = {(unsigned char)(e.group & 255), (unsigned char)(e.group >> 8),
+                                   (unsigned char)(e.element & 255), (unsigned char)(e.element >> 8), 0, 0};
+            if (swap) swapPairs(tg);
+            std::vector<int64_t> at = find(tg, 4, bcLen_, true);
+            if (at.empty()) continue;
+            if (hasFrames_ && mod((double)at.size(), nFrames_) < 2) {
+                at.resize(1);
+            } else if (at.size() > 1) {    // +1 tags found, add vr to try again if expl
+                if (!hasVR || e.vr.size() != 2) return false;
+                tg[4] = (unsigned char)e.vr[0];
+                tg[5] = (unsigned char)e.vr[1];
+                at = find(tg, 6, bcLen_, true);
+                if (at.size() != 1) return false;
+            }
+            int64_t i = at[0] + 4;
+            std::string vr;
+            if (hasVR) {
+                vr += (char)bc(i);
+                vr += (char)bc(i + 1);
+                i += 2;
+                if (vr[0] < 'A' || vr[0] > 'Z' || vr[1] < 'A' || vr[1] > 'Z') return false;
+                if (vr == "UN" || vr == "OB") vr = e.vr;
+            } else {
+                vr = e.vr;
+            }
+            int nvr = 0;
+            const int64_t n = valLen(vr, i, hasVR, swap, nvr);
+            i += nvr;
+            if (h_.redo) return true;
+            if (n < 1 || n % 2 || i + n - 1 > iPixelData_) continue;    // skip this tag
+
+            Value v;
+            const bool has = readVal(i, n, vr, swap, v, h_.info);
+            if (h_.redo) return true;
+            if (!h_.info.empty()) return false;    // re-do in regular way
+            if (has) h_.set(0, e.name, v);
+        }
+        return true;
+    }
+
+    // Tag bytes as searched by dicm_hdr: swapped if big endian, with the VR
+    // if explicit.
+    void pattern(unsigned group, unsigned element, const char *vr, std::vector<unsigned char> &tg) const
+    {
+        unsigned char t[4] = {(unsigned char)group, 0, (unsigned char)element, 0};
+        if (be_) swapPairs(t);
+        tg.assign(t, t + 4);
+        if (expl_) tg.insert(tg.end(), vr, vr + 2);
+    }
+
+    // updateVendor: a different Manufacturer switches dictionaries.
+    void updateVendor(const Value &v)
+    {
+        if (v.kind != Value::kText || dict_.vendor.empty() || !strncmpi2(v.bytes, dict_.vendor)) h_.redo = true;
+    }
+
+    // read_item: the tag at i, its value if it is in the dictionary.
+    Item readItem(int64_t &i)
+    {
+        Item it;
+        const unsigned g0 = b(i), g1 = b(i + 1);
+        i += 2;
+        bool swap = be_ && !(g0 == 2 && g1 == 0);
+        const unsigned group = swap ? g1 + g0 * 256 : g0 + g1 * 256;
+        const unsigned elmnt = (unsigned)int16(i, swap);
+        i += 2;
+        it.tag = group * 65536u + elmnt;
+        if (h_.redo) return it;
+        if (it.tag == kItemEnd) {
+            i += 4;    // skip length
+            return it;
+        }
+
+        swap = be_ && group != 2;
+        const bool hasVR = expl_ || group == 2;
+        std::string vr = "CS";    // implicit
+        if (hasVR) {
+            vr = std::string(1, (char)b(i)) + (char)b(i + 1);
+            i += 2;
+        }
+        int nvr = 0;
+        const int64_t n = valLen(vr, i, hasVR, swap, nvr);
+        i += nvr;
+        if (h_.redo || n == 0) return it;
+
+        if (const Entry *e = dict_.find(it.tag)) {
+            it.name = e->name;
+            it.named = true;
+            if (vr == "UN" || vr == "OB" || !hasVR) vr = e->vr;
+        } else if (it.tag == 524400) {    // in case not in dict
+            it.name = "Manufacturer";
+            it.named = true;
+        } else if (it.tag == 131088) {    // need TransferSyntaxUID even if not in dict
+            it.name = "TransferSyntaxUID";
+            it.named = true;
+        } else if (it.tag == 593936) {    // 0x0009 0010 GEIIS not dicom compliant
+            i += n;
+            return it;
+        } else if (n < kUndefined) {
+            i += n;
+            return it;
+        }
+        if (!hasVR && n == kUndefined) vr = "SQ";    // best guess
+        if (n + i > iPixelData_ && vr != "SQ") {
+            i += n;    // PixelData or err
+            return it;
+        }
+
+        if (vr == "SQ") {
+            if (it.tag == kPerFrameSQ) {
+                h_.redo = true;
+                return it;
+            }
+            const int64_t nEnd = std::min(i + n, iPixelData_);
+            std::size_t node = 0;
+            it.hasValue = readSQ(i, nEnd, node, it.info);
+            it.value = node;
+        } else {
+            Value v;
+            it.hasValue = readVal(i, n, vr, swap, v, it.info);
+            i += n;
+            if (it.hasValue) {
+                h_.values.push_back(v);
+                it.value = h_.values.size() - 1;
+            }
+        }
+        return it;
+    }
+
+    // read_sq: items of a sequence, as Item_1, Item_2... Returns false if
+    // no value was decoded.
+    bool readSQ(int64_t &i, int64_t nEnd, std::size_t &rst, std::string &info)
+    {
+        bool has = false;
+        info.clear();
+        int j = 0;
+        while (i < nEnd && !h_.redo) {
+            unsigned t[4] = {b(i + 2), b(i + 3), b(i), b(i + 1)};
+            i += 4;
+            if (be_) std::swap(t[0], t[1]);
+            const uint32_t tag = t[0] + t[1] * 256u + t[2] * 65536u + t[3] * 16777216u;
+            if (tag != kItem) {
+                i += 4;
+                break;
+            }
+            int64_t n = int32(i, be_);    // n may be 0xffff ffff
+            i += 4;
+            n = std::min(i + n, nEnd);
+            ++j;
+            char itemName[32];
+            std::sprintf(itemName, "Item_%d", j);
+            while (i < n && !h_.redo) {
+                Item it = readItem(i);
+                info = it.info;
+                if (it.tag == kItemEnd) break;
+                if (!it.hasValue || !it.named) continue;
+                if (!has) {
+                    rst = h_.newStruct();
+                    has = true;
+                }
+                const Value *item = h_.get(rst, itemName);
+                std::size_t node;
+                if (item) {
+                    node = item - &h_.values[0];
+                } else {
+                    node = h_.newStruct();
+                    h_.link(rst, itemName, node);
+                }
+                h_.link(node, it.name, it.value);
+            }
+        }
+        return has;
+    }
+
+    void notDicom(const std::string &fname)
+    {
+        // PAR/XML/HEAD/MGH/BrainVoyager files are read by dicm_hdr
+        std::string ext;
+        const std::size_t slash = fname.find_last_of("/\\"), dot = fname.find_last_of('.');
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ext = fname.substr(dot);
+        for (std::size_t k = 0; k < ext.size(); ++k) ext[k] = (char)std::tolower((unsigned char)ext[k]);
+        static const char *known[] = {".par", ".xml", ".head", ".mgh", ".mgz", ".vmr", ".fmr", ".dmr"};
+        for (std::size_t k = 0; k < sizeof known / sizeof known[0]; ++k)
+            if (ext == known[k]) {
+                h_.redo = true;
+                return;
+            }
+        h_.info = "Unknown file type: " + fname;
+    }
+
+    const unsigned char *data_;
+    int64_t fSize_, len_, bcLen_;
+    const Dict &dict_;
+    Header &h_;
+    bool expl_, be_;
+    int64_t iPixelData_, bytes_;
+    std::string pixelVR_;
+    bool hasVR_, hasFrames_;
+    double nFrames_;
+};
+
+} // namespace detail
+
+// Reads the header of `path` as dicm_hdr(path, dict).
+inline void parse(const std::string &path, const Dict &dict, Header &h)
+{
+    h = Header();
+    MappedFile file;
+    if (!file.open(path)) {
+        h.redo = true;    // dicm_hdr reports it (or finds it on the path)
+        return;
+    }
+    detail::Parser(file.data(), (int64_t)file.size(), dict, h).run(path);
+}
+
+// Uncompressed pixel data of a file, as dicm_img(s, 0) reads it.
+struct Pixels {
+    int64_t start, count;    // byte offset and number of values
+    std::size_t bytes;       // bytes per value
+    int64_t columns, rows, spp, frames;
+    bool planar;             // PlanarConfiguration 1: samples not interleaved
+    int shift;               // bitshift applied to integer values
+    bool swap;               // big endian
+};
+
+// Copies the pixels of `path` into out, [columns rows spp frames].
+inline bool readPixels(const std::string &path, const Pixels &p, unsigned char *out, std::string &error)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "cannot open " + path;
+        return false;
+    }
+    if (p.start < 0 || (uint64_t)p.start + (uint64_t)p.count * p.bytes > (uint64_t)file.size()) {
+        error = path + " is truncated";
+        return false;
+    }
+    const unsigned char *in = file.data() + p.start;
+    const std::size_t w = p.bytes;
+    if (p.planar || p.spp == 1) {
+        std::memcpy(out, in, (std::size_t)p.count * w);
+    } else {
+        // [spp columns rows frames] -> [columns rows spp frames]
+        const int64_t plane = p.columns * p.rows;
+        for (int64_t f = 0; f < p.frames; ++f)
+            for (int64_t v = 0; v < plane; ++v)
+                for (int64_t s = 0; s < p.spp; ++s)
+                    std::memcpy(out + ((f * p.spp + s) * plane + v) * w, in + ((f * plane + v) * p.spp + s) * w, w);
+    }
+    if (p.shift) {
+        for (int64_t k = 0; k < p.count; ++k) {
+            uint64_t x = 0;
+            std::memcpy(&x, out + k * w, w);    // little endian host
+            x = p.shift > 0 ? x << p.shift : x >> -p.shift;
+            std::memcpy(out + k * w, &x, w);
+        }
+    }
+    if (p.swap && w > 1)
+        for (int64_t k = 0; k < p.count; ++k) std::reverse(out + k * w, out + (k + 1) * w);
+    return true;
+}
+
+} // namespace dicom
+} // namespace qmr
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * qmr_fft.hh: self-contained FFTs shared by the qMRLab MEX engines.
+ *
+ * Plan1d is a complex transform of one length: a mixed-radix Stockham FFT
+ * (radices 4, 2, 3, 5 and 7) when the length only has small prime factors,
+ * Bluestein's chirp-z algorithm over a power of two otherwise. Plans hold
+ * the factorization and the twiddle tables, are immutable once built, and
+ * may be shared by any number of threads; callers pass the scratch memory
+ * (workSize() complex values).
+ *
+ * RealFft3d is the real-to-complex transform of a column-major n1 x n2 x n3
+ * volume, as fftn of a real array keeping only the first n1/2+1 rows (the
+ * rest follows from Hermitian symmetry), and its complex-to-real inverse,
+ * normalized as ifftn. Even n1 uses the half-length complex transform, so
+ * both directions cost about half of a complex fftn. Lines are transformed
+ * in parallel; strided axes are gathered in batches of neighbouring lines.
+ *
+ * Forward transforms use the exp(-2*pi*i*j*k/n) convention of MATLAB fft.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_FFT_HH
+#define QMR_FFT_HH
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace fft {
+
+typedef std::complex<double> cplx;
+
+static const double kPi = 3.14159265358979323846;
+
+// Plain complex product (std::complex's operator* checks for NaN/Inf
+// operands, which is slow in inner loops without -ffast-math).
+inline cplx mul(const cplx &a, const cplx &b)
+{
+    return cplx(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Smallest length >= n whose only prime factors are 2, 3 and 5.
+inline std::size_t smoothLength(std::size_t n)
+{
+    for (;; ++n) {
+        std::size_t r = n;
+        const std::size_t small[] = {2, 3, 5};
+        for (int i = 0; i < 3; ++i)
+            while (r % small[i] == 0) r /= small[i];
+        if (r == 1) return n;
+    }
+}
+
+class Plan1d {
+public:
+    explicit Plan1d(std::size_t n = 1) : n_(n), m_(0) { init(); }
+
+    std::size_t size() const { return n_; }
+
+    // Complex scratch values needed by forward/inverse.
+    std::size_t workSize() const { return m_ ? m_ + blue_->workSize() : n_; }
+
+    // In-place unnormalized transforms of x (n values).
+    void forward(cplx *x, cplx *work) const
+    {
+        if (m_) bluestein(x, work);
+        else stockham(x, work);
+    }
+
+    void inverse(cplx *x, cplx *work) const
+    {
+        for (std::size_t k = 0; k < n_; ++k) x[k] = std::conj(x[k]);
+        forward(x, work);
+        for (std::size_t k = 0; k < n_; ++k) x[k] = std::conj(x[k]);
+    }
+
+    Plan1d(const Plan1d &o) : n_(o.n_), m_(0) { init(); }
+    Plan1d &operator=(const Plan1d &o)
+    {
+        if (this != &o) {
+            delete blue_;
+            n_ = o.n_;
+            init();
+        }
+        return *this;
+    }
+    ~Plan1d() { delete blue_; }
+
+private:
+    static cplx twiddle(std::size_t k, std::size_t n)
+    {
+        const double a = -2 * kPi * (double)k / (double)n;
+        return cplx(std::cos(a), std::sin(a));
+    }
+
+    void init()
+    {
+        blue_ = NULL;
+        m_ = 0;
+        radices_.clear();
+        twiddles_.clear();
+        roots_.clear();
+        if (n_ <= 1) return;
+        std::size_t rest = n_;
+        while (rest % 4 == 0) { radices_.push_back(4); rest /= 4; }
+        const std::size_t small[] = {2, 3, 5, 7};
+        for (int i = 0; i < 4; ++i)
+            while (rest % small[i] == 0) { radices_.push_back(small[i]); rest /= small[i]; }
+        if (rest != 1) {
+            // Large prime factor: Bluestein over a smooth length >= 2n - 1
+            radices_.clear();
+            m_ = smoothLength(2 * n_ - 1);
+            blue_ = new Plan1d(m_);
+            chirp_.resize(n_);
+            for (std::size_t k = 0; k < n_; ++k) {
+                // k^2 mod 2n keeps the angle exact for large k
+                const std::size_t k2 = (std::size_t)(((unsigned long long)k * k) % (2 * n_));
+                chirp_[k] = std::conj(twiddle(k2, 2 * n_));   // exp(-i*pi*k^2/n) conjugated
+            }
+            chirpFft_.assign(m_, cplx(0, 0));
+            chirpFft_[0] = chirp_[0];
+            for (std::size_t k = 1; k < n_; ++k) chirpFft_[k] = chirpFft_[m_ - k] = chirp_[k];
+            std::vector<cplx> work(blue_->workSize());
+            blue_->forward(&chirpFft_[0], &work[0]);
+            return;
+        }
+        // Stockham stages: stage s of radix r has n/(stride*r) twiddle groups
+        std::size_t len = n_;
+        for (std::size_t s = 0; s < radices_.size(); ++s) {
+            const std::size_t r = radices_[s], m = len / r;
+            for (std::size_t p = 0; p < m; ++p)
+                for (std::size_t k = 1; k < r; ++k) twiddles_.push_back(twiddle(p * k, len));
+            len = m;
+        }
+        if (std::find(radices_.begin(), radices_.end(), (std::size_t)7) != radices_.end())
+            for (std::size_t k = 0; k < 7; ++k) roots_.push_back(twiddle(k, 7));
+    }
+
+    // r-point DFT of a[0..r-1] into b, with the fixed small radices unrolled.
+    void butterfly(std::size_t r, const cplx *a, cplx *b) const
+    {
+        switch (r) {
+        case 2:
+            b[0] = a[0] + a[1];
+            b[1] = a[0] - a[1];
+            return;
+        case 3: {
+            const double c = -0.5, s = -0.86602540378443864676;
+            const cplx t = a[1] + a[2], u = a[1] - a[2];
+            const cplx m = a[0] + c * t, v(-s * u.imag(), s * u.real());
+            b[0] = a[0] + t;
+            b[1] = m + v;
+            b[2] = m - v;
+            return;
+        }
+        case 4: {
+            const cplx t0 = a[0] + a[2], t1 = a[0] - a[2], t2 = a[1] + a[3], t3 = a[1] - a[3];
+            const cplx t3i(t3.imag(), -t3.real());   // -i * t3
+            b[0] = t0 + t2;
+            b[1] = t1 + t3i;
+            b[2] = t0 - t2;
+            b[3] = t1 - t3i;
+            return;
+        }
+        case 5: {
+            const double c1 = 0.30901699437494742410, c2 = -0.80901699437494742410;
+            const double s1 = -0.95105651629515357212, s2 = -0.58778525229247312917;
+            const cplx t1 = a[1] + a[4], t2 = a[2] + a[3], t3 = a[1] - a[4], t4 = a[2] - a[3];
+            const cplx m1 = a[0] + c1 * t1 + c2 * t2, m2 = a[0] + c2 * t1 + c1 * t2;
+            const cplx n1 = s1 * t3 + s2 * t4, n2 = s2 * t3 - s1 * t4;
+            const cplx in1(-n1.imag(), n1.real()), in2(-n2.imag(), n2.real());
+            b[0] = a[0] + t1 + t2;
+            b[1] = m1 + in1;
+            b[4] = m1 - in1;
+            b[2] = m2 + in2;
+            b[3] = m2 - in2;
+            return;
+        }
+        default:   // 7
+            for (std::size_t k = 0; k < r; ++k) {
+                cplx acc = a[0];
+                for (std::size_t j = 1; j < r; ++j) acc += mul(a[j], roots_[(j * k) % r]);
+                b[k] = acc;
+            }
+        }
+    }
+
+    void stockham(cplx *x, cplx *work) const
+    {
+        cplx *in = x, *out = work;
+        std::size_t len = n_, stride = 1;
+        const cplx *tw = twiddles_.empty() ? NULL : &twiddles_[0];
+        cplx a[7], b[7];
+        for (std::size_t s = 0; s < radices_.size(); ++s) {
+            const std::size_t r = radices_[s], m = len / r;
+            for (std::size_t p = 0; p < m; ++p) {
+                const cplx *w = tw + p * (r - 1);
+                for (std::size_t q = 0; q < stride; ++q) {
+                    for (std::size_t j = 0; j < r; ++j) a[j] = in[q + stride * (p + j * m)];
+                    butterfly(r, a, b);
+                    cplx *y = out + q + stride * r * p;
+                    y[0] = b[0];
+                    for (std::size_t k = 1; k < r; ++k) y[stride * k] = mul(b[k], w[k - 1]);
+                }
+            }
+            tw += m * (r - 1);
+            std::swap(in, out);
+            len = m;
+            stride *= r;
+        }
+        if (in != x) std::copy(in, in + n_, x);
+    }
+
+    void bluestein(cplx *x, cplx *work) const
+    {
+        cplx *a = work, *scratch = work + m_;
+        for (std::size_t k = 0; k < n_; ++k) a[k] = mul(x[k], std::conj(chirp_[k]));
+        std::fill(a + n_, a + m_, cplx(0, 0));
+        blue_->forward(a, scratch);
+        for (std::size_t k = 0; k < m_; ++k) a[k] = std::conj(mul(a[k], chirpFft_[k]));
+        blue_->forward(a, scratch);   // inverse through conjugation
+        const double scale = 1.0 / (double)m_;
+        for (std::size_t k = 0; k < n_; ++k) x[k] = mul(std::conj(a[k]) * scale, std::conj(chirp_[k]));
+    }
+
+    std::size_t n_, m_;
+    std::vector<std::size_t> radices_;
+    std::vector<cplx> twiddles_, roots_;
+    Plan1d *blue_;
+    std::vector<cplx> chirp_, chirpFft_;
+};
+
+class RealFft3d {
+public:
+    RealFft3d(std::size_t n1, std::size_t n2, std::size_t n3, int nthreads = 0)
+        : n1_(n1), n2_(n2), n3_(n3), h_(n1 / 2 + 1), nthreads_(nthreads),
+          p1_(n1 % 2 ? n1 : n1 / 2), p2_(n2), p3_(n3)
+    {
+        if (n1 % 2 == 0) {
+            w1_.resize(h_);
+            for (std::size_t k = 0; k < h_; ++k) w1_[k] = cplx(std::cos(2 * kPi * k / n1), -std::sin(2 * kPi * k / n1));
+        }
+    }
+
+    std::size_t n1() const { return n1_; }
+    std::size_t n2() const { return n2_; }
+    std::size_t n3() const { return n3_; }
+    std::size_t realSize() const { return n1_ * n2_ * n3_; }
+    // Rows of the half spectrum (n1/2 + 1) and its number of values.
+    std::size_t rows() const { return h_; }
+    std::size_t complexSize() const { return h_ * n2_ * n3_; }
+    int threads() const { return nthreads_; }
+
+    // out (rows x n2 x n3) = fftn(in) restricted to the first rows.
+    void forward(const double *in, cplx *out) const
+    {
+        parallel_for(n2_ * n3_, grain(n2_ * n3_), [&](std::size_t b, std::size_t e, int) {
+            std::vector<cplx> line(n1_ + 1), work(p1_.workSize());
+            for (std::size_t l = b; l < e; ++l) realLine(in + l * n1_, out + l * h_, &line[0], &work[0]);
+        }, nthreads_);
+        strided(out, false);
+    }
+
+    // out (n1 x n2 x n3) = real(ifftn) of the Hermitian spectrum `in`,
+    // which is overwritten.
+    void inverse(cplx *in, double *out) const
+    {
+        strided(in, true);
+        const double scale = 1.0 / (double)realSize();
+        parallel_for(n2_ * n3_, grain(n2_ * n3_), [&](std::size_t b, std::size_t e, int) {
+            std::vector<cplx> line(n1_ + 1), work(p1_.workSize());
+            for (std::size_t l = b; l < e; ++l) realInverseLine(in + l * h_, out + l * n1_, &line[0], &work[0], scale);
+        }, nthreads_);
+    }
+
+private:
+    std::size_t grain(std::size_t lines) const
+    {
+        return std::max<std::size_t>(1, lines / (4 * (std::size_t)num_threads(nthreads_)));
+    }
+
+    // Real line x (n1) to its first h spectrum values.
+    void realLine(const double *x, cplx *X, cplx *z, cplx *work) const
+    {
+        if (n1_ % 2) {
+            for (std::size_t j = 0; j < n1_; ++j) z[j] = cplx(x[j], 0);
+            p1_.forward(z, work);
+            std::copy(z, z + h_, X);
+            return;
+        }
+        const std::size_t m = n1_ / 2;
+        for (std::size_t j = 0; j < m; ++j) z[j] = cplx(x[2 * j], x[2 * j + 1]);
+        p1_.forward(z, work);
+        z[m] = z[0];
+        for (std::size_t k = 0; k <= m; ++k) {
+            const cplx zc = std::conj(z[m - k]);
+            const cplx e = 0.5 * (z[k] + zc), d = z[k] - zc;
+            const cplx o(0.5 * d.imag(), -0.5 * d.real());   // d / (2i)
+            X[k] = e + mul(w1_[k], o);
+        }
+    }
+
+    void realInverseLine(const cplx *X, double *x, cplx *z, cplx *work, double scale) const
+    {
+        if (n1_ % 2) {
+            z[0] = X[0];
+            for (std::size_t k = 1; k < h_; ++k) {
+                z[k] = X[k];
+                z[n1_ - k] = std::conj(X[k]);
+            }
+            p1_.inverse(z, work);
+            for (std::size_t j = 0; j < n1_; ++j) x[j] = z[j].real() * scale;
+            return;
+        }
+        const std::size_t m = n1_ / 2;
+        for (std::size_t k = 0; k < m; ++k) {
+            const cplx xc = std::conj(X[m - k]);
+            const cplx o = mul(X[k] - xc, std::conj(w1_[k]));
+            z[k] = X[k] + xc + cplx(-o.imag(), o.real());
+        }
+        p1_.inverse(z, work);
+        for (std::size_t j = 0; j < m; ++j) {
+            x[2 * j] = z[j].real() * scale;
+            x[2 * j + 1] = z[j].imag() * scale;
+        }
+    }
+
+    // Complex transforms of the half spectrum along dims 2 and 3, lines
+    // gathered kBatch rows at a time.
+    void strided(cplx *X, bool inverse) const
+    {
+        static const std::size_t kBatch = 8;
+        const std::size_t nb = (h_ + kBatch - 1) / kBatch;
+        if (n2_ > 1)
+            parallel_for(nb * n3_, grain(nb * n3_), [&](std::size_t b, std::size_t e, int) {
+                std::vector<cplx> buf(kBatch * n2_), work(p2_.workSize());
+                for (std::size_t t = b; t < e; ++t)
+                    axis(X + (t / nb) * h_ * n2_, (t % nb) * kBatch, h_, n2_, p2_, inverse, &buf[0], &work[0]);
+            }, nthreads_);
+        if (n3_ > 1)
+            parallel_for(nb * n2_, grain(nb * n2_), [&](std::size_t b, std::size_t e, int) {
+                std::vector<cplx> buf(kBatch * n3_), work(p3_.workSize());
+                for (std::size_t t = b; t < e; ++t)
+                    axis(X + (t / nb) * h_, (t % nb) * kBatch, h_ * n2_, n3_, p3_, inverse, &buf[0], &work[0]);
+            }, nthreads_);
+    }
+
+    // Transforms up to kBatch lines base[r0 + i + j*stride], j < n.
+    void axis(cplx *base, std::size_t r0, std::size_t stride, std::size_t n, const Plan1d &plan, bool inverse,
+              cplx *buf, cplx *work) const
+    {
+        const std::size_t nr = std::min<std::size_t>(8, h_ - r0);
+        for (std::size_t j = 0; j < n; ++j)
+            for (std::size_t i = 0; i < nr; ++i) buf[i * n + j] = base[r0 + i + j * stride];
+        for (std::size_t i = 0; i < nr; ++i) {
+            if (inverse) plan.inverse(buf + i * n, work);
+            else plan.forward(buf + i * n, work);
+        }
+        for (std::size_t j = 0; j < n; ++j)
+            for (std::size_t i = 0; i < nr; ++i) base[r0 + i + j * stride] = buf[i * n + j];
+    }
+
+    std::size_t n1_, n2_, n3_, h_;
+    int nthreads_;
+    Plan1d p1_, p2_, p3_;
+    std::vector<cplx> w1_;
+};
+
+} // namespace fft
+} // namespace qmr
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * qmr_gzip.hh: in-memory gzip streams for the qMRLab MEX engines (zlib;
+ * engines including it link with -lz).
+ *
+ * readFile inflates a .gz file straight into memory, in chunks, with no
+ * temporary file. Concatenated members (as written by gzip -c >>) are
+ * read as one stream.
+ *
+ * writeFile compresses in parallel the way pigz does: the input is cut
+ * into fixed blocks, each deflated on its own with the 32 KiB preceding
+ * it as dictionary and ended with a sync flush, so the raw streams
+ * concatenate into a single valid deflate stream; the CRC-32 of the
+ * blocks are combined. Blocks do not depend on the thread count, so the
+ * file is identical for any number of threads. Blocks are compressed
+ * and written in waves, which bounds the memory held for output.
+ * Inflating is inherently sequential.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_GZIP_HH
+#define QMR_GZIP_HH
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace gzip {
+
+// A run of bytes to compress; writeFile takes the concatenation of several.
+struct Span {
+    const unsigned char *data;
+    std::size_t size;
+};
+
+namespace detail {
+
+static const std::size_t kBlock = 1 << 20;     // input per parallel block
+static const std::size_t kWindow = 1 << 15;    // deflate dictionary
+static const std::size_t kChunk = 1 << 20;     // file read size
+
+class File {
+public:
+    File(const std::string &path, const char *mode) : f_(std::fopen(path.c_str(), mode)) {}
+    ~File()
+    {
+        if (f_) std::fclose(f_);
+    }
+    std::FILE *get() const { return f_; }
+    // Closes the file, returning false if buffered data could not be written.
+    bool close()
+    {
+        const bool ok = f_ && std::fclose(f_) == 0;
+        f_ = NULL;
+        return ok;
+    }
+
+private:
+    File(const File &);
+    File &operator=(const File &);
+    std::FILE *f_;
+};
+
+// Size recorded in the trailer of the last member (modulo 2^32).
+inline std::size_t storedSize(std::FILE *f)
+{
+    unsigned char t[4];
+    const bool ok = std::fseek(f, -4, SEEK_END) == 0 && std::fread(t, 1, 4, f) == 4;
+    std::rewind(f);
+    if (!ok) return 0;
+    return (std::size_t)t[0] | (std::size_t)t[1] << 8 | (std::size_t)t[2] << 16 | (std::size_t)t[3] << 24;
+}
+
+// One compressed block: raw deflate data and CRC-32 of its input.
+struct Block {
+    std::vector<unsigned char> out;
+    uLong crc;
+    bool ok;
+};
+
+inline void deflateBlock(const unsigned char *in, std::size_t n, const unsigned char *dict, std::size_t ndict,
+                         bool last, int level, Block &b)
+{
+    z_stream s;
+    std::memset(&s, 0, sizeof(s));
+    b.ok = false;
+    b.crc = crc32(0L, in, (uInt)n);
+    if (deflateInit2(&s, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+    if (ndict) deflateSetDictionary(&s, dict, (uInt)ndict);
+    b.out.resize(deflateBound(&s, (uLong)n) + 16);
+    s.next_in = const_cast<unsigned char *>(in);
+    s.avail_in = (uInt)n;
+    s.next_out = &b.out[0];
+    s.avail_out = (uInt)b.out.size();
+    const int rc = deflate(&s, last ? Z_FINISH : Z_SYNC_FLUSH);
+    b.ok = last ? rc == Z_STREAM_END : rc == Z_OK && s.avail_in == 0 && s.avail_out > 0;
+    b.out.resize(s.total_out);
+    deflateEnd(&s);
+}
+
+} // namespace detail
+
+// Inflates the gzip file at `path` into out, stopping after `limit` bytes
+// if given (e.g. a header, or the bytes a header declares, which also
+// sizes out in one allocation). Returns false with a reason in `error` on
+// failure.
+inline bool readFile(const std::string &path, std::vector<unsigned char> &out, std::string &error,
+                     std::size_t limit = (std::size_t)-1)
+{
+    out.clear();
+    detail::File f(path, "rb");
+    if (!f.get()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    out.reserve(limit != (std::size_t)-1 ? limit : detail::storedSize(f.get()));
+
+    z_stream s;
+    std::memset(&s, 0, sizeof(s));
+    if (inflateInit2(&s, 15 + 16) != Z_OK) {
+        error = "cannot initialize zlib";
+        return false;
+    }
+    std::vector<unsigned char> in(detail::kChunk);
+    bool ended = false;
+    int rc = Z_OK;
+    while (out.size() < limit) {
+        if (s.avail_in == 0) {
+            s.avail_in = (uInt)std::fread(&in[0], 1, in.size(), f.get());
+            s.next_in = &in[0];
+            if (s.avail_in == 0) break;
+        }
+        if (ended) {
+            // Next member, unless only padding is left
+            if (s.next_in[0] != 0x1f) break;
+            inflateReset(&s);
+            ended = false;
+        }
+        // Fill the reserved space, then grow (geometrically) by the vector
+        const std::size_t have = out.size();
+        const std::size_t room = std::min(limit - have, std::max(out.capacity() - have, detail::kChunk));
+        out.resize(have + room);
+        s.next_out = &out[have];
+        s.avail_out = (uInt)room;
+        rc = inflate(&s, Z_NO_FLUSH);
+        out.resize(have + room - s.avail_out);
+        if (rc == Z_STREAM_END) ended = true;
+        else if (rc != Z_OK && rc != Z_BUF_ERROR) break;
+    }
+    inflateEnd(&s);
+    if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+        error = path + " is not a valid gzip file";
+        return false;
+    }
+    if (!ended && out.size() < limit) {
+        error = path + " is truncated";
+        return false;
+    }
+    return true;
+}
+
+// Writes the concatenation of parts to `path` as one gzip member, with
+// compression level 1 (fast) to 9 (small). Returns false with a reason in
+// `error` on failure.
+inline bool writeFile(const std::string &path, const std::vector<Span> &parts, int level, int nthreads,
+                      std::string &error)
+{
+    // Blocks never straddle two parts; a block's dictionary is the end of
+    // the previous block of the same part.
+    struct Piece {
+        std::size_t part, offset, size;
+    };
+    std::vector<Piece> pieces;
+    for (std::size_t p = 0; p < parts.size(); ++p)
+        for (std::size_t o = 0; o < parts[p].size; o += detail::kBlock) {
+            Piece c = {p, o, std::min(detail::kBlock, parts[p].size - o)};
+            pieces.push_back(c);
+        }
+
+    detail::File f(path, "wb");
+    if (!f.get()) {
+        error = "cannot open " + path + " for writing";
+        return false;
+    }
+    static const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255};
+    bool ok = std::fwrite(header, 1, 10, f.get()) == 10;
+    if (pieces.empty()) {
+        // Empty input: a single empty final block
+        static const unsigned char empty[2] = {3, 0};
+        ok = ok && std::fwrite(empty, 1, 2, f.get()) == 2;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    std::size_t total = 0;
+    const std::size_t wave = 4 * (std::size_t)num_threads(nthreads);
+    std::vector<detail::Block> blocks(wave);
+    for (std::size_t first = 0; ok && first < pieces.size(); first += wave) {
+        const std::size_t n = std::min(wave, pieces.size() - first);
+        parallel_for(n, 1, [&](std::size_t b, std::size_t e, int) {
+            for (std::size_t i = b; i < e; ++i) {
+                const Piece &c = pieces[first + i];
+                const unsigned char *in = parts[c.part].data + c.offset;
+                const std::size_t ndict = std::min(c.offset, detail::kWindow);
+                detail::deflateBlock(in, c.size, in - ndict, ndict, first + i + 1 == pieces.size(), level,
+                                     blocks[i]);
+            }
+        }, nthreads);
+        for (std::size_t i = 0; ok && i < n; ++i) {
+            const detail::Block &b = blocks[i];
+            ok = b.ok && std::fwrite(&b.out[0], 1, b.out.size(), f.get()) == b.out.size();
+            crc = crc32_combine(crc, b.crc, (z_off_t)pieces[first + i].size);
+            total += pieces[first + i].size;
+        }
+    }
+
+    unsigned char trailer[8];
+    for (int k = 0; k < 4; ++k) {
+        trailer[k] = (unsigned char)(crc >> (8 * k));
+        trailer[4 + k] = (unsigned char)(total >> (8 * k));
+    }
+    ok = ok && std::fwrite(trailer, 1, 8, f.get()) == 8;
+    ok = f.close() && ok;
+    if (!ok) {
+        error = "cannot write " + path;
+        std::remove(path.c_str());
+    }
+    return ok;
+}
+
+} // namespace gzip
+} // namespace qmr
+
+#endif
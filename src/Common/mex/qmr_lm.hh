@@ -0,0 +1,369 @@
+/*
+ * qmr_lm.hh: batched, bound-constrained Levenberg-Marquardt solver for many
+ * small independent nonlinear least-squares problems (one per voxel).
+ *
+ * Voxels are advanced in lockstep, W at a time ("lanes"). Every per-voxel
+ * quantity is stored structure-of-arrays with the lane index innermost, e.g.
+ *
+ *     p[k*W + l]              parameter k of lane l
+ *     J[(o*nP + k)*W + l]     d model(o) / d p(k) of lane l
+ *
+ * so that residuals, normal equations and the small Cholesky solves are
+ * plain loops over l that the compiler vectorizes across voxels.
+ *
+ * A kernel provides the forward model and (optionally) its Jacobian:
+ *
+ *     struct Kernel {
+ *         int nParams() const;
+ *         int nObs() const;
+ *         // p: [nP][W] in, m: [nObs][W] out, J: [nObs][nP][W] out or NULL
+ *         void eval(const double *p, double *m, double *J, int W) const;
+ *     };
+ *
+ * eval() is called concurrently from several threads and must not modify
+ * shared state. Kernels without an analytic Jacobian can be wrapped in
+ * FiniteDifference<>.
+ *
+ * Bounds are handled by projecting every trial point onto [lb, ub]; the
+ * projected step is accepted only if it decreases the cost.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_LM_HH
+#define QMR_LM_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace lm {
+
+struct Options {
+    int    maxIter;      // maximum number of LM iterations per voxel
+    double tolFun;       // relative decrease of the cost
+    double tolX;         // relative step size
+    double lambda0;      // initial damping
+    double lambdaUp;     // damping increase on a rejected step
+    double lambdaDown;   // damping decrease on an accepted step
+    int    blockWidth;   // voxels advanced in lockstep (lanes)
+    int    numThreads;   // 0: all hardware threads
+
+    Options()
+        : maxIter(200), tolFun(1e-8), tolX(1e-8), lambda0(1e-3),
+          lambdaUp(10), lambdaDown(0.1), blockWidth(16), numThreads(0) {}
+};
+
+// Per-voxel exit flags, same meaning as lsqnonlin's exitflag.
+enum ExitFlag {
+    kMaxIter   = 0,   // maximum number of iterations reached
+    kConverged = 1,   // relative change of the cost below tolFun
+    kSmallStep = 2,   // relative step below tolX
+    kNoData    = -1,  // no finite observation, or failed model evaluation
+};
+
+// Forward-difference Jacobian for kernels that only provide the model.
+template <class Kernel>
+class FiniteDifference {
+public:
+    explicit FiniteDifference(const Kernel &k) : k_(k) {}
+    int nParams() const { return k_.nParams(); }
+    int nObs() const { return k_.nObs(); }
+
+    void eval(const double *p, double *m, double *J, int W) const
+    {
+        k_.eval(p, m, NULL, W);
+        if (!J) return;
+        const int nP = nParams(), nO = nObs();
+        std::vector<double> pp(p, p + nP * W), mm(nO * W), h(W);
+        for (int k = 0; k < nP; ++k) {
+            for (int l = 0; l < W; ++l) {
+                double v = p[k * W + l];
+                h[l] = 1.4901161193847656e-08 * std::max(std::fabs(v), 1.0);
+                pp[k * W + l] = v + h[l];
+            }
+            k_.eval(pp.data(), mm.data(), NULL, W);
+            for (int o = 0; o < nO; ++o)
+                for (int l = 0; l < W; ++l)
+                    J[(o * nP + k) * W + l] = (mm[o * W + l] - m[o * W + l]) / h[l];
+            for (int l = 0; l < W; ++l) pp[k * W + l] = p[k * W + l];
+        }
+    }
+
+private:
+    const Kernel &k_;
+};
+
+// Workspace for one block of W lanes. Reused across blocks by a thread.
+struct Workspace {
+    int nP, nO, W;
+    std::vector<double> p, pt, y, w, m, J, JtJ, g, A, d;
+    std::vector<double> cost, costTrial, lambda;
+    std::vector<int> flag, iter, active, ok;
+
+    Workspace(int nP_, int nO_, int W_)
+        : nP(nP_), nO(nO_), W(W_),
+          p(nP_ * W_), pt(nP_ * W_), y(nO_ * W_), w(nO_ * W_), m(nO_ * W_),
+          J(nO_ * nP_ * W_), JtJ(nP_ * nP_ * W_), g(nP_ * W_), A(nP_ * nP_ * W_),
+          d(nP_ * W_), cost(W_), costTrial(W_), lambda(W_),
+          flag(W_), iter(W_), active(W_), ok(W_) {}
+};
+
+namespace detail {
+
+// Weighted residual cost sum(w .* (m - y).^2) per lane.
+inline void cost(const Workspace &ws, const double *m, double *c)
+{
+    const int W = ws.W;
+    for (int l = 0; l < W; ++l) c[l] = 0;
+    for (int o = 0; o < ws.nO; ++o)
+        for (int l = 0; l < W; ++l) {
+            double r = ws.w[o * W + l] * (m[o * W + l] - ws.y[o * W + l]);
+            c[l] += r * r;
+        }
+    for (int l = 0; l < W; ++l)
+        if (!std::isfinite(c[l])) c[l] = std::numeric_limits<double>::infinity();
+}
+
+// JtJ and gradient Jt*r from the current m and J, for lanes with upd[l].
+inline void normalEquations(Workspace &ws, const int *upd)
+{
+    const int W = ws.W, nP = ws.nP;
+    for (int i = 0; i < nP; ++i) {
+        for (int j = 0; j <= i; ++j) {
+            double *a = &ws.JtJ[(i * nP + j) * W];
+            for (int l = 0; l < W; ++l) if (upd[l]) a[l] = 0;
+        }
+        for (int l = 0; l < W; ++l) if (upd[l]) ws.g[i * W + l] = 0;
+    }
+    for (int o = 0; o < ws.nO; ++o) {
+        const double *Jo = &ws.J[o * nP * W];
+        for (int i = 0; i < nP; ++i) {
+            const double *Ji = Jo + i * W;
+            for (int l = 0; l < W; ++l) {
+                if (!upd[l]) continue;
+                double w2 = ws.w[o * W + l] * ws.w[o * W + l];
+                ws.g[i * W + l] += w2 * Ji[l] * (ws.m[o * W + l] - ws.y[o * W + l]);
+            }
+            for (int j = 0; j <= i; ++j) {
+                const double *Jj = Jo + j * W;
+                double *a = &ws.JtJ[(i * nP + j) * W];
+                for (int l = 0; l < W; ++l) {
+                    if (!upd[l]) continue;
+                    double w2 = ws.w[o * W + l] * ws.w[o * W + l];
+                    a[l] += w2 * Ji[l] * Jj[l];
+                }
+            }
+        }
+    }
+    for (int i = 0; i < nP; ++i)
+        for (int j = i + 1; j < nP; ++j)
+            for (int l = 0; l < W; ++l)
+                if (upd[l]) ws.JtJ[(i * nP + j) * W + l] = ws.JtJ[(j * nP + i) * W + l];
+}
+
+// Solves (JtJ + lambda*diag(JtJ)) d = -g for every active lane with an
+// in-place SoA Cholesky. ws.ok[l] is cleared for non positive definite lanes.
+inline void dampedStep(Workspace &ws)
+{
+    const int W = ws.W, nP = ws.nP;
+    double *A = ws.A.data();
+    for (int i = 0; i < nP; ++i)
+        for (int j = 0; j < nP; ++j)
+            for (int l = 0; l < W; ++l) {
+                double v = ws.JtJ[(i * nP + j) * W + l];
+                if (i == j) v += ws.lambda[l] * std::max(v, 1e-12);
+                A[(i * nP + j) * W + l] = v;
+            }
+    for (int l = 0; l < W; ++l) ws.ok[l] = ws.active[l];
+
+    for (int j = 0; j < nP; ++j) {
+        double *Ajj = &A[(j * nP + j) * W];
+        for (int k = 0; k < j; ++k) {
+            const double *Ajk = &A[(j * nP + k) * W];
+            for (int l = 0; l < W; ++l) Ajj[l] -= Ajk[l] * Ajk[l];
+        }
+        for (int l = 0; l < W; ++l) {
+            if (!(Ajj[l] > 0)) { ws.ok[l] = 0; Ajj[l] = 1; }
+            Ajj[l] = std::sqrt(Ajj[l]);
+        }
+        for (int i = j + 1; i < nP; ++i) {
+            double *Aij = &A[(i * nP + j) * W];
+            for (int k = 0; k < j; ++k) {
+                const double *Aik = &A[(i * nP + k) * W];
+                const double *Ajk = &A[(j * nP + k) * W];
+                for (int l = 0; l < W; ++l) Aij[l] -= Aik[l] * Ajk[l];
+            }
+            for (int l = 0; l < W; ++l) Aij[l] /= Ajj[l];
+        }
+    }
+    // L z = -g
+    for (int i = 0; i < nP; ++i) {
+        double *di = &ws.d[i * W];
+        for (int l = 0; l < W; ++l) di[l] = -ws.g[i * W + l];
+        for (int k = 0; k < i; ++k) {
+            const double *Aik = &A[(i * nP + k) * W];
+            const double *dk = &ws.d[k * W];
+            for (int l = 0; l < W; ++l) di[l] -= Aik[l] * dk[l];
+        }
+        const double *Aii = &A[(i * nP + i) * W];
+        for (int l = 0; l < W; ++l) di[l] /= Aii[l];
+    }
+    // L' d = z
+    for (int i = nP - 1; i >= 0; --i) {
+        double *di = &ws.d[i * W];
+        for (int k = i + 1; k < nP; ++k) {
+            const double *Aki = &A[(k * nP + i) * W];
+            const double *dk = &ws.d[k * W];
+            for (int l = 0; l < W; ++l) di[l] -= Aki[l] * dk[l];
+        }
+        const double *Aii = &A[(i * nP + i) * W];
+        for (int l = 0; l < W; ++l) di[l] /= Aii[l];
+    }
+}
+
+inline void project(double *p, const double *lb, const double *ub, int nP, int W)
+{
+    for (int k = 0; k < nP; ++k)
+        for (int l = 0; l < W; ++l)
+            p[k * W + l] = std::min(ub[k], std::max(lb[k], p[k * W + l]));
+}
+
+} // namespace detail
+
+// Runs LM on the W lanes loaded in ws.p (start point), ws.y and ws.w
+// (observation weights, 0 for missing data). Returns the solution in ws.p,
+// the cost in ws.cost, ws.flag and ws.iter.
+template <class Kernel>
+void solveBlock(const Kernel &kernel, Workspace &ws,
+                const double *lb, const double *ub, const Options &opt)
+{
+    const int W = ws.W, nP = ws.nP;
+
+    detail::project(ws.p.data(), lb, ub, nP, W);
+    kernel.eval(ws.p.data(), ws.m.data(), ws.J.data(), W);
+    detail::cost(ws, ws.m.data(), ws.cost.data());
+
+    for (int l = 0; l < W; ++l) {
+        double wsum = 0;
+        for (int o = 0; o < ws.nO; ++o) wsum += ws.w[o * W + l];
+        bool valid = wsum > 0 && std::isfinite(ws.cost[l]);
+        ws.active[l] = valid;
+        ws.flag[l] = valid ? kMaxIter : kNoData;
+        ws.iter[l] = 0;
+        ws.lambda[l] = opt.lambda0;
+    }
+    detail::normalEquations(ws, ws.active.data());
+
+    std::vector<int> accepted(W);
+    for (int it = 0; it < opt.maxIter; ++it) {
+        bool any = false;
+        for (int l = 0; l < W; ++l) any = any || ws.active[l];
+        if (!any) break;
+
+        detail::dampedStep(ws);
+        for (int k = 0; k < nP; ++k)
+            for (int l = 0; l < W; ++l)
+                ws.pt[k * W + l] = ws.p[k * W + l] + (ws.ok[l] ? ws.d[k * W + l] : 0);
+        detail::project(ws.pt.data(), lb, ub, nP, W);
+
+        kernel.eval(ws.pt.data(), ws.m.data(), NULL, W);
+        detail::cost(ws, ws.m.data(), ws.costTrial.data());
+
+        bool anyAccepted = false;
+        for (int l = 0; l < W; ++l) {
+            accepted[l] = 0;
+            if (!ws.active[l]) continue;
+            ws.iter[l]++;
+            if (ws.ok[l] && ws.costTrial[l] < ws.cost[l]) {
+                double step = 0, norm = 0;
+                for (int k = 0; k < nP; ++k) {
+                    double dk = ws.pt[k * W + l] - ws.p[k * W + l];
+                    step += dk * dk;
+                    norm += ws.p[k * W + l] * ws.p[k * W + l];
+                    ws.p[k * W + l] = ws.pt[k * W + l];
+                }
+                double decrease = ws.cost[l] - ws.costTrial[l];
+                ws.cost[l] = ws.costTrial[l];
+                ws.lambda[l] = std::max(ws.lambda[l] * opt.lambdaDown, 1e-15);
+                accepted[l] = 1;
+                anyAccepted = true;
+                if (decrease <= opt.tolFun * (ws.cost[l] + opt.tolFun)) {
+                    ws.flag[l] = kConverged;
+                    ws.active[l] = 0;
+                } else if (std::sqrt(step) <= opt.tolX * (std::sqrt(norm) + opt.tolX)) {
+                    ws.flag[l] = kSmallStep;
+                    ws.active[l] = 0;
+                }
+            } else {
+                ws.lambda[l] *= opt.lambdaUp;
+                // No descent direction left within the bounds.
+                if (ws.lambda[l] > 1e16) {
+                    ws.flag[l] = kSmallStep;
+                    ws.active[l] = 0;
+                }
+            }
+        }
+        if (anyAccepted) {
+            kernel.eval(ws.p.data(), ws.m.data(), ws.J.data(), W);
+            detail::normalEquations(ws, accepted.data());
+        }
+    }
+}
+
+// Solves nV problems. Arrays are MATLAB column-major with voxels along the
+// rows: P0/P are nV x nP, Y is nV x nObs. Non-finite observations are
+// ignored. lb/ub hold nP values (use +/-Inf for unbounded parameters).
+// resnorm, exitflag and iterations (nV each) may be NULL.
+template <class Kernel>
+void solve(const Kernel &kernel, std::size_t nV, const double *P0, const double *Y,
+           const double *lb, const double *ub, const Options &opt,
+           double *P, double *resnorm, double *exitflag, double *iterations)
+{
+    const int nP = kernel.nParams(), nO = kernel.nObs();
+    const int W = std::max(1, opt.blockWidth);
+    const std::size_t nBlocks = (nV + W - 1) / W;
+    const int nt = parallel_width(nBlocks, 1, opt.numThreads);
+    std::vector<Workspace> pool(nt, Workspace(nP, nO, W));
+
+    parallel_for(nBlocks, 1, [&](std::size_t b0, std::size_t b1, int tid) {
+        Workspace &ws = pool[tid];
+        for (std::size_t b = b0; b < b1; ++b) {
+            const std::size_t v0 = b * W;
+            const int n = static_cast<int>(std::min<std::size_t>(W, nV - v0));
+            // Pad the last block by repeating its last voxel.
+            for (int l = 0; l < W; ++l) {
+                std::size_t v = v0 + std::min(l, n - 1);
+                for (int k = 0; k < nP; ++k) ws.p[k * W + l] = P0[v + k * nV];
+                for (int o = 0; o < nO; ++o) {
+                    double yo = Y[v + o * nV];
+                    bool finite = std::isfinite(yo);
+                    ws.y[o * W + l] = finite ? yo : 0;
+                    ws.w[o * W + l] = finite ? 1 : 0;
+                }
+            }
+            solveBlock(kernel, ws, lb, ub, opt);
+            for (int l = 0; l < n; ++l) {
+                std::size_t v = v0 + l;
+                bool valid = ws.flag[l] != kNoData;
+                for (int k = 0; k < nP; ++k)
+                    P[v + k * nV] = valid ? ws.p[k * W + l]
+                                          : std::numeric_limits<double>::quiet_NaN();
+                if (resnorm) resnorm[v] = valid ? ws.cost[l]
+                                                : std::numeric_limits<double>::quiet_NaN();
+                if (exitflag) exitflag[v] = ws.flag[l];
+                if (iterations) iterations[v] = ws.iter[l];
+            }
+        }
+    }, nt);
+}
+
+} // namespace lm
+} // namespace qmr
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * qmr_lm_kernels.hh: compiled signal models for the batched LM solver
+ * (qmr_lm.hh). Each kernel holds a pointer to the protocol vector (xdata),
+ * which must outlive the kernel.
+ *
+ * Parameter order matches the MATLAB models that use them:
+ *
+ *   monoexp         [M0 T2]        M0*exp(-x/T2)                (mono_t2)
+ *   monoexp_offset  [M0 T2 C]      M0*exp(-x/T2) + C            (mono_t2, OffsetTerm)
+ *   ir              [T1 b a]       a + b*exp(-x/T1)             (inversion_recovery)
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_LM_KERNELS_HH
+#define QMR_LM_KERNELS_HH
+
+#include <cmath>
+#include <cstddef>
+
+namespace qmr {
+namespace lm {
+
+class MonoExp {
+public:
+    MonoExp(const double *x, int nObs, bool offset) : x_(x), nO_(nObs), offset_(offset) {}
+    int nParams() const { return offset_ ? 3 : 2; }
+    int nObs() const { return nO_; }
+
+    void eval(const double *p, double *m, double *J, int W) const
+    {
+        const int nP = nParams();
+        const double *M0 = p, *T2 = p + W, *C = p + 2 * W;
+        for (int o = 0; o < nO_; ++o) {
+            const double x = x_[o];
+            double *mo = m + o * W;
+            double *Jo = J ? J + o * nP * W : NULL;
+            for (int l = 0; l < W; ++l) {
+                double r = 1.0 / T2[l];
+                double e = std::exp(-x * r);
+                mo[l] = M0[l] * e + (offset_ ? C[l] : 0.0);
+                if (Jo) {
+                    Jo[l] = e;
+                    Jo[W + l] = M0[l] * e * x * r * r;
+                    if (offset_) Jo[2 * W + l] = 1.0;
+                }
+            }
+        }
+    }
+
+private:
+    const double *x_;
+    int nO_;
+    bool offset_;
+};
+
+class InversionRecovery {
+public:
+    InversionRecovery(const double *x, int nObs) : x_(x), nO_(nObs) {}
+    int nParams() const { return 3; }
+    int nObs() const { return nO_; }
+
+    void eval(const double *p, double *m, double *J, int W) const
+    {
+        const double *T1 = p, *b = p + W, *a = p + 2 * W;
+        for (int o = 0; o < nO_; ++o) {
+            const double x = x_[o];
+            double *mo = m + o * W;
+            double *Jo = J ? J + o * 3 * W : NULL;
+            for (int l = 0; l < W; ++l) {
+                double r = 1.0 / T1[l];
+                double e = std::exp(-x * r);
+                mo[l] = a[l] + b[l] * e;
+                if (Jo) {
+                    Jo[l] = b[l] * e * x * r * r;
+                    Jo[W + l] = e;
+                    Jo[2 * W + l] = 1.0;
+                }
+            }
+        }
+    }
+
+private:
+    const double *x_;
+    int nO_;
+};
+
+} // namespace lm
+} // namespace qmr
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * [P, resnorm, exitflag, iterations] = qmr_lm_mex(kernel, P0, Y, xdata, lb, ub, opts)
+ *
+ * Batched bound-constrained Levenberg-Marquardt fit of nV voxels.
+ * Use through batchLM.m rather than calling this gateway directly.
+ *
+ *   kernel   name of a compiled model ('monoexp', 'monoexp_offset', 'ir')
+ *            or a function handle [F, J] = fun(P, xdata) evaluating nP x n
+ *            parameters P to F (nObs x n) and, when opts.Jacobian is true,
+ *            J (nObs x nP x n).
+ *   P0       nV x nP starting points
+ *   Y        nV x nObs data (NaN/Inf observations are ignored)
+ *   xdata    protocol vector (nObs elements)
+ *   lb, ub   1 x nP bounds, or [] for unbounded
+ *   opts     struct with optional fields MaxIter, TolFun, TolX, Lambda0,
+ *            BlockSize, NumThreads, Jacobian
+ *
+ * Function-handle kernels are evaluated on the MATLAB thread, one call per
+ * block of BlockSize voxels (default 4096); compiled kernels run on all
+ * cores in blocks of 16 voxels.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "qmr_lm.hh"
+#include "qmr_lm_kernels.hh"
+
+static const char *kName = "qmr_lm_mex";
+
+// Forward model implemented by a MATLAB function handle.
+class MatlabKernel {
+public:
+    MatlabKernel(const mxArray *fun, const mxArray *xdata, int nP, int nO)
+        : fun_(const_cast<mxArray *>(fun)), xdata_(const_cast<mxArray *>(xdata)),
+          nP_(nP), nO_(nO) {}
+    int nParams() const { return nP_; }
+    int nObs() const { return nO_; }
+
+    void eval(const double *p, double *m, double *J, int W) const
+    {
+        mxArray *P = mxCreateDoubleMatrix(nP_, W, mxREAL);
+        double *pp = mxGetPr(P);
+        for (int l = 0; l < W; ++l)
+            for (int k = 0; k < nP_; ++k) pp[k + l * nP_] = p[k * W + l];
+
+        mxArray *rhs[3] = {fun_, P, xdata_};
+        mxArray *lhs[2] = {NULL, NULL};
+        int nout = J ? 2 : 1;
+        mexCallMATLAB(nout, lhs, 3, rhs, "feval");
+        mxDestroyArray(P);
+
+        if (!mxIsDouble(lhs[0]) || mxGetNumberOfElements(lhs[0]) != (std::size_t)nO_ * W)
+            qmr::mex::fail(kName, "invalidKernelOutput",
+                           "The model function must return a double nObs x n array F.");
+        const double *F = mxGetPr(lhs[0]);
+        for (int l = 0; l < W; ++l)
+            for (int o = 0; o < nO_; ++o) m[o * W + l] = F[o + l * nO_];
+        mxDestroyArray(lhs[0]);
+
+        if (J) {
+            if (!mxIsDouble(lhs[1]) ||
+                mxGetNumberOfElements(lhs[1]) != (std::size_t)nO_ * nP_ * W)
+                qmr::mex::fail(kName, "invalidKernelOutput",
+                               "The model function must return a double nObs x nP x n Jacobian J.");
+            const double *Jm = mxGetPr(lhs[1]);
+            for (int l = 0; l < W; ++l)
+                for (int k = 0; k < nP_; ++k)
+                    for (int o = 0; o < nO_; ++o)
+                        J[(o * nP_ + k) * W + l] = Jm[o + nO_ * (k + nP_ * l)];
+            mxDestroyArray(lhs[1]);
+        }
+    }
+
+private:
+    mxArray *fun_;
+    mxArray *xdata_;
+    int nP_, nO_;
+};
+
+static std::vector<double> bound(const mxArray *a, int nP, double fill, const char *argName)
+{
+    std::vector<double> b(nP, fill);
+    if (!a || mxIsEmpty(a)) return b;
+    qmr::mex::requireDouble(kName, a, argName);
+    if ((int)mxGetNumberOfElements(a) != nP)
+        qmr::mex::fail(kName, "invalidBounds",
+                       std::string(argName) + " must have one element per parameter.");
+    const double *v = mxGetPr(a);
+    for (int k = 0; k < nP; ++k)
+        if (!std::isnan(v[k])) b[k] = v[k];
+    return b;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 4 || nrhs > 7)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_lm_mex expects 4 to 7 input arguments.");
+
+    const mxArray *P0a = prhs[1], *Ya = prhs[2], *xa = prhs[3];
+    qmr::mex::requireDouble(kName, P0a, "P0");
+    qmr::mex::requireDouble(kName, Ya, "Y");
+    qmr::mex::requireDouble(kName, xa, "xdata");
+
+    const std::size_t nV = mxGetM(P0a);
+    const int nP = static_cast<int>(mxGetN(P0a));
+    const int nO = static_cast<int>(mxGetNumberOfElements(xa));
+    if (mxGetM(Ya) != nV || (int)mxGetN(Ya) != nO)
+        qmr::mex::fail(kName, "invalidInputSize",
+                       "Y must be nV x numel(xdata), with nV = size(P0,1).");
+
+    const mxArray *opts = nrhs > 6 ? prhs[6] : NULL;
+    qmr::lm::Options opt;
+    opt.maxIter = (int)qmr::mex::option(opts, "MaxIter", opt.maxIter);
+    opt.tolFun = qmr::mex::option(opts, "TolFun", opt.tolFun);
+    opt.tolX = qmr::mex::option(opts, "TolX", opt.tolX);
+    opt.lambda0 = qmr::mex::option(opts, "Lambda0", opt.lambda0);
+    opt.numThreads = (int)qmr::mex::option(opts, "NumThreads", 0);
+    bool jacobian = qmr::mex::option(opts, "Jacobian", 1) != 0;
+
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> lb = bound(nrhs > 4 ? prhs[4] : NULL, nP, -inf, "lb");
+    std::vector<double> ub = bound(nrhs > 5 ? prhs[5] : NULL, nP, inf, "ub");
+
+    plhs[0] = mxCreateDoubleMatrix(nV, nP, mxREAL);
+    mxArray *res = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *flag = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *iter = mxCreateDoubleMatrix(nV, 1, mxREAL);
+
+    const double *P0 = mxGetPr(P0a), *Y = mxGetPr(Ya), *x = mxGetPr(xa);
+    double *P = mxGetPr(plhs[0]);
+
+    if (mxIsClass(prhs[0], "function_handle")) {
+        MatlabKernel k(prhs[0], xa, nP, nO);
+        opt.blockWidth = (int)qmr::mex::option(opts, "BlockSize", 4096);
+        opt.numThreads = 1;
+        if (jacobian)
+            qmr::lm::solve(k, nV, P0, Y, lb.data(), ub.data(), opt,
+                           P, mxGetPr(res), mxGetPr(flag), mxGetPr(iter));
+        else
+            qmr::lm::solve(qmr::lm::FiniteDifference<MatlabKernel>(k), nV, P0, Y,
+                           lb.data(), ub.data(), opt,
+                           P, mxGetPr(res), mxGetPr(flag), mxGetPr(iter));
+    } else {
+        std::string name = qmr::mex::string(kName, prhs[0], "kernel");
+        opt.blockWidth = (int)qmr::mex::option(opts, "BlockSize", opt.blockWidth);
+        if (name == "monoexp" || name == "monoexp_offset") {
+            qmr::lm::MonoExp k(x, nO, name == "monoexp_offset");
+            if (k.nParams() != nP)
+                qmr::mex::fail(kName, "invalidInputSize", "P0 has the wrong number of columns for kernel " + name + ".");
+            qmr::lm::solve(k, nV, P0, Y, lb.data(), ub.data(), opt,
+                           P, mxGetPr(res), mxGetPr(flag), mxGetPr(iter));
+        } else if (name == "ir") {
+            qmr::lm::InversionRecovery k(x, nO);
+            if (k.nParams() != nP)
+                qmr::mex::fail(kName, "invalidInputSize", "P0 has the wrong number of columns for kernel ir.");
+            qmr::lm::solve(k, nV, P0, Y, lb.data(), ub.data(), opt,
+                           P, mxGetPr(res), mxGetPr(flag), mxGetPr(iter));
+        } else {
+            qmr::mex::fail(kName, "unknownKernel", "Unknown kernel '" + name + "'.");
+        }
+    }
+
+    if (nlhs > 1) plhs[1] = res; else mxDestroyArray(res);
+    if (nlhs > 2) plhs[2] = flag; else mxDestroyArray(flag);
+    if (nlhs > 3) plhs[3] = iter; else mxDestroyArray(iter);
+}
@@ -0,0 +1,109 @@
+/*
+ * qmr_mapped.hh: read-only memory mapping of a whole file, shared by the
+ * qMRLab MEX engines that read large files in place (qmr_nifti.hh,
+ * qmr_dicom.hh). Pages are read from disk when first touched.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_MAPPED_HH
+#define QMR_MAPPED_HH
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace qmr {
+
+// Read-only mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() : data_(NULL), size_(0)
+#ifdef _WIN32
+        , file_(INVALID_HANDLE_VALUE), map_(NULL)
+#endif
+    {}
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) return false;
+        size_ = (std::size_t)size.QuadPart;
+        if (size_ == 0) return true;
+        map_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!map_) return false;
+        data_ = static_cast<const unsigned char *>(MapViewOfFile(map_, FILE_MAP_READ, 0, 0, 0));
+        return data_ != NULL;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = (std::size_t)st.st_size;
+        if (size_ == 0) {
+            ::close(fd);
+            return true;
+        }
+        void *p = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);   // the mapping stays valid
+        if (p == MAP_FAILED) {
+            size_ = 0;
+            return false;
+        }
+        data_ = static_cast<const unsigned char *>(p);
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (map_) CloseHandle(map_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        map_ = NULL;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(const_cast<unsigned char *>(data_), size_);
+#endif
+        data_ = NULL;
+        size_ = 0;
+    }
+
+    const unsigned char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    const unsigned char *data_;
+    std::size_t size_;
+#ifdef _WIN32
+    HANDLE file_, map_;
+#endif
+};
+
+} // namespace qmr
+
+#endif
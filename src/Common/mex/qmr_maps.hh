@@ -0,0 +1,244 @@
+/*
+ * qmr_maps.hh: closed-form relaxometry and B1 map kernels.
+ *
+ * Whole-volume, single pass versions of the per-voxel formulas of
+ *
+ *   vfa  - Compute_M0_T1_OnSPGR.m (DESPOT1 linear fit S/sin(a) vs
+ *          S/tan(a)), optionally reweighted as in Chang et al. 2008
+ *   mtsat - MTSAT_exec.m (MTsat and R1, with optional B1 correction)
+ *   afi  - b1_afi.fit (actual flip angle imaging)
+ *   dam  - b1_dam.fit (double angle method)
+ *
+ * Volumes are processed in blocks of kBlock voxels split across threads.
+ * Inside a block the loops run over contiguous voxels with per-volume
+ * constants hoisted, so the compiler vectorizes them; each input volume is
+ * read once and each output written once. Inputs and outputs are templated
+ * on float/double (single-precision volumes halve the memory traffic) and
+ * arithmetic is done in double. Masks, zeros and NaN are handled in the
+ * kernels with the conventions of the MATLAB functions.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_MAPS_HH
+#define QMR_MAPS_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace maps {
+
+static const std::size_t kBlock = 512;
+static const double kPi = 3.14159265358979323846;
+
+namespace detail {
+
+inline double nan() { return std::numeric_limits<double>::quiet_NaN(); }
+
+// MATLAB abs(acos(x)) for real x, including |x| > 1 (complex acos).
+inline double absAcos(double x)
+{
+    if (x > 1) return std::acosh(x);
+    if (x < -1) return std::hypot(kPi, std::acosh(-x));
+    return std::acos(x);
+}
+
+} // namespace detail
+
+// ---------------------------------------------------------------- VFA --
+
+struct VFAParams {
+    std::vector<double> flipAngles;   // degrees
+    double TR;
+    bool weighted;                    // one reweighting pass (Chang 2008)
+};
+
+// data: nVox x nFlip (flip angle volumes one after the other).
+// b1, mask: nVox or NULL. Voxels outside the mask get 0; failed fits
+// (NaN, negative slope or intercept) get NaN.
+template <class In, class Aux, class Out>
+void vfa(const VFAParams &p, std::size_t nVox, const In *data, const Aux *b1, const Aux *mask,
+         Out *T1, Out *M0, int nthreads = 0)
+{
+    const std::size_t nF = p.flipAngles.size();
+    std::vector<double> alpha(nF), sinA(nF), tanA(nF), cosA(nF);
+    for (std::size_t i = 0; i < nF; ++i) {
+        alpha[i] = p.flipAngles[i] * kPi / 180;
+        sinA[i] = std::sin(alpha[i]);
+        tanA[i] = std::tan(alpha[i]);
+        cosA[i] = std::cos(alpha[i]);
+    }
+    const double n = static_cast<double>(nF);
+
+    parallel_for((nVox + kBlock - 1) / kBlock, 1, [&](std::size_t b0, std::size_t b1e, int) {
+        double sx[kBlock], sy[kBlock], sxy[kBlock], sxx[kBlock], slope[kBlock], icpt[kBlock];
+        for (std::size_t blk = b0; blk < b1e; ++blk) {
+            const std::size_t v0 = blk * kBlock, m = std::min(kBlock, nVox - v0);
+            std::fill(sx, sx + m, 0.0); std::fill(sy, sy + m, 0.0);
+            std::fill(sxy, sxy + m, 0.0); std::fill(sxx, sxx + m, 0.0);
+
+            for (std::size_t i = 0; i < nF; ++i) {
+                const In *s = data + i * nVox + v0;
+                if (!b1) {
+                    const double sa = sinA[i], ta = tanA[i];
+                    for (std::size_t j = 0; j < m; ++j) {
+                        const double x = s[j] / ta, y = s[j] / sa;
+                        sx[j] += x; sy[j] += y; sxy[j] += x * y; sxx[j] += x * x;
+                    }
+                } else {
+                    for (std::size_t j = 0; j < m; ++j) {
+                        const double a = alpha[i] * b1[v0 + j];
+                        const double x = s[j] / std::tan(a), y = s[j] / std::sin(a);
+                        sx[j] += x; sy[j] += y; sxy[j] += x * y; sxx[j] += x * x;
+                    }
+                }
+            }
+            // LinLeastSquares
+            for (std::size_t j = 0; j < m; ++j) {
+                slope[j] = (sxy[j] - sx[j] * sy[j] / n) / (sxx[j] - sx[j] * sx[j] / n);
+                icpt[j] = sy[j] / n - slope[j] * (sx[j] / n);
+            }
+
+            if (p.weighted) {
+                // Residual variance of S/sin(a) - E1 S/tan(a) is proportional
+                // to ((1 - E1 cos a)/sin a)^2: refit with the inverse weights.
+                double sw[kBlock];
+                std::fill(sw, sw + m, 0.0);
+                std::fill(sx, sx + m, 0.0); std::fill(sy, sy + m, 0.0);
+                std::fill(sxy, sxy + m, 0.0); std::fill(sxx, sxx + m, 0.0);
+                for (std::size_t i = 0; i < nF; ++i) {
+                    const In *s = data + i * nVox + v0;
+                    for (std::size_t j = 0; j < m; ++j) {
+                        const double a = b1 ? alpha[i] * b1[v0 + j] : alpha[i];
+                        const double sa = b1 ? std::sin(a) : sinA[i];
+                        const double ca = b1 ? std::cos(a) : cosA[i];
+                        const double r = sa / (1 - slope[j] * ca), w = r * r;
+                        const double x = s[j] * ca / sa, y = s[j] / sa;
+                        sw[j] += w; sx[j] += w * x; sy[j] += w * y;
+                        sxy[j] += w * x * y; sxx[j] += w * x * x;
+                    }
+                }
+                for (std::size_t j = 0; j < m; ++j) {
+                    if (std::isnan(slope[j]) || slope[j] < 0) continue;
+                    slope[j] = (sw[j] * sxy[j] - sx[j] * sy[j]) / (sw[j] * sxx[j] - sx[j] * sx[j]);
+                    icpt[j] = (sy[j] - slope[j] * sx[j]) / sw[j];
+                }
+            }
+
+            for (std::size_t j = 0; j < m; ++j) {
+                const std::size_t v = v0 + j;
+                double t1, m0;
+                if (mask && !(mask[v] != 0)) {
+                    t1 = m0 = 0;
+                } else if (std::isnan(slope[j]) || slope[j] < 0 || std::isnan(icpt[j]) || icpt[j] < 0) {
+                    t1 = m0 = detail::nan();
+                } else {
+                    m0 = icpt[j] / (1 - slope[j]);
+                    t1 = -p.TR / std::log(slope[j]);
+                }
+                T1[v] = static_cast<Out>(t1);
+                M0[v] = static_cast<Out>(m0);
+            }
+        }
+    }, nthreads);
+}
+
+// -------------------------------------------------------------- MTsat --
+
+struct MTsatParams {
+    double faMT, trMT, faPD, trPD, faT1, trT1;   // degrees, TR
+    double b1Factor;                             // empirical B1 correction
+};
+
+// Voxels where any of MTw, T1w, PDw is 0 get MTsat = R1 = 0. With b1, MTsat
+// is multiplied by (1-f)/(1-f*B1) everywhere; with mask, by the mask value.
+template <class In, class Aux, class Out>
+void mtsat(const MTsatParams &p, std::size_t nVox, const In *MTw, const In *T1w, const In *PDw,
+           const Aux *b1, const Aux *mask, Out *MTsat, Out *R1, int nthreads = 0)
+{
+    const double aMT = kPi / 180 * p.faMT, aPD = kPi / 180 * p.faPD, aT1 = kPi / 180 * p.faT1;
+    const double cT1 = aT1 / p.trT1, cPD = aPD / p.trPD;
+    const double cA = p.trPD * aT1 / aPD - p.trT1 * aPD / aT1;
+    const double f = p.b1Factor;
+
+    parallel_for((nVox + kBlock - 1) / kBlock, 1, [&](std::size_t b0, std::size_t b1e, int) {
+        for (std::size_t blk = b0; blk < b1e; ++blk) {
+            const std::size_t v0 = blk * kBlock, v1 = std::min(nVox, v0 + kBlock);
+            for (std::size_t v = v0; v < v1; ++v) {
+                const double mt = MTw[v], t1w = T1w[v], pd = PDw[v];
+                double r1 = 0, ms = 0;
+                if (pd != 0 && t1w != 0 && mt != 0) {
+                    const double b = b1 ? static_cast<double>(b1[v]) : 1;
+                    r1 = (b1 ? 0.5 * b * b : 0.5) * (cT1 * t1w - cPD * pd) / (pd / aPD - t1w / aT1);
+                    double A = cA * ((pd * t1w) / (p.trPD * aT1 * t1w - p.trT1 * aPD * pd));
+                    if (b1) A = (1 / b) * A;
+                    ms = 100 * (p.trMT * (aMT * (A / mt) - 1) * r1 - aMT * aMT / 2);
+                }
+                if (b1) ms = ms * (1 - f) / (1 - f * b1[v]);
+                if (mask) ms = ms * mask[v];
+                MTsat[v] = static_cast<Out>(ms);
+                R1[v] = static_cast<Out>(r1);
+            }
+        }
+    }, nthreads);
+}
+
+// ------------------------------------------------------------- B1 maps --
+
+// Shared post-processing of b1_afi / b1_dam: raw map, spurious flag
+// (raw < 0.5) and the map with spurious or NaN values set to 0.6.
+template <class Out>
+inline void b1Outputs(double raw, std::size_t v, Out *B1raw, Out *spurious, Out *B1nospur)
+{
+    B1raw[v] = static_cast<Out>(raw);
+    if (spurious) spurious[v] = static_cast<Out>(raw < 0.5 ? 1 : 0);
+    if (B1nospur) B1nospur[v] = static_cast<Out>((raw < 0.6 || std::isnan(raw)) ? 0.6 : raw);
+}
+
+// AFI: r = |S2/S1|, n = TR2/TR1, FA = acos((r n - 1)/(n - r)) (1 for r > 1).
+template <class In, class Out>
+void afi(double nomFA, double n, std::size_t nVox, const In *S1, const In *S2,
+         Out *B1raw, Out *spurious, Out *B1nospur, int nthreads = 0)
+{
+    const double scale = 180 / kPi / nomFA;
+    parallel_for((nVox + kBlock - 1) / kBlock, 1, [&](std::size_t b0, std::size_t b1e, int) {
+        for (std::size_t blk = b0; blk < b1e; ++blk) {
+            const std::size_t v0 = blk * kBlock, v1 = std::min(nVox, v0 + kBlock);
+            for (std::size_t v = v0; v < v1; ++v) {
+                const double r = std::fabs(static_cast<double>(S2[v]) / S1[v]);
+                const double c = ((r * n - 1) / (n - r)) * (r <= 1 ? 1 : 0) + (r > 1 ? 1 : 0);
+                // acos of c < -1 is complex in MATLAB; keep its real part.
+                const double fa = c < -1 ? kPi : std::acos(c);
+                b1Outputs(fa * scale, v, B1raw, spurious, B1nospur);
+            }
+        }
+    }, nthreads);
+}
+
+// DAM: B1 = |acos(S(2a) / (2 S(a)))| / a.
+template <class In, class Out>
+void dam(double alphaDeg, std::size_t nVox, const In *Sa, const In *S2a,
+         Out *B1raw, Out *spurious, Out *B1nospur, int nthreads = 0)
+{
+    const double a = alphaDeg * kPi / 180;
+    parallel_for((nVox + kBlock - 1) / kBlock, 1, [&](std::size_t b0, std::size_t b1e, int) {
+        for (std::size_t blk = b0; blk < b1e; ++blk) {
+            const std::size_t v0 = blk * kBlock, v1 = std::min(nVox, v0 + kBlock);
+            for (std::size_t v = v0; v < v1; ++v) {
+                const double x = static_cast<double>(S2a[v]) / (2 * static_cast<double>(Sa[v]));
+                b1Outputs(std::fabs(detail::absAcos(x) / a), v, B1raw, spurious, B1nospur);
+            }
+        }
+    }, nthreads);
+}
+
+} // namespace maps
+} // namespace qmr
+
+#endif
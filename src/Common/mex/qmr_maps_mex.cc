@@ -0,0 +1,194 @@
+/*
+ * Closed-form relaxometry and B1 maps (see qmr_maps.hh).
+ *
+ *   [T1, M0]  = qmr_maps_mex('vfa', data, flipAngles, TR, B1, Mask, opts)
+ *   [MTsat, R1] = qmr_maps_mex('mtsat', MTw, T1w, PDw, B1, Mask, MTparams, PDparams, T1params, B1factor, opts)
+ *   [B1raw, Spurious, B1nospur] = qmr_maps_mex('afi', AFIData1, AFIData2, nomFA, TR2/TR1, opts)
+ *   [B1raw, Spurious, B1nospur] = qmr_maps_mex('dam', SFalpha, SF2alpha, alpha, opts)
+ *
+ * Volumes are real double or single arrays (B1 and Mask may be [], Mask may
+ * be logical). For 'vfa' the last dimension of data holds the flip angles.
+ * *params are [FlipAngle TR] pairs as in MTSAT_exec. opts is an optional
+ * struct with NumThreads (0: all cores) and, for 'vfa', Weighted (false).
+ *
+ * Outputs have the spatial size of the first volume and are single when it
+ * is single, double otherwise.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "qmr_maps.hh"
+
+static const char *kName = "qmr_maps_mex";
+
+namespace {
+
+// Holds a volume converted to the working class (double or single).
+class Volume {
+public:
+    Volume(const mxArray *a, bool single, const char *argName) : a_(a), tmp_(NULL)
+    {
+        if (mxIsEmpty(a)) { a_ = NULL; return; }
+        if (mxIsComplex(a) || mxIsSparse(a) || !(mxIsNumeric(a) || mxIsLogical(a)))
+            qmr::mex::fail(kName, "invalidInputType", std::string(argName) + " must be a real array.");
+        if (single ? !mxIsSingle(a) : !mxIsDouble(a)) {
+            mxArray *in = const_cast<mxArray *>(a);
+            mexCallMATLAB(1, &tmp_, 1, &in, single ? "single" : "double");
+            a_ = tmp_;
+        }
+    }
+    ~Volume() { if (tmp_) mxDestroyArray(tmp_); }
+
+    bool empty() const { return a_ == NULL; }
+    std::size_t numel() const { return a_ ? mxGetNumberOfElements(a_) : 0; }
+    template <class T> const T *data() const { return a_ ? static_cast<const T *>(mxGetData(a_)) : NULL; }
+
+private:
+    Volume(const Volume &);
+    Volume &operator=(const Volume &);
+    const mxArray *a_;
+    mxArray *tmp_;
+};
+
+mxArray *createLike(const mxArray *a, bool single, std::size_t dropLast = 0)
+{
+    std::vector<mwSize> d(mxGetDimensions(a), mxGetDimensions(a) + mxGetNumberOfDimensions(a));
+    if (dropLast) {
+        // Spatial size of a volume whose last dimension holds dropLast samples.
+        if (d.size() <= 2 && (d[0] == 1 || d[1] == 1)) d.assign(2, 1);
+        else d.pop_back();
+        if (d.size() < 2) d.push_back(1);
+    }
+    return mxCreateNumericArray(d.size(), d.data(), single ? mxSINGLE_CLASS : mxDOUBLE_CLASS, mxREAL);
+}
+
+template <class T> T *out(mxArray *a) { return static_cast<T *>(mxGetData(a)); }
+
+std::vector<double> pair(const mxArray *a, const char *argName)
+{
+    std::vector<double> v = qmr::mex::toVector(a);
+    if (v.size() < 2)
+        qmr::mex::fail(kName, "invalidInputSize", std::string(argName) + " must be [FlipAngle TR].");
+    return v;
+}
+
+void checkSize(const Volume &v, std::size_t n, const char *argName)
+{
+    if (!v.empty() && v.numel() != n)
+        qmr::mex::fail(kName, "invalidInputSize", std::string(argName) + " must have the spatial size of the data.");
+}
+
+void vfa(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 6 || nrhs > 7)
+        qmr::mex::fail(kName, "wrongNumInputs", "'vfa' expects data, flipAngles, TR, B1, Mask[, opts].");
+    const bool single = mxIsSingle(prhs[1]);
+    qmr::maps::VFAParams p;
+    p.flipAngles = qmr::mex::toVector(prhs[2]);
+    p.TR = qmr::mex::scalar(kName, prhs[3], "TR");
+    const mxArray *opts = nrhs > 6 ? prhs[6] : NULL;
+    p.weighted = qmr::mex::option(opts, "Weighted", 0.0) != 0;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    Volume data(prhs[1], single, "data"), b1(prhs[4], single, "B1"), mask(prhs[5], single, "Mask");
+    const std::size_t nF = p.flipAngles.size();
+    if (!nF || data.numel() % nF)
+        qmr::mex::fail(kName, "invalidInputSize", "The last dimension of data must match flipAngles.");
+    const std::size_t nVox = data.numel() / nF;
+    checkSize(b1, nVox, "B1");
+    checkSize(mask, nVox, "Mask");
+
+    plhs[0] = createLike(prhs[1], single, nF);
+    mxArray *M0 = createLike(prhs[1], single, nF);
+    if (single)
+        qmr::maps::vfa(p, nVox, data.data<float>(), b1.data<float>(), mask.data<float>(),
+                       out<float>(plhs[0]), out<float>(M0), nthreads);
+    else
+        qmr::maps::vfa(p, nVox, data.data<double>(), b1.data<double>(), mask.data<double>(),
+                       out<double>(plhs[0]), out<double>(M0), nthreads);
+    if (nlhs > 1) plhs[1] = M0; else mxDestroyArray(M0);
+}
+
+void mtsat(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 10 || nrhs > 11)
+        qmr::mex::fail(kName, "wrongNumInputs",
+                       "'mtsat' expects MTw, T1w, PDw, B1, Mask, MTparams, PDparams, T1params, B1factor[, opts].");
+    const bool single = mxIsSingle(prhs[1]);
+    Volume MTw(prhs[1], single, "MTw"), T1w(prhs[2], single, "T1w"), PDw(prhs[3], single, "PDw");
+    Volume b1(prhs[4], single, "B1"), mask(prhs[5], single, "Mask");
+    const std::size_t n = MTw.numel();
+    if (T1w.numel() != n || PDw.numel() != n)
+        qmr::mex::fail(kName, "invalidInputSize", "MTw, T1w and PDw must have the same size.");
+    checkSize(b1, n, "B1");
+    checkSize(mask, n, "Mask");
+
+    std::vector<double> mt = pair(prhs[6], "MTparams"), pd = pair(prhs[7], "PDparams"),
+                        t1 = pair(prhs[8], "T1params");
+    qmr::maps::MTsatParams p;
+    p.faMT = mt[0]; p.trMT = mt[1];
+    p.faPD = pd[0]; p.trPD = pd[1];
+    p.faT1 = t1[0]; p.trT1 = t1[1];
+    p.b1Factor = qmr::mex::scalar(kName, prhs[9], "B1factor");
+    const int nthreads = (int)qmr::mex::option(nrhs > 10 ? prhs[10] : NULL, "NumThreads", 0.0);
+
+    plhs[0] = createLike(prhs[1], single);
+    mxArray *R1 = createLike(prhs[1], single);
+    if (single)
+        qmr::maps::mtsat(p, n, MTw.data<float>(), T1w.data<float>(), PDw.data<float>(),
+                         b1.data<float>(), mask.data<float>(), out<float>(plhs[0]), out<float>(R1), nthreads);
+    else
+        qmr::maps::mtsat(p, n, MTw.data<double>(), T1w.data<double>(), PDw.data<double>(),
+                         b1.data<double>(), mask.data<double>(), out<double>(plhs[0]), out<double>(R1), nthreads);
+    if (nlhs > 1) plhs[1] = R1; else mxDestroyArray(R1);
+}
+
+void b1map(bool isAfi, int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    const int nArgs = isAfi ? 5 : 4;
+    if (nrhs < nArgs || nrhs > nArgs + 1)
+        qmr::mex::fail(kName, "wrongNumInputs", isAfi ? "'afi' expects AFIData1, AFIData2, nomFA, n[, opts]."
+                                                      : "'dam' expects SFalpha, SF2alpha, alpha[, opts].");
+    const bool single = mxIsSingle(prhs[1]);
+    Volume s1(prhs[1], single, "data"), s2(prhs[2], single, "data");
+    const std::size_t n = s1.numel();
+    if (s2.numel() != n)
+        qmr::mex::fail(kName, "invalidInputSize", "Both volumes must have the same size.");
+    const double angle = qmr::mex::scalar(kName, prhs[3], isAfi ? "nomFA" : "alpha");
+    const double ratio = isAfi ? qmr::mex::scalar(kName, prhs[4], "n") : 0;
+    const int nthreads = (int)qmr::mex::option(nrhs > nArgs ? prhs[nArgs] : NULL, "NumThreads", 0.0);
+
+    mxArray *all[3];
+    for (int k = 0; k < 3; ++k) all[k] = k == 0 || k < nlhs ? createLike(prhs[1], single) : NULL;
+    if (single) {
+        float *o[3];
+        for (int k = 0; k < 3; ++k) o[k] = all[k] ? out<float>(all[k]) : NULL;
+        if (isAfi) qmr::maps::afi(angle, ratio, n, s1.data<float>(), s2.data<float>(), o[0], o[1], o[2], nthreads);
+        else qmr::maps::dam(angle, n, s1.data<float>(), s2.data<float>(), o[0], o[1], o[2], nthreads);
+    } else {
+        double *o[3];
+        for (int k = 0; k < 3; ++k) o[k] = all[k] ? out<double>(all[k]) : NULL;
+        if (isAfi) qmr::maps::afi(angle, ratio, n, s1.data<double>(), s2.data<double>(), o[0], o[1], o[2], nthreads);
+        else qmr::maps::dam(angle, n, s1.data<double>(), s2.data<double>(), o[0], o[1], o[2], nthreads);
+    }
+    for (int k = 0; k < 3; ++k) if (all[k]) plhs[k] = all[k];
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 1)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_maps_mex expects a kernel name.");
+    const std::string kernel = qmr::mex::string(kName, prhs[0], "kernel");
+    if (kernel == "vfa") vfa(nlhs, plhs, nrhs, prhs);
+    else if (kernel == "mtsat") mtsat(nlhs, plhs, nrhs, prhs);
+    else if (kernel == "afi") b1map(true, nlhs, plhs, nrhs, prhs);
+    else if (kernel == "dam") b1map(false, nlhs, plhs, nrhs, prhs);
+    else qmr::mex::fail(kName, "unknownKernel", "Unknown kernel '" + kernel + "'.");
+}
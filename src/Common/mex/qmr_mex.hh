@@ -0,0 +1,108 @@
+/*
+ * qmr_mex.hh: argument helpers shared by the qMRLab MEX gateways.
+ *
+ * Error identifiers follow the MATLAB convention
+ * "qMRLab:<function>:<reason>", e.g. "qMRLab:qmr_lm_mex:wrongNumInputs".
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_MEX_HH
+#define QMR_MEX_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+
+namespace qmr {
+namespace mex {
+
+inline void fail(const char *fname, const char *reason, const std::string &msg)
+{
+    std::string id = std::string("qMRLab:") + fname + ":" + reason;
+    mexErrMsgIdAndTxt(id.c_str(), "%s", msg.c_str());
+}
+
+// Real, dense, double array check.
+inline void requireDouble(const char *fname, const mxArray *a, const char *argName)
+{
+    if (!mxIsDouble(a) || mxIsComplex(a) || mxIsSparse(a))
+        fail(fname, "invalidInputType",
+             std::string(argName) + " must be a real, full, double array.");
+}
+
+inline double scalar(const char *fname, const mxArray *a, const char *argName)
+{
+    if (!mxIsNumeric(a) && !mxIsLogical(a))
+        fail(fname, "invalidInputType", std::string(argName) + " must be numeric.");
+    if (mxGetNumberOfElements(a) != 1)
+        fail(fname, "invalidInputSize", std::string(argName) + " must be a scalar.");
+    return mxGetScalar(a);
+}
+
+inline std::string string(const char *fname, const mxArray *a, const char *argName)
+{
+    if (!mxIsChar(a))
+        fail(fname, "invalidInputType", std::string(argName) + " must be a character vector.");
+    char *buf = mxArrayToString(a);
+    std::string s(buf ? buf : "");
+    mxFree(buf);
+    return s;
+}
+
+// Optional option-struct field. Missing or empty fields return `def`.
+inline double option(const mxArray *opts, const char *field, double def)
+{
+    if (!opts || !mxIsStruct(opts)) return def;
+    const mxArray *f = mxGetField(opts, 0, field);
+    if (!f || mxIsEmpty(f) || !(mxIsNumeric(f) || mxIsLogical(f))) return def;
+    return mxGetScalar(f);
+}
+
+inline std::string option(const mxArray *opts, const char *field, const std::string &def)
+{
+    if (!opts || !mxIsStruct(opts)) return def;
+    const mxArray *f = mxGetField(opts, 0, field);
+    if (!f || !mxIsChar(f)) return def;
+    char *buf = mxArrayToString(f);
+    std::string s(buf ? buf : "");
+    mxFree(buf);
+    return s;
+}
+
+// Copies any real numeric array into a std::vector<double>.
+inline std::vector<double> toVector(const mxArray *a)
+{
+    std::size_t n = mxGetNumberOfElements(a);
+    std::vector<double> v(n);
+    if (mxIsDouble(a)) {
+        const double *p = mxGetPr(a);
+        v.assign(p, p + n);
+        return v;
+    }
+    mxArray *in = const_cast<mxArray *>(a);
+    mxArray *out = NULL;
+    mexCallMATLAB(1, &out, 1, &in, "double");
+    const double *p = mxGetPr(out);
+    v.assign(p, p + n);
+    mxDestroyArray(out);
+    return v;
+}
+
+// Dimensions of `a`, padded with ones up to `ndims`.
+inline std::vector<std::size_t> dims(const mxArray *a, std::size_t ndims)
+{
+    std::size_t nd = mxGetNumberOfDimensions(a);
+    const mwSize *d = mxGetDimensions(a);
+    std::vector<std::size_t> out(std::max(nd, ndims), 1);
+    for (std::size_t k = 0; k < nd; ++k) out[k] = d[k];
+    return out;
+}
+
+} // namespace mex
+} // namespace qmr
+
+#endif
@@ -0,0 +1,374 @@
+/*
+ * qmr_nifti.hh: reader and writer of NIfTI-1 and NIfTI-2 images (.nii,
+ * or .hdr/.img pairs, optionally gzipped).
+ *
+ * An uncompressed image file is mapped read-only and only the requested
+ * part is copied out, in the stored data type: a set of slices of a set
+ * of volumes, or the values of a set of voxels in every requested volume.
+ * Pages that are not touched are never read from disk, so pulling the
+ * masked voxels of a large 4D file costs the size of the result, not of
+ * the file. A gzipped file is inflated in memory (qmr_gzip.hh) up to the
+ * end of the voxels, with no temporary file. Foreign byte order is
+ * swapped while copying; scl_slope and scl_inter are reported but not
+ * applied.
+ *
+ * write() stores a header and voxels as a .nii or, compressed in
+ * parallel, as a .nii.gz.
+ *
+ * Dimensions 4 to 7 are flattened into one volume index, as in the
+ * file layout.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_NIFTI_HH
+#define QMR_NIFTI_HH
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "qmr_gzip.hh"
+#include "qmr_mapped.hh"
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace nifti {
+
+// Fields of the header needed to locate and interpret the voxels.
+struct Header {
+    int version;          // 1 or 2
+    bool swapped;         // stored in the other byte order
+    int64_t dim[8];       // dim[0] = number of dimensions
+    double pixdim[8];
+    int datatype, bitpix;
+    int64_t voxOffset;
+    double sclSlope, sclInter;
+
+    int64_t nx() const { return dim[1]; }
+    int64_t ny() const { return dim[2]; }
+    int64_t nz() const { return dim[3]; }
+    // Voxels of one volume and number of volumes (dims 4 to 7).
+    int64_t volumeSize() const { return dim[1] * dim[2] * dim[3]; }
+    int64_t volumes() const
+    {
+        int64_t n = 1;
+        for (int k = 4; k <= 7; ++k) n *= dim[k];
+        return n;
+    }
+    std::size_t bytes() const { return (std::size_t)bitpix / 8; }
+};
+
+namespace detail {
+
+inline void swapBytes(unsigned char *p, std::size_t size)
+{
+    std::reverse(p, p + size);
+}
+
+template <class T>
+T read(const unsigned char *p, bool swapped)
+{
+    unsigned char b[sizeof(T)];
+    std::memcpy(b, p, sizeof(T));
+    if (swapped) swapBytes(b, sizeof(T));
+    T v;
+    std::memcpy(&v, b, sizeof(T));
+    return v;
+}
+
+inline bool endsWith(const std::string &s, const char *suffix)
+{
+    const std::size_t n = std::strlen(suffix);
+    if (s.size() < n) return false;
+    for (std::size_t i = 0; i < n; ++i)
+        if (std::tolower((unsigned char)s[s.size() - n + i]) != suffix[i]) return false;
+    return true;
+}
+
+// path with its 3-letter extension replaced by ext, in the same case.
+inline std::string sibling(const std::string &path, const char *ext)
+{
+    std::string s = path.substr(0, path.size() - 3) + ext;
+    if (std::isupper((unsigned char)path[path.size() - 1]))
+        for (std::size_t i = s.size() - 3; i < s.size(); ++i) s[i] = (char)std::toupper((unsigned char)s[i]);
+    return s;
+}
+
+// Splits "name.ext.gz" into "name.ext" and ".gz" (empty if not gzipped).
+inline void splitGz(const std::string &path, std::string &base, std::string &gz)
+{
+    const bool z = endsWith(path, ".gz");
+    base = z ? path.substr(0, path.size() - 3) : path;
+    gz = z ? path.substr(path.size() - 3) : std::string();
+}
+
+// path if it exists, else path with ".gz" added or removed if that does
+// (a pair may have only its image compressed).
+inline std::string locate(const std::string &path)
+{
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (f) {
+        std::fclose(f);
+        return path;
+    }
+    std::string base, gz;
+    splitGz(path, base, gz);
+    const std::string other = gz.empty() ? path + ".gz" : base;
+    f = std::fopen(other.c_str(), "rb");
+    if (!f) return path;
+    std::fclose(f);
+    return other;
+}
+
+} // namespace detail
+
+// Bits per voxel of a NIfTI datatype code handled here (integers and
+// reals), 0 for the others (complex, RGB).
+inline int datatypeBits(int datatype)
+{
+    switch (datatype) {
+    case 2: case 256: return 8;            // uint8, int8
+    case 4: case 512: return 16;           // int16, uint16
+    case 8: case 768: case 16: return 32;  // int32, uint32, float32
+    case 64: case 1024: case 1280: return 64;  // float64, int64, uint64
+    default: return 0;
+    }
+}
+
+// Parses the first bytes of a NIfTI-1 (348) or NIfTI-2 (540) header.
+// Returns false with a reason in `error` if it is neither.
+inline bool parseHeader(const unsigned char *h, std::size_t n, Header &hdr, bool &pair, std::string &error)
+{
+    using detail::read;
+    if (n < 348) {
+        error = "file too short for a NIfTI header";
+        return false;
+    }
+    const int32_t size = read<int32_t>(h, false), sizeSwapped = read<int32_t>(h, true);
+    if (size == 348 || sizeSwapped == 348) {
+        const bool sw = size != 348;
+        if (std::memcmp(h + 344, "n+1", 4) && std::memcmp(h + 344, "ni1", 4)) {
+            error = "not a NIfTI-1 file (Analyze 7.5 is not supported)";
+            return false;
+        }
+        pair = h[345] == 'i';
+        hdr.version = 1;
+        hdr.swapped = sw;
+        for (int k = 0; k < 8; ++k) {
+            hdr.dim[k] = read<int16_t>(h + 40 + 2 * k, sw);
+            hdr.pixdim[k] = read<float>(h + 76 + 4 * k, sw);
+        }
+        hdr.datatype = read<int16_t>(h + 70, sw);
+        hdr.bitpix = read<int16_t>(h + 72, sw);
+        hdr.voxOffset = (int64_t)read<float>(h + 108, sw);
+        hdr.sclSlope = read<float>(h + 112, sw);
+        hdr.sclInter = read<float>(h + 116, sw);
+    } else if (size == 540 || sizeSwapped == 540) {
+        const bool sw = size != 540;
+        if (n < 540) {
+            error = "file too short for a NIfTI-2 header";
+            return false;
+        }
+        if (std::memcmp(h + 4, "n+2", 4) && std::memcmp(h + 4, "ni2", 4)) {
+            error = "not a NIfTI-2 file";
+            return false;
+        }
+        pair = h[5] == 'i';
+        hdr.version = 2;
+        hdr.swapped = sw;
+        hdr.datatype = read<int16_t>(h + 12, sw);
+        hdr.bitpix = read<int16_t>(h + 14, sw);
+        for (int k = 0; k < 8; ++k) {
+            hdr.dim[k] = read<int64_t>(h + 16 + 8 * k, sw);
+            hdr.pixdim[k] = read<double>(h + 104 + 8 * k, sw);
+        }
+        hdr.voxOffset = read<int64_t>(h + 168, sw);
+        hdr.sclSlope = read<double>(h + 176, sw);
+        hdr.sclInter = read<double>(h + 184, sw);
+    } else {
+        error = "not a NIfTI-1 or NIfTI-2 file";
+        return false;
+    }
+
+    if (hdr.dim[0] < 1 || hdr.dim[0] > 7) {
+        error = "invalid number of dimensions";
+        return false;
+    }
+    for (int k = 1; k <= 7; ++k) {
+        if (k > hdr.dim[0] || hdr.dim[k] < 1) hdr.dim[k] = 1;
+    }
+    if (datatypeBits(hdr.datatype) == 0) {
+        error = "unsupported datatype (complex and RGB images are not handled)";
+        return false;
+    }
+    hdr.bitpix = datatypeBits(hdr.datatype);
+    if (hdr.voxOffset < 0) {
+        error = "invalid vox_offset";
+        return false;
+    }
+    return true;
+}
+
+// Bytes of a file: mapped, or inflated in memory if it is gzipped.
+class FileData {
+public:
+    FileData() : compressed_(false) {}
+
+    // Opens `path`; a gzipped file is inflated up to `limit` bytes.
+    bool open(const std::string &path, std::size_t limit, std::string &error)
+    {
+        map_.close();
+        buffer_.clear();
+        compressed_ = detail::endsWith(path, ".gz");
+        if (compressed_) return gzip::readFile(path, buffer_, error, limit);
+        if (!map_.open(path)) {
+            error = "cannot open " + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool compressed() const { return compressed_; }
+    const unsigned char *data() const { return compressed_ ? (buffer_.empty() ? NULL : &buffer_[0]) : map_.data(); }
+    std::size_t size() const { return compressed_ ? buffer_.size() : map_.size(); }
+
+private:
+    MappedFile map_;
+    std::vector<unsigned char> buffer_;
+    bool compressed_;
+};
+
+// A NIfTI image whose voxels are read from a mapped or inflated file.
+class Image {
+public:
+    Image() : voxels_(NULL) {}
+
+    // Opens `path` (.nii, or .hdr/.img of a pair, each possibly .gz); with
+    // headerOnly, a gzipped file is only inflated as far as the header.
+    // Returns false with a reason in error() on failure.
+    bool open(const std::string &path, bool headerOnly = false)
+    {
+        static const std::size_t kHeaderBytes = 540;
+        error_.clear();
+        voxels_ = NULL;
+        std::string base, gz;
+        detail::splitGz(path, base, gz);
+        const std::string hdrPath =
+            detail::endsWith(base, ".img") ? detail::locate(detail::sibling(base, "hdr") + gz) : path;
+        if (!header_.open(hdrPath, kHeaderBytes, error_)) return false;
+        bool pair = false;
+        if (!parseHeader(header_.data(), header_.size(), hdr_, pair, error_)) return false;
+        if (headerOnly) return true;
+
+        const int64_t need = hdr_.voxOffset + hdr_.volumeSize() * hdr_.volumes() * (int64_t)hdr_.bytes();
+        const FileData *img = &header_;
+        if (pair) {
+            detail::splitGz(hdrPath, base, gz);
+            const std::string imgPath = detail::locate(detail::sibling(base, "img") + gz);
+            if (!image_.open(imgPath, (std::size_t)need, error_)) return false;
+            img = &image_;
+        } else if (header_.compressed() && !header_.open(hdrPath, (std::size_t)need, error_)) {
+            return false;
+        }
+        if ((int64_t)img->size() < need) return fail("file is shorter than its header declares");
+        voxels_ = img->data() + hdr_.voxOffset;
+        return true;
+    }
+
+    const Header &header() const { return hdr_; }
+    const std::string &error() const { return error_; }
+
+    // Copies slices z (0-based) of volumes t into out, stored as
+    // [nx ny z.size() t.size()] in the file data type.
+    void slab(const std::vector<int64_t> &z, const std::vector<int64_t> &t, void *out, int nthreads = 0) const
+    {
+        const std::size_t plane = (std::size_t)(hdr_.nx() * hdr_.ny()) * hdr_.bytes();
+        unsigned char *o = static_cast<unsigned char *>(out);
+        const std::size_t nz = z.size();
+        parallel_for(nz * t.size(), 1, [&](std::size_t b, std::size_t e, int) {
+            for (std::size_t p = b; p < e; ++p) {
+                const int64_t src = (t[p / nz] * hdr_.nz() + z[p % nz]) * (int64_t)plane;
+                copy(voxels_ + src, o + p * plane, plane);
+            }
+        }, nthreads);
+    }
+
+    // Copies voxels idx (0-based linear indices in a volume) of volumes t
+    // into out, stored as [idx.size() t.size()] in the file data type.
+    void gather(const std::vector<int64_t> &idx, const std::vector<int64_t> &t, void *out, int nthreads = 0) const
+    {
+        const std::size_t bytes = hdr_.bytes(), n = idx.size();
+        unsigned char *o = static_cast<unsigned char *>(out);
+        parallel_for(n, std::max<std::size_t>(4096, n / (4 * (std::size_t)num_threads(nthreads)) + 1),
+                     [&](std::size_t b, std::size_t e, int) {
+            for (std::size_t v = 0; v < t.size(); ++v) {
+                const unsigned char *vol = voxels_ + t[v] * hdr_.volumeSize() * (int64_t)bytes;
+                unsigned char *col = o + v * n * bytes;
+                for (std::size_t i = b; i < e; ++i) copy(vol + idx[i] * (int64_t)bytes, col + i * bytes, bytes);
+            }
+        }, nthreads);
+    }
+
+private:
+    bool fail(const std::string &msg)
+    {
+        error_ = msg;
+        return false;
+    }
+
+    // Copies n bytes of voxels, swapping each value to native order.
+    void copy(const unsigned char *src, unsigned char *dst, std::size_t n) const
+    {
+        std::memcpy(dst, src, n);
+        if (!hdr_.swapped) return;
+        const std::size_t b = hdr_.bytes();
+        if (b > 1)
+            for (std::size_t i = 0; i < n; i += b) detail::swapBytes(dst + i, b);
+    }
+
+    FileData header_, image_;
+    Header hdr_;
+    const unsigned char *voxels_;
+    std::string error_;
+};
+
+// Writes a single-file image: `header` (vox_offset bytes, extensions
+// included) then `bytes` of voxels, gzipped with compression `level` if
+// path ends with .gz. Returns false with a reason in `error` on failure.
+inline bool write(const std::string &path, const std::vector<unsigned char> &header, const void *voxels,
+                  std::size_t bytes, int level, int nthreads, std::string &error)
+{
+    std::vector<gzip::Span> parts(2);
+    parts[0].data = header.empty() ? NULL : &header[0];
+    parts[0].size = header.size();
+    parts[1].data = static_cast<const unsigned char *>(voxels);
+    parts[1].size = bytes;
+    if (detail::endsWith(path, ".gz")) return gzip::writeFile(path, parts, level, nthreads, error);
+
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        error = "cannot open " + path + " for writing";
+        return false;
+    }
+    bool ok = true;
+    for (std::size_t p = 0; p < parts.size(); ++p)
+        ok = ok && std::fwrite(parts[p].data, 1, parts[p].size, f) == parts[p].size;
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        error = "cannot write " + path;
+        std::remove(path.c_str());
+    }
+    return ok;
+}
+
+} // namespace nifti
+} // namespace qmr
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * Partial reads of NIfTI-1/2 images, memory-mapped or inflated in memory,
+ * and gzip-aware writes (see qmr_nifti.hh). Use through qMRniiRead.m,
+ * save_nii.m (.nii.gz) and nii_tool.m (reading .gz).
+ *
+ *   info = qmr_nii_mex('info', filename)
+ *   img  = qmr_nii_mex('slab', filename, slices, volumes, opts)
+ *   vals = qmr_nii_mex('voxels', filename, index, volumes, opts)
+ *          qmr_nii_mex('save', filename, hdr, img, opts)
+ *
+ * filename is a .nii, .hdr or .img file, or the same gzipped (.gz);
+ * a gzipped file is inflated in memory. slices and volumes are 1-based
+ * indices ([]: all); volumes count every dimension past the 3rd. index
+ * is a logical mask with one value per voxel of a volume, or 1-based
+ * linear indices in a volume. img is [nx ny numel(slices)
+ * numel(volumes)] and vals [numel(index) numel(volumes)], both in the
+ * class of the stored data type, unscaled. info holds version, dim and
+ * pixdim (as hdr.dime of load_untouch_header_only), datatype, bitpix,
+ * vox_offset, scl_slope, scl_inter and swapped.
+ *
+ * 'save' writes a .nii or .nii.gz file from hdr, a NIfTI-1 header struct
+ * with fields hk, dime and hist (make_nii, load_untouch_header_only), and
+ * img, whose class must be that of hdr.dime.datatype and whose number of
+ * elements must match hdr.dime.dim. The header is written as given,
+ * except sizeof_hdr, bitpix, vox_offset (352, no extension) and magic.
+ *
+ * opts is an optional struct with NumThreads (0: all cores) and, for
+ * 'save', Level (gzip compression, 1 fast to 9 small; default 6).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "qmr_nifti.hh"
+
+static const char *kName = "qmr_nii_mex";
+
+namespace {
+
+mxClassID classOf(int datatype)
+{
+    switch (datatype) {
+    case 2: return mxUINT8_CLASS;
+    case 256: return mxINT8_CLASS;
+    case 4: return mxINT16_CLASS;
+    case 512: return mxUINT16_CLASS;
+    case 8: return mxINT32_CLASS;
+    case 768: return mxUINT32_CLASS;
+    case 16: return mxSINGLE_CLASS;
+    case 64: return mxDOUBLE_CLASS;
+    case 1024: return mxINT64_CLASS;
+    default: return mxUINT64_CLASS;
+    }
+}
+
+void open(qmr::nifti::Image &img, const mxArray *a, bool headerOnly = false)
+{
+    const std::string fname = qmr::mex::string(kName, a, "filename");
+    if (!img.open(fname, headerOnly)) qmr::mex::fail(kName, "cannotRead", fname + ": " + img.error() + ".");
+}
+
+// 0-based indices from 1-based ones in [1, n] ([] or missing: all).
+std::vector<int64_t> indices(const mxArray *a, int64_t n, const char *argName)
+{
+    std::vector<int64_t> out;
+    if (!a || mxIsEmpty(a)) {
+        out.resize((std::size_t)n);
+        for (int64_t i = 0; i < n; ++i) out[(std::size_t)i] = i;
+        return out;
+    }
+    const std::vector<double> v = qmr::mex::toVector(a);
+    out.resize(v.size());
+    for (std::size_t i = 0; i < v.size(); ++i) {
+        if (!(v[i] >= 1 && v[i] <= (double)n) || v[i] != (double)(int64_t)v[i])
+            qmr::mex::fail(kName, "invalidIndex", std::string(argName) + " must hold indices in 1.." +
+                                                      std::to_string((long long)n) + ".");
+        out[i] = (int64_t)v[i] - 1;
+    }
+    return out;
+}
+
+mxArray *info(const qmr::nifti::Header &h)
+{
+    static const char *fields[] = {"version", "dim", "pixdim", "datatype", "bitpix",
+                                   "vox_offset", "scl_slope", "scl_inter", "swapped"};
+    mxArray *s = mxCreateStructMatrix(1, 1, 9, fields);
+    mxArray *dim = mxCreateDoubleMatrix(1, 8, mxREAL), *pixdim = mxCreateDoubleMatrix(1, 8, mxREAL);
+    for (int k = 0; k < 8; ++k) {
+        mxGetPr(dim)[k] = (double)h.dim[k];
+        mxGetPr(pixdim)[k] = h.pixdim[k];
+    }
+    mxSetField(s, 0, "version", mxCreateDoubleScalar(h.version));
+    mxSetField(s, 0, "dim", dim);
+    mxSetField(s, 0, "pixdim", pixdim);
+    mxSetField(s, 0, "datatype", mxCreateDoubleScalar(h.datatype));
+    mxSetField(s, 0, "bitpix", mxCreateDoubleScalar(h.bitpix));
+    mxSetField(s, 0, "vox_offset", mxCreateDoubleScalar((double)h.voxOffset));
+    mxSetField(s, 0, "scl_slope", mxCreateDoubleScalar(h.sclSlope));
+    mxSetField(s, 0, "scl_inter", mxCreateDoubleScalar(h.sclInter));
+    mxSetField(s, 0, "swapped", mxCreateLogicalScalar(h.swapped));
+    return s;
+}
+
+void slab(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 2 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_nii_mex('slab', filename, slices, volumes, opts).");
+    qmr::nifti::Image img;
+    open(img, prhs[1]);
+    const qmr::nifti::Header &h = img.header();
+    const std::vector<int64_t> z = indices(nrhs > 2 ? prhs[2] : NULL, h.nz(), "slices");
+    const std::vector<int64_t> t = indices(nrhs > 3 ? prhs[3] : NULL, h.volumes(), "volumes");
+    const int nthreads = (int)qmr::mex::option(nrhs > 4 ? prhs[4] : NULL, "NumThreads", 0.0);
+
+    mwSize dims[4] = {(mwSize)h.nx(), (mwSize)h.ny(), z.size(), t.size()};
+    plhs[0] = mxCreateNumericArray(4, dims, classOf(h.datatype), mxREAL);
+    img.slab(z, t, mxGetData(plhs[0]), nthreads);
+}
+
+void voxels(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 3 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_nii_mex('voxels', filename, index, volumes, opts).");
+    qmr::nifti::Image img;
+    open(img, prhs[1]);
+    const qmr::nifti::Header &h = img.header();
+    std::vector<int64_t> idx;
+    if (mxIsLogical(prhs[2])) {
+        if ((int64_t)mxGetNumberOfElements(prhs[2]) != h.volumeSize())
+            qmr::mex::fail(kName, "invalidInputSize", "A logical index must have one value per voxel of a volume.");
+        const mxLogical *m = mxGetLogicals(prhs[2]);
+        for (int64_t i = 0; i < h.volumeSize(); ++i)
+            if (m[i]) idx.push_back(i);
+    } else {
+        if (mxIsEmpty(prhs[2])) qmr::mex::fail(kName, "invalidIndex", "index must not be empty.");
+        idx = indices(prhs[2], h.volumeSize(), "index");
+    }
+    const std::vector<int64_t> t = indices(nrhs > 3 ? prhs[3] : NULL, h.volumes(), "volumes");
+    const int nthreads = (int)qmr::mex::option(nrhs > 4 ? prhs[4] : NULL, "NumThreads", 0.0);
+
+    plhs[0] = mxCreateNumericMatrix(idx.size(), t.size(), classOf(h.datatype), mxREAL);
+    img.gather(idx, t, mxGetData(plhs[0]), nthreads);
+}
+
+// Serializes the fields of a NIfTI-1 header struct in file order.
+class HeaderWriter {
+public:
+    explicit HeaderWriter(const mxArray *hdr) : hdr_(hdr), group_(NULL) {}
+
+    void group(const char *name)
+    {
+        group_ = mxGetField(hdr_, 0, name);
+        if (!group_ || !mxIsStruct(group_))
+            qmr::mex::fail(kName, "invalidInput", std::string("hdr must have a struct field ") + name + ".");
+    }
+
+    // n values of a numeric (or character code) field, 0 if missing.
+    template <class T>
+    void number(const char *name, std::size_t n = 1)
+    {
+        const std::vector<double> v = values(name);
+        for (std::size_t i = 0; i < n; ++i) put<T>(i < v.size() ? v[i] : 0.0);
+    }
+
+    // Text field, zero-padded or cut to n bytes.
+    void text(const char *name, std::size_t n)
+    {
+        const mxArray *f = mxGetField(group_, 0, name);
+        std::string s;
+        if (f && mxIsChar(f)) s = qmr::mex::string(kName, f, name);
+        s.resize(n, '\0');
+        bytes_.insert(bytes_.end(), s.begin(), s.end());
+    }
+
+    // Integer fields are rounded and saturated, NaN written as 0, as
+    // fwrite does (glmax/glmin of maps with Inf or NaN).
+    template <class T>
+    void put(double v)
+    {
+        T t = (T)0;
+        if (!std::numeric_limits<T>::is_integer) {
+            t = (T)v;
+        } else if (!std::isnan(v)) {
+            v = v < 0 ? std::ceil(v - 0.5) : std::floor(v + 0.5);
+            const double lo = (double)std::numeric_limits<T>::min(), hi = (double)std::numeric_limits<T>::max();
+            t = (T)std::min(hi, std::max(lo, v));
+        }
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(&t);
+        bytes_.insert(bytes_.end(), p, p + sizeof(T));
+    }
+
+    void raw(const char *s, std::size_t n) { bytes_.insert(bytes_.end(), s, s + n); }
+
+    // Values of a field of the current group (character codes for text).
+    std::vector<double> values(const char *name) const
+    {
+        const mxArray *f = mxGetField(group_, 0, name);
+        std::vector<double> v;
+        if (!f || mxIsEmpty(f)) return v;
+        if (mxIsChar(f)) {
+            const mxChar *c = mxGetChars(f);
+            for (std::size_t i = 0; i < mxGetNumberOfElements(f); ++i) v.push_back(c[i]);
+            return v;
+        }
+        if (!mxIsNumeric(f) && !mxIsLogical(f))
+            qmr::mex::fail(kName, "invalidInputType", std::string("hdr field ") + name + " must be numeric.");
+        return qmr::mex::toVector(f);
+    }
+
+    const std::vector<unsigned char> &bytes() const { return bytes_; }
+
+private:
+    const mxArray *hdr_, *group_;
+    std::vector<unsigned char> bytes_;
+};
+
+void save(int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_nii_mex('save', filename, hdr, img, opts).");
+    const std::string fname = qmr::mex::string(kName, prhs[1], "filename");
+    if (!qmr::nifti::detail::endsWith(fname, ".nii") && !qmr::nifti::detail::endsWith(fname, ".nii.gz"))
+        qmr::mex::fail(kName, "invalidInput", "filename must end with .nii or .nii.gz.");
+    const mxArray *hdr = prhs[2], *img = prhs[3];
+    if (!mxIsStruct(hdr) || mxGetNumberOfElements(hdr) != 1)
+        qmr::mex::fail(kName, "invalidInputType", "hdr must be a NIfTI-1 header struct.");
+    const mxArray *opts = nrhs > 4 ? prhs[4] : NULL;
+    const int level = (int)qmr::mex::option(opts, "Level", 6.0);
+    if (level < 1 || level > 9) qmr::mex::fail(kName, "invalidInput", "Level must be in 1..9.");
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    HeaderWriter w(hdr);
+    w.group("dime");
+    const int datatype = (int)w.values("datatype").at(0);
+    const int bits = qmr::nifti::datatypeBits(datatype);
+    if (!bits || mxIsComplex(img) || mxIsSparse(img) || mxGetClassID(img) != classOf(datatype))
+        qmr::mex::fail(kName, "invalidInputType", "img must be a real array of the class of hdr.dime.datatype.");
+    const std::vector<double> dim = w.values("dim");
+    double count = 1;
+    for (std::size_t k = 1; dim.size() == 8 && k <= 7 && k <= (std::size_t)dim[0]; ++k) count *= dim[k];
+    if (dim.size() != 8 || dim[0] < 1 || dim[0] > 7 || count != (double)mxGetNumberOfElements(img))
+        qmr::mex::fail(kName, "invalidInputSize", "hdr.dime.dim must match the number of elements of img.");
+
+    w.group("hk");
+    w.put<int32_t>(348);
+    w.text("data_type", 10);
+    w.text("db_name", 18);
+    w.number<int32_t>("extents");
+    w.number<int16_t>("session_error");
+    w.number<uint8_t>("regular");
+    w.number<uint8_t>("dim_info");
+    w.group("dime");
+    w.number<int16_t>("dim", 8);
+    w.number<float>("intent_p1");
+    w.number<float>("intent_p2");
+    w.number<float>("intent_p3");
+    w.number<int16_t>("intent_code");
+    w.put<int16_t>(datatype);
+    w.put<int16_t>(bits);
+    w.number<int16_t>("slice_start");
+    w.number<float>("pixdim", 8);
+    w.put<float>(352);
+    w.number<float>("scl_slope");
+    w.number<float>("scl_inter");
+    w.number<int16_t>("slice_end");
+    w.number<uint8_t>("slice_code");
+    w.number<uint8_t>("xyzt_units");
+    w.number<float>("cal_max");
+    w.number<float>("cal_min");
+    w.number<float>("slice_duration");
+    w.number<float>("toffset");
+    w.number<int32_t>("glmax");
+    w.number<int32_t>("glmin");
+    w.group("hist");
+    w.text("descrip", 80);
+    w.text("aux_file", 24);
+    w.number<int16_t>("qform_code");
+    w.number<int16_t>("sform_code");
+    w.number<float>("quatern_b");
+    w.number<float>("quatern_c");
+    w.number<float>("quatern_d");
+    w.number<float>("qoffset_x");
+    w.number<float>("qoffset_y");
+    w.number<float>("qoffset_z");
+    w.number<float>("srow_x", 4);
+    w.number<float>("srow_y", 4);
+    w.number<float>("srow_z", 4);
+    w.text("intent_name", 16);
+    w.raw("n+1\0", 4);
+    w.raw("\0\0\0\0", 4);    // no extension
+
+    std::string error;
+    if (!qmr::nifti::write(fname, w.bytes(), mxGetData(img), mxGetNumberOfElements(img) * (bits / 8), level, nthreads,
+                           error))
+        qmr::mex::fail(kName, "cannotWrite", error + ".");
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    (void)nlhs;
+    if (nrhs < 2)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_nii_mex expects a command and a file name.");
+    const std::string cmd = qmr::mex::string(kName, prhs[0], "command");
+    if (cmd == "info") {
+        qmr::nifti::Image img;
+        open(img, prhs[1], true);
+        plhs[0] = info(img.header());
+    } else if (cmd == "slab") slab(plhs, nrhs, prhs);
+    else if (cmd == "voxels") voxels(plhs, nrhs, prhs);
+    else if (cmd == "save") save(nrhs, prhs);
+    else qmr::mex::fail(kName, "unknownCommand", "Unknown command '" + cmd + "'.");
+}
@@ -0,0 +1,118 @@
+/*
+ * qmr_parallel.hh: minimal threading helpers shared by the qMRLab MEX
+ * engines.
+ *
+ * Work is split into chunks of `grain` items that worker threads pull from
+ * an atomic counter, so uneven per-voxel costs (e.g. fits that converge at
+ * different iterations) still balance across threads. The callback receives
+ * [begin, end) and the id of the calling worker (0..nthreads-1), which is
+ * what engines use to index per-thread scratch buffers.
+ *
+ * The MATLAB API (mxMalloc, mexCallMATLAB, mexPrintf...) is NOT thread safe:
+ * callbacks must only touch plain C++ memory.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_PARALLEL_HH
+#define QMR_PARALLEL_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qmr {
+
+// Number of workers to use. 0 (or negative) means "all hardware threads".
+inline int num_threads(int requested = 0)
+{
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? static_cast<int>(hw) : 1;
+}
+
+// Calls f(begin, end, threadId) over [0, n) in chunks of `grain` items.
+// Exceptions thrown by a worker are rethrown on the calling thread.
+template <class F>
+void parallel_for(std::size_t n, std::size_t grain, F f, int nthreads = 0)
+{
+    if (n == 0) return;
+    if (grain == 0) grain = 1;
+    std::size_t nchunks = (n + grain - 1) / grain;
+    int nt = static_cast<int>(std::min<std::size_t>(num_threads(nthreads), nchunks));
+
+    if (nt <= 1) {
+        for (std::size_t b = 0; b < n; b += grain)
+            f(b, std::min(n, b + grain), 0);
+        return;
+    }
+
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorLock;
+
+    auto worker = [&](int tid) {
+        try {
+            for (;;) {
+                std::size_t c = next.fetch_add(1);
+                if (c >= nchunks) break;
+                std::size_t b = c * grain;
+                f(b, std::min(n, b + grain), tid);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(errorLock);
+            if (!error) error = std::current_exception();
+            next.store(nchunks);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(nt - 1);
+    for (int t = 1; t < nt; ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : pool) th.join();
+    if (error) std::rethrow_exception(error);
+}
+
+// Number of workers parallel_for will actually start for (n, grain); use it
+// to size per-thread scratch buffers.
+inline int parallel_width(std::size_t n, std::size_t grain, int nthreads = 0)
+{
+    if (grain == 0) grain = 1;
+    std::size_t nchunks = (n + grain - 1) / grain;
+    return static_cast<int>(std::max<std::size_t>(1,
+        std::min<std::size_t>(num_threads(nthreads), nchunks)));
+}
+
+// Reusable barrier for engines whose workers iterate in lockstep (one
+// parallel_for chunk per worker, synchronized between sweeps). Waiters
+// spin briefly, then yield, since sweeps are usually short.
+class Barrier {
+public:
+    explicit Barrier(int count) : count_(count), waiting_(0), generation_(0) {}
+
+    void wait()
+    {
+        const unsigned gen = generation_.load();
+        if (waiting_.fetch_add(1) + 1 == count_) {
+            waiting_.store(0);
+            generation_.fetch_add(1);
+            return;
+        }
+        for (int spin = 0; generation_.load() == gen; ++spin)
+            if (spin > 1000) std::this_thread::yield();
+    }
+
+private:
+    const int count_;
+    std::atomic<int> waiting_;
+    std::atomic<unsigned> generation_;
+};
+
+} // namespace qmr
+
+#endif
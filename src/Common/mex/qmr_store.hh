@@ -0,0 +1,321 @@
+/*
+ * qmr_store.hh: chunked, compressed store of fitted parameter maps,
+ * written incrementally while a fit runs so that it survives a crash.
+ *
+ * A store is a directory holding a manifest (store.txt: volume size, the
+ * name and number of channels of every field and the fingerprint of the
+ * inputs of the fit that writes it) and one chunk file per
+ * committed block of voxels. A chunk is a gzip stream (qmr_gzip.hh) of a
+ * small header, the 0-based linear indices of its voxels and their values
+ * as an [n channels] matrix, fields one after the other in manifest
+ * order. Chunks are named after their first voxel, so writers (parallel
+ * workers, separate processes) never need to coordinate, and are written
+ * to a temporary file renamed into place, so a chunk that exists is
+ * complete. Resuming a fit is reading back the indices of every chunk;
+ * the fingerprint keeps a fit from resuming (or adding chunks to) the
+ * store of another dataset.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_STORE_HH
+#define QMR_STORE_HH
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "qmr_gzip.hh"
+
+namespace qmr {
+namespace store {
+
+struct Field {
+    std::string name;
+    int channels;
+};
+
+// Volume size and fields of a store, and the fingerprint of the fit
+// that writes it (empty: none).
+struct Layout {
+    int64_t dim[3];
+    std::vector<Field> fields;
+    std::string fingerprint;
+
+    int64_t voxels() const { return dim[0] * dim[1] * dim[2]; }
+    int channels() const
+    {
+        int c = 0;
+        for (std::size_t f = 0; f < fields.size(); ++f) c += fields[f].channels;
+        return c;
+    }
+    bool operator==(const Layout &o) const
+    {
+        if (dim[0] != o.dim[0] || dim[1] != o.dim[1] || dim[2] != o.dim[2] || fields.size() != o.fields.size())
+            return false;
+        for (std::size_t f = 0; f < fields.size(); ++f)
+            if (fields[f].name != o.fields[f].name || fields[f].channels != o.fields[f].channels) return false;
+        return true;
+    }
+};
+
+namespace detail {
+
+static const char kMagic[8] = {'q', 'M', 'R', 'c', 'h', 'u', 'n', 'k'};
+static const std::size_t kChunkHeader = 24;    // magic, voxels, channels
+
+inline std::string join(const std::string &dir, const std::string &name)
+{
+#ifdef _WIN32
+    const char sep = '\\';
+#else
+    const char sep = '/';
+#endif
+    std::string p = dir;
+    if (!p.empty() && p[p.size() - 1] != '/' && p[p.size() - 1] != sep) p += sep;
+    return p + name;
+}
+
+// Renames tmp onto path if ok (the write succeeded), else removes tmp.
+inline bool replace(const std::string &path, const std::string &tmp, bool ok)
+{
+    if (ok) {
+#ifdef _WIN32
+        std::remove(path.c_str());   // rename does not replace on Windows
+#endif
+        ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
+}
+
+inline std::string tmpName(const std::string &path, const void *tag)
+{
+    char s[32];
+    std::sprintf(s, ".%p.tmp", tag);
+    return path + s;
+}
+
+} // namespace detail
+
+// Checksum of the inputs of a fit (data, mask, model options), fed in
+// pieces: CRC-32 and Adler-32 of the bytes, and their number. It tells a
+// different dataset apart, it is not meant to resist a forged one.
+class Fingerprint {
+public:
+    Fingerprint() : crc_(crc32(0L, Z_NULL, 0)), adler_(adler32(0L, Z_NULL, 0)), bytes_(0) {}
+
+    void add(const void *data, std::size_t n)
+    {
+        const Bytef *p = static_cast<const Bytef *>(data);
+        bytes_ += n;
+        while (n) {
+            const uInt m = (uInt)std::min<std::size_t>(n, 1u << 30);
+            crc_ = crc32(crc_, p, m);
+            adler_ = adler32(adler_, p, m);
+            p += m;
+            n -= m;
+        }
+    }
+    template <class T> void value(const T &v) { add(&v, sizeof v); }
+
+    std::string hex() const
+    {
+        char s[40];
+        std::sprintf(s, "%08lx%08lx%016llx", (unsigned long)crc_ & 0xffffffffUL, (unsigned long)adler_ & 0xffffffffUL,
+                     (unsigned long long)bytes_);
+        return s;
+    }
+
+private:
+    uLong crc_, adler_;
+    uint64_t bytes_;
+};
+
+// Reads the manifest of the store in `dir`.
+inline bool open(const std::string &dir, Layout &layout, std::string &error)
+{
+    const std::string path = detail::join(dir, "store.txt");
+    std::FILE *f = std::fopen(path.c_str(), "r");
+    if (!f) {
+        error = "no store in " + dir;
+        return false;
+    }
+    int version = 0;
+    long long d[3] = {0, 0, 0};
+    char line[512], name[256], c;
+    bool ok = std::fgets(line, sizeof line, f) && std::sscanf(line, "qMRstore %d", &version) == 1 && version == 1 &&
+              std::fgets(line, sizeof line, f) && std::sscanf(line, "dims %lld %lld %lld", &d[0], &d[1], &d[2]) == 3 &&
+              d[0] > 0 && d[1] > 0 && d[2] > 0;
+    layout.fields.clear();
+    layout.fingerprint.clear();
+    int channels = 0;
+    while (ok && std::fgets(line, sizeof line, f)) {
+        if (std::sscanf(line, " field %255s %d", name, &channels) == 2) {
+            Field fd = {name, channels};
+            ok = channels > 0;
+            layout.fields.push_back(fd);
+        } else if (std::sscanf(line, " fingerprint %255s", name) == 1) {
+            layout.fingerprint = name;
+        } else {
+            ok = std::sscanf(line, " %c", &c) != 1;   // blank line
+        }
+    }
+    ok = ok && !std::ferror(f) && !layout.fields.empty();
+    std::fclose(f);
+    if (!ok) {
+        error = path + " is not a valid store manifest";
+        return false;
+    }
+    for (int k = 0; k < 3; ++k) layout.dim[k] = d[k];
+    return true;
+}
+
+// Creates a store in the existing directory `dir`, or checks that the
+// store already there has the same layout and fingerprint (resuming).
+inline bool create(const std::string &dir, const Layout &layout, std::string &error)
+{
+    Layout existing;
+    std::string ignored;
+    if (open(dir, existing, ignored)) {
+        if (!(existing == layout)) {
+            error = "the store in " + dir + " holds different fields or a different volume size";
+            return false;
+        }
+        if (existing.fingerprint != layout.fingerprint) {
+            error = "the store in " + dir + " was written by a fit of other data or model options";
+            return false;
+        }
+        return true;
+    }
+    const std::string path = detail::join(dir, "store.txt"), tmp = detail::tmpName(path, &layout);
+    std::FILE *f = std::fopen(tmp.c_str(), "w");
+    if (!f) {
+        error = "cannot write " + path;
+        return false;
+    }
+    bool ok = std::fprintf(f, "qMRstore 1\ndims %lld %lld %lld\n", (long long)layout.dim[0],
+                           (long long)layout.dim[1], (long long)layout.dim[2]) > 0;
+    if (!layout.fingerprint.empty())
+        ok = ok && std::fprintf(f, "fingerprint %s\n", layout.fingerprint.c_str()) > 0;
+    for (std::size_t k = 0; k < layout.fields.size(); ++k)
+        ok = ok && std::fprintf(f, "field %s %d\n", layout.fields[k].name.c_str(), layout.fields[k].channels) > 0;
+    ok = std::fclose(f) == 0 && ok;
+    if (!detail::replace(path, tmp, ok)) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+// Commits the values ([n channels], column-major) of the n voxels idx
+// (0-based linear indices) as one chunk.
+inline bool write(const std::string &dir, const Layout &layout, const int64_t *idx, std::size_t n,
+                  const double *values, int level, std::string &error)
+{
+    if (n == 0) return true;
+    unsigned char head[detail::kChunkHeader];
+    const uint64_t count = n, channels = (uint64_t)layout.channels();
+    std::memcpy(head, detail::kMagic, 8);
+    std::memcpy(head + 8, &count, 8);
+    std::memcpy(head + 16, &channels, 8);
+    std::vector<gzip::Span> parts(3);
+    parts[0].data = head;
+    parts[0].size = sizeof head;
+    parts[1].data = reinterpret_cast<const unsigned char *>(idx);
+    parts[1].size = n * sizeof(int64_t);
+    parts[2].data = reinterpret_cast<const unsigned char *>(values);
+    parts[2].size = n * channels * sizeof(double);
+
+    char name[48];
+    std::sprintf(name, "chunk_%012lld.gz", (long long)*std::min_element(idx, idx + n));
+    const std::string path = detail::join(dir, name), tmp = detail::tmpName(path, values);
+    if (!gzip::writeFile(tmp, parts, level, 1, error) || !detail::replace(path, tmp, true)) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+// Paths of the chunks of the store in `dir`, sorted.
+inline std::vector<std::string> chunks(const std::string &dir)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(detail::join(dir, "chunk_*.gz").c_str(), &fd);
+    if (h != INVALID_HANDLE_VALUE) {
+        do names.push_back(fd.cFileName);
+        while (FindNextFileA(h, &fd));
+        FindClose(h);
+    }
+#else
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *e = readdir(d)) {
+            const std::string s = e->d_name;
+            if (s.compare(0, 6, "chunk_") == 0 && s.size() > 9 && s.compare(s.size() - 3, 3, ".gz") == 0)
+                names.push_back(s);
+        }
+        closedir(d);
+    }
+#endif
+    std::sort(names.begin(), names.end());
+    for (std::size_t i = 0; i < names.size(); ++i) names[i] = detail::join(dir, names[i]);
+    return names;
+}
+
+// Reads a chunk: indices, and values unless `values` is NULL (then only
+// the start of the stream is inflated).
+inline bool read(const std::string &path, const Layout &layout, std::vector<int64_t> &idx,
+                 std::vector<double> *values, std::string &error)
+{
+    std::vector<unsigned char> buf;
+    if (!gzip::readFile(path, buf, error, detail::kChunkHeader)) return false;
+    uint64_t n = 0, channels = 0;
+    if (buf.size() < detail::kChunkHeader || std::memcmp(&buf[0], detail::kMagic, 8)) {
+        error = path + " is not a store chunk";
+        return false;
+    }
+    std::memcpy(&n, &buf[8], 8);
+    std::memcpy(&channels, &buf[16], 8);
+    if (channels != (uint64_t)layout.channels()) {
+        error = path + " does not match the store fields";
+        return false;
+    }
+    const std::size_t need = detail::kChunkHeader + n * sizeof(int64_t) + (values ? n * channels * sizeof(double) : 0);
+    if (!gzip::readFile(path, buf, error, need)) return false;
+    if (buf.size() < need) {
+        error = path + " is truncated";
+        return false;
+    }
+    idx.resize(n);
+    if (n) std::memcpy(&idx[0], &buf[detail::kChunkHeader], n * sizeof(int64_t));
+    for (std::size_t i = 0; i < n; ++i)
+        if (idx[i] < 0 || idx[i] >= layout.voxels()) {
+            error = path + " holds voxels outside the volume";
+            return false;
+        }
+    if (values) {
+        values->resize(n * channels);
+        if (n) std::memcpy(&(*values)[0], &buf[detail::kChunkHeader + n * sizeof(int64_t)], values->size() * sizeof(double));
+    }
+    return true;
+}
+
+} // namespace store
+} // namespace qmr
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Chunked, compressed store of fitted maps (see qmr_store.hh). Used by
+ * FitData and ParFitData for their temporary results, and by
+ * FitResultsExport_nii.
+ *
+ *          qmr_store_mex('create', dir, dims, fields, channels, key)
+ *          qmr_store_mex('write', dir, index, values, opts)
+ *   info  = qmr_store_mex('info', dir)
+ *   index = qmr_store_mex('computed', dir)
+ *   Fit   = qmr_store_mex('read', dir, fields, opts)
+ *   key   = qmr_store_mex('fingerprint', A, B, ...)
+ *
+ * 'create' makes a store in the existing folder dir for a volume of size
+ * dims ([x y z]) and the fields (cellstr) with the given number of
+ * channels each, or checks that the store already there matches. key is
+ * an optional fingerprint of the fit (char, see 'fingerprint'): a store
+ * is only resumed by a fit with the same key.
+ * 'write' commits the voxels index (1-based linear indices) with values,
+ * a real double [numel(index) sum(channels)] matrix, fields side by side.
+ * 'info' returns the layout: dims, fields, channels and fingerprint ('' if
+ * none). 'computed'
+ * returns the sorted indices of every committed voxel.
+ * 'read' returns a struct with one [x y z channels] double map per field
+ * (all, or the fields listed, char or cellstr), NaN where nothing was
+ * committed, plus 'fields' and 'computed' ([x y z], 1 where committed),
+ * laid out as FitData results.
+ * 'fingerprint' returns a checksum (char) of the class, size and contents
+ * of its inputs, structs and cells included (objects and function handles
+ * by class only): FitData and ParFitData pass their data and model
+ * options.
+ *
+ * opts is an optional struct with Level (gzip compression of the chunks,
+ * 1 fast to 9 small; default 1) and NumThreads (0: all cores; chunks
+ * are inflated in parallel).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "qmr_parallel.hh"
+#include "qmr_store.hh"
+
+static const char *kName = "qmr_store_mex";
+
+namespace {
+
+qmr::store::Layout open(const std::string &dir)
+{
+    qmr::store::Layout layout;
+    std::string error;
+    if (!qmr::store::open(dir, layout, error)) qmr::mex::fail(kName, "cannotRead", error + ".");
+    return layout;
+}
+
+std::vector<std::string> names(const mxArray *a, const char *argName)
+{
+    std::vector<std::string> out;
+    if (mxIsChar(a)) {
+        out.push_back(qmr::mex::string(kName, a, argName));
+    } else if (mxIsCell(a)) {
+        for (std::size_t i = 0; i < mxGetNumberOfElements(a); ++i) {
+            const mxArray *c = mxGetCell(a, i);
+            if (!c || !mxIsChar(c))
+                qmr::mex::fail(kName, "invalidInputType", std::string(argName) + " must be a cell array of names.");
+            out.push_back(qmr::mex::string(kName, c, argName));
+        }
+    } else {
+        qmr::mex::fail(kName, "invalidInputType", std::string(argName) + " must be a name or a cell array of names.");
+    }
+    return out;
+}
+
+void create(int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 5 || nrhs > 6)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_store_mex('create', dir, dims, fields, channels, key).");
+    const std::string dir = qmr::mex::string(kName, prhs[1], "dir");
+    const std::vector<double> dims = qmr::mex::toVector(prhs[2]);
+    const std::vector<std::string> fields = names(prhs[3], "fields");
+    const std::vector<double> channels = qmr::mex::toVector(prhs[4]);
+    if (dims.empty() || dims.size() > 3 || fields.empty() || channels.size() != fields.size())
+        qmr::mex::fail(kName, "invalidInputSize", "dims must have 1 to 3 elements and channels one per field.");
+
+    qmr::store::Layout layout;
+    for (int k = 0; k < 3; ++k) {
+        layout.dim[k] = k < (int)dims.size() ? (int64_t)dims[k] : 1;
+        if (layout.dim[k] < 1) qmr::mex::fail(kName, "invalidInput", "dims must be positive.");
+    }
+    for (std::size_t f = 0; f < fields.size(); ++f) {
+        if (fields[f].empty() || fields[f].find_first_of(" \t\r\n") != std::string::npos || !(channels[f] >= 1))
+            qmr::mex::fail(kName, "invalidInput", "Field names must be words, with at least one channel each.");
+        qmr::store::Field fd = {fields[f], (int)channels[f]};
+        layout.fields.push_back(fd);
+    }
+    if (nrhs > 5) {
+        layout.fingerprint = qmr::mex::string(kName, prhs[5], "key");
+        if (layout.fingerprint.find_first_of(" \t\r\n") != std::string::npos || layout.fingerprint.size() > 255)
+            qmr::mex::fail(kName, "invalidInput", "key must be a word.");
+    }
+    std::string error;
+    if (!qmr::store::create(dir, layout, error)) qmr::mex::fail(kName, "storeMismatch", error + ".");
+}
+
+void write(int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "qmr_store_mex('write', dir, index, values, opts).");
+    const std::string dir = qmr::mex::string(kName, prhs[1], "dir");
+    const qmr::store::Layout layout = open(dir);
+    const std::vector<double> index = qmr::mex::toVector(prhs[2]);
+    qmr::mex::requireDouble(kName, prhs[3], "values");
+    const std::size_t n = index.size();
+    if (mxGetM(prhs[3]) != n || mxGetN(prhs[3]) != (std::size_t)layout.channels())
+        qmr::mex::fail(kName, "invalidInputSize", "values must be [numel(index) x total channels of the store].");
+    const int level = (int)qmr::mex::option(nrhs > 4 ? prhs[4] : NULL, "Level", 1.0);
+    if (level < 1 || level > 9) qmr::mex::fail(kName, "invalidInput", "Level must be in 1..9.");
+
+    std::vector<int64_t> idx(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!(index[i] >= 1 && index[i] <= (double)layout.voxels()) || index[i] != std::floor(index[i]))
+            qmr::mex::fail(kName, "invalidIndex", "index must hold linear indices in the store volume.");
+        idx[i] = (int64_t)index[i] - 1;
+    }
+    std::string error;
+    if (n && !qmr::store::write(dir, layout, &idx[0], n, mxGetPr(prhs[3]), level, error))
+        qmr::mex::fail(kName, "cannotWrite", error + ".");
+}
+
+void info(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 2) qmr::mex::fail(kName, "wrongNumInputs", "qmr_store_mex('info', dir).");
+    const qmr::store::Layout layout = open(qmr::mex::string(kName, prhs[1], "dir"));
+    static const char *fields[] = {"dims", "fields", "channels", "fingerprint"};
+    plhs[0] = mxCreateStructMatrix(1, 1, 4, fields);
+    mxArray *dims = mxCreateDoubleMatrix(1, 3, mxREAL);
+    for (int k = 0; k < 3; ++k) mxGetPr(dims)[k] = (double)layout.dim[k];
+    mxArray *names = mxCreateCellMatrix(1, layout.fields.size());
+    mxArray *channels = mxCreateDoubleMatrix(1, layout.fields.size(), mxREAL);
+    for (std::size_t f = 0; f < layout.fields.size(); ++f) {
+        mxSetCell(names, f, mxCreateString(layout.fields[f].name.c_str()));
+        mxGetPr(channels)[f] = layout.fields[f].channels;
+    }
+    mxSetField(plhs[0], 0, "dims", dims);
+    mxSetField(plhs[0], 0, "fields", names);
+    mxSetField(plhs[0], 0, "channels", channels);
+    mxSetField(plhs[0], 0, "fingerprint", mxCreateString(layout.fingerprint.c_str()));
+}
+
+void hash(qmr::store::Fingerprint &key, const mxArray *a)
+{
+    const mwSize nd = mxGetNumberOfDimensions(a);
+    key.value((int)mxGetClassID(a));
+    key.value((uint64_t)nd);
+    for (mwSize k = 0; k < nd; ++k) key.value((uint64_t)mxGetDimensions(a)[k]);
+    const std::size_t n = mxGetNumberOfElements(a);
+    if (mxIsStruct(a)) {
+        const int nf = mxGetNumberOfFields(a);
+        for (int f = 0; f < nf; ++f) {
+            const char *name = mxGetFieldNameByNumber(a, f);
+            key.add(name, std::strlen(name) + 1);
+        }
+        for (std::size_t i = 0; i < n; ++i)
+            for (int f = 0; f < nf; ++f) {
+                const mxArray *v = mxGetFieldByNumber(a, i, f);
+                key.value((char)(v != NULL));
+                if (v) hash(key, v);
+            }
+    } else if (mxIsCell(a)) {
+        for (std::size_t i = 0; i < n; ++i) {
+            const mxArray *v = mxGetCell(a, i);
+            key.value((char)(v != NULL));
+            if (v) hash(key, v);
+        }
+    } else if (mxIsNumeric(a) || mxIsChar(a) || mxIsLogical(a)) {
+        std::size_t count = n;
+        if (mxIsSparse(a)) {
+            const std::size_t cols = mxGetN(a);
+            count = mxGetJc(a)[cols];
+            key.add(mxGetJc(a), (cols + 1) * sizeof(mwIndex));
+            key.add(mxGetIr(a), count * sizeof(mwIndex));
+        }
+        key.add(mxGetData(a), count * mxGetElementSize(a));   // both parts, interleaved complex API
+#if !defined(MX_HAS_INTERLEAVED_COMPLEX) || !MX_HAS_INTERLEAVED_COMPLEX
+        if (mxIsComplex(a)) key.add(mxGetImagData(a), count * mxGetElementSize(a));
+#endif
+    } else {
+        const char *name = mxGetClassName(a);
+        key.add(name, std::strlen(name) + 1);
+    }
+}
+
+void fingerprint(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    qmr::store::Fingerprint key;
+    for (int i = 1; i < nrhs; ++i) hash(key, prhs[i]);
+    plhs[0] = mxCreateString(key.hex().c_str());
+}
+
+void computed(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 2) qmr::mex::fail(kName, "wrongNumInputs", "qmr_store_mex('computed', dir).");
+    const std::string dir = qmr::mex::string(kName, prhs[1], "dir");
+    const qmr::store::Layout layout = open(dir);
+    std::vector<bool> done((std::size_t)layout.voxels(), false);
+    const std::vector<std::string> files = qmr::store::chunks(dir);
+    std::vector<int64_t> idx;
+    std::string error;
+    std::size_t count = 0;
+    for (std::size_t c = 0; c < files.size(); ++c) {
+        if (!qmr::store::read(files[c], layout, idx, NULL, error)) qmr::mex::fail(kName, "cannotRead", error + ".");
+        for (std::size_t i = 0; i < idx.size(); ++i)
+            if (!done[(std::size_t)idx[i]]) {
+                done[(std::size_t)idx[i]] = true;
+                ++count;
+            }
+    }
+    plhs[0] = mxCreateDoubleMatrix(count, 1, mxREAL);
+    double *out = mxGetPr(plhs[0]);
+    for (std::size_t v = 0; v < done.size(); ++v)
+        if (done[v]) *out++ = (double)(v + 1);
+}
+
+void read(mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 2 || nrhs > 4) qmr::mex::fail(kName, "wrongNumInputs", "qmr_store_mex('read', dir, fields, opts).");
+    const std::string dir = qmr::mex::string(kName, prhs[1], "dir");
+    const qmr::store::Layout layout = open(dir);
+    const int nthreads = (int)qmr::mex::option(nrhs > 3 ? prhs[3] : NULL, "NumThreads", 0.0);
+
+    // Requested fields and their first channel in a chunk row
+    std::vector<std::size_t> wanted, offset;
+    std::vector<std::string> requested;
+    if (nrhs > 2 && !mxIsEmpty(prhs[2])) requested = names(prhs[2], "fields");
+    std::size_t first = 0;
+    for (std::size_t f = 0; f < layout.fields.size(); ++f) {
+        bool keep = requested.empty();
+        for (std::size_t r = 0; r < requested.size(); ++r) keep = keep || requested[r] == layout.fields[f].name;
+        if (keep) {
+            wanted.push_back(f);
+            offset.push_back(first);
+        }
+        first += layout.fields[f].channels;
+    }
+    if (wanted.size() < requested.size()) qmr::mex::fail(kName, "invalidInput", "Unknown field requested.");
+
+    std::vector<const char *> fieldNames;
+    for (std::size_t w = 0; w < wanted.size(); ++w) fieldNames.push_back(layout.fields[wanted[w]].name.c_str());
+    fieldNames.push_back("fields");
+    fieldNames.push_back("computed");
+    plhs[0] = mxCreateStructMatrix(1, 1, (int)fieldNames.size(), &fieldNames[0]);
+
+    const std::size_t nV = (std::size_t)layout.voxels();
+    std::vector<double *> maps(wanted.size());
+    for (std::size_t w = 0; w < wanted.size(); ++w) {
+        mwSize d[4] = {(mwSize)layout.dim[0], (mwSize)layout.dim[1], (mwSize)layout.dim[2],
+                       (mwSize)layout.fields[wanted[w]].channels};
+        mxArray *m = mxCreateNumericArray(d[3] > 1 ? 4 : 3, d, mxDOUBLE_CLASS, mxREAL);
+        maps[w] = mxGetPr(m);
+        std::fill(maps[w], maps[w] + nV * d[3], std::numeric_limits<double>::quiet_NaN());
+        mxSetField(plhs[0], 0, fieldNames[w], m);
+    }
+    mxArray *list = mxCreateCellMatrix(1, wanted.size());
+    for (std::size_t w = 0; w < wanted.size(); ++w) mxSetCell(list, w, mxCreateString(fieldNames[w]));
+    mxSetField(plhs[0], 0, "fields", list);
+    mwSize d3[3] = {(mwSize)layout.dim[0], (mwSize)layout.dim[1], (mwSize)layout.dim[2]};
+    mxArray *done = mxCreateNumericArray(3, d3, mxDOUBLE_CLASS, mxREAL);
+    mxSetField(plhs[0], 0, "computed", done);
+    double *computedMap = mxGetPr(done);
+
+    // Inflate chunks in parallel, a wave at a time, and scatter them in
+    // file order (a voxel committed twice keeps its last value).
+    const std::vector<std::string> files = qmr::store::chunks(dir);
+    const std::size_t wave = 4 * (std::size_t)qmr::num_threads(nthreads);
+    std::vector<std::vector<int64_t> > idx(wave);
+    std::vector<std::vector<double> > values(wave);
+    std::vector<std::string> errors(wave);
+    std::vector<char> ok(wave);
+    for (std::size_t c0 = 0; c0 < files.size(); c0 += wave) {
+        const std::size_t n = std::min(wave, files.size() - c0);
+        qmr::parallel_for(n, 1, [&](std::size_t b, std::size_t e, int) {
+            for (std::size_t i = b; i < e; ++i)
+                ok[i] = qmr::store::read(files[c0 + i], layout, idx[i], &values[i], errors[i]);
+        }, nthreads);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (!ok[i]) qmr::mex::fail(kName, "cannotRead", errors[i] + ".");
+            const std::size_t m = idx[i].size();
+            for (std::size_t j = 0; j < m; ++j) {
+                const std::size_t v = (std::size_t)idx[i][j];
+                computedMap[v] = 1;
+                for (std::size_t w = 0; w < wanted.size(); ++w)
+                    for (int k = 0; k < layout.fields[wanted[w]].channels; ++k)
+                        maps[w][v + nV * k] = values[i][j + m * (offset[w] + k)];
+            }
+        }
+    }
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    (void)nlhs;
+    if (nrhs < 2) qmr::mex::fail(kName, "wrongNumInputs", "qmr_store_mex expects a command and a store folder (or inputs).");
+    const std::string cmd = qmr::mex::string(kName, prhs[0], "command");
+    if (cmd == "create") create(nrhs, prhs);
+    else if (cmd == "write") write(nrhs, prhs);
+    else if (cmd == "info") info(plhs, nrhs, prhs);
+    else if (cmd == "computed") computed(plhs, nrhs, prhs);
+    else if (cmd == "read") read(plhs, nrhs, prhs);
+    else if (cmd == "fingerprint") fingerprint(plhs, nrhs, prhs);
+    else qmr::mex::fail(kName, "unknownCommand", "Unknown command '" + cmd + "'.");
+}
@@ -0,0 +1,71 @@
+/*
+ * qmr_tensor.hh: closed-form eigen-decomposition of 3x3 symmetric
+ * tensors, shared by the diffusion engines (dti_mex, amico_mex).
+ *
+ * Tensors are stored [Dxx Dyy Dzz Dxy Dxz Dyz], each component over W
+ * voxels ([6][W]) so the loops vectorize.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QMR_TENSOR_HH
+#define QMR_TENSOR_HH
+
+#include <algorithm>
+#include <cmath>
+
+namespace qmr {
+namespace tensor {
+
+// Sorted eigenvalues L1 >= L2 >= L3 of the symmetric tensors d ([6][W]),
+// with the closed-form trigonometric solution (Smith, 1961), and the
+// unit eigenvector of L1 when V1 is not NULL.
+inline void eigen(const double *d, double *L, double *V1, int W)
+{
+    const double third = 1.0 / 3.0, twoPiThird = 2.0943951023931954923;
+    for (int l = 0; l < W; ++l) {
+        const double a11 = d[l], a22 = d[W + l], a33 = d[2 * W + l];
+        const double a12 = d[3 * W + l], a13 = d[4 * W + l], a23 = d[5 * W + l];
+        const double q = (a11 + a22 + a33) * third;
+        const double b11 = a11 - q, b22 = a22 - q, b33 = a33 - q;
+        const double p1 = a12 * a12 + a13 * a13 + a23 * a23;
+        const double p = std::sqrt((b11 * b11 + b22 * b22 + b33 * b33 + 2 * p1) / 6);
+        const double ip = p > 0 ? 1 / p : 0;
+        const double det = b11 * (b22 * b33 - a23 * a23) - a12 * (a12 * b33 - a23 * a13) +
+                           a13 * (a12 * a23 - b22 * a13);
+        const double r = std::min(1.0, std::max(-1.0, 0.5 * det * ip * ip * ip));
+        const double phi = std::acos(r) * third;
+        const double e1 = q + 2 * p * std::cos(phi);
+        const double e3 = q + 2 * p * std::cos(phi + twoPiThird);
+        L[l] = e1;
+        L[W + l] = 3 * q - e1 - e3;
+        L[2 * W + l] = e3;
+    }
+    if (!V1) return;
+    for (int l = 0; l < W; ++l) {
+        // Largest cross product of two rows of D - L1*I.
+        const double e = L[l];
+        const double r0[3] = {d[l] - e, d[3 * W + l], d[4 * W + l]};
+        const double r1[3] = {d[3 * W + l], d[W + l] - e, d[5 * W + l]};
+        const double r2[3] = {d[4 * W + l], d[5 * W + l], d[2 * W + l] - e};
+        const double *rows[3][2] = {{r0, r1}, {r0, r2}, {r1, r2}};
+        double best[3] = {1, 0, 0}, bestNorm = 0;
+        for (int c = 0; c < 3; ++c) {
+            const double *u = rows[c][0], *v = rows[c][1];
+            const double x[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                                 u[0] * v[1] - u[1] * v[0]};
+            const double n = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+            if (n > bestNorm) {
+                bestNorm = n;
+                for (int k = 0; k < 3; ++k) best[k] = x[k];
+            }
+        }
+        const double s = bestNorm > 0 ? 1 / std::sqrt(bestNorm) : 1;
+        for (int k = 0; k < 3; ++k) V1[k * W + l] = std::isfinite(e) ? best[k] * s : e;
+    }
+}
+
+} // namespace tensor
+} // namespace qmr
+
+#endif
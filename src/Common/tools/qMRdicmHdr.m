@@ -0,0 +1,49 @@
+function [hh, errStr, dict] = qMRdicmHdr(fnames, dict, updateDict)
+% qMRdicmHdr   Read the DICOM headers of many files, in parallel
+%
+%   [hh, errStr, dict] = qMRdicmHdr(fnames, dict)
+%   [hh, errStr]       = qMRdicmHdr(fnames, dict, false)
+%
+%   hh{k} and errStr{k} are what dicm_hdr(fnames{k}, dict) returns, dict
+%   being a partial dictionary from dicm_dict(vendor, fields). As in the
+%   loop of dicm2nii, dict follows the Manufacturer of the files read so
+%   far and the last one is returned. With updateDict false, every file
+%   is read with the given dict, as in sort_dicm.
+%
+%   With qmr_dicm_mex compiled (qMRbuildMex), DICOM files are parsed in
+%   native code, in parallel, and dicm_hdr only reads the files it leaves
+%   out (PAR/HEAD and other formats, another vendor, multi-frame).
+%   Otherwise dicm_hdr reads every file.
+%
+% Example:
+%   dict = dicm_dict('SIEMENS', {'SeriesInstanceUID' 'InstanceNumber'});
+%   hh = qMRdicmHdr(fnames, dict);
+%
+% Written by: qMRLab contributors, 2026
+
+if ~exist('updateDict','var') || isempty(updateDict), updateDict = true; end
+nFile = numel(fnames);
+hh = cell(1, nFile); errStr = cell(1, nFile);
+native = exist('qmr_dicm_mex','file')==3;
+if native
+    [h, e, redo] = qmr_dicm_mex('headers', fnames, dict);
+    offset = 0; % h{j} is the header of fnames{offset+j}
+end
+
+k = 1;
+while k <= nFile
+    if native && ~redo(k-offset)
+        hh{k} = h{k-offset}; errStr{k} = e{k-offset};
+        k = k + 1;
+        continue;
+    end
+    [hh{k}, errStr{k}, newDict] = dicm_hdr(fnames{k}, dict);
+    k = k + 1;
+    if updateDict && ~isequal(newDict, dict)
+        dict = newDict;
+        if native && k <= nFile % headers after it depend on the new vendor
+            [h, e, redo] = qmr_dicm_mex('headers', fnames(k:end), dict);
+            offset = k - 1;
+        end
+    end
+end
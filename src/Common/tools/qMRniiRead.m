@@ -0,0 +1,65 @@
+function [out, info] = qMRniiRead(filename, what, index, volumes)
+% qMRniiRead   Read part of a NIfTI image without loading all of it
+%
+%   info = qMRniiRead(filename)
+%   img  = qMRniiRead(filename, 'slab', slices, volumes)
+%   vals = qMRniiRead(filename, 'voxels', index, volumes)
+%
+%   'slab' returns slices (1-based, [] for all) of the requested volumes
+%   ([] for all) as an [nx ny numel(slices) numel(volumes)] array.
+%   'voxels' returns the voxels selected by index (logical mask of the
+%   size of a volume, or linear indices) as a [nVoxels numel(volumes)]
+%   matrix, e.g. the masked voxels of a 4D dataset for FitData.
+%
+%   Values keep the stored data type and are not scaled; apply
+%   info.scl_slope and info.scl_inter if needed (a slope of 0 means no
+%   scaling).
+%
+%   With qmr_nii_mex compiled (qMRbuildMex), uncompressed files (.nii,
+%   .hdr/.img) are memory-mapped, so only the requested part is read from
+%   disk, and gzipped files are inflated in memory, without a temporary
+%   file. Otherwise load_untouch_nii is used.
+%
+% Example:
+%   mask = load_nii_data('mask.nii.gz') > 0;
+%   dwi  = qMRniiRead('dwi.nii', 'voxels', mask);
+%
+% Written by: qMRLab contributors, 2026
+
+if ~exist('what','var') || isempty(what), what = 'info'; end
+if ~exist('index','var'), index = []; end
+if ~exist('volumes','var'), volumes = []; end
+
+native = exist('qmr_nii_mex','file')==3;
+if native
+    info = qmr_nii_mex('info', filename);
+else
+    hdr = load_untouch_header_only(filename);
+    info = struct('version', 1, 'dim', hdr.dime.dim, 'pixdim', hdr.dime.pixdim, ...
+        'datatype', hdr.dime.datatype, 'bitpix', hdr.dime.bitpix, 'vox_offset', hdr.dime.vox_offset, ...
+        'scl_slope', hdr.dime.scl_slope, 'scl_inter', hdr.dime.scl_inter, 'swapped', false);
+end
+
+switch what
+    case 'info'
+        out = info;
+    case 'slab'
+        if native
+            out = qmr_nii_mex('slab', filename, index, volumes);
+        else
+            nii = load_untouch_nii(filename, volumes, [], [], [], [], index);
+            out = nii.img;
+        end
+    case 'voxels'
+        if native
+            out = qmr_nii_mex('voxels', filename, index, volumes);
+        else
+            nii = load_untouch_nii(filename, volumes);
+            nV = prod(info.dim(2:4));
+            out = reshape(nii.img, nV, []);
+            out = out(index(:), :);
+        end
+    otherwise
+        error('qMRLab:qMRniiRead:unknownRequest', 'Unknown request ''%s'' (use ''slab'' or ''voxels'').', what);
+end
+end
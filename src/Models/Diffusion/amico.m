@@ -110,15 +110,26 @@ end
                 CONFIG.model.isExvivo=true; % Dot compartment in ex vivo
             end
             
-            % rotation matrices
             lmax = 12;
-            AMICO_PrecomputeRotationMatrices(lmax);
-            
             if ~isempty(KERNELS) && isfield(ProtLUTable,'scheme') && isequal(ProtLUTable.scheme,obj.Prot.DiffusionData.Mat)
                 doResampleKernels = false;
             else
                 doResampleKernels = true;
             end
+
+            if exist('amico_kernels_mex','file')==3
+                % Kernels straight on the scheme (SH coefficients cached by shells)
+                if doResampleKernels
+                    h = msgbox('Generate Kernels (Lookup Table) for this protocol...');
+                    KERNELS = amico_kernels(CONFIG.model, CONFIG.scheme, lmax);
+                    if ishandle(h), delete(h); end
+                end
+                ProtLUTable.scheme = obj.Prot.DiffusionData.Mat;
+                return;
+            end
+
+            % rotation matrices
+            AMICO_PrecomputeRotationMatrices(lmax);
             
             ModelDefault = noddi;
             if isequal(obj.Prot.DiffusionData.Mat(:,4:end),ModelDefault.Prot.DiffusionData.Mat(:,4:end))
@@ -200,6 +211,40 @@ end
             FitResults.fr  = FitResults.ficvf*(1-FitResults.fiso);
         end
 
+        function FitResults = fitBatch(obj,data)
+            % Fits all voxels at once with the compiled AMICO engine
+            % (amico_mex): voxels are grouped by direction bin, so that the
+            % dictionary of each bin and its Gram matrix are built once.
+            % Called by FitData with data.DiffusionData of size
+            % [nVoxels x nVol]; returns [] when amico_mex is not compiled so
+            % that FitData fits voxel by voxel.
+            global CONFIG KERNELS ProtLUTable
+
+            FitResults = [];
+            if exist('amico_mex','file')~=3, return; end
+            if ~isfield(CONFIG,'scheme') || ~isfield(CONFIG,'model') || ~isfield(ProtLUTable,'scheme') || ~isequal(ProtLUTable.scheme,obj.Prot.DiffusionData.Mat)
+                obj.Precompute();
+            end
+
+            opts = struct('Exvivo',CONFIG.model.isExvivo, ...
+                          'Lambda',CONFIG.OPTIMIZATION.SPAMS_param.lambda, ...
+                          'Lambda2',CONFIG.OPTIMIZATION.SPAMS_param.lambda2, ...
+                          'TolX',CONFIG.OPTIMIZATION.LS_param.TolX);
+            [MAPs,DIRs,b0] = amico_mex(double(data.DiffusionData),CONFIG.scheme,KERNELS,opts);
+
+            outputsName = {'ficvf' 'ODI' 'fiso' 'irfrac'};
+            for io = 1:size(MAPs,2)
+                FitResults.(outputsName{io}) = MAPs(:,io);
+            end
+            FitResults.kappa = 1 ./ tan(FitResults.ODI*pi/2)/10;
+            FitResults.di = repmat(CONFIG.model.dPar * 1E3, size(b0));
+            FitResults.diso = repmat(CONFIG.model.dIso * 1E3, size(b0));
+            FitResults.b0 = b0;
+            FitResults.theta = acos(DIRs(:,3));
+            FitResults.phi = asin(DIRs(:,2)./sin(FitResults.theta));
+            FitResults.fr  = FitResults.ficvf.*(1-FitResults.fiso);
+        end
+
 
     end
 
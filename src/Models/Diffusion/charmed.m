@@ -210,7 +210,7 @@ end
             end
 
             %% FITTING (with rician assumption)
-            if ~moxunit_util_platform_is_octave
+            if ~moxunit_util_platform_is_octave && SigmaNoise
                 [xopt, residue] = fmincon(@(x) double(-2*sum(scd_model_likelihood_rician(datadif,max(eps,S0.*equation(obj, addfixparameters(obj.st,x,fixedparam))), SigmaNoise))), double(obj.st(~fixedparam)), [], [], [],[],double(obj.lb(~fixedparam)),double(obj.ub(~fixedparam)),[],optimoptions('fmincon','MaxIter',20,'display','off','DiffMinChange',0.03));
                 obj.st(~fixedparam) = xopt; xopt = obj.st;
             end
@@ -244,6 +244,69 @@ end
 
         end
 
+        function FitResults = fitBatch(obj,data)
+            % Fits all voxels at once with the compiled CHARMED kernel
+            % (charmed_mex). Called by FitData with data.DiffusionData of
+            % size [nVoxels x nVol]. The batch fit is the least-squares
+            % step of fit (raw signal, S0 from the b=0 images), so it is
+            % only used where fit stops there: Octave, or a SigmaNoise of
+            % 0 for all voxels (no Rician likelihood). Otherwise, or with
+            % 'Single T2 compartment', returns [] so that FitData fits
+            % voxel by voxel.
+
+            FitResults = [];
+            Mat = obj.Prot.DiffusionData.Mat;
+            if exist('charmed_mex','file')~=3 || isempty(Mat) || size(Mat,1) ~= size(data.DiffusionData,2), return; end
+            if ~strcmp(obj.options.S0normalization,'Use b=0'), return; end
+            Y = max(eps,double(data.DiffusionData));
+
+            % Noise level, as in fit (which stops when it is 0 per voxel)
+            if isfield(data,'SigmaNoise') && ~isempty(data.SigmaNoise)
+                SigmaNoise = double(data.SigmaNoise(:,1));
+            elseif strcmp(obj.options.Riciannoisebias_Method,'Compute Sigma per voxel')
+                SigmaNoise = computesigmanoise_batch(Mat,Y);
+                if ~all(SigmaNoise), return; end
+            else
+                SigmaNoise = obj.options.Riciannoisebias_value;
+            end
+            if ~moxunit_util_platform_is_octave && any(SigmaNoise(:)), return; end
+            Prot = ConvertSchemeUnits(Mat,0);
+
+            % S0: scd_preproc_getS0, for all voxels
+            TEs = unique(round(Prot(:,7)));
+            bvals = scd_scheme2bvecsbvals(Prot);
+            S0 = zeros(size(Y));
+            for ii = 1:length(TEs)
+                indexTEi = round(Prot(:,7))==TEs(ii);
+                refs = indexTEi & bvals==min(bvals(indexTEi));
+                S0(:,indexTEi) = repmat(median(Y(:,refs),2),1,sum(indexTEi));
+            end
+
+            % x of scd_model_CHARMED: diameter STD (0) is inserted at
+            % position 4, and Dcsf is 3 as in equation
+            x0 = [obj.st(1:3) 0 obj.st(4:end)]; x0(7) = 3;
+            lb = [obj.lb(1:3) 0 obj.lb(4:end)];
+            ub = [obj.ub(1:3) 0 obj.ub(4:end)];
+            fixed = [obj.fx(1:3) 1 obj.fx(4:end)]; fixed(7) = 1;
+            [X,residue] = charmed_mex('fit',Y,S0,double(x0),double(lb),double(ub),double(fixed),Prot,struct('MaxIter',100));
+            % [fr Dh mean std fcsf lc Dcsf Dr] -> xnames; Dcsf keeps its start value
+            X(:,7) = obj.st(6);
+            X = [X(:,1:3) X(:,5:6) X(:,7) X(:,8)];
+
+            for ix = 1:length(obj.xnames)
+                FitResults.(obj.xnames{ix}) = X(:,ix);
+            end
+            for ii = 1:length(TEs)
+                refs = find(round(Prot(:,7))==TEs(ii),1);
+                FitResults.(['S0_TE' num2str(TEs(ii))]) = S0(:,refs);
+            end
+            FitResults.fh = 1 - X(:,4) - X(:,1);
+            FitResults.residue = residue;
+            if strcmp(obj.options.Riciannoisebias_Method,'Compute Sigma per voxel')
+                FitResults.SigmaNoise = SigmaNoise;
+            end
+        end
+
         % -------------PLOT EQUATION-------------------------------------------------------------------------
         function plotModel(obj, x, data)
             % u.plotModel(u.st)
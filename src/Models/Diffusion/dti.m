@@ -210,6 +210,46 @@ end
 
         end
 
+        function FitResults = fitBatch(obj,data)
+            % Fits all voxels at once with the compiled tensor fit
+            % (dti_mex, see dti_fit_batch). Called by FitData with
+            % data.DiffusionData of size [nVoxels x nVol]. Only the linear
+            % estimate is computed in batch: with the Rician likelihood,
+            % it is used when fit would skip the likelihood step
+            % (SigmaNoise of 0 for all voxels, or Octave). Otherwise, or
+            % when the engine is not compiled, returns [] so that FitData
+            % fits voxel by voxel.
+
+            FitResults = [];
+            Mat = obj.Prot.DiffusionData.Mat;
+            if exist('dti_mex','file')~=3 || isempty(Mat) || size(Mat,1) ~= size(data.DiffusionData,2), return; end
+            Y = double(data.DiffusionData);
+
+            if ~strcmp(obj.options.fittingtype,'linear') && ~moxunit_util_platform_is_octave
+                if isfield(data,'SigmaNoise') && ~isempty(data.SigmaNoise)
+                    SigmaNoise = double(data.SigmaNoise(:,1));
+                elseif strcmp(obj.options.Riciannoisebias_Method,'Compute Sigma per voxel')
+                    SigmaNoise = computesigmanoise_batch(Mat,Y);
+                else
+                    SigmaNoise = obj.options.Riciannoisebias_value;
+                end
+                if isempty(SigmaNoise) || any(SigmaNoise(:)), return; end
+            end
+
+            [D,L,S0] = dti_fit_batch(Y,Mat,'linear');
+            FitResults.FA = sqrt(3/2)*sqrt(sum(bsxfun(@minus,L,mean(L,2)).^2,2))./sqrt(sum(L.^2,2));
+            FitResults.L1 = L(:,1);
+            FitResults.L2 = L(:,2);
+            FitResults.L3 = L(:,3);
+            FitResults.D  = D;
+            FitResults.residue = zeros(size(Y,1),1);
+            Prot = ConvertSchemeUnits(Mat,0,1);
+            TEs = unique(round(Prot(:,7)));
+            for ii = 1:length(TEs)
+                FitResults.(['S0_TE' num2str(TEs(ii))]) = S0(:,ii);
+            end
+        end
+
         function plotModel(obj, FitResults, data)
             % plotModel(obj, FitResults, data)
             % EXAMPLE:
@@ -102,8 +102,13 @@ end
             Phase_uw = Phase;
             if TwoD
                 Complex = Magn.*exp(Phase*1i);
-                for iEcho = 1:size(Magn,4)
-                    Phase_uw(:,:,:,iEcho) = sunwrap(Complex(:,:,:,iEcho));
+                if exist('sunwrap_mex','file')==3
+                    % all echoes at once, unwrapped in parallel
+                    Phase_uw = sunwrap_mex(abs(double(Complex)), angle(double(Complex)), 0);
+                else
+                    for iEcho = 1:size(Magn,4)
+                        Phase_uw(:,:,:,iEcho) = sunwrap(Complex(:,:,:,iEcho));
+                    end
                 end
             % MATLAB "laplacianUnwrap" for 3D data
             else
@@ -68,19 +68,26 @@ classdef b1_afi < AbstractModel & FilterClass
             nomFA = obj.Prot.Sequence.Mat(1); %nominal Flip Angle
             n = obj.Prot.Sequence.Mat(3)/obj.Prot.Sequence.Mat(2); %TR2/TR1
 
-            r = abs(data.AFIData2./data.AFIData1); %Signal AFI2/Signal AFI1
-            cos_arg = (r*n-1)./(n-r);
-            % filter out cases where r > 1:
-            % r should not be greater than one, so must be noise
-            cos_arg = double(cos_arg).*(r<=1) + ones(size(r)).*(r>1);
-            AFImap = acos(cos_arg); %AFImap is in radians
-            AFImap = AFImap*180/pi;
-            FitResult.B1map_raw = AFImap/nomFA;
-                
-            %remove 'spurious' points to reduce edge effects
-            FitResult.Spurious = double(FitResult.B1map_raw<0.5);
-            B1map_nospur = FitResult.B1map_raw;
-            B1map_nospur(B1map_nospur<0.6 | isnan(B1map_nospur))=0.6; %set 'spurious' values to 0.6
+            if exist('qmr_maps_mex','file')==3
+                % Compiled closed-form kernel, same formulas as below
+                S1 = data.AFIData1; if ~isreal(S1), S1 = abs(S1); end
+                S2 = data.AFIData2; if ~isreal(S2), S2 = abs(S2); end
+                [FitResult.B1map_raw, FitResult.Spurious, B1map_nospur] = qmr_maps_mex('afi', S1, S2, nomFA, n);
+            else
+                r = abs(data.AFIData2./data.AFIData1); %Signal AFI2/Signal AFI1
+                cos_arg = (r*n-1)./(n-r);
+                % filter out cases where r > 1:
+                % r should not be greater than one, so must be noise
+                cos_arg = double(cos_arg).*(r<=1) + ones(size(r)).*(r>1);
+                AFImap = acos(cos_arg); %AFImap is in radians
+                AFImap = AFImap*180/pi;
+                FitResult.B1map_raw = AFImap/nomFA;
+
+                %remove 'spurious' points to reduce edge effects
+                FitResult.Spurious = double(FitResult.B1map_raw<0.5);
+                B1map_nospur = FitResult.B1map_raw;
+                B1map_nospur(B1map_nospur<0.6 | isnan(B1map_nospur))=0.6; %set 'spurious' values to 0.6
+            end
             
             % call the superclass (FilterClass) fit function
             data.Raw = B1map_nospur;
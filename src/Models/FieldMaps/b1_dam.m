@@ -80,11 +80,16 @@ end
         end
         
         function FitResult = fit(obj,data)
-            FitResult.B1map_raw = abs(acos(data.SF2alpha./(2*data.SFalpha))./(deg2rad(obj.Prot.Alpha.Mat)));
-            %remove 'spurious' points to reduce edge effects
-            FitResult.Spurious = double(FitResult.B1map_raw<0.5);
-            B1map_nospur = FitResult.B1map_raw;
-            B1map_nospur(B1map_nospur<0.6 | isnan(B1map_nospur))=0.6; %set 'spurious' values to 0.6
+            if exist('qmr_maps_mex','file')==3 && isreal(data.SFalpha) && isreal(data.SF2alpha)
+                % Compiled closed-form kernel, same formulas as below
+                [FitResult.B1map_raw, FitResult.Spurious, B1map_nospur] = qmr_maps_mex('dam', data.SFalpha, data.SF2alpha, obj.Prot.Alpha.Mat);
+            else
+                FitResult.B1map_raw = abs(acos(data.SF2alpha./(2*data.SFalpha))./(deg2rad(obj.Prot.Alpha.Mat)));
+                %remove 'spurious' points to reduce edge effects
+                FitResult.Spurious = double(FitResult.B1map_raw<0.5);
+                B1map_nospur = FitResult.B1map_raw;
+                B1map_nospur(B1map_nospur<0.6 | isnan(B1map_nospur))=0.6; %set 'spurious' values to 0.6
+            end
             
             % call the superclass (FilterClass) fit function
             data.Raw = B1map_nospur;
@@ -28,6 +28,9 @@ classdef denoising_mppca < AbstractModel
 %   FitResults = FitData(data,Model,1);  % Fit each voxel within mask
 %   FitResultsSave_nii(FitResults,'Data4D.nii.gz');  % Save in local folder: FitResults/
 %
+%   For volumes that do not fit in memory, denoise the NIfTI file slab by slab:
+%   Model.denoiseNii('Data4D.nii.gz','Data4D_denoised.nii.gz','sigma_g.nii.gz');
+%
 % Author: Tanguy Duval, 2016
 %
 % References:
@@ -72,7 +75,23 @@ classdef denoising_mppca < AbstractModel
             [V,Ind] = min(dims(1:3));
             if ~isfield(data,'Mask'), data.Mask = []; end
             if V<7 && kernel(Ind)>1, helpdlg(['your dataset has very few slices. To avoid loosing too many slices, kernel is set to 1 in the dimension #' num2str(Ind) '.']); kernel(Ind)=1; end
-            [FitResults.Data4D_denoised, FitResults.sigma_g] = MPdenoising(data.Data4D,data.Mask,kernel, obj.options.sampling);
+            [FitResults.Data4D_denoised, FitResults.sigma_g] = MPdenoising_batch(data.Data4D,data.Mask,kernel, obj.options.sampling);
+        end
+
+        function denoiseNii(obj,dataFile,outFile,sigmaFile,Mask,slabSize)
+            % Out-of-core fit: reads dataFile (4D NIfTI) by slabs of
+            % slabSize slices (default 8), denoises them and writes outFile
+            % and sigmaFile (optional) slab by slab. Mask is an array, a
+            % NIfTI file name or [] (see MPdenoising_stream).
+            if ~exist('sigmaFile','var'), sigmaFile = []; end
+            if ~exist('Mask','var'), Mask = []; end
+            if ~exist('slabSize','var'), slabSize = []; end
+            hdr = load_untouch_header_only(dataFile);
+            dims = hdr.dime.dim(2:4);
+            kernel = min(dims,obj.options.kernel);
+            [V,Ind] = min(dims);
+            if V<7 && kernel(Ind)>1, warning(['your dataset has very few slices. To avoid loosing too many slices, kernel is set to 1 in the dimension #' num2str(Ind) '.']); kernel(Ind)=1; end
+            MPdenoising_stream(dataFile,outFile,sigmaFile,Mask,kernel,obj.options.sampling,slabSize);
         end
         
     end
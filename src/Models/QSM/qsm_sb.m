@@ -243,9 +243,7 @@ function FitResults = fit(obj,data)
       clear magnGREPad % Release
   else
       disp('Started   : Laplacian phase unwrapping ...');
-      for iEcho = nEcho:-1:1
-          freqEstimate(:,:,:,iEcho) = unwrapPhaseLaplacian(data.PhaseGRE(:,:,:,iEcho));
-      end
+      freqEstimate = unwrapPhaseLaplacian(data.PhaseGRE);
       disp('Completed : Laplacian phase unwrapping');
       disp('-----------------------------------------------');
       freqEstimate = mean(freqEstimate ./ reshape(TE, [1,1,1,numel(TE)]), 4);
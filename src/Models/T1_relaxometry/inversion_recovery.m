@@ -175,6 +175,28 @@ end
             end
         end
 
+        function FitResults = fitBatch(obj,data)
+            % Fits all voxels at once with the compiled grid search
+            % (rdNls_mex, see fitT1_IR_batch). Called by FitData with
+            % data.IRData of size [nVoxels x nTI]; returns [] when the
+            % engine is not compiled so that FitData fits voxel by voxel.
+
+            FitResults = [];
+            if exist('rdNls_mex','file')~=3, return; end
+
+            switch obj.options.fitModel
+                case 'Barral'
+                    [T1,rb,ra,res,idx] = fitT1_IR_batch(data.IRData,obj.Prot.IRData.Mat,obj.options.method);
+                    FitResults.T1  = T1;
+                    FitResults.rb  = rb;
+                    FitResults.ra  = ra;
+                    FitResults.res = res;
+                    if (strcmp(obj.options.method, 'Magnitude'))
+                        FitResults.idx = idx;
+                    end
+            end
+        end
+
         function plotModel(obj, FitResults, data)
             % Plots the fit
             %
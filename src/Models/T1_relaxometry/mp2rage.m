@@ -224,22 +224,21 @@ methods
             
         end
         
+        % MP2RAGE_lookupT1 uses the compiled lookup engine when available
+        % and falls back to T1B1correctpackageTFL / T1estimateMP2RAGE.
         if ~isempty(data.B1map)
 
-            [T1corrected, MP2RAGEcorr] = T1B1correctpackageTFL(data.B1map,MP2RAGEimg,[],MP2RAGE,[],invEFF);
-            
-            FitResult.T1 = T1corrected.img;
+            [FitResult.T1, FitResult.MP2RAGEcor] = MP2RAGE_lookupT1(MP2RAGEimg.img,MP2RAGE,invEFF,data.B1map);
+
             FitResult.R1=1./FitResult.T1;
-            FitResult.R1(isnan(FitResult.R1))=0;
-            FitResult.MP2RAGEcor = MP2RAGEcorr.img;
+            FitResult.R1(~isfinite(FitResult.R1))=0;
 
         else
 
-            [T1map, R1map]=T1estimateMP2RAGE(MP2RAGEimg,MP2RAGE,invEFF);
-        
-            FitResult.T1 = T1map.img;
-            FitResult.R1 = R1map.img;
-            
+            FitResult.T1 = MP2RAGE_lookupT1(MP2RAGEimg.img,MP2RAGE,invEFF);
+            FitResult.R1 = 1./FitResult.T1;
+            FitResult.R1(~isfinite(FitResult.R1))=0;
+
         end
         
     end % FIT RESULTS END 
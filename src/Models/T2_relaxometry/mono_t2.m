@@ -195,6 +195,47 @@ end
         end
         
         
+        function FitResults = fitBatch(obj,data)
+            %  Fit all voxels at once with the native batched LM solver
+            %  (batchLM). data.SEdata is [nVoxels x nTE]. Called by
+            %  FitData; returns [] when the batched path does not apply,
+            %  in which case FitData falls back to the voxelwise fit.
+            
+            FitResults = [];
+            if ~strcmp(obj.options.FitType,'Exponential') || exist('qmr_lm_mex','file')~=3
+                return;
+            end
+            
+            xData = obj.Prot.SEdata.Mat(:);
+            yDat = double(data.SEdata);
+            if obj.options.DropFirstEcho
+                if length(xData) < 3
+                    error('DropFirstEcho is not valid for ETL of 2.');
+                end
+                xData = xData(2:end);
+                yDat = yDat(:,2:end);
+            end
+            
+            % Same T2 initialization as fit. M0 is initialized from the
+            % data scale instead of the normalized signal.
+            yAbs = abs(yDat);
+            t2Init = (xData(1) - xData(end-1))./log(yAbs(:,end-1)./yAbs(:,1));
+            t2Init(~(t2Init>0) | isinf(t2Init)) = 30;
+            pdInit = max(yAbs,[],2)*1.5;
+            
+            if obj.options.OffsetTerm
+                [P, ~, exitflag] = batchLM('monoexp_offset', [pdInit t2Init zeros(size(t2Init))], yDat, xData, ...
+                    [obj.lb(2) obj.lb(1) -Inf], [obj.ub(2) obj.ub(1) Inf]);
+            else
+                [P, ~, exitflag] = batchLM('monoexp', [pdInit t2Init], yDat, xData, ...
+                    [obj.lb(2) obj.lb(1)], [obj.ub(2) obj.ub(1)]);
+            end
+            P(exitflag<0,:) = NaN;
+            
+            FitResults.T2 = P(:,2);
+            FitResults.M0 = P(:,1);
+        end
+        
         function plotModel(obj, FitResults, data)
             %  Plot the Model and Data.
             if nargin<2, qMRusage(obj,'plotModel'), FitResults=obj.st; end
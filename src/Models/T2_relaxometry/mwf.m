@@ -136,6 +136,24 @@ end
             [FitResults,Spectrum] = multi_comp_fit_v2(reshape(data.MET2data,[1 1 1 length(obj.Prot.MET2data.Mat)]), EchoTimes, DecayMatrix, T2, Opt, 'tissue', data.Mask);
         end
 
+        function FitResults = fitBatch(obj,data)
+            %  Fit all voxels at once with the native regularized NNLS
+            %  solver (multi_comp_fit_batch). data.MET2data is
+            %  [nVoxels x nEchoes]. Called by FitData; returns [] when
+            %  mwf_nnls_mex is not compiled.
+            FitResults = [];
+            if exist('mwf_nnls_mex','file')~=3, return; end
+
+            EchoTimes   = obj.Prot.MET2data.Mat;
+            T2          = getT2(obj,EchoTimes);
+            DecayMatrix = getDecayMatrix(EchoTimes,T2.vals);
+            Opt.Sigma            = obj.options.Sigma;
+            Opt.lower_cutoff_MW  = 1.5*obj.Prot.MET2data.Mat(1); % 1.5 * FirstEcho
+            Opt.upper_cutoff_MW  = obj.options.Cutoffms;
+            Opt.upper_cutoff_IEW = obj.ub(3);
+            FitResults = multi_comp_fit_batch(data.MET2data, EchoTimes, DecayMatrix, T2, Opt);
+        end
+
         function FitResults = Sim_Single_Voxel_Curve(obj, x, Opt,display)
             % Example: obj.Sim_Single_Voxel_Curve(obj.st,button2opts(obj.Sim_Single_Voxel_Curve_buttons))
             if ~exist('display','var'), display = 1; end
@@ -0,0 +1,440 @@
+/*
+ * amico_fit.hh: whole-volume AMICO NODDI fit (Daducci et al., 2015).
+ *
+ * Native counterpart of AMICO_Fit.m / amico.fit with AMICO_NODDI.Fit:
+ *
+ *   1. b0 = mean of the b0 rows, y = S/b0 (negative values set to 0)
+ *   2. main direction from a linear tensor fit of -log(y) (AMICO_FitTensor)
+ *      and its (theta, phi) bin of the 181 x 181 kernel grid (AMICO_Dir2idx)
+ *   3. lsqnonneg of [1; y] on [1'; A] (A = coupled atoms of the bin, the
+ *      isotropic atom and, ex vivo, the dot compartment); the isotropic
+ *      (and dot) contributions are removed from y
+ *   4. non-negative elastic net of mexLasso (mode 2):
+ *        min 0.5*||y - An*x||^2 + lambda*||x||_1 + 0.5*lambda2*||x||^2
+ *      on the normalized coupled atoms An
+ *   5. lsqnonneg on the atoms selected by 4 plus the isotropic (and dot)
+ *      ones, and the maps of AMICO_NODDI.Fit
+ *
+ * Voxels are sorted by direction bin. For each bin, the dictionary is
+ * read once from the (single precision) rotated kernels of
+ * AMICO_ResampleKernels and its Gram matrix is computed once; every
+ * voxel of the bin then only costs A'*y and small non-negative quadratic
+ * programs on that Gram matrix, solved with the Lawson-Hanson active set
+ * of lsqnonneg. Bins are processed in parallel.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef AMICO_FIT_HH
+#define AMICO_FIT_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+#include "qmr_tensor.hh"
+
+namespace qmr {
+namespace amico {
+
+static const int kGrid = 181;   // 1 degree bins of theta and phi
+static const double kPi = 3.14159265358979323846;
+
+struct Options {
+    bool   exvivo;       // dot compartment
+    double lambda;       // l1 weight of mexLasso
+    double lambda2;      // l2 weight of mexLasso
+    double tolX;         // lsqnonneg tolerance (CONFIG.OPTIMIZATION.LS_param)
+    int    numThreads;   // 0: all hardware threads
+
+    Options() : exvivo(false), lambda(0.5), lambda2(1e-3), tolX(1e-4), numThreads(0) {}
+};
+
+// Solves the n x n SPD system M x = y in place (x in y). False if M is not
+// positive definite.
+inline bool cholSolve(double *M, int n, double *y)
+{
+    for (int j = 0; j < n; ++j) {
+        double s = M[(n + 1) * j];
+        for (int k = 0; k < j; ++k) s -= M[n * j + k] * M[n * j + k];
+        if (!(s > 0)) return false;
+        M[(n + 1) * j] = std::sqrt(s);
+        for (int i = j + 1; i < n; ++i) {
+            double t = M[n * i + j];
+            for (int k = 0; k < j; ++k) t -= M[n * i + k] * M[n * j + k];
+            M[n * i + j] = t / M[(n + 1) * j];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < i; ++k) y[i] -= M[n * i + k] * y[k];
+        y[i] /= M[(n + 1) * i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        for (int k = i + 1; k < n; ++k) y[i] -= M[n * k + i] * y[k];
+        y[i] /= M[(n + 1) * i];
+    }
+    return true;
+}
+
+// Protocol: rows of CONFIG.scheme (camino directions, b-values and the
+// b0 / diffusion-weighted row indices) and the pseudo-inverse of the
+// b-matrix of AMICO_FitTensor.
+class Scheme {
+public:
+    int nS;
+    std::vector<int> b0, dwi;
+    std::vector<double> pinv;   // [6][nS], D = pinv * -log(y)
+
+    // camino: nS x (>= 3) column-major, b: nS, indices 0-based.
+    Scheme(const double *camino, const double *b, int n, const std::vector<int> &b0Idx,
+           const std::vector<int> &dwiIdx)
+        : nS(n), b0(b0Idx), dwi(dwiIdx), pinv(6 * (std::size_t)n)
+    {
+        // [Dxx 2Dxy 2Dxz Dyy 2Dyz Dzz] rows of AMICO's bMATRIX.
+        std::vector<double> H(6 * (std::size_t)n);
+        for (int s = 0; s < n; ++s) {
+            const double x = camino[s], y = camino[n + s], z = camino[2 * n + s];
+            const double h[6] = {x * x, 2 * x * y, 2 * x * z, y * y, 2 * y * z, z * z};
+            for (int k = 0; k < 6; ++k) H[6 * s + k] = b[s] * h[k];
+        }
+        std::vector<double> HtH(36);
+        for (int i = 0; i < 6; ++i)
+            for (int j = 0; j < 6; ++j) {
+                double t = 0;
+                for (int s = 0; s < n; ++s) t += H[6 * s + i] * H[6 * s + j];
+                HtH[6 * i + j] = t;
+            }
+        valid = true;
+        for (int s = 0; s < n && valid; ++s) {
+            std::vector<double> M(HtH), col(H.begin() + 6 * s, H.begin() + 6 * s + 6);
+            valid = cholSolve(M.data(), 6, col.data());
+            for (int k = 0; k < 6; ++k) pinv[(std::size_t)k * n + s] = col[k];
+        }
+    }
+
+    bool valid;   // false if the b-matrix is rank deficient
+};
+
+// Views of the KERNELS structure of AMICO_NODDI.ResampleKernels. The
+// rotated atoms are not copied.
+struct Kernels {
+    const float *A;      // nS x nA x 181 x 181, column-major
+    const float *Aiso;   // nS
+    int nA;
+    std::vector<double> norm;    // nA, 1/||A(dwi,:,1,1)|| (KERNELS.A_norm)
+    std::vector<double> kappa;   // nA, KERNELS.A_kappa
+    std::vector<double> icvf;    // nA, KERNELS.A_icvf
+};
+
+// Outputs, MATLAB column-major with voxels along the rows.
+struct Output {
+    double *maps;   // nV x (3 + exvivo): ICVF, OD, ISOVF (, DOTVF)
+    double *dirs;   // nV x 3, main direction with y >= 0
+    double *b0;     // nV
+};
+
+namespace detail {
+
+// AMICO_Dir2idx, 0-based: bin = i1 + 181*i2 (theta, phi).
+inline int dir2bin(const double *d)
+{
+    const double twoPi = 2 * kPi;
+    const auto mod = [twoPi](double a) { return a - std::floor(a / twoPi) * twoPi; };
+    double i1, i2 = mod(std::atan2(d[1], d[0]));
+    if (i2 > kPi) {
+        i2 = mod(std::atan2(-d[1], -d[0]));
+        i1 = std::atan2(std::sqrt(d[0] * d[0] + d[1] * d[1]), -d[2]);
+    } else {
+        i1 = std::atan2(std::sqrt(d[0] * d[0] + d[1] * d[1]), d[2]);
+    }
+    const int t = (int)std::round(i1 / kPi * 180), p = (int)std::round(i2 / kPi * 180);
+    if (t < 0 || t >= kGrid || p < 0 || p >= kGrid) return -1;
+    return t + kGrid * p;
+}
+
+// min 0.5*x'*G*x - c'*x subject to x >= 0, over the m columns `cols` of
+// the n x n matrix G (row-major, n <= the size given to the constructor).
+// Lawson-Hanson active set as lsqnonneg, written with G = C'*C and
+// c = C'*d: w = c - G*x is lsqnonneg's C'*resid. x (size n) is 0 outside
+// cols.
+class NNQP {
+public:
+    explicit NNQP(int nMax) : n_(nMax), P_(nMax), z_(nMax), w_(nMax), M_((std::size_t)nMax * nMax),
+                              rhs_(nMax), idx_(nMax) {}
+
+    void solve(const double *G, int n, const double *c, const int *cols, int m, double tol, double *x)
+    {
+        n_ = n;
+        for (int j = 0; j < n; ++j) x[j] = 0;
+        for (int k = 0; k < m; ++k) P_[cols[k]] = 0;
+        const int itmax = 3 * m;
+        int iter = 0;
+        gradient(G, c, cols, m, x);
+        for (;;) {
+            int t = -1;
+            double best = tol;
+            for (int k = 0; k < m; ++k) {
+                const int j = cols[k];
+                if (!P_[j] && w_[j] > best) { best = w_[j]; t = j; }
+            }
+            if (t < 0) break;
+            P_[t] = 1;
+            passive(G, c, cols, m);
+            for (;;) {
+                bool feasible = true;
+                for (int k = 0; k < m && feasible; ++k)
+                    if (P_[cols[k]] && z_[cols[k]] <= 0) feasible = false;
+                if (feasible) break;
+                if (++iter > itmax) {
+                    for (int k = 0; k < m; ++k) x[cols[k]] = z_[cols[k]];
+                    return;
+                }
+                double alpha = std::numeric_limits<double>::infinity();
+                for (int k = 0; k < m; ++k) {
+                    const int j = cols[k];
+                    if (P_[j] && z_[j] <= 0) alpha = std::min(alpha, x[j] / (x[j] - z_[j]));
+                }
+                for (int k = 0; k < m; ++k) {
+                    const int j = cols[k];
+                    x[j] += alpha * (z_[j] - x[j]);
+                    if (P_[j] && std::fabs(x[j]) < tol) P_[j] = 0;
+                }
+                passive(G, c, cols, m);
+            }
+            for (int k = 0; k < m; ++k) x[cols[k]] = z_[cols[k]];
+            gradient(G, c, cols, m, x);
+        }
+    }
+
+private:
+    void gradient(const double *G, const double *c, const int *cols, int m, const double *x)
+    {
+        for (int a = 0; a < m; ++a) {
+            const int i = cols[a];
+            double t = c[i];
+            for (int b = 0; b < m; ++b) t -= G[(std::size_t)i * n_ + cols[b]] * x[cols[b]];
+            w_[i] = t;
+        }
+    }
+
+    // z = G(P,P) \ c(P), 0 outside P.
+    void passive(const double *G, const double *c, const int *cols, int m)
+    {
+        int p = 0;
+        for (int k = 0; k < m; ++k) {
+            z_[cols[k]] = 0;
+            if (P_[cols[k]]) idx_[p++] = cols[k];
+        }
+        for (int a = 0; a < p; ++a) {
+            rhs_[a] = c[idx_[a]];
+            for (int b = 0; b < p; ++b) M_[(std::size_t)a * p + b] = G[(std::size_t)idx_[a] * n_ + idx_[b]];
+        }
+        if (!cholSolve(M_.data(), p, rhs_.data())) {
+            // Dependent atoms: tiny ridge, as a minimum-norm solution would.
+            double tr = 0;
+            for (int a = 0; a < p; ++a) tr += G[(std::size_t)idx_[a] * (n_ + 1)];
+            for (int a = 0; a < p; ++a) {
+                rhs_[a] = c[idx_[a]];
+                for (int b = 0; b < p; ++b)
+                    M_[(std::size_t)a * p + b] = G[(std::size_t)idx_[a] * n_ + idx_[b]] + (a == b ? 1e-12 * tr : 0);
+            }
+            cholSolve(M_.data(), p, rhs_.data());
+        }
+        for (int a = 0; a < p; ++a) z_[idx_[a]] = rhs_[a];
+    }
+
+    int n_;
+    std::vector<char> P_;
+    std::vector<double> z_, w_, M_, rhs_;
+    std::vector<int> idx_;
+};
+
+// Per-thread dictionary of one bin and its Gram matrices.
+struct Workspace {
+    int nA, nC, nD;
+    std::vector<double> A;     // [nC][nD] atoms on the diffusion-weighted rows
+    std::vector<double> M;     // [nC][nC] A'*A
+    std::vector<double> G1;    // [nC][nC] [1';A]'*[1';A] = A'*A + 1
+    std::vector<double> GL;    // [nA][nA] An'*An + lambda2*I
+    std::vector<double> y, r, c, x, xl;
+    std::vector<int> cols;
+    NNQP nnqp;
+
+    Workspace(const Scheme &s, int nA_, bool exvivo)
+        : nA(nA_), nC(nA_ + 1 + exvivo), nD((int)s.dwi.size()), A((std::size_t)nC * nD),
+          M((std::size_t)nC * nC), G1((std::size_t)nC * nC), GL((std::size_t)nA_ * nA_),
+          y(s.nS), r(nC), c(nC), x(nC), xl(nC), cols(nC), nnqp(nC) {}
+};
+
+// Dictionary of bin `bin` and its Gram matrices.
+inline void loadBin(const Scheme &s, const Kernels &k, const Options &opt, int bin, Workspace &ws)
+{
+    const int nS = s.nS, nD = ws.nD;
+    const float *slab = k.A + (std::size_t)bin * nS * k.nA;
+    for (int a = 0; a < k.nA; ++a)
+        for (int d = 0; d < nD; ++d) ws.A[(std::size_t)a * nD + d] = slab[(std::size_t)a * nS + s.dwi[d]];
+    for (int d = 0; d < nD; ++d) ws.A[(std::size_t)k.nA * nD + d] = k.Aiso[s.dwi[d]];
+    if (opt.exvivo)
+        for (int d = 0; d < nD; ++d) ws.A[(std::size_t)(k.nA + 1) * nD + d] = 1;
+
+    for (int i = 0; i < ws.nC; ++i)
+        for (int j = i; j < ws.nC; ++j) {
+            const double *ai = &ws.A[(std::size_t)i * nD], *aj = &ws.A[(std::size_t)j * nD];
+            double t = 0;
+            for (int d = 0; d < nD; ++d) t += ai[d] * aj[d];
+            ws.M[(std::size_t)i * ws.nC + j] = ws.M[(std::size_t)j * ws.nC + i] = t;
+        }
+    for (std::size_t e = 0; e < ws.M.size(); ++e) ws.G1[e] = ws.M[e] + 1;
+    for (int i = 0; i < k.nA; ++i)
+        for (int j = 0; j < k.nA; ++j)
+            ws.GL[(std::size_t)i * k.nA + j] =
+                k.norm[i] * k.norm[j] * ws.M[(std::size_t)i * ws.nC + j] + (i == j ? opt.lambda2 : 0);
+}
+
+// Steps 3 to 5 for the normalized signal ws.y; maps [3 + exvivo].
+inline void fitVoxel(const Scheme &s, const Kernels &k, const Options &opt, Workspace &ws, double *maps)
+{
+    const int nA = k.nA, nC = ws.nC, nD = ws.nD, iso = nA, dot = nA + 1;
+    for (int j = 0; j < nC; ++j) {
+        const double *aj = &ws.A[(std::size_t)j * nD];
+        double t = 0;
+        for (int d = 0; d < nD; ++d) t += aj[d] * ws.y[s.dwi[d]];
+        ws.r[j] = t;
+        ws.c[j] = t + 1;
+        ws.cols[j] = j;
+    }
+
+    // 3. isotropic (and dot) partial volumes
+    ws.nnqp.solve(ws.G1.data(), nC, ws.c.data(), ws.cols.data(), nC, opt.tolX, ws.x.data());
+    const double xIso = ws.x[iso], xDot = opt.exvivo ? ws.x[dot] : 0;
+
+    // 4. elastic net on the normalized coupled atoms, for y - xIso*Aiso - xDot
+    for (int j = 0; j < nA; ++j) {
+        double t = ws.r[j] - xIso * ws.M[(std::size_t)j * nC + iso];
+        if (opt.exvivo) t -= xDot * ws.M[(std::size_t)j * nC + dot];
+        ws.xl[j] = k.norm[j] * t - opt.lambda;
+    }
+    ws.nnqp.solve(ws.GL.data(), nA, ws.xl.data(), ws.cols.data(), nA, 1e-12, ws.x.data());
+
+    // 5. debiasing on the selected atoms
+    int m = 0;
+    for (int j = 0; j < nA; ++j)
+        if (ws.x[j] > 0) ws.cols[m++] = j;
+    ws.cols[m++] = iso;
+    if (opt.exvivo) ws.cols[m++] = dot;
+    ws.nnqp.solve(ws.G1.data(), nC, ws.c.data(), ws.cols.data(), m, opt.tolX, ws.x.data());
+
+    double sum = 0;
+    for (int j = 0; j < nA; ++j) sum += ws.x[j];
+    const double eps = std::numeric_limits<double>::epsilon();
+    double f1 = 0, f2 = 0, kx = 0;
+    for (int j = 0; j < nA; ++j) {
+        const double xx = ws.x[j] / (sum + eps);
+        f1 += k.icvf[j] * xx;
+        f2 += (1 - k.icvf[j]) * xx;
+        kx += k.kappa[j] * xx;
+    }
+    maps[0] = f1 / (f1 + f2 + eps);
+    maps[1] = 2 / kPi * std::atan2(1.0, kx);
+    maps[2] = ws.x[iso];
+    if (opt.exvivo) maps[3] = ws.x[dot];
+}
+
+// Step 1: b0 of voxel v and its signal divided by b0 in y.
+inline double normalize(const Scheme &s, const double *data, std::size_t nV, std::size_t v, double *y)
+{
+    double b0 = 0;
+    for (std::size_t i = 0; i < s.b0.size(); ++i) b0 += data[v + s.b0[i] * nV];
+    b0 /= (double)s.b0.size();
+    const double eps = std::numeric_limits<double>::epsilon();
+    for (int r = 0; r < s.nS; ++r) y[r] = std::max(0.0, data[v + r * nV] / (b0 + eps));
+    return b0;
+}
+
+// Steps 1 and 2: normalized signal in y, b0 and direction bin (-1 when
+// b0 < 1e-3 or the direction is not finite).
+inline int prepare(const Scheme &s, const double *data, std::size_t nV, std::size_t v, double *y,
+                   double &b0, double *dir)
+{
+    b0 = normalize(s, data, nV, v, y);
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    dir[0] = dir[1] = dir[2] = nan;
+    if (!(b0 >= 1e-3)) return -1;
+
+    const double eps = std::numeric_limits<double>::epsilon();
+    double t[6] = {0, 0, 0, 0, 0, 0};
+    for (int r = 0; r < s.nS; ++r) {
+        const double l = -std::log(y[r] + eps);
+        for (int k = 0; k < 6; ++k) t[k] += s.pinv[(std::size_t)k * s.nS + r] * l;
+    }
+    // [xx 2xy 2xz yy 2yz zz] coefficients to [xx yy zz xy xz yz].
+    const double d[6] = {t[0], t[3], t[5], t[1], t[2], t[4]};
+    double L[3];
+    qmr::tensor::eigen(d, L, dir, 1);
+    if (dir[1] < 0)
+        for (int k = 0; k < 3; ++k) dir[k] = -dir[k];
+    if (!(std::isfinite(dir[0]) && std::isfinite(dir[1]) && std::isfinite(dir[2]))) return -1;
+    return dir2bin(dir);
+}
+
+} // namespace detail
+
+// Fits nV voxels (data: nV x nS, column-major). Voxels without b0 signal
+// or direction get NaN maps.
+inline void fit(const Scheme &s, const Kernels &k, const Options &opt, std::size_t nV, const double *data,
+                const Output &out)
+{
+    const int nMaps = 3 + opt.exvivo;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const int nt = qmr::num_threads(opt.numThreads);
+
+    // Directions, then voxels sorted by bin (counting sort).
+    std::vector<int> bin(nV);
+    qmr::parallel_for(nV, 256, [&](std::size_t v0, std::size_t v1, int) {
+        std::vector<double> y(s.nS);
+        double dir[3];
+        for (std::size_t v = v0; v < v1; ++v) {
+            bin[v] = detail::prepare(s, data, nV, v, y.data(), out.b0[v], dir);
+            for (int c = 0; c < 3; ++c) out.dirs[v + c * nV] = dir[c];
+            if (bin[v] < 0)
+                for (int m = 0; m < nMaps; ++m) out.maps[v + m * nV] = nan;
+        }
+    }, nt);
+
+    const int nBins = kGrid * kGrid;
+    std::vector<std::size_t> start(nBins + 1, 0);
+    for (std::size_t v = 0; v < nV; ++v)
+        if (bin[v] >= 0) ++start[bin[v] + 1];
+    std::vector<int> occupied;
+    for (int b = 0; b < nBins; ++b) {
+        if (start[b + 1]) occupied.push_back(b);
+        start[b + 1] += start[b];
+    }
+    std::vector<std::size_t> order(start[nBins]), fill(start.begin(), start.end() - 1);
+    for (std::size_t v = 0; v < nV; ++v)
+        if (bin[v] >= 0) order[fill[bin[v]]++] = v;
+
+    std::vector<detail::Workspace> ws(nt, detail::Workspace(s, k.nA, opt.exvivo));
+    qmr::parallel_for(occupied.size(), 1, [&](std::size_t i0, std::size_t i1, int tid) {
+        detail::Workspace &w = ws[tid];
+        std::vector<double> maps(nMaps);
+        for (std::size_t ib = i0; ib < i1; ++ib) {
+            const int b = occupied[ib];
+            detail::loadBin(s, k, opt, b, w);
+            for (std::size_t i = start[b]; i < start[b + 1]; ++i) {
+                const std::size_t v = order[i];
+                detail::normalize(s, data, nV, v, w.y.data());
+                detail::fitVoxel(s, k, opt, w, maps.data());
+                for (int m = 0; m < nMaps; ++m) out.maps[v + m * nV] = maps[m];
+            }
+        }
+    }, nt);
+}
+
+} // namespace amico
+} // namespace qmr
+
+#endif
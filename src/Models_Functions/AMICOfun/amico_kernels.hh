@@ -0,0 +1,96 @@
+/*
+ * amico_kernels.hh: rotated AMICO kernels resampled on the acquisition
+ * scheme (AMICO_RotateKernel + AMICO_ResampleKernel), for all atoms and
+ * the 181 x 181 orientations.
+ *
+ * AMICO fits the spherical harmonics (even l, real basis of
+ * AMICO_CreateYlm) of each axially symmetric high-resolution kernel, keeps
+ * the zonal coefficients k_l, rotates them to the orientation u with
+ * sqrt(4*pi/(2l+1))*k_l*Y_lm(u) and evaluates the result on the scheme
+ * directions g. By the addition theorem, sum_m Y_lm(g)*Y_lm(u) =
+ * (2l+1)/(4*pi)*P_l(g.u), this is
+ *
+ *   K(g, u) = sum_l sqrt((2l+1)/(4*pi)) * k_l * P_l(g.u)
+ *
+ * so each (orientation, row) costs the Legendre polynomials of one cosine,
+ * shared by all atoms, and no rotation matrix is needed.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef AMICO_KERNELS_HH
+#define AMICO_KERNELS_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace amico {
+
+// Zonal coefficients of the atoms and the scheme they are resampled on.
+struct KernelInput {
+    int lmax;                     // even
+    int nShells, nAtoms, nS;
+    const double *zonal;          // [nAtoms][nShells][lmax/2+1], k_l for l = 0, 2, .., lmax
+    std::vector<double> dirs;     // [nS][3] unit directions
+    std::vector<int> shell;       // [nS] 0-based shell, -1 for rows kept at 1 (b0)
+};
+
+// A: nS x nAtoms x 181 x 181 (column-major), as KERNELS.A.
+inline void resample(const KernelInput &in, float *A, int nthreads = 0)
+{
+    const int nL = in.lmax / 2 + 1, grid = 181, nS = in.nS, nA = in.nAtoms;
+    const double pi = 3.14159265358979323846;
+
+    // Weights sqrt((2l+1)/(4*pi))*k_l, [shell][atom][l].
+    std::vector<double> w((std::size_t)in.nShells * nA * nL);
+    for (int a = 0; a < nA; ++a)
+        for (int s = 0; s < in.nShells; ++s)
+            for (int i = 0; i < nL; ++i) {
+                const int l = 2 * i;
+                w[((std::size_t)s * nA + a) * nL + i] =
+                    std::sqrt((2 * l + 1) / (4 * pi)) * in.zonal[((std::size_t)a * in.nShells + s) * nL + i];
+            }
+
+    qmr::parallel_for((std::size_t)grid * grid, 64, [&](std::size_t b0, std::size_t b1, int) {
+        std::vector<double> P(nL);
+        for (std::size_t bin = b0; bin < b1; ++bin) {
+            const double theta = (double)(bin % grid) / 180 * pi, phi = (double)(bin / grid) / 180 * pi;
+            const double u[3] = {std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)};
+            float *out = A + bin * nS * nA;
+            for (int r = 0; r < nS; ++r) {
+                const int s = in.shell[r];
+                if (s < 0) {
+                    for (int a = 0; a < nA; ++a) out[r + (std::size_t)a * nS] = 1;
+                    continue;
+                }
+                const double *g = &in.dirs[3 * r];
+                const double x = std::min(1.0, std::max(-1.0, g[0] * u[0] + g[1] * u[1] + g[2] * u[2]));
+                // Even Legendre polynomials, P_{l+1} = ((2l+1) x P_l - l P_{l-1}) / (l+1).
+                double pm = 1, p = x;
+                P[0] = 1;
+                for (int l = 1; l < in.lmax; ++l) {
+                    const double pn = ((2 * l + 1) * x * p - l * pm) / (l + 1);
+                    pm = p;
+                    p = pn;
+                    if ((l + 1) % 2 == 0) P[(l + 1) / 2] = p;
+                }
+                const double *ws = &w[(std::size_t)s * nA * nL];
+                for (int a = 0; a < nA; ++a) {
+                    double k = 0;
+                    for (int i = 0; i < nL; ++i) k += ws[a * nL + i] * P[i];
+                    out[r + (std::size_t)a * nS] = (float)k;
+                }
+            }
+        }
+    }, nthreads);
+}
+
+} // namespace amico
+} // namespace qmr
+
+#endif
@@ -0,0 +1,98 @@
+function KERNELS = amico_kernels(model, scheme, lmax)
+% usage
+% KERNELS = amico_kernels(model, scheme, lmax)
+%
+% AMICO NODDI dictionary on the acquisition scheme, as
+% AMICO_GenerateKernels followed by AMICO_ResampleKernels, without the
+% rotation matrices (AMICO_PrecomputeRotationMatrices) or the per-atom
+% files.
+%
+% model   AMICO_NODDI model (CONFIG.model)
+% scheme  acquisition scheme (CONFIG.scheme, AMICO_LoadSchemeMAT)
+% lmax    spherical harmonics order (12)
+%
+% KERNELS has the fields of AMICO_NODDI.ResampleKernels. The atoms are
+% synthesized on 500 directions per shell and projected on spherical
+% harmonics once; these coefficients only depend on the model and on the
+% b-values of the shells, and are cached in tempdir/qMRLab. The rotation
+% to the 181 x 181 orientations and the resampling on the scheme are done
+% by amico_kernels_mex.
+
+if nargin < 3, lmax = 12; end
+
+nShells = numel(scheme.shells);
+b = cellfun(@(s) s.b, scheme.shells);
+nVF = numel(model.IC_VFs);
+nOD = numel(model.IC_ODs);
+nA = nVF*nOD;
+nL = lmax/2+1;
+nSH = (lmax+1)*(lmax+2)/2;
+
+% High-resolution directions, as AMICO_CreateHighResolutionScheme
+grad500 = dlmread('500_dirs.txt', '', 0, 0);
+grad500 = bsxfun(@rdivide, grad500, sqrt(sum(grad500.^2,2)));
+grad500(grad500(:,2)<0,:) = -grad500(grad500(:,2)<0,:);
+[colatitude, longitude] = AMICO_Cart2sphere(grad500(:,1), grad500(:,2), grad500(:,3));
+Ylm = AMICO_CreateYlm(lmax, colatitude, longitude);
+fit = pinv(Ylm'*Ylm)*Ylm';
+
+% SH coefficients of the atoms (zonal only: the atoms are axially symmetric)
+cacheDir = fullfile(tempdir, 'qMRLab');
+if ~exist(cacheDir, 'dir')
+    [ok, ~] = mkdir(cacheDir);
+    if ~ok, cacheDir = ''; end
+end
+key = [lmax model.dPar model.dIso nVF model.IC_VFs(:)' nOD model.IC_ODs(:)' b(:)'];
+blob = amico_kernels_mex('load', cacheDir, key);
+if numel(blob) ~= nL*nShells*nA + nSH*nShells
+    schemeHR.camino = repmat(grad500, nShells, 1);
+    schemeHR.b = kron(b(:), ones(500,1));
+    protocolHR = model.Scheme2noddi(schemeHR);
+
+    dPar = model.dPar * 1E-6;
+    dIso = model.dIso * 1E-6;
+    Khr = zeros(500*nShells, nA);
+    for ii = 1:nOD
+        kappa = 1 ./ tan(model.IC_ODs(ii)*pi/2);
+        signal_ic = SynthMeasWatsonSHCylNeuman_PGSE( [dPar 0 kappa], protocolHR.grad_dirs, protocolHR.G', protocolHR.delta', protocolHR.smalldel', [0;0;1], 0 );
+        for jj = 1:nVF
+            v_ic = model.IC_VFs(jj);
+            dPerp = dPar * (1 - v_ic);
+            signal_ec = SynthMeasWatsonHinderedDiffusion_PGSE( [dPar dPerp kappa], protocolHR.grad_dirs, protocolHR.G', protocolHR.delta', protocolHR.smalldel', [0;0;1] );
+            Khr(:,jj+(ii-1)*nVF) = v_ic*signal_ic + (1-v_ic)*signal_ec;
+        end
+    end
+    Kiso = SynthMeasIsoGPD(dIso, protocolHR);
+
+    Klm = fit * reshape(Khr, 500, []);
+    l = 0:2:lmax;
+    Z = Klm((l.*l + l + 2)/2, :);
+    Klm_iso = fit * reshape(Kiso, 500, nShells);
+    blob = [Z(:); Klm_iso(:)];
+    amico_kernels_mex('store', cacheDir, key, blob);
+end
+Z = reshape(blob(1:nL*nShells*nA), nL, nShells, nA);
+Klm_iso = reshape(blob(nL*nShells*nA+1:end), nSH, nShells);
+
+% Rotate and resample on the scheme
+shell = zeros(scheme.nS, 1);
+for s = 1:nShells
+    shell(scheme.shells{s}.idx) = s;
+end
+KERNELS = struct();
+KERNELS.nS      = scheme.nS;
+KERNELS.A       = amico_kernels_mex('resample', Z, scheme.camino(:,1:3), shell);
+KERNELS.A_kappa = single(kron(1 ./ tan(model.IC_ODs(:)'*pi/2), ones(1,nVF)));
+KERNELS.A_icvf  = single(repmat(model.IC_VFs(:)', 1, nOD));
+
+A = double(KERNELS.A(scheme.dwi_idx,:,1,1));
+KERNELS.A_norm = repmat(1./sqrt(sum(A.^2)), [size(A,1),1]);
+
+Aiso = ones(scheme.nS, 1);
+for s = 1:nShells
+    g = scheme.shells{s}.grad;
+    [colatitude, longitude] = AMICO_Cart2sphere(g(:,1), g(:,2), g(:,3));
+    Aiso(scheme.shells{s}.idx) = AMICO_CreateYlm(lmax, colatitude, longitude) * Klm_iso(:,s);
+end
+KERNELS.Aiso   = single(Aiso);
+KERNELS.Aiso_d = model.dIso;
@@ -0,0 +1,124 @@
+/*
+ * AMICO kernels on the acquisition scheme (see amico_kernels.hh) and
+ * their disk cache. Use through amico_kernels.m.
+ *
+ *   A    = amico_kernels_mex('resample', Z, dirs, shell, opts)
+ *   blob = amico_kernels_mex('load', dir, key)
+ *   ok   = amico_kernels_mex('store', dir, key, blob)
+ *
+ *   Z      (lmax/2+1) x nShells x nAtoms zonal SH coefficients of the
+ *          high-resolution atoms (l = 0, 2, .., lmax)
+ *   dirs   nS x 3 gradient directions of the scheme
+ *   shell  nS shell of each row (1..nShells), 0 for the b0 rows (kept at 1)
+ *   opts   optional struct: NumThreads (0: all cores)
+ *   A      single nS x nAtoms x 181 x 181, as KERNELS.A
+ *
+ * 'load' returns the vector stored under the hash of the double vector
+ * key in the folder dir, or [] if there is none; 'store' writes it (see
+ * qmr_cache.hh).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_cache.hh"
+#include "qmr_mex.hh"
+#include "amico_kernels.hh"
+
+static const char *kName = "amico_kernels_mex";
+
+namespace {
+
+uint64_t key(const mxArray *a)
+{
+    const std::vector<double> v = qmr::mex::toVector(a);
+    return qmr::cache::Hash().text("amico_kernels v1").values(v.data(), v.size()).key();
+}
+
+void resample(int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "'resample' expects Z, dirs, shell[, opts].");
+    qmr::mex::requireDouble(kName, prhs[1], "Z");
+    const std::vector<std::size_t> dZ = qmr::mex::dims(prhs[1], 3);
+    if (mxGetNumberOfDimensions(prhs[1]) > 3 || dZ[0] == 0)
+        qmr::mex::fail(kName, "invalidInputSize", "Z must be (lmax/2+1) x nShells x nAtoms.");
+
+    qmr::amico::KernelInput in;
+    in.lmax = 2 * ((int)dZ[0] - 1);
+    in.nShells = (int)dZ[1];
+    in.nAtoms = (int)dZ[2];
+    in.zonal = mxGetPr(prhs[1]);
+
+    qmr::mex::requireDouble(kName, prhs[2], "dirs");
+    in.nS = (int)mxGetM(prhs[2]);
+    if (mxGetN(prhs[2]) != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "dirs must be nS x 3.");
+    const std::vector<double> shell = qmr::mex::toVector(prhs[3]);
+    if ((int)shell.size() != in.nS)
+        qmr::mex::fail(kName, "invalidInputSize", "shell must have one value per row of dirs.");
+
+    const double *g = mxGetPr(prhs[2]);
+    in.dirs.resize(3 * (std::size_t)in.nS);
+    in.shell.resize(in.nS);
+    for (int r = 0; r < in.nS; ++r) {
+        if (!(shell[r] >= 0 && shell[r] <= in.nShells && shell[r] == std::floor(shell[r])))
+            qmr::mex::fail(kName, "invalidShell", "shell must be 0 (b0) or a shell index of Z.");
+        in.shell[r] = (int)shell[r] - 1;
+        const double x = g[r], y = g[in.nS + r], z = g[2 * in.nS + r];
+        const double n = std::sqrt(x * x + y * y + z * z);
+        // A zero direction is the z axis, as with AMICO_Cart2sphere.
+        in.dirs[3 * r] = n > 0 ? x / n : 0;
+        in.dirs[3 * r + 1] = n > 0 ? y / n : 0;
+        in.dirs[3 * r + 2] = n > 0 ? z / n : 1;
+    }
+
+    const mxArray *opts = nrhs > 4 ? prhs[4] : NULL;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    mwSize d[4] = {(mwSize)in.nS, (mwSize)in.nAtoms, 181, 181};
+    plhs[0] = mxCreateNumericArray(4, d, mxSINGLE_CLASS, mxREAL);
+    qmr::amico::resample(in, (float *)mxGetData(plhs[0]), nthreads);
+}
+
+void load(int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+    if (nrhs != 3)
+        qmr::mex::fail(kName, "wrongNumInputs", "'load' expects dir and key.");
+    const std::string dir = qmr::mex::string(kName, prhs[1], "dir");
+    std::vector<double> blob;
+    if (!qmr::cache::load(dir, "amico_kernels", key(prhs[2]), blob)) {
+        plhs[0] = mxCreateDoubleMatrix(0, 0, mxREAL);
+        return;
+    }
+    plhs[0] = mxCreateDoubleMatrix(blob.size(), 1, mxREAL);
+    std::copy(blob.begin(), blob.end(), mxGetPr(plhs[0]));
+}
+
+void store(int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+    if (nrhs != 4)
+        qmr::mex::fail(kName, "wrongNumInputs", "'store' expects dir, key and blob.");
+    const std::string dir = qmr::mex::string(kName, prhs[1], "dir");
+    const bool ok = qmr::cache::store(dir, "amico_kernels", key(prhs[2]), qmr::mex::toVector(prhs[3]));
+    plhs[0] = mxCreateLogicalScalar(ok);
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    (void)nlhs;
+    if (nrhs < 1)
+        qmr::mex::fail(kName, "wrongNumInputs", "amico_kernels_mex expects a command.");
+    const std::string cmd = qmr::mex::string(kName, prhs[0], "command");
+    if (cmd == "resample") resample(nrhs, plhs, prhs);
+    else if (cmd == "load") load(nrhs, plhs, prhs);
+    else if (cmd == "store") store(nrhs, plhs, prhs);
+    else qmr::mex::fail(kName, "unknownCommand", "Unknown command '" + cmd + "'.");
+}
@@ -0,0 +1,135 @@
+/*
+ * [MAPs, DIRs, b0] = amico_mex(data, scheme, KERNELS, opts)
+ *
+ * Whole-volume AMICO NODDI fit (see amico_fit.hh). Used by amico.fitBatch
+ * and AMICO_Fit when compiled.
+ *
+ *   data     nV x nS diffusion signal
+ *   scheme   CONFIG.scheme (fields camino, b, b0_idx, dwi_idx)
+ *   KERNELS  rotated kernels of AMICO_NODDI.ResampleKernels (fields A, Aiso,
+ *            A_norm, A_kappa, A_icvf)
+ *   opts     optional struct:
+ *              Exvivo      dot compartment (false)
+ *              Lambda      l1 weight of mexLasso (0.5)
+ *              Lambda2     l2 weight of mexLasso (1e-3)
+ *              TolX        lsqnonneg tolerance (1e-4)
+ *              NumThreads  0: all cores
+ *
+ * MAPs is nV x 3 (ICVF, OD, ISOVF, plus DOTVF ex vivo), DIRs nV x 3 (main
+ * direction, y >= 0) and b0 nV x 1. Voxels with b0 < 1e-3 get NaN maps
+ * and directions.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "amico_fit.hh"
+
+static const char *kName = "amico_mex";
+
+static const mxArray *field(const mxArray *s, const char *name, const char *argName)
+{
+    const mxArray *f = mxIsStruct(s) ? mxGetField(s, 0, name) : NULL;
+    if (!f || mxIsEmpty(f))
+        qmr::mex::fail(kName, "missingField", std::string(argName) + "." + name + " is required.");
+    return f;
+}
+
+static std::vector<int> indices(const mxArray *a, int n, const char *name)
+{
+    std::vector<double> v = qmr::mex::toVector(a);
+    std::vector<int> idx(v.size());
+    for (std::size_t i = 0; i < v.size(); ++i) {
+        if (!(v[i] >= 1 && v[i] <= n && v[i] == std::floor(v[i])))
+            qmr::mex::fail(kName, "invalidIndex", std::string("scheme.") + name + " must index the rows of data.");
+        idx[i] = (int)v[i] - 1;
+    }
+    return idx;
+}
+
+static const float *single(const mxArray *a, std::size_t numel, const char *name)
+{
+    if (!mxIsSingle(a) || mxIsComplex(a) || mxIsSparse(a) || mxGetNumberOfElements(a) != numel)
+        qmr::mex::fail(kName, "invalidKernels",
+                       std::string("KERNELS.") + name + " must be the single array of AMICO_ResampleKernels.");
+    return (const float *)mxGetData(a);
+}
+
+static std::vector<double> atoms(const mxArray *a, int nA, const char *name)
+{
+    std::vector<double> v = qmr::mex::toVector(a);
+    if ((int)v.size() != nA)
+        qmr::mex::fail(kName, "invalidKernels", std::string("KERNELS.") + name + " must have one value per atom.");
+    return v;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 3 || nrhs > 4)
+        qmr::mex::fail(kName, "wrongNumInputs", "amico_mex expects data, scheme, KERNELS[, opts].");
+
+    qmr::mex::requireDouble(kName, prhs[0], "data");
+    const std::size_t nV = mxGetM(prhs[0]);
+    const int nS = (int)mxGetN(prhs[0]);
+
+    // Protocol
+    const mxArray *camino = field(prhs[1], "camino", "scheme");
+    qmr::mex::requireDouble(kName, camino, "scheme.camino");
+    if ((int)mxGetM(camino) != nS || mxGetN(camino) < 3)
+        qmr::mex::fail(kName, "invalidInputSize", "scheme.camino must have one row per column of data.");
+    const std::vector<double> b = qmr::mex::toVector(field(prhs[1], "b", "scheme"));
+    if ((int)b.size() != nS)
+        qmr::mex::fail(kName, "invalidInputSize", "scheme.b must have one value per column of data.");
+    const std::vector<int> b0 = indices(field(prhs[1], "b0_idx", "scheme"), nS, "b0_idx");
+    const std::vector<int> dwi = indices(field(prhs[1], "dwi_idx", "scheme"), nS, "dwi_idx");
+    const qmr::amico::Scheme scheme(mxGetPr(camino), b.data(), nS, b0, dwi);
+    if (!scheme.valid)
+        qmr::mex::fail(kName, "rankDeficient",
+                       "The protocol must have at least 6 non-coplanar diffusion directions.");
+
+    // Dictionary
+    const mxArray *A = field(prhs[2], "A", "KERNELS");
+    const std::vector<std::size_t> dA = qmr::mex::dims(A, 4);
+    if ((int)dA[0] != nS || dA[2] != qmr::amico::kGrid || dA[3] != qmr::amico::kGrid)
+        qmr::mex::fail(kName, "invalidKernels", "KERNELS.A must be nS x nAtoms x 181 x 181.");
+    qmr::amico::Kernels k;
+    k.nA = (int)dA[1];
+    k.A = single(A, mxGetNumberOfElements(A), "A");
+    k.Aiso = single(field(prhs[2], "Aiso", "KERNELS"), nS, "Aiso");
+    const mxArray *norm = field(prhs[2], "A_norm", "KERNELS");
+    if ((int)mxGetN(norm) != k.nA)
+        qmr::mex::fail(kName, "invalidKernels", "KERNELS.A_norm must have one column per atom.");
+    k.norm = qmr::mex::toVector(norm);
+    k.norm.resize(k.nA);
+    for (int a = 0; a < k.nA; ++a) k.norm[a] = k.norm[(std::size_t)a * mxGetM(norm)];
+    k.kappa = atoms(field(prhs[2], "A_kappa", "KERNELS"), k.nA, "A_kappa");
+    k.icvf = atoms(field(prhs[2], "A_icvf", "KERNELS"), k.nA, "A_icvf");
+
+    const mxArray *opts = nrhs > 3 ? prhs[3] : NULL;
+    qmr::amico::Options opt;
+    opt.exvivo = qmr::mex::option(opts, "Exvivo", 0.0) != 0;
+    opt.lambda = qmr::mex::option(opts, "Lambda", opt.lambda);
+    opt.lambda2 = qmr::mex::option(opts, "Lambda2", opt.lambda2);
+    opt.tolX = qmr::mex::option(opts, "TolX", opt.tolX);
+    opt.numThreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    mxArray *maps = mxCreateDoubleMatrix(nV, 3 + opt.exvivo, mxREAL);
+    mxArray *dirs = mxCreateDoubleMatrix(nV, 3, mxREAL);
+    mxArray *b0v = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    qmr::amico::Output out;
+    out.maps = mxGetPr(maps);
+    out.dirs = mxGetPr(dirs);
+    out.b0 = mxGetPr(b0v);
+    qmr::amico::fit(scheme, k, opt, nV, mxGetPr(prhs[0]), out);
+
+    mxArray *all[3] = {maps, dirs, b0v};
+    for (int i = 0; i < 3; ++i) {
+        if (i < nlhs || i == 0) plhs[i] = all[i];
+        else mxDestroyArray(all[i]);
+    }
+}
@@ -0,0 +1,387 @@
+/*
+ * charmed_kernel.hh: CHARMED signal model (Assaf and Basser, 2005) with
+ * its Jacobian, for the batched fits of charmed.m.
+ *
+ * Native counterpart of scd_model_CHARMED.m (Burcaw 2015 time dependence):
+ *
+ *   S = (1-fr-fcsf)*exp(-b*Dh(t)) + fr*Er + fcsf*exp(-b*Dcsf)
+ *
+ * with parameters x = [fr Dh mean std fcsf lc Dcsf Dr] in um/ms units and
+ * the restricted signal Er of cylinders in the Gaussian phase
+ * approximation (scd_model_GPD_RDr, roots of J1'). Everything that only
+ * depends on the protocol is computed once (Protocol): b-values, the
+ * centred Burcaw time-dependence terms and the list of distinct
+ * (Delta, delta, b) shells. For one diameter (std = 0) Er and its
+ * derivatives are evaluated in closed form per (Delta, delta) timing.
+ * For a gamma distribution of diameters (std > 0), Er is interpolated
+ * bilinearly in a table over (mean, std) built for one Dr (DiameterTable),
+ * integrated as scd_model_CHARMED does with onediam = 0.
+ *
+ * As in MATLAB, non-finite GPD terms are dropped and NaN signals are set
+ * to 1 (their Jacobian rows to 0).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef CHARMED_KERNEL_HH
+#define CHARMED_KERNEL_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_lm.hh"
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace charmed {
+
+enum Param { kFr, kDh, kMean, kStd, kFcsf, kLc, kDcsf, kDr, kNumParams };
+
+static const double kGyro = 42.58;   // rad.kHz/mT, as scd_model_CHARMED
+static const double kPi = 3.14159265358979323846;
+
+// Rows of a scheme converted by ConvertSchemeUnits(Mat, 0): G (mT/um),
+// Delta and delta (ms) in columns 4 to 6.
+class Protocol {
+public:
+    int nObs;
+    std::vector<double> scheme;   // [nObs][3] G, Delta, delta (cache key)
+    std::vector<double> b;        // [nObs] (2*pi*q)^2*(Delta - delta/3)
+    std::vector<double> c;        // [nObs] Burcaw term / A, minus its mean
+    std::vector<int> timing;      // [nObs] index in Delta/delta/td
+    std::vector<double> Delta, delta, td;
+    std::vector<int> shell;       // [nObs] index of the distinct (timing, b)
+    std::vector<int> shellTiming;
+    std::vector<double> shellB, shellC;
+
+    Protocol(const double *G, const double *Dl, const double *dl, int n)
+        : nObs(n), scheme(3 * (std::size_t)n), b(n), c(n), timing(n), shell(n)
+    {
+        double cMean = 0;
+        for (int o = 0; o < n; ++o) {
+            scheme[3 * o] = G[o]; scheme[3 * o + 1] = Dl[o]; scheme[3 * o + 2] = dl[o];
+            const double q = kGyro * dl[o] * G[o];
+            b[o] = (2 * kPi * q) * (2 * kPi * q) * (Dl[o] - dl[o] / 3);
+
+            // scd_model_timedependence
+            const double t = std::max(Dl[o], dl[o] + 1e-4), d = dl[o];
+            const double term3 = t * t * std::log((t * t - d * d) / (t * t)) +
+                                 d * d * std::log((t * t - d * d) / (d * d)) +
+                                 2 * t * d * std::log((t + d) / (t - d));
+            c[o] = term3 / (2 * d * d * (t - d / 3));
+            cMean += c[o];
+
+            int k = 0;
+            while (k < (int)Delta.size() && !(Delta[k] == Dl[o] && delta[k] == dl[o])) ++k;
+            if (k == (int)Delta.size()) {
+                Delta.push_back(Dl[o]);
+                delta.push_back(dl[o]);
+                td.push_back(Dl[o] - dl[o] / 3);
+            }
+            timing[o] = k;
+
+            int s = 0;
+            while (s < (int)shellB.size() && !(shellTiming[s] == k && shellB[s] == b[o])) ++s;
+            if (s == (int)shellB.size()) {
+                shellTiming.push_back(k);
+                shellB.push_back(b[o]);
+            }
+            shell[o] = s;
+        }
+        cMean /= n;
+        for (int o = 0; o < n; ++o) c[o] -= cMean;
+        shellC.resize(shellB.size());
+        for (int o = 0; o < n; ++o) shellC[shell[o]] = c[o];
+    }
+
+    int nTimings() const { return (int)Delta.size(); }
+    int nShells() const { return (int)shellB.size(); }
+};
+
+namespace detail {
+
+// Sum g(u) of the terms of scd_model_GPD_RDr, u = Dr/d^2, and dg/du:
+// RDr = d^2/(2*td)*g(u).
+inline void gpd(double u, double Delta, double delta, double &g, double &dg)
+{
+    static const double a[5] = {1.84118378134065 * 1.84118378134065, 5.33144277352503 * 5.33144277352503,
+                                8.53631636634628 * 8.53631636634628, 11.7060049025920 * 11.7060049025920,
+                                14.8635886339090 * 14.8635886339090};
+    const double al = 4 * delta * u, be = 4 * Delta * u;
+    g = dg = 0;
+    for (int m = 0; m < 5; ++m) {
+        const double am = a[m];
+        const double ep = std::exp(al * am), em = std::exp(-al * am), eb = std::exp(-be * am);
+        const double N = 2 * al * am - 2 + 2 * em + (2 - ep - em) * eb;
+        const double D = al * al * am * am * am * (am - 1);
+        const double k = N / D;
+        if (std::isnan(k)) continue;   // k(isnan(k)) = 0
+        g += k;
+        const double dN = 8 * delta * am * (1 - em) + 4 * delta * am * (em - ep) * eb -
+                          4 * Delta * am * (2 - ep - em) * eb;
+        const double dD = 8 * delta * al * am * am * am * (am - 1);
+        const double dk = (dN * D - N * dD) / (D * D);
+        if (std::isfinite(dk)) dg += dk;
+    }
+}
+
+// Restricted signal exponent R = RDr of one diameter d and its partial
+// derivatives with respect to d and Dr.
+inline void restricted(double d, double Dr, double Delta, double delta, double td,
+                       double &R, double &dRdd, double &dRdDr)
+{
+    double g, dg;
+    const double u = Dr / (d * d);
+    gpd(u, Delta, delta, g, dg);
+    R = g * d * d / (2 * td);
+    dRdd = d != 0 ? d * (g - u * dg) / td : 0;
+    dRdDr = dg / (2 * td);
+}
+
+} // namespace detail
+
+// Er of every shell for gamma distributions of diameters, on a (mean, std)
+// grid, for one Dr. The distribution is sampled on diam = 0.1:0.2:10 and
+// weighted by area, as in scd_model_CHARMED (onediam = 0); the std = 0 row
+// holds the single-diameter signal.
+class DiameterTable {
+public:
+    static const int nMean = 100, nStd = 51;
+    double Dr;
+    std::vector<double> values;   // [std][mean][shell]
+
+    static double meanAt(int i) { return 0.1 * (i + 1); }
+    static double stdAt(int j) { return 0.1 * j; }
+
+    DiameterTable(const Protocol &p, double Dr_, int nthreads = 0)
+        : Dr(Dr_), values((std::size_t)nStd * nMean * p.nShells()), nSh_(p.nShells())
+    {
+        const double resol = 0.2;
+        const int nDiam = 50;
+        // Signal of every sampled diameter and shell.
+        std::vector<double> E((std::size_t)nDiam * nSh_);
+        for (int j = 0; j < nDiam; ++j)
+            for (int s = 0; s < nSh_; ++s) {
+                const int t = p.shellTiming[s];
+                double R, dd, dr;
+                detail::restricted(0.1 + resol * j, Dr, p.Delta[t], p.delta[t], p.td[t], R, dd, dr);
+                E[(std::size_t)j * nSh_ + s] = std::exp(-p.shellB[s] * R);
+            }
+
+        parallel_for(nStd, 1, [&](std::size_t j0, std::size_t j1, int) {
+            std::vector<double> coeff(nDiam);
+            for (std::size_t js = j0; js < j1; ++js)
+                for (int im = 0; im < nMean; ++im) {
+                    double *out = &values[((std::size_t)js * nMean + im) * nSh_];
+                    const double mean = meanAt(im), sd = stdAt((int)js);
+                    if (js == 0) {
+                        for (int s = 0; s < nSh_; ++s) {
+                            const int t = p.shellTiming[s];
+                            double R, dd, dr;
+                            detail::restricted(mean, Dr, p.Delta[t], p.delta[t], p.td[t], R, dd, dr);
+                            out[s] = std::exp(-p.shellB[s] * R);
+                        }
+                        continue;
+                    }
+                    // Gamma pdf with shape mean^2/var and scale var/mean, times diam^2.
+                    const double beta = sd * sd / mean, alpha = mean / beta;
+                    const double logNorm = -std::lgamma(alpha) - alpha * std::log(beta);
+                    double sum = 0;
+                    for (int k = 0; k < nDiam; ++k) {
+                        const double d = 0.1 + resol * k;
+                        coeff[k] = std::exp(logNorm + (alpha - 1) * std::log(d) - d / beta) * d * d;
+                        sum += coeff[k] * resol;
+                    }
+                    double norm = 0;
+                    for (int k = 0; k < nDiam; ++k) {
+                        coeff[k] /= sum;
+                        if (coeff[k] > 0.01) norm += resol * coeff[k];
+                    }
+                    for (int s = 0; s < nSh_; ++s) out[s] = 0;
+                    for (int k = 0; k < nDiam; ++k) {
+                        if (!(coeff[k] > 0.01) && k > 0) continue;
+                        const double w = resol * coeff[k] / norm;
+                        const double *Ek = &E[(std::size_t)k * nSh_];
+                        for (int s = 0; s < nSh_; ++s) out[s] += w * Ek[s];
+                    }
+                }
+        }, nthreads);
+    }
+
+    // Er of shell s and its derivatives with respect to mean and std.
+    // Outside the grid the value is clamped and the derivative is 0.
+    void interpolate(double mean, double sd, int s, double &Er, double &dMean, double &dStd) const
+    {
+        double fm = (mean - meanAt(0)) / 0.1, fs = sd / 0.1;
+        const bool inM = fm >= 0 && fm <= nMean - 1, inS = fs >= 0 && fs <= nStd - 1;
+        fm = std::min<double>(std::max(fm, 0.0), nMean - 1);
+        fs = std::min<double>(std::max(fs, 0.0), nStd - 1);
+        const int i = std::min((int)fm, nMean - 2), j = std::min((int)fs, nStd - 2);
+        const double tm = fm - i, ts = fs - j;
+        const double e00 = at(j, i, s), e10 = at(j, i + 1, s), e01 = at(j + 1, i, s), e11 = at(j + 1, i + 1, s);
+        Er = (1 - ts) * ((1 - tm) * e00 + tm * e10) + ts * ((1 - tm) * e01 + tm * e11);
+        dMean = inM ? ((1 - ts) * (e10 - e00) + ts * (e11 - e01)) / 0.1 : 0;
+        dStd = inS ? ((1 - tm) * (e01 - e00) + tm * (e11 - e10)) / 0.1 : 0;
+    }
+
+    bool matches(double Dr_) const { return Dr == Dr_; }
+
+private:
+    int nSh_;
+    double at(int j, int i, int s) const { return values[((std::size_t)j * nMean + i) * nSh_ + s]; }
+};
+
+// Signal of one voxel, evaluated once per shell. With a table, std > 0
+// (or all voxels when useTable) go through it; the Jacobian column of Dr
+// is then 0.
+class Model {
+public:
+    Model(const Protocol &p, const DiameterTable *table, bool useTable)
+        : p_(p), table_(table), useTable_(useTable) {}
+
+    int nObs() const { return p_.nObs; }
+    std::size_t scratchSize() const { return 3 * p_.nTimings() + (std::size_t)p_.nShells() * (1 + kNumParams); }
+
+    // m: [nObs], J: [nObs][kNumParams] or NULL, tmp: scratchSize().
+    void eval(const double *x, double *m, double *J, double *tmp) const
+    {
+        const double fr = x[kFr], Dh = x[kDh], mean = x[kMean], sd = x[kStd], fcsf = x[kFcsf];
+        const double lc = x[kLc], Dcsf = x[kDcsf], Dr = x[kDr];
+        const double A = lc * lc * 0.2, fh = 1 - fr - fcsf;
+        const bool tab = table_ && (useTable_ || sd > 0);
+        const int nT = p_.nTimings(), nSh = p_.nShells();
+
+        double *R = tmp, *dRdd = tmp + nT, *dRdDr = tmp + 2 * nT;
+        double *ms = tmp + 3 * nT, *Js = ms + nSh;
+        if (!tab)
+            for (int t = 0; t < nT; ++t)
+                detail::restricted(mean, Dr, p_.Delta[t], p_.delta[t], p_.td[t], R[t], dRdd[t], dRdDr[t]);
+
+        for (int s = 0; s < nSh; ++s) {
+            const double b = p_.shellB[s], c = p_.shellC[s];
+            const double Eh = std::exp(-b * (A ? Dh + A * c : Dh));
+            const double Ec = std::exp(-b * Dcsf);
+            double Er, dMean, dStd = 0, dDr = 0;
+            if (tab) {
+                table_->interpolate(mean, sd, s, Er, dMean, dStd);
+            } else {
+                const int t = p_.shellTiming[s];
+                Er = std::exp(-b * R[t]);
+                dMean = -b * Er * dRdd[t];
+                dDr = -b * Er * dRdDr[t];
+            }
+            const double S = fh * Eh + fr * Er + fcsf * Ec;
+            const bool nan = std::isnan(S);
+            ms[s] = nan ? 1 : S;
+            if (!J) continue;
+            double *Jo = Js + s * kNumParams;
+            Jo[kFr] = Er - Eh;
+            Jo[kDh] = -fh * b * Eh;
+            Jo[kMean] = fr * dMean;
+            Jo[kStd] = fr * dStd;
+            Jo[kFcsf] = Ec - Eh;
+            Jo[kLc] = lc ? -fh * b * Eh * 0.4 * lc * c : 0;
+            Jo[kDcsf] = -fcsf * b * Ec;
+            Jo[kDr] = fr * dDr;
+            if (nan)
+                for (int k = 0; k < kNumParams; ++k) Jo[k] = 0;
+        }
+
+        for (int o = 0; o < p_.nObs; ++o) {
+            const int s = p_.shell[o];
+            m[o] = ms[s];
+            if (J)
+                for (int k = 0; k < kNumParams; ++k) J[o * kNumParams + k] = Js[s * kNumParams + k];
+        }
+    }
+
+private:
+    const Protocol &p_;
+    const DiameterTable *table_;
+    bool useTable_;
+};
+
+// Adapter to the batched LM solver: the free parameters of x0, with the
+// other parameters fixed to the values of x0.
+class FitKernel {
+public:
+    FitKernel(const Model &model, const double *x0, const std::vector<int> &free)
+        : model_(model), x0_(x0, x0 + kNumParams), free_(free) {}
+    int nParams() const { return (int)free_.size(); }
+    int nObs() const { return model_.nObs(); }
+
+    void eval(const double *p, double *m, double *J, int W) const
+    {
+        const int nP = nParams(), nO = nObs();
+        std::vector<double> x(x0_), mv(nO), Jv(J ? (std::size_t)nO * kNumParams : 0), tmp(model_.scratchSize());
+        for (int l = 0; l < W; ++l) {
+            for (int k = 0; k < nP; ++k) x[free_[k]] = p[k * W + l];
+            model_.eval(x.data(), mv.data(), J ? Jv.data() : NULL, tmp.data());
+            for (int o = 0; o < nO; ++o) {
+                m[o * W + l] = mv[o];
+                if (J)
+                    for (int k = 0; k < nP; ++k) J[(o * nP + k) * W + l] = Jv[o * kNumParams + free_[k]];
+            }
+        }
+    }
+
+private:
+    const Model &model_;
+    std::vector<double> x0_;
+    std::vector<int> free_;
+};
+
+// Fits nV voxels: data and S0 are nV x nObs, the model is S0.*S(x).
+// x0 holds the kNumParams start (and fixed) values, lb/ub the bounds of the
+// free parameters. P (nV x nFree), resnorm (sum((S0.*S - data).^2)) and
+// exitflag (nV each, see qmr_lm.hh) are written.
+inline void fit(const Model &model, const double *x0, const std::vector<int> &free,
+                const double *lb, const double *ub, std::size_t nV, const double *data,
+                const double *S0, int maxIter, int nthreads, double *P, double *resnorm, double *exitflag)
+{
+    const FitKernel kernel(model, x0, free);
+    const int nP = kernel.nParams(), nO = kernel.nObs();
+    qmr::lm::Options opt;
+    opt.maxIter = maxIter;
+    const int W = opt.blockWidth;
+    const std::size_t nBlocks = (nV + W - 1) / W;
+    const int nt = parallel_width(nBlocks, 1, nthreads);
+    std::vector<qmr::lm::Workspace> pool(nt, qmr::lm::Workspace(nP, nO, W));
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    parallel_for(nBlocks, 1, [&](std::size_t b0, std::size_t b1, int tid) {
+        qmr::lm::Workspace &ws = pool[tid];
+        for (std::size_t b = b0; b < b1; ++b) {
+            const std::size_t v0 = b * W;
+            const int n = static_cast<int>(std::min<std::size_t>(W, nV - v0));
+            // Pad the last block by repeating its last voxel. The cost
+            // sum(w.^2.*(S - data./S0).^2) with w = S0 is the cost of S0.*S.
+            for (int l = 0; l < W; ++l) {
+                const std::size_t v = v0 + std::min(l, n - 1);
+                for (int k = 0; k < nP; ++k) ws.p[k * W + l] = x0[free[k]];
+                for (int o = 0; o < nO; ++o) {
+                    const double s0 = S0[v + o * nV], y = data[v + o * nV];
+                    const bool finite = std::isfinite(s0) && std::isfinite(y) && s0 != 0;
+                    ws.y[o * W + l] = finite ? y / s0 : 0;
+                    ws.w[o * W + l] = finite ? s0 : 0;
+                }
+            }
+            qmr::lm::solveBlock(kernel, ws, lb, ub, opt);
+            for (int l = 0; l < n; ++l) {
+                const std::size_t v = v0 + l;
+                const bool valid = ws.flag[l] != qmr::lm::kNoData;
+                for (int k = 0; k < nP; ++k) P[v + k * nV] = valid ? ws.p[k * W + l] : nan;
+                resnorm[v] = valid ? ws.cost[l] : nan;
+                exitflag[v] = ws.flag[l];
+            }
+        }
+    }, nt);
+}
+
+} // namespace charmed
+} // namespace qmr
+
+#endif
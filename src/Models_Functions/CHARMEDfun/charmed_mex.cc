@@ -0,0 +1,189 @@
+/*
+ * CHARMED signal model and batched fit (see charmed_kernel.hh).
+ *
+ *   [S, J] = charmed_mex('signal', X, scheme)
+ *   [X, resnorm, exitflag] = charmed_mex('fit', data, S0, x0, lb, ub, fixed, scheme, opts)
+ *
+ *   X        nV x 8 parameters [fr Dh mean std fcsf lc Dcsf Dr], as x of
+ *            scd_model_CHARMED (um, ms)
+ *   scheme   nObs x (>= 6) scheme from ConvertSchemeUnits(Mat, 0)
+ *   S        nV x nObs signals, J nV x nObs x 8 Jacobian
+ *   data, S0 nV x nObs signals and their S0 (the model is S0.*S)
+ *   x0       1 x 8 start point; fixed parameters keep their x0 value
+ *   lb, ub   1 x 8 bounds
+ *   fixed    1 x 8, true for the parameters that are not fitted
+ *   opts     optional struct: MaxIter (100), NumThreads (0: all cores)
+ *
+ * In 'fit', X is nV x 8 (fixed parameters included), resnorm is
+ * sum((S0.*S - data).^2) and exitflag that of batchLM.
+ *
+ * Diameter distributions (std > 0, or std fitted) use a table over
+ * (mean, std) built for one Dr, kept between calls with the protocol.
+ * Dr must then be the same for all voxels and is not fitted.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "charmed_kernel.hh"
+
+static const char *kName = "charmed_mex";
+
+static std::unique_ptr<qmr::charmed::Protocol> gProt;
+static std::unique_ptr<qmr::charmed::DiameterTable> gTable;
+
+namespace {
+
+const qmr::charmed::Protocol &protocol(const mxArray *a)
+{
+    qmr::mex::requireDouble(kName, a, "scheme");
+    const std::size_t n = mxGetM(a);
+    if (mxGetN(a) < 6 || n == 0)
+        qmr::mex::fail(kName, "invalidInputSize", "scheme must be nObs x 6 or more (ConvertSchemeUnits).");
+    const double *s = mxGetPr(a);
+    const double *G = s + 3 * n, *Dl = s + 4 * n, *dl = s + 5 * n;
+    bool same = gProt && gProt->nObs == (int)n;
+    for (std::size_t o = 0; same && o < n; ++o)
+        same = gProt->scheme[3 * o] == G[o] && gProt->scheme[3 * o + 1] == Dl[o] &&
+               gProt->scheme[3 * o + 2] == dl[o];
+    if (!same) {
+        gProt.reset(new qmr::charmed::Protocol(G, Dl, dl, (int)n));
+        gTable.reset();
+    }
+    return *gProt;
+}
+
+const qmr::charmed::DiameterTable &table(const qmr::charmed::Protocol &p, double Dr, int nthreads)
+{
+    if (!gTable || !gTable->matches(Dr)) gTable.reset(new qmr::charmed::DiameterTable(p, Dr, nthreads));
+    return *gTable;
+}
+
+std::vector<double> params(const mxArray *a, const char *argName)
+{
+    std::vector<double> v = qmr::mex::toVector(a);
+    if (v.size() != qmr::charmed::kNumParams)
+        qmr::mex::fail(kName, "invalidInputSize", std::string(argName) + " must have 8 values.");
+    return v;
+}
+
+void signal(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    using namespace qmr::charmed;
+    if (nrhs != 3)
+        qmr::mex::fail(kName, "wrongNumInputs", "'signal' expects X and scheme.");
+    qmr::mex::requireDouble(kName, prhs[1], "X");
+    if (mxGetN(prhs[1]) != kNumParams)
+        qmr::mex::fail(kName, "invalidInputSize", "X must be nV x 8.");
+    const std::size_t nV = mxGetM(prhs[1]);
+    const double *X = mxGetPr(prhs[1]);
+    const Protocol &p = protocol(prhs[2]);
+    const int nO = p.nObs;
+
+    const DiameterTable *tab = NULL;
+    for (std::size_t v = 0; v < nV; ++v) {
+        if (!(X[v + kStd * nV] > 0)) continue;
+        const double Dr = X[v + kDr * nV];
+        if (tab && !tab->matches(Dr))
+            qmr::mex::fail(kName, "unsupportedDistribution",
+                           "Voxels with a diameter distribution (std > 0) must share Dr.");
+        if (!tab) tab = &table(p, Dr, 0);
+    }
+    const Model model(p, tab, false);
+
+    plhs[0] = mxCreateDoubleMatrix(nV, nO, mxREAL);
+    mxArray *J = NULL;
+    if (nlhs > 1) {
+        mwSize d[3] = {(mwSize)nV, (mwSize)nO, (mwSize)kNumParams};
+        J = mxCreateNumericArray(3, d, mxDOUBLE_CLASS, mxREAL);
+    }
+    double *S = mxGetPr(plhs[0]), *Jp = J ? mxGetPr(J) : NULL;
+
+    qmr::parallel_for(nV, 64, [&](std::size_t v0, std::size_t v1, int) {
+        std::vector<double> x(kNumParams), m(nO), Jv(Jp ? (std::size_t)nO * kNumParams : 0),
+            tmp(model.scratchSize());
+        for (std::size_t v = v0; v < v1; ++v) {
+            for (int k = 0; k < kNumParams; ++k) x[k] = X[v + k * nV];
+            model.eval(x.data(), m.data(), Jp ? Jv.data() : NULL, tmp.data());
+            for (int o = 0; o < nO; ++o) {
+                S[v + o * nV] = m[o];
+                if (Jp)
+                    for (int k = 0; k < kNumParams; ++k)
+                        Jp[v + (o + (std::size_t)k * nO) * nV] = Jv[o * kNumParams + k];
+            }
+        }
+    });
+    if (J) plhs[1] = J;
+}
+
+void fit(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    using namespace qmr::charmed;
+    if (nrhs < 8 || nrhs > 9)
+        qmr::mex::fail(kName, "wrongNumInputs", "'fit' expects data, S0, x0, lb, ub, fixed, scheme[, opts].");
+    qmr::mex::requireDouble(kName, prhs[1], "data");
+    qmr::mex::requireDouble(kName, prhs[2], "S0");
+    const std::size_t nV = mxGetM(prhs[1]);
+    const Protocol &p = protocol(prhs[7]);
+    if ((int)mxGetN(prhs[1]) != p.nObs || mxGetM(prhs[2]) != nV || mxGetN(prhs[2]) != mxGetN(prhs[1]))
+        qmr::mex::fail(kName, "invalidInputSize", "data and S0 must be nV x nObs (rows of scheme).");
+    const std::vector<double> x0 = params(prhs[3], "x0"), lb = params(prhs[4], "lb"),
+                              ub = params(prhs[5], "ub"), fixed = params(prhs[6], "fixed");
+    const mxArray *opts = nrhs > 8 ? prhs[8] : NULL;
+    const int maxIter = (int)qmr::mex::option(opts, "MaxIter", 100.0);
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    std::vector<int> free;
+    std::vector<double> lbFree, ubFree;
+    for (int k = 0; k < kNumParams; ++k)
+        if (!fixed[k]) {
+            free.push_back(k);
+            lbFree.push_back(lb[k]);
+            ubFree.push_back(ub[k]);
+        }
+    if (free.empty())
+        qmr::mex::fail(kName, "noFreeParameter", "At least one parameter must be fitted.");
+
+    const bool distribution = !fixed[kStd] || x0[kStd] > 0;
+    if (distribution && !fixed[kDr])
+        qmr::mex::fail(kName, "unsupportedDistribution", "Dr must be fixed to fit a diameter distribution.");
+    const Model model(p, distribution ? &table(p, x0[kDr], nthreads) : NULL, distribution);
+
+    const std::size_t nF = free.size();
+    std::vector<double> P(nV * nF);
+    mxArray *X = mxCreateDoubleMatrix(nV, kNumParams, mxREAL);
+    mxArray *res = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *flag = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    qmr::charmed::fit(model, x0.data(), free, lbFree.data(), ubFree.data(), nV,
+                      mxGetPr(prhs[1]), mxGetPr(prhs[2]), maxIter, nthreads, P.data(),
+                      mxGetPr(res), mxGetPr(flag));
+
+    double *Xp = mxGetPr(X);
+    for (int k = 0; k < kNumParams; ++k)
+        for (std::size_t v = 0; v < nV; ++v) Xp[v + k * nV] = x0[k];
+    for (std::size_t f = 0; f < nF; ++f)
+        for (std::size_t v = 0; v < nV; ++v) Xp[v + free[f] * nV] = P[v + f * nV];
+
+    mxArray *all[3] = {X, res, flag};
+    for (int k = 0; k < 3; ++k) {
+        if (k < nlhs || k == 0) plhs[k] = all[k];
+        else mxDestroyArray(all[k]);
+    }
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 1)
+        qmr::mex::fail(kName, "wrongNumInputs", "charmed_mex expects a command.");
+    const std::string cmd = qmr::mex::string(kName, prhs[0], "command");
+    if (cmd == "signal") signal(nlhs, plhs, nrhs, prhs);
+    else if (cmd == "fit") fit(nlhs, plhs, nrhs, prhs);
+    else qmr::mex::fail(kName, "unknownCommand", "Unknown command '" + cmd + "'.");
+}
@@ -0,0 +1,19 @@
+function SigmaNoise = computesigmanoise_batch(Prot,data)
+% SigmaNoise = computesigmanoise_batch(Prot,data)
+% computesigmanoise for many voxels at once (fitBatch of the diffusion
+% models): data is [nVoxels x nVol], SigmaNoise is [nVoxels x 1]. Zero
+% when no image is repeated (no dialog).
+Prot(Prot(:,4)==0,1:6) = 0;
+% find images that where repeated
+[~,c,ind] = consolidator(Prot(:,1:7),[],'count');
+repeated_measured = find(c>1);
+if isempty(repeated_measured)
+    SigmaNoise = zeros(size(data,1),1);
+    return
+end
+vars = zeros(size(data,1),length(repeated_measured));
+for irep = 1:length(repeated_measured)
+    vars(:,irep) = var(data(:,ind==repeated_measured(irep)),0,2);
+end
+SigmaNoise = sqrt(median(vars,2));
+end
@@ -49,6 +49,13 @@ if isfield(Ax,'output_signal'), output_signal = Ax.output_signal; else output_si
 if ~isfield(Ax,'save_plot'), Ax.save_plot=0; end
 if ~isfield(Ax,'Dcsf'), Dcsf=3; end
 if ~isfield(Ax,'fixDh'), Dh=x(2); else if Ax.fixDh, Dh=Dr*(1-fr-fcsf)/(1-fcsf); end; end  % tortuosity model, D. Alexander 2008
+if ~isfield(Ax,'Time_dependent_models'), Ax.Time_dependent_models='Burcaw 2015'; end
+
+% Compiled kernel (charmed_mex): same signal, single diameter, whole scheme
+if output_signal && ~isfield(Ax,'index') && onediam>=0 && ~std_d && strcmp(Ax.Time_dependent_models,'Burcaw 2015') && exist('charmed_mex','file')==3
+    output = charmed_mex('signal',double([fr Dh mean_d std_d fcsf x(6) Dcsf Dr]),double(Ax.scheme))';
+    return;
+end
 
 
 
@@ -60,7 +67,6 @@ q=gyro.*Ax.scheme(:,6).*Ax.scheme(:,4); %um-1
 %==========================================================================
 %Signal model for the hindered (extra-axonal) compartment
 %==========================================================================
-if ~isfield(Ax,'Time_dependent_models'), Ax.Time_dependent_models='Burcaw 2015'; end
 switch Ax.Time_dependent_models
     case 'Burcaw 2015'
         Dh = scd_model_timedependence(Dh,A,bigdelta,littledelta);
@@ -0,0 +1,89 @@
+function [D,L,S0,residue,V1] = dti_fit_batch(data, Prot, method, sigma)
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Vectorized scd_model_dti: diffusion tensors of many voxels.
+%
+% INPUT VARIABLES :
+%     -data:   [nVoxels x nVol] diffusion signal, one voxel per row
+%     -Prot:   [nVol x 7] protocol (Gx Gy Gz Gnorm Delta delta TE) in SI
+%              units, as dti.Prot.DiffusionData.Mat
+%     -method: 'linear' (default): linear fit of the log-signal, as
+%              scd_model_dti. 'wls': weighted linear fit. 'nlls':
+%              least-squares fit of the signal, started from 'wls'.
+%     -sigma:  noise level, scalar or [nVoxels x 1] (default: []). When
+%              given, magnitudes are corrected for the Rician bias,
+%              sqrt(max(S.^2 - sigma.^2, 0)), before the fit.
+%
+% OUTPUT VARIABLES :
+%     -D:       [nVoxels x 9] tensors, D(:) of each 3x3 matrix
+%     -L:       [nVoxels x 3] eigenvalues of D, in descending order
+%     -S0:      [nVoxels x nTE] S0 of each echo time unique(round(TE))
+%               (TE in ms), as scd_preproc_getS0
+%     -residue: [nVoxels x 1] sum of squared differences between the
+%               signal and S0*exp(-b*g'*D*g)
+%     -V1:      [nVoxels x 3] eigenvector of L1 (sign is arbitrary)
+%
+% Uses the compiled engine dti_mex when available: the design matrix and
+% its pseudo-inverse are computed once per protocol, then all voxels are
+% fitted with blocked matrix products and a closed-form 3x3 eigensolver
+% on all cores. Otherwise the linear fit is computed here for all voxels
+% at once, with eig voxel by voxel.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+if ~exist('method','var') || isempty(method), method = 'linear'; end
+if ~exist('sigma','var'), sigma = []; end
+
+% Protocol, as in dti.fit: rows with G < 5 mT/m are left out of the
+% tensor fit, S0 is the median of the lowest b of each TE
+scheme = ConvertSchemeUnits(Prot,0,1);
+bvecs  = scheme(:,1:3);
+bvals  = scd_scheme_bvalue(scheme);
+bvals(scheme(:,4)<5e-6) = 0;
+TEs = unique(round(scheme(:,7)));
+[~,groups] = ismember(round(scheme(:,7)),TEs);
+bref = scd_scheme2bvecsbvals(scheme);
+refs = false(size(groups));
+for g = 1:length(TEs)
+    refs(groups==g) = bref(groups==g) == min(bref(groups==g));
+end
+
+data = double(data);
+if exist('dti_mex','file')==3
+    opts = struct('Method',strrep(method,'linear','ols'),'Sigma',double(sigma(:)));
+    if nargout > 4
+        [D,L,S0,residue,V1] = dti_mex(data,bvecs,bvals,groups,refs,opts);
+    else
+        [D,L,S0,residue] = dti_mex(data,bvecs,bvals,groups,refs,opts);
+    end
+    return;
+end
+
+if ~strcmp(method,'linear')
+    error('qMRLab:dti_fit_batch:notCompiled','Method ''%s'' needs dti_mex (see qMRbuildMex).',method);
+end
+nV = size(data,1);
+if ~isempty(sigma)
+    data = sqrt(max(bsxfun(@minus,data.^2,sigma(:).^2),0));
+end
+S0 = zeros(nV,length(TEs));
+for g = 1:length(TEs)
+    S0(:,g) = median(data(:,refs & groups==g),2);
+end
+data = max(0,data);
+
+fit = bvals>0;
+H = [bvecs(:,1).^2 bvecs(:,2).^2 bvecs(:,3).^2 2*bvecs(:,1).*bvecs(:,2) 2*bvecs(:,1).*bvecs(:,3) 2*bvecs(:,2).*bvecs(:,3)];
+K = (H(fit,:)'*H(fit,:))\H(fit,:)';
+y = log(max(eps,data(:,fit))./max(eps,S0(:,groups(fit))));
+d = -bsxfun(@rdivide,y,bvals(fit)')*K';
+D = d(:,[1 4 5 4 2 6 5 6 3]);
+
+model = S0(:,groups).*exp(-d*bsxfun(@times,H,bvals)');
+residue = sum((model - data).^2,2);
+
+L = zeros(nV,3); V1 = zeros(nV,3);
+for ii = 1:nV
+    [V,E] = eig(reshape(D(ii,:),3,3));
+    [L(ii,:),I] = sort(diag(E),'descend');
+    V1(ii,:) = V(:,I(1))';
+end
+end
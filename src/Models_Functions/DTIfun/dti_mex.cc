@@ -0,0 +1,128 @@
+/*
+ * [D, L, S0, residue, V1] = dti_mex(data, bvecs, bvals, groups, refs, opts)
+ *
+ * Whole-volume diffusion tensor fit (see dti_tensor.hh). Use through
+ * dti_fit_batch.m.
+ *
+ *   data     nV x nObs diffusion signal
+ *   bvecs    nObs x 3 unit gradient directions
+ *   bvals    nObs b-values; rows with b = 0 are left out of the tensor fit
+ *   groups   nObs TE group of each row (1..nGroups)
+ *   refs     nObs, true for the rows whose median is the S0 of their group
+ *   opts     optional struct:
+ *              Method      'ols' (default, as scd_model_dti), 'wls' or 'nlls'
+ *              Sigma       [] (default), scalar or nV noise levels for the
+ *                          Rician bias correction of the magnitudes
+ *              MaxIter     LM iterations for 'nlls' (50)
+ *              NumThreads  0: all cores
+ *
+ * D is nV x 9 (3x3 tensors, column-major), L nV x 3 (descending
+ * eigenvalues), S0 nV x nGroups, residue nV x 1 and V1 nV x 3 (principal
+ * eigenvector, up to its sign).
+ *
+ * The design matrix and its pseudo-inverse are kept between calls and
+ * rebuilt only when the protocol changes.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "dti_tensor.hh"
+
+static const char *kName = "dti_mex";
+
+static std::unique_ptr<qmr::dti::Scheme> gScheme;
+
+static const qmr::dti::Scheme &scheme(const std::vector<double> &bvecs, const std::vector<double> &bvals,
+                                      const std::vector<int> &groups, const std::vector<char> &refs)
+{
+    if (!gScheme || gScheme->bvecs != bvecs || gScheme->bvals != bvals ||
+        gScheme->groups != groups || gScheme->refs != refs)
+        gScheme.reset(new qmr::dti::Scheme(bvecs.data(), bvals.data(), groups.data(), refs.data(),
+                                           (int)bvals.size()));
+    return *gScheme;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 5 || nrhs > 6)
+        qmr::mex::fail(kName, "wrongNumInputs", "dti_mex expects data, bvecs, bvals, groups, refs[, opts].");
+
+    qmr::mex::requireDouble(kName, prhs[0], "data");
+    const std::size_t nV = mxGetM(prhs[0]);
+    const std::size_t nObs = mxGetN(prhs[0]);
+
+    qmr::mex::requireDouble(kName, prhs[1], "bvecs");
+    if (mxGetM(prhs[1]) != nObs || mxGetN(prhs[1]) != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "bvecs must be nObs x 3.");
+    // Row-major copy of the directions.
+    const double *g = mxGetPr(prhs[1]);
+    std::vector<double> bvecs(3 * nObs);
+    for (std::size_t o = 0; o < nObs; ++o)
+        for (int k = 0; k < 3; ++k) bvecs[3 * o + k] = g[o + k * nObs];
+
+    std::vector<double> bvals = qmr::mex::toVector(prhs[2]);
+    std::vector<double> grp = qmr::mex::toVector(prhs[3]);
+    std::vector<double> ref = qmr::mex::toVector(prhs[4]);
+    if (bvals.size() != nObs || grp.size() != nObs || ref.size() != nObs)
+        qmr::mex::fail(kName, "invalidInputSize", "bvals, groups and refs must have one value per column of data.");
+    std::vector<int> groups(nObs);
+    std::vector<char> refs(nObs);
+    for (std::size_t o = 0; o < nObs; ++o) {
+        if (!(grp[o] >= 1 && grp[o] <= (double)nObs && grp[o] == std::floor(grp[o])))
+            qmr::mex::fail(kName, "invalidGroups", "groups must be integers from 1 to the number of rows.");
+        if (!(bvals[o] >= 0))
+            qmr::mex::fail(kName, "invalidBvals", "bvals must be non-negative.");
+        groups[o] = (int)grp[o] - 1;
+        refs[o] = ref[o] != 0;
+    }
+
+    const mxArray *opts = nrhs > 5 ? prhs[5] : NULL;
+    qmr::dti::Options opt;
+    const std::string method = qmr::mex::option(opts, "Method", std::string("ols"));
+    if (method == "ols") opt.method = qmr::dti::kOLS;
+    else if (method == "wls") opt.method = qmr::dti::kWLS;
+    else if (method == "nlls") opt.method = qmr::dti::kNLLS;
+    else qmr::mex::fail(kName, "unknownMethod", "Unknown method '" + method + "'.");
+    opt.maxIter = (int)qmr::mex::option(opts, "MaxIter", 50.0);
+    opt.numThreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    std::vector<double> sigma;
+    const mxArray *s = opts && mxIsStruct(opts) ? mxGetField(opts, 0, "Sigma") : NULL;
+    if (s && !mxIsEmpty(s)) {
+        sigma = qmr::mex::toVector(s);
+        if (sigma.size() != 1 && sigma.size() != nV)
+            qmr::mex::fail(kName, "invalidInputSize", "Sigma must be a scalar or have one value per voxel.");
+    }
+
+    const qmr::dti::Scheme &sch = scheme(bvecs, bvals, groups, refs);
+    if (!sch.valid)
+        qmr::mex::fail(kName, "rankDeficient",
+                       "The protocol must have at least 6 non-coplanar diffusion directions.");
+
+    mxArray *D = mxCreateDoubleMatrix(nV, 9, mxREAL);
+    mxArray *L = mxCreateDoubleMatrix(nV, 3, mxREAL);
+    mxArray *S0 = mxCreateDoubleMatrix(nV, sch.nGroups, mxREAL);
+    mxArray *res = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *V1 = nlhs > 4 ? mxCreateDoubleMatrix(nV, 3, mxREAL) : NULL;
+
+    qmr::dti::Output out;
+    out.D = mxGetPr(D);
+    out.L = mxGetPr(L);
+    out.S0 = mxGetPr(S0);
+    out.residue = mxGetPr(res);
+    out.V1 = V1 ? mxGetPr(V1) : NULL;
+    qmr::dti::fit(sch, nV, mxGetPr(prhs[0]), sigma.empty() ? NULL : sigma.data(), sigma.size(), opt, out);
+
+    mxArray *all[5] = {D, L, S0, res, V1};
+    for (int k = 0; k < 5; ++k) {
+        if (k < nlhs || k == 0) plhs[k] = all[k];
+        else if (all[k]) mxDestroyArray(all[k]);
+    }
+}
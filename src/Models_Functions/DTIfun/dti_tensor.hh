@@ -0,0 +1,351 @@
+/*
+ * dti_tensor.hh: whole-volume diffusion tensor fit (Basser et al., 1994).
+ *
+ * Native counterpart of scd_model_dti.m as used by dti.m. Everything that
+ * depends only on the protocol is built once (Scheme): the design matrix H
+ * of the diffusion-weighted rows and the pseudo-inverse (H'H)\H' of
+ * scd_model_dti, scaled by 1/b. Voxels are then processed in blocks of
+ * kBlock: S0 (median of the reference rows of each TE group, as in
+ * scd_preproc_getS0), the log-signals, the (6 x nFit) * (nFit x kBlock)
+ * product giving the tensors, optional refinements and the closed-form
+ * eigenvalues of the 3x3 symmetric tensors. Per-voxel quantities are
+ * stored with the voxel index innermost so the block loops vectorize.
+ *
+ * Refinements, starting from the linear fit:
+ *   kWLS   weighted linear fit of the log-signals, weights (S0*exp(-b*h*d))^2
+ *   kNLLS  least squares on the signals with the batched LM of qmr_lm.hh
+ * With a noise level sigma, magnitudes are first corrected for the Rician
+ * bias as sqrt(max(S^2 - sigma^2, 0)) (Gudbjartsson and Patz, 1995).
+ *
+ * Tensors are [Dxx Dyy Dzz Dxy Dxz Dyz] internally and returned as the
+ * 9 elements of the 3x3 matrix, column-major, as dti.m stores D(:).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef DTI_TENSOR_HH
+#define DTI_TENSOR_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_lm.hh"
+#include "qmr_parallel.hh"
+#include "qmr_tensor.hh"
+
+namespace qmr {
+namespace dti {
+
+static const int kBlock = 64;
+
+enum Method { kOLS, kWLS, kNLLS };
+
+struct Options {
+    Method method;
+    int    maxIter;      // LM iterations for kNLLS
+    int    numThreads;   // 0: all hardware threads
+
+    Options() : method(kOLS), maxIter(50), numThreads(0) {}
+};
+
+// Protocol: nObs rows of gradient direction, b-value (0 for the rows left
+// out of the tensor fit), TE group (0-based) and whether the row is a
+// reference (b = 0) image of its group.
+class Scheme {
+public:
+    int nObs, nGroups;
+    std::vector<double> bvecs;     // [nObs][3]
+    std::vector<double> bvals;     // [nObs]
+    std::vector<int>    groups;    // [nObs]
+    std::vector<char>   refs;      // [nObs]
+    std::vector<int>    fitRows;   // rows with b > 0
+    std::vector<double> A;         // [nObs][6] b*h, zero for the other rows
+    std::vector<double> P;         // [6][nFit] ((H'H)\H') ./ b'
+    bool valid;                    // H'H is positive definite
+
+    Scheme(const double *bvec, const double *bval, const int *group, const char *ref, int n)
+        : nObs(n), nGroups(0), bvecs(bvec, bvec + 3 * n), bvals(bval, bval + n),
+          groups(group, group + n), refs(ref, ref + n), A(6 * (std::size_t)n, 0.0), valid(false)
+    {
+        for (int o = 0; o < n; ++o) {
+            nGroups = std::max(nGroups, groups[o] + 1);
+            if (bvals[o] > 0) fitRows.push_back(o);
+        }
+        const int nFit = (int)fitRows.size();
+        std::vector<double> H(6 * (std::size_t)nFit);
+        for (int i = 0; i < nFit; ++i) {
+            const int o = fitRows[i];
+            const double x = bvecs[3 * o], y = bvecs[3 * o + 1], z = bvecs[3 * o + 2];
+            const double h[6] = {x * x, y * y, z * z, 2 * x * y, 2 * x * z, 2 * y * z};
+            for (int k = 0; k < 6; ++k) {
+                H[6 * i + k] = h[k];
+                A[6 * o + k] = bvals[o] * h[k];
+            }
+        }
+
+        // Cholesky factor of H'H, then P = (H'H)\H' column by column.
+        double L[36] = {0}, maxDiag = 0;
+        for (int i = 0; i < 6; ++i)
+            for (int j = 0; j <= i; ++j) {
+                double s = 0;
+                for (int r = 0; r < nFit; ++r) s += H[6 * r + i] * H[6 * r + j];
+                L[6 * i + j] = s;
+            }
+        for (int i = 0; i < 6; ++i) maxDiag = std::max(maxDiag, L[7 * i]);
+        for (int j = 0; j < 6; ++j) {
+            double s = L[7 * j];
+            for (int k = 0; k < j; ++k) s -= L[6 * j + k] * L[6 * j + k];
+            if (!(s > 1e-12 * maxDiag)) return;
+            L[7 * j] = std::sqrt(s);
+            for (int i = j + 1; i < 6; ++i) {
+                double t = L[6 * i + j];
+                for (int k = 0; k < j; ++k) t -= L[6 * i + k] * L[6 * j + k];
+                L[6 * i + j] = t / L[7 * j];
+            }
+        }
+        P.assign(6 * (std::size_t)nFit, 0.0);
+        for (int r = 0; r < nFit; ++r) {
+            double x[6];
+            for (int i = 0; i < 6; ++i) {
+                double t = H[6 * r + i];
+                for (int k = 0; k < i; ++k) t -= L[6 * i + k] * x[k];
+                x[i] = t / L[7 * i];
+            }
+            for (int i = 5; i >= 0; --i) {
+                double t = x[i];
+                for (int k = i + 1; k < 6; ++k) t -= L[6 * k + i] * x[k];
+                x[i] = t / L[7 * i];
+            }
+            for (int k = 0; k < 6; ++k) P[(std::size_t)k * nFit + r] = x[k] / bvals[fitRows[r]];
+        }
+        valid = true;
+    }
+};
+
+// Signal model exp(-b*h*d) of every row, for the LM solver (S0 enters
+// through the observation weights, see fitBlock).
+class TensorKernel {
+public:
+    explicit TensorKernel(const Scheme &s) : s_(s) {}
+    int nParams() const { return 6; }
+    int nObs() const { return s_.nObs; }
+
+    void eval(const double *p, double *m, double *J, int W) const
+    {
+        for (int o = 0; o < s_.nObs; ++o) {
+            const double *a = &s_.A[6 * o];
+            double *mo = m + o * W;
+            double *Jo = J ? J + o * 6 * W : NULL;
+            for (int l = 0; l < W; ++l) {
+                double e = std::exp(-(a[0] * p[l] + a[1] * p[W + l] + a[2] * p[2 * W + l] +
+                                      a[3] * p[3 * W + l] + a[4] * p[4 * W + l] + a[5] * p[5 * W + l]));
+                mo[l] = e;
+                if (Jo)
+                    for (int k = 0; k < 6; ++k) Jo[k * W + l] = -a[k] * e;
+            }
+        }
+    }
+
+private:
+    const Scheme &s_;
+};
+
+// Outputs, MATLAB column-major with voxels along the rows. V1 may be NULL.
+struct Output {
+    double *D;        // nV x 9
+    double *L;        // nV x 3, descending
+    double *S0;       // nV x nGroups
+    double *residue;  // nV, sum((S0*exp(-b*h*d) - S).^2)
+    double *V1;       // nV x 3
+};
+
+namespace detail {
+
+// MATLAB's median of n values (NaN if any is NaN). Reorders v.
+inline double median(double *v, int n)
+{
+    if (n == 0) return std::numeric_limits<double>::quiet_NaN();
+    for (int i = 0; i < n; ++i)
+        if (std::isnan(v[i])) return v[i];
+    const int h = n / 2;
+    std::nth_element(v, v + h, v + n);
+    if (n % 2) return v[h];
+    return 0.5 * (v[h] + *std::max_element(v, v + h));
+}
+
+// Solves the 6x6 SPD system M x = y in place (x in y). False if M is not
+// positive definite.
+inline bool solve6(double *M, double *y)
+{
+    for (int j = 0; j < 6; ++j) {
+        double s = M[7 * j];
+        for (int k = 0; k < j; ++k) s -= M[6 * j + k] * M[6 * j + k];
+        if (!(s > 0)) return false;
+        M[7 * j] = std::sqrt(s);
+        for (int i = j + 1; i < 6; ++i) {
+            double t = M[6 * i + j];
+            for (int k = 0; k < j; ++k) t -= M[6 * i + k] * M[6 * j + k];
+            M[6 * i + j] = t / M[7 * j];
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        for (int k = 0; k < i; ++k) y[i] -= M[6 * i + k] * y[k];
+        y[i] /= M[7 * i];
+    }
+    for (int i = 5; i >= 0; --i) {
+        for (int k = i + 1; k < 6; ++k) y[i] -= M[6 * k + i] * y[k];
+        y[i] /= M[7 * i];
+    }
+    return true;
+}
+
+struct Workspace {
+    std::vector<double> S, S0, z, d, L, V, med;
+    qmr::lm::Workspace lm;
+
+    Workspace(const Scheme &s)
+        : S((std::size_t)s.nObs * kBlock), S0((std::size_t)s.nGroups * kBlock),
+          z(s.fitRows.size() * kBlock), d(6 * kBlock), L(3 * kBlock), V(3 * kBlock),
+          med(s.nObs), lm(6, s.nObs, kBlock) {}
+};
+
+// Fits the kBlock lanes loaded in ws.S (corrected magnitudes).
+inline void fitBlock(const Scheme &s, Workspace &ws, const Options &opt, bool wantV1)
+{
+    const int W = kBlock, nObs = s.nObs, nFit = (int)s.fitRows.size();
+    const double eps = std::numeric_limits<double>::epsilon();
+
+    for (int g = 0; g < s.nGroups; ++g)
+        for (int l = 0; l < W; ++l) {
+            int n = 0;
+            for (int o = 0; o < nObs; ++o)
+                if (s.groups[o] == g && s.refs[o]) ws.med[n++] = ws.S[o * W + l];
+            ws.S0[g * W + l] = median(ws.med.data(), n);
+        }
+    for (int o = 0; o < nObs; ++o)
+        for (int l = 0; l < W; ++l) ws.S[o * W + l] = std::max(0.0, ws.S[o * W + l]);
+
+    // Linear fit: d = -P * log(S./S0)
+    for (int i = 0; i < nFit; ++i) {
+        const int o = s.fitRows[i];
+        const double *S = &ws.S[o * W], *S0 = &ws.S0[s.groups[o] * W];
+        double *z = &ws.z[i * W];
+        for (int l = 0; l < W; ++l) z[l] = -std::log(std::max(eps, S[l]) / std::max(eps, S0[l]));
+    }
+    std::fill(ws.d.begin(), ws.d.end(), 0.0);
+    for (int k = 0; k < 6; ++k) {
+        double *dk = &ws.d[k * W];
+        const double *Pk = &s.P[(std::size_t)k * nFit];
+        for (int i = 0; i < nFit; ++i) {
+            const double pki = Pk[i], *z = &ws.z[i * W];
+            for (int l = 0; l < W; ++l) dk[l] += pki * z[l];
+        }
+    }
+
+    if (opt.method != kOLS) {
+        // Weighted linear fit, also the start point of the LM refinement.
+        for (int l = 0; l < W; ++l) {
+            double M[36] = {0}, y[6] = {0};
+            for (int i = 0; i < nFit; ++i) {
+                const int o = s.fitRows[i];
+                const double *a = &s.A[6 * o];
+                double ad = 0;
+                for (int k = 0; k < 6; ++k) ad += a[k] * ws.d[k * W + l];
+                const double m = std::max(eps, ws.S0[s.groups[o] * W + l]) * std::exp(-ad);
+                const double w = m * m;
+                if (!std::isfinite(w)) continue;
+                for (int r = 0; r < 6; ++r) {
+                    y[r] += w * a[r] * ws.z[i * W + l];
+                    for (int c = 0; c <= r; ++c) M[6 * r + c] += w * a[r] * a[c];
+                }
+            }
+            if (solve6(M, y))
+                for (int k = 0; k < 6; ++k) ws.d[k * W + l] = y[k];
+        }
+    }
+
+    if (opt.method == kNLLS) {
+        // min sum((S0*m - S).^2) as sum(w.^2 .* (m - S./S0).^2) with w = S0
+        qmr::lm::Workspace &lw = ws.lm;
+        for (int o = 0; o < nObs; ++o)
+            for (int l = 0; l < W; ++l) {
+                const double S0 = std::max(eps, ws.S0[s.groups[o] * W + l]), S = ws.S[o * W + l];
+                const bool finite = std::isfinite(S0) && std::isfinite(S);
+                lw.y[o * W + l] = finite ? S / S0 : 0;
+                lw.w[o * W + l] = finite ? S0 : 0;
+            }
+        std::copy(ws.d.begin(), ws.d.end(), lw.p.begin());
+        const double inf = std::numeric_limits<double>::infinity();
+        const double lb[6] = {-inf, -inf, -inf, -inf, -inf, -inf};
+        const double ub[6] = {inf, inf, inf, inf, inf, inf};
+        qmr::lm::Options lo;
+        lo.maxIter = opt.maxIter;
+        lo.blockWidth = W;
+        qmr::lm::solveBlock(TensorKernel(s), lw, lb, ub, lo);
+        for (int l = 0; l < W; ++l)
+            if (lw.flag[l] != qmr::lm::kNoData)
+                for (int k = 0; k < 6; ++k) ws.d[k * W + l] = lw.p[k * W + l];
+    }
+
+    qmr::tensor::eigen(ws.d.data(), ws.L.data(), wantV1 ? ws.V.data() : NULL, W);
+}
+
+} // namespace detail
+
+// Fits nV voxels. data is nV x nObs; sigma is NULL, one value or nV values
+// (nSigma) of the noise level used for the Rician bias correction.
+inline void fit(const Scheme &s, std::size_t nV, const double *data,
+                const double *sigma, std::size_t nSigma, const Options &opt, const Output &out)
+{
+    const int W = kBlock, nObs = s.nObs;
+    const std::size_t nBlocks = (nV + W - 1) / W;
+    const int nt = parallel_width(nBlocks, 1, opt.numThreads);
+    std::vector<detail::Workspace> pool(nt, detail::Workspace(s));
+    // Element of D(:) for each of the 9 outputs.
+    static const int kFull[9] = {0, 3, 4, 3, 1, 5, 4, 5, 2};
+
+    parallel_for(nBlocks, 1, [&](std::size_t b0, std::size_t b1, int tid) {
+        detail::Workspace &ws = pool[tid];
+        for (std::size_t b = b0; b < b1; ++b) {
+            const std::size_t v0 = b * W;
+            const int n = static_cast<int>(std::min<std::size_t>(W, nV - v0));
+            // Pad the last block by repeating its last voxel.
+            for (int l = 0; l < W; ++l) {
+                const std::size_t v = v0 + std::min(l, n - 1);
+                const double sg = !sigma ? 0 : sigma[nSigma == 1 ? 0 : v];
+                for (int o = 0; o < nObs; ++o) {
+                    double y = data[v + o * nV];
+                    if (sg > 0) y = std::sqrt(std::max(y * y - sg * sg, 0.0));
+                    ws.S[o * W + l] = y;
+                }
+            }
+            detail::fitBlock(s, ws, opt, out.V1 != NULL);
+
+            for (int l = 0; l < n; ++l) {
+                const std::size_t v = v0 + l;
+                for (int k = 0; k < 9; ++k) out.D[v + k * nV] = ws.d[kFull[k] * W + l];
+                for (int k = 0; k < 3; ++k) out.L[v + k * nV] = ws.L[k * W + l];
+                for (int g = 0; g < s.nGroups; ++g) out.S0[v + g * nV] = ws.S0[g * W + l];
+                if (out.V1)
+                    for (int k = 0; k < 3; ++k) out.V1[v + k * nV] = ws.V[k * W + l];
+                double r = 0;
+                for (int o = 0; o < nObs; ++o) {
+                    const double *a = &s.A[6 * o];
+                    double ad = 0;
+                    for (int k = 0; k < 6; ++k) ad += a[k] * ws.d[k * W + l];
+                    const double e = ws.S0[s.groups[o] * W + l] * std::exp(-ad) - ws.S[o * W + l];
+                    r += e * e;
+                }
+                out.residue[v] = r;
+            }
+        }
+    }, nt);
+}
+
+} // namespace dti
+} // namespace qmr
+
+#endif
@@ -12,6 +12,15 @@ if nargin < 3
     mask = ones(N);
 end
 
+% Compiled engine (qMRbuildMex): no design matrix
+if exist('polyfit3d_mex','file')==3
+    if max(size(order))==1, order = 0:order; end
+    fit = polyfit3d_mex(double(data), mask, order, 'tensor');
+    out = zeros(N);
+    out(mask~=0) = fit(mask~=0);
+    return
+end
+
 [x,y] = meshgrid( linspace(-1,1,N(2)), linspace(-1,1,N(1)) );
 
 v_idx = find(mask);
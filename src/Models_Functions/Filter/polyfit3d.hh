@@ -0,0 +1,228 @@
+/*
+ * polyfit3d.hh: least-squares polynomial fit of a 2-D/3-D map over a mask,
+ * evaluated back on the whole grid (polyfit_3D.m, poly_fit.m and the
+ * fit{2,3}dpolynomialmodel path of mtv_fit3dpolynomialmodel.m).
+ *
+ * The basis terms are products x^a y^b z^c of per-axis exponents, either
+ * all combinations of a list of exponents (kTensor, polyfit_3D/poly_fit)
+ * or all terms of total degree <= d (kTotal, constructpolynomialmatrix3d).
+ * Both term sets are closed under lowering an exponent, so each axis can
+ * use an orthonormalized basis of the same span (Gram-Schmidt of the
+ * monomials over the grid points, in increasing order) without changing
+ * the fitted field, and the normal equations stay well conditioned at high
+ * orders. Axes with fewer points than exponents keep the independent
+ * functions only.
+ *
+ * No design matrix is built. Since every basis function is separable, the
+ * Gram matrix is accumulated row by row (rows along the first dimension):
+ * the masked sum of X_a X_a' over a row comes from prefix sums over the
+ * runs of the mask, is weighted by Y_b Y_b' into a plane partial, and
+ * planes are weighted by Z_c Z_c' into the P x P Gram matrix. Rows are
+ * split into one contiguous block per thread, each with its own partial
+ * Gram matrix and right-hand side, summed in block order. The system is
+ * solved once by Cholesky (terms with no support in the mask get a zero
+ * coefficient) and the field is evaluated separably, one row at a time.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef POLYFIT3D_HH
+#define POLYFIT3D_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace polyfit {
+
+enum TermSet { kTensor, kTotal };
+
+// Orthonormal basis of span{t^e, e in exps} over the n points
+// t = linspace(-1, 1, n) (t = 1 when n = 1), stored [function][point].
+// keptExps receives the exponent each function was built from.
+inline std::vector<double> axisBasis(std::size_t n, const std::vector<int> &exps, std::vector<int> &keptExps)
+{
+    std::vector<double> Q;
+    keptExps.clear();
+    std::vector<double> v(n);
+    for (std::size_t e = 0; e < exps.size(); ++e) {
+        double norm0 = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            const double t = n == 1 ? 1.0 : -1.0 + 2.0 * (double)i / (double)(n - 1);
+            v[i] = std::pow(t, exps[e]);
+            norm0 += v[i] * v[i];
+        }
+        // Modified Gram-Schmidt, twice
+        const std::size_t m = keptExps.size();
+        for (int pass = 0; pass < 2; ++pass)
+            for (std::size_t q = 0; q < m; ++q) {
+                const double *u = &Q[q * n];
+                double d = 0;
+                for (std::size_t i = 0; i < n; ++i) d += u[i] * v[i];
+                for (std::size_t i = 0; i < n; ++i) v[i] -= d * u[i];
+            }
+        double norm = 0;
+        for (std::size_t i = 0; i < n; ++i) norm += v[i] * v[i];
+        if (!(norm > 1e-20 * norm0)) continue;
+        norm = 1 / std::sqrt(norm);
+        for (std::size_t i = 0; i < n; ++i) Q.push_back(v[i] * norm);
+        keptExps.push_back(exps[e]);
+    }
+    return Q;
+}
+
+// Fits data over the voxels where mask is nonzero and data is finite, and
+// writes the fitted field on the whole n1 x n2 x n3 grid to out. exps are
+// the per-axis exponents in increasing order; kTotal keeps the terms with
+// a + b + c <= max(exps).
+inline void fit(const double *data, const unsigned char *mask, const std::size_t n[3], const std::vector<int> &exps,
+                TermSet terms, double *out, int nthreads = 0)
+{
+    const std::size_t n1 = n[0], n2 = n[1], n3 = n[2];
+
+    // Per-axis bases, and the terms as indices into them
+    std::vector<int> ex[3];
+    const std::vector<double> X = axisBasis(n1, exps, ex[0]), Y = axisBasis(n2, exps, ex[1]),
+                              Z = axisBasis(n3, exps, ex[2]);
+    const std::size_t mx = ex[0].size(), my = ex[1].size(), mz = ex[2].size();
+    const int maxDeg = exps.empty() ? 0 : *std::max_element(exps.begin(), exps.end());
+    std::vector<int> ta, tb, tc;
+    for (std::size_t c = 0; c < mz; ++c)
+        for (std::size_t b = 0; b < my; ++b)
+            for (std::size_t a = 0; a < mx; ++a)
+                if (terms == kTensor || ex[0][a] + ex[1][b] + ex[2][c] <= maxDeg) {
+                    ta.push_back((int)a);
+                    tb.push_back((int)b);
+                    tc.push_back((int)c);
+                }
+    const std::size_t P = ta.size();
+    std::fill(out, out + n1 * n2 * n3, 0.0);
+    if (P == 0) return;
+
+    // Prefix sums of X_a X_a' along the first dimension: [i][a][a']
+    std::vector<double> prefix((n1 + 1) * mx * mx, 0.0);
+    for (std::size_t i = 0; i < n1; ++i)
+        for (std::size_t a = 0; a < mx; ++a)
+            for (std::size_t b = 0; b < mx; ++b)
+                prefix[((i + 1) * mx + a) * mx + b] = prefix[(i * mx + a) * mx + b] + X[a * n1 + i] * X[b * n1 + i];
+
+    // Normal equations, one partial per block of rows
+    const std::size_t rows = n2 * n3;
+    const int nb = parallel_width(rows, 1, nthreads);
+    std::vector<std::vector<double> > Gb(nb), rb(nb);
+    parallel_for((std::size_t)nb, 1, [&](std::size_t blk, std::size_t, int) {
+        std::vector<double> &G = Gb[blk], &r = rb[blk];
+        G.assign(P * P, 0.0);
+        r.assign(P, 0.0);
+        std::vector<double> R(mx * mx), Ry(mx), Pk(mx * mx * my * my, 0.0), Py(mx * my, 0.0);
+        bool pending = false;
+        const std::size_t rowBegin = rows * blk / nb, rowEnd = rows * (blk + 1) / nb;
+        auto flush = [&](std::size_t k) {
+            for (std::size_t s = 0; s < P; ++s) {
+                const double zs = Z[tc[s] * n3 + k];
+                r[s] += Py[tb[s] * mx + ta[s]] * zs;
+                for (std::size_t t = s; t < P; ++t)
+                    G[s * P + t] += Pk[((tb[s] * my + tb[t]) * mx + ta[s]) * mx + ta[t]] * zs * Z[tc[t] * n3 + k];
+            }
+            std::fill(Pk.begin(), Pk.end(), 0.0);
+            std::fill(Py.begin(), Py.end(), 0.0);
+            pending = false;
+        };
+        for (std::size_t row = rowBegin; row < rowEnd; ++row) {
+            const std::size_t j = row % n2, k = row / n2;
+            const double *d = data + row * n1;
+            const unsigned char *m = mask + row * n1;
+            std::fill(R.begin(), R.end(), 0.0);
+            std::fill(Ry.begin(), Ry.end(), 0.0);
+            bool any = false;
+            for (std::size_t i = 0; i < n1;) {
+                if (!(m[i] && std::isfinite(d[i]))) {
+                    ++i;
+                    continue;
+                }
+                const std::size_t lo = i;
+                for (; i < n1 && m[i] && std::isfinite(d[i]); ++i)
+                    for (std::size_t a = 0; a < mx; ++a) Ry[a] += d[i] * X[a * n1 + i];
+                for (std::size_t q = 0; q < mx * mx; ++q) R[q] += prefix[i * mx * mx + q] - prefix[lo * mx * mx + q];
+                any = true;
+            }
+            if (any) {
+                for (std::size_t b = 0; b < my; ++b) {
+                    const double yb = Y[b * n2 + j];
+                    for (std::size_t a = 0; a < mx; ++a) Py[b * mx + a] += Ry[a] * yb;
+                    for (std::size_t b2 = 0; b2 < my; ++b2) {
+                        const double w = yb * Y[b2 * n2 + j];
+                        double *p = &Pk[(b * my + b2) * mx * mx];
+                        for (std::size_t q = 0; q < mx * mx; ++q) p[q] += R[q] * w;
+                    }
+                }
+                pending = true;
+            }
+            if (pending && (j + 1 == n2 || row + 1 == rowEnd)) flush(k);
+        }
+    }, nthreads);
+    std::vector<double> G(P * P, 0.0), c(P, 0.0);
+    for (int blk = 0; blk < nb; ++blk)
+        for (std::size_t s = 0; s < P; ++s) {
+            c[s] += rb[blk][s];
+            for (std::size_t t = s; t < P; ++t) G[s * P + t] += Gb[blk][s * P + t];
+        }
+
+    // Cholesky G = L L' (upper triangle of G holds G, L goes to the lower
+    // triangle and the diagonal); terms whose pivot vanishes are dropped.
+    double maxDiag = 0;
+    for (std::size_t s = 0; s < P; ++s) maxDiag = std::max(maxDiag, G[s * P + s]);
+    std::vector<char> used(P, 0);
+    std::vector<double> L(P * P, 0.0);
+    for (std::size_t s = 0; s < P; ++s) {
+        double d = G[s * P + s];
+        for (std::size_t q = 0; q < s; ++q) d -= L[s * P + q] * L[s * P + q];
+        if (!(d > 1e-10 * maxDiag)) continue;
+        used[s] = 1;
+        L[s * P + s] = std::sqrt(d);
+        for (std::size_t t = s + 1; t < P; ++t) {
+            double v = G[s * P + t];
+            for (std::size_t q = 0; q < s; ++q) v -= L[t * P + q] * L[s * P + q];
+            L[t * P + s] = v / L[s * P + s];
+        }
+    }
+    for (std::size_t s = 0; s < P; ++s) {
+        if (!used[s]) {
+            c[s] = 0;
+            continue;
+        }
+        double v = c[s];
+        for (std::size_t q = 0; q < s; ++q) v -= L[s * P + q] * c[q];
+        c[s] = v / L[s * P + s];
+    }
+    for (std::size_t s = P; s-- > 0;) {
+        if (!used[s]) continue;
+        double v = c[s];
+        for (std::size_t t = s + 1; t < P; ++t) v -= L[t * P + s] * c[t];
+        c[s] = v / L[s * P + s];
+    }
+
+    // Separable evaluation: per row, collapse the y and z factors
+    parallel_for(rows, std::max<std::size_t>(1, n2), [&](std::size_t b, std::size_t e, int) {
+        std::vector<double> C1(mx);
+        for (std::size_t row = b; row < e; ++row) {
+            const std::size_t j = row % n2, k = row / n2;
+            std::fill(C1.begin(), C1.end(), 0.0);
+            for (std::size_t s = 0; s < P; ++s) C1[ta[s]] += c[s] * Y[tb[s] * n2 + j] * Z[tc[s] * n3 + k];
+            double *o = out + row * n1;
+            for (std::size_t a = 0; a < mx; ++a) {
+                const double w = C1[a], *x = &X[a * n1];
+                for (std::size_t i = 0; i < n1; ++i) o[i] += w * x[i];
+            }
+        }
+    }, nthreads);
+}
+
+} // namespace polyfit
+} // namespace qmr
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * F = polyfit3d_mex(data, mask, orders, terms, opts)
+ *
+ * Least-squares polynomial fit of a 2-D/3-D map (see polyfit3d.hh). Use
+ * through polyfit_3D.m, poly_fit.m or mtv_fit3dpolynomialmodel.m.
+ *
+ *   data    real double 2-D/3-D array
+ *   mask    voxels to fit (size of data), or [] for all; non-finite data
+ *           are left out
+ *   orders  per-axis exponents, non-negative integers
+ *   terms   'tensor': all products x^a y^b z^c of orders (polyfit_3D)
+ *           'total':  all terms of total degree <= max(orders)
+ *                     (constructpolynomialmatrix3d)
+ *   opts    optional struct: NumThreads (0: all cores)
+ *
+ * F is the fitted polynomial on the whole grid, size of data. Coordinates
+ * span [-1, 1] along each dimension; the fitted field does not depend on
+ * that range.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "polyfit3d.hh"
+
+static const char *kName = "polyfit3d_mex";
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    (void)nlhs;
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "polyfit3d_mex(data, mask, orders, terms, opts).");
+    qmr::mex::requireDouble(kName, prhs[0], "data");
+    if (mxGetNumberOfDimensions(prhs[0]) > 3)
+        qmr::mex::fail(kName, "invalidInputSize", "data must be 2D or 3D.");
+    const std::vector<std::size_t> d = qmr::mex::dims(prhs[0], 3);
+    const std::size_t n[3] = {d[0], d[1], d[2]}, nvox = mxGetNumberOfElements(prhs[0]);
+
+    std::vector<unsigned char> mask(nvox, 1);
+    if (!mxIsEmpty(prhs[1])) {
+        if (mxGetNumberOfElements(prhs[1]) != nvox)
+            qmr::mex::fail(kName, "invalidInputSize", "mask must have the size of data.");
+        if (mxIsLogical(prhs[1])) {
+            const mxLogical *m = mxGetLogicals(prhs[1]);
+            for (std::size_t v = 0; v < nvox; ++v) mask[v] = m[v];
+        } else {
+            const std::vector<double> m = qmr::mex::toVector(prhs[1]);
+            for (std::size_t v = 0; v < nvox; ++v) mask[v] = m[v] != 0;
+        }
+    }
+
+    const std::vector<double> o = qmr::mex::toVector(prhs[2]);
+    if (o.empty()) qmr::mex::fail(kName, "invalidInput", "orders must not be empty.");
+    std::vector<int> orders(o.size());
+    for (std::size_t i = 0; i < o.size(); ++i) {
+        if (!(o[i] >= 0 && o[i] <= 100 && o[i] == std::floor(o[i])))
+            qmr::mex::fail(kName, "invalidInput", "orders must be integers between 0 and 100.");
+        orders[i] = (int)o[i];
+    }
+    std::sort(orders.begin(), orders.end());
+    orders.erase(std::unique(orders.begin(), orders.end()), orders.end());
+
+    const std::string t = qmr::mex::string(kName, prhs[3], "terms");
+    qmr::polyfit::TermSet terms = qmr::polyfit::kTensor;
+    if (t == "total") {
+        terms = qmr::polyfit::kTotal;
+        if (orders.front() != 0 || orders.back() + 1 != (int)orders.size())
+            qmr::mex::fail(kName, "invalidInput", "'total' terms need orders = 0:degree.");
+    } else if (t != "tensor") {
+        qmr::mex::fail(kName, "invalidInput", "terms must be 'tensor' or 'total'.");
+    }
+    const mxArray *opts = nrhs > 4 ? prhs[4] : NULL;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    plhs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(prhs[0]), mxGetDimensions(prhs[0]), mxDOUBLE_CLASS, mxREAL);
+    if (nvox > 0)
+        qmr::polyfit::fit(mxGetPr(prhs[0]), mask.data(), n, orders, terms, mxGetPr(plhs[0]), nthreads);
+}
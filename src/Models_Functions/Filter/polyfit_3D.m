@@ -30,6 +30,15 @@ if nargin < 2
     order = 5;
 end
 
+% Compiled engine (qMRbuildMex): no design matrix
+if exist('polyfit3d_mex','file')==3
+    if length(order) == 1, order = 0:order; end
+    output_all = polyfit3d_mex(double(rawmap), mask, order, 'tensor');
+    output = zeros(N_raw);
+    output(mask~=0) = output_all(mask~=0);
+    return
+end
+
 roi_idx = find(mask);
 full_idx = find(ones(size(mask)));
 
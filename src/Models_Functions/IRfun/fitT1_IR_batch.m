@@ -0,0 +1,54 @@
+function [T1,b,a,res,idx]=fitT1_IR_batch(data,T_IR,method)
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Vectorized fitT1_IR: estimates T1 for many voxels at once.
+%
+% INPUT VARIABLES :
+%     -data:   [nVoxels x nTI] signal values, one voxel per row
+%     -T_IR:   Array containing the IR times, in ms.
+%     -method: 'Complex' or 'Magnitude', as in fitT1_IR
+%
+% OUTPUT VARIABLES :
+%     [nVoxels x 1] T1, b, a, res and idx, as returned by fitT1_IR for each
+%     voxel (idx is empty for 'Complex').
+%
+% Uses the compiled grid search rdNls_mex when available: the T1 dictionary
+% is built once for the protocol and all voxels are searched with blocked
+% dictionary x data products on all cores. Otherwise falls back to
+% calling fitT1_IR voxel by voxel.
+%
+% The search grid (T1 = 1:5000 ms, one zoom pass of 21 points) is the one
+% used by fitT1_IR.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+T1Vec = 1:5000;
+nbrOfZoom = 2;
+T1LenZ = 21;
+
+nV = size(data,1);
+T_IR = T_IR(:);
+
+if exist('rdNls_mex','file')==3
+    switch method
+        case{'Complex'}
+            if isreal(data)
+                [T1,b,a,res] = rdNls_mex(double(data),[],T_IR,T1Vec,'Complex',nbrOfZoom,T1LenZ,0);
+            else
+                [T1,br,ar,res,~,bi,ai] = rdNls_mex(double(real(data)),double(imag(data)),T_IR,T1Vec,'Complex',nbrOfZoom,T1LenZ,0);
+                b = complex(br,bi);
+                a = complex(ar,ai);
+            end
+            idx = [];
+        case{'Magnitude'}
+            [tVec, order] = sort(T_IR);
+            [T1,b,a,res,idx] = rdNls_mex(double(abs(data(:,order))),[],tVec,T1Vec,'Magnitude',nbrOfZoom,T1LenZ,0);
+    end
+    return;
+end
+
+T1 = zeros(nV,1); b = zeros(nV,1); a = zeros(nV,1); res = zeros(nV,1);
+if strcmp(method,'Magnitude'), idx = zeros(nV,1); else, idx = []; end
+for ii = 1:nV
+    [T1(ii),b(ii),a(ii),res(ii),idxii] = fitT1_IR(data(ii,:),T_IR,method);
+    if ~isempty(idx), idx(ii) = idxii; end
+end
+end
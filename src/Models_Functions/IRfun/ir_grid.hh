@@ -0,0 +1,303 @@
+/*
+ * ir_grid.hh: whole-volume reduced-dimension NLS grid search for the
+ * inversion recovery model a + b*exp(-TI/T1) (Barral et al., 2010).
+ *
+ * Native counterpart of rdNls.m (complex data) and rdNlsPr.m (magnitude
+ * data with polarity restoration). The T1 dictionary exp(-TI/T1), its
+ * column sums and the norms rhoNormVec are built once per protocol
+ * (IRGrid). Voxels are then processed in blocks: for a block of B signals
+ * the criterion |rho'*y|^2/||rho||^2 is evaluated for every dictionary atom
+ * as a (K x N) * (N x B) product whose inner loop runs over the B voxels,
+ * followed by a running argmax, the zoomed refinement passes and the
+ * closed-form a, b and residual.
+ *
+ * Results follow the MATLAB code: first maximum on ties, same zoom grids
+ * (linspace over the neighbouring grid points) and residual
+ * 1/sqrt(N)*norm(1 - model./data).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef IR_GRID_HH
+#define IR_GRID_HH
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace ir {
+
+struct IRGrid {
+    int N;                       // number of TIs
+    int K;                       // number of T1 atoms
+    int nbrOfZoom;               // 1: no zoom
+    int T1LenZ;                  // length of each zoomed grid
+    std::vector<double> tVec;    // TIs, in the order of the data given to fit()
+    std::vector<double> T1Vec;   // coarse T1 grid
+    std::vector<double> theExp;  // [K][N] exp(-tVec/T1Vec(k))
+    std::vector<double> expSum;  // [K] column sums of theExp
+    std::vector<double> rhoNorm; // [K] ||rho||^2 - (sum rho)^2/N
+
+    IRGrid(const double *t, int N_, const double *T1, int K_, int zoom, int lenZ)
+        : N(N_), K(K_), nbrOfZoom(zoom), T1LenZ(lenZ),
+          tVec(t, t + N_), T1Vec(T1, T1 + K_),
+          theExp((std::size_t)K_ * N_), expSum(K_), rhoNorm(K_)
+    {
+        for (int k = 0; k < K; ++k) {
+            double s = 0, s2 = 0;
+            for (int n = 0; n < N; ++n) {
+                double e = std::exp(-tVec[n] / T1Vec[k]);
+                theExp[(std::size_t)k * N + n] = e;
+                s += e;
+                s2 += e * e;
+            }
+            expSum[k] = s;
+            rhoNorm[k] = s2 - s * s / N;
+        }
+    }
+};
+
+struct Estimate {
+    double T1, res;
+    std::complex<double> a, b;
+};
+
+namespace detail {
+
+// MATLAB's linspace(a, b, n).
+inline void linspace(double a, double b, int n, double *out)
+{
+    for (int i = 0; i < n; ++i) out[i] = a + i * (b - a) / (n - 1);
+    out[n - 1] = b;
+}
+
+// Zoom passes and closed-form a, b, residual for one signal whose coarse
+// argmax is `ind`. y has N complex samples in the order of g.tVec.
+inline Estimate refine(const IRGrid &g, const std::complex<double> *y, int ind)
+{
+    const int N = g.N;
+    std::complex<double> ySum = 0;
+    for (int n = 0; n < N; ++n) ySum += y[n];
+
+    std::vector<double> T1Vec(g.T1Vec);
+    std::vector<double> sum(g.T1LenZ), norm(g.T1LenZ);
+    std::vector<std::complex<double> > rhoTy(g.T1LenZ);
+
+    // Quantities at the selected atom, for the final estimate.
+    std::complex<double> rhoTyInd;
+    double normInd, sumInd;
+    {
+        const double *e = &g.theExp[(std::size_t)ind * N];
+        std::complex<double> r = 0;
+        for (int n = 0; n < N; ++n) r += e[n] * y[n];
+        rhoTyInd = r - g.expSum[ind] * ySum / double(N);
+        normInd = g.rhoNorm[ind];
+        sumInd = g.expSum[ind];
+    }
+
+    for (int z = 2; z <= g.nbrOfZoom; ++z) {
+        const int len = static_cast<int>(T1Vec.size());
+        std::vector<double> zoomed(g.T1LenZ);
+        if (ind > 0 && ind < len - 1)
+            linspace(T1Vec[ind - 1], T1Vec[ind + 1], g.T1LenZ, zoomed.data());
+        else if (ind == 0)
+            linspace(T1Vec[0], T1Vec[std::min(2, len - 1)], g.T1LenZ, zoomed.data());
+        else
+            linspace(T1Vec[std::max(0, ind - 2)], T1Vec[ind], g.T1LenZ, zoomed.data());
+        T1Vec.swap(zoomed);
+
+        double best = -1;
+        int bestInd = 0;
+        for (int k = 0; k < g.T1LenZ; ++k) {
+            double s = 0, s2 = 0;
+            std::complex<double> r = 0;
+            for (int n = 0; n < N; ++n) {
+                double e = std::exp(-g.tVec[n] / T1Vec[k]);
+                s += e;
+                s2 += e * e;
+                r += e * y[n];
+            }
+            sum[k] = s;
+            norm[k] = s2 - s * s / N;
+            rhoTy[k] = r - s * ySum / double(N);
+            double crit = std::norm(rhoTy[k]) / norm[k];
+            if (crit > best) { best = crit; bestInd = k; }   // NaN never wins
+        }
+        ind = bestInd;
+        rhoTyInd = rhoTy[ind];
+        normInd = norm[ind];
+        sumInd = sum[ind];
+    }
+
+    Estimate est;
+    est.T1 = T1Vec[ind];
+    est.b = rhoTyInd / normInd;
+    est.a = (ySum - est.b * sumInd) / double(N);
+    double r2 = 0;
+    for (int n = 0; n < N; ++n) {
+        std::complex<double> model = est.a + est.b * std::exp(-g.tVec[n] / est.T1);
+        r2 += std::norm(1.0 - model / y[n]);
+    }
+    est.res = std::sqrt(r2) / std::sqrt(double(N));
+    return est;
+}
+
+} // namespace detail
+
+// Coarse grid search over B signals stored [N][B] (yr real part, yi
+// imaginary part or NULL). Writes the first argmax of the criterion into
+// ind[B]. `acc` is scratch of 2*B doubles.
+inline void coarseArgmax(const IRGrid &g, const double *yr, const double *yi, int B,
+                         int *ind, double *best, double *acc)
+{
+    const int N = g.N;
+    double *ar = acc, *ai = acc + B;
+    for (int b = 0; b < B; ++b) { best[b] = -1; ind[b] = 0; }
+    for (int k = 0; k < g.K; ++k) {
+        const double *e = &g.theExp[(std::size_t)k * N];
+        for (int b = 0; b < B; ++b) ar[b] = 0;
+        for (int n = 0; n < N; ++n) {
+            const double en = e[n];
+            const double *yn = yr + (std::size_t)n * B;
+            for (int b = 0; b < B; ++b) ar[b] += en * yn[b];
+        }
+        const double inv = 1.0 / g.rhoNorm[k];
+        if (yi) {
+            for (int b = 0; b < B; ++b) ai[b] = 0;
+            for (int n = 0; n < N; ++n) {
+                const double en = e[n];
+                const double *yn = yi + (std::size_t)n * B;
+                for (int b = 0; b < B; ++b) ai[b] += en * yn[b];
+            }
+            for (int b = 0; b < B; ++b) {
+                double c = (ar[b] * ar[b] + ai[b] * ai[b]) * inv;
+                if (c > best[b]) { best[b] = c; ind[b] = k; }
+            }
+        } else {
+            for (int b = 0; b < B; ++b) {
+                double c = ar[b] * ar[b] * inv;
+                if (c > best[b]) { best[b] = c; ind[b] = k; }
+            }
+        }
+    }
+}
+
+// Output arrays, nV elements each (ai/bi may be NULL for real data, idx
+// may be NULL for complex fits).
+struct Output {
+    double *T1, *br, *bi, *ar, *ai, *res, *idx;
+};
+
+// rdNls.m on nV voxels. Y is nV x N (voxels along rows), Yi its imaginary
+// part or NULL. Data are in the order of g.tVec.
+inline void fitComplex(const IRGrid &g, std::size_t nV, const double *Y, const double *Yi,
+                       const Output &out, int nthreads = 0)
+{
+    const int N = g.N, B = 64;
+    const std::size_t nBlocks = (nV + B - 1) / B;
+
+    parallel_for(nBlocks, 1, [&](std::size_t b0, std::size_t b1, int) {
+        std::vector<double> yr((std::size_t)N * B), yi(Yi ? (std::size_t)N * B : 0);
+        std::vector<double> best(B), acc(2 * B);
+        std::vector<int> ind(B);
+        std::vector<std::complex<double> > y(N);
+        for (std::size_t blk = b0; blk < b1; ++blk) {
+            const std::size_t v0 = blk * B;
+            const int nb = static_cast<int>(std::min<std::size_t>(B, nV - v0));
+            // Centered data: rho'*y - sum(rho)*sum(y)/N == rho'*(y - mean(y)).
+            for (int b = 0; b < nb; ++b) {
+                double mr = 0, mi = 0;
+                for (int n = 0; n < N; ++n) {
+                    mr += Y[v0 + b + n * nV];
+                    if (Yi) mi += Yi[v0 + b + n * nV];
+                }
+                mr /= N; mi /= N;
+                for (int n = 0; n < N; ++n) {
+                    yr[(std::size_t)n * nb + b] = Y[v0 + b + n * nV] - mr;
+                    if (Yi) yi[(std::size_t)n * nb + b] = Yi[v0 + b + n * nV] - mi;
+                }
+            }
+            coarseArgmax(g, yr.data(), Yi ? yi.data() : NULL, nb, ind.data(), best.data(), acc.data());
+            for (int b = 0; b < nb; ++b) {
+                const std::size_t v = v0 + b;
+                for (int n = 0; n < N; ++n)
+                    y[n] = std::complex<double>(Y[v + n * nV], Yi ? Yi[v + n * nV] : 0.0);
+                Estimate e = detail::refine(g, y.data(), ind[b]);
+                out.T1[v] = e.T1;
+                out.br[v] = e.b.real();
+                out.ar[v] = e.a.real();
+                if (out.bi) out.bi[v] = e.b.imag();
+                if (out.ai) out.ai[v] = e.a.imag();
+                out.res[v] = e.res;
+            }
+        }
+    }, nthreads);
+}
+
+// rdNlsPr.m on nV voxels of magnitude data. g.tVec must be sorted
+// ascending and the columns of Y given in that order.
+inline void fitMagnitude(const IRGrid &g, std::size_t nV, const double *Y,
+                         const Output &out, int nthreads = 0)
+{
+    const int N = g.N, B = 64;
+    const std::size_t nBlocks = (nV + B - 1) / B;
+
+    parallel_for(nBlocks, 1, [&](std::size_t b0, std::size_t b1, int) {
+        // Two polarity hypotheses per voxel: columns [0, nb) flip samples up
+        // to and including the minimum, [nb, 2nb) flip the ones before it.
+        std::vector<double> yc((std::size_t)N * 2 * B);
+        std::vector<double> best(2 * B), acc(4 * B);
+        std::vector<int> ind(2 * B), minInd(B);
+        std::vector<std::complex<double> > y(N);
+        for (std::size_t blk = b0; blk < b1; ++blk) {
+            const std::size_t v0 = blk * B;
+            const int nb = static_cast<int>(std::min<std::size_t>(B, nV - v0));
+            const int W = 2 * nb;
+            for (int b = 0; b < nb; ++b) {
+                const double *yv = Y + v0 + b;
+                int mi = 0;
+                for (int n = 1; n < N; ++n)
+                    if (yv[n * nV] < yv[mi * nV]) mi = n;
+                minInd[b] = mi;
+                for (int h = 0; h < 2; ++h) {
+                    const int flip = h == 0 ? mi + 1 : mi;
+                    double m = 0;
+                    for (int n = 0; n < N; ++n) m += (n < flip ? -1 : 1) * yv[n * nV];
+                    m /= N;
+                    for (int n = 0; n < N; ++n)
+                        yc[(std::size_t)n * W + h * nb + b] = (n < flip ? -1 : 1) * yv[n * nV] - m;
+                }
+            }
+            coarseArgmax(g, yc.data(), NULL, W, ind.data(), best.data(), acc.data());
+            for (int b = 0; b < nb; ++b) {
+                const std::size_t v = v0 + b;
+                Estimate e[2];
+                for (int h = 0; h < 2; ++h) {
+                    const int flip = h == 0 ? minInd[b] + 1 : minInd[b];
+                    for (int n = 0; n < N; ++n)
+                        y[n] = (n < flip ? -1.0 : 1.0) * Y[v + n * nV];
+                    e[h] = detail::refine(g, y.data(), ind[h * nb + b]);
+                }
+                // [res, ind] = min(resTmp): first minimum, NaN ignored
+                const int h = (std::isnan(e[0].res) && !std::isnan(e[1].res)) ||
+                              e[1].res < e[0].res ? 1 : 0;
+                out.T1[v] = e[h].T1;
+                out.br[v] = e[h].b.real();
+                out.ar[v] = e[h].a.real();
+                out.res[v] = e[h].res;
+                if (out.idx) out.idx[v] = h == 0 ? minInd[b] + 1 : minInd[b];
+            }
+        }
+    }, nthreads);
+}
+
+} // namespace ir
+} // namespace qmr
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * [T1, br, ar, res, idx, bi, ai] = rdNls_mex(data, dataImag, tVec, T1Vec, method, nbrOfZoom, T1LenZ, numThreads)
+ *
+ * Whole-volume RD-NLS inversion recovery fit (see ir_grid.hh). Use through
+ * fitT1_IR_batch.m.
+ *
+ *   data        nV x N real part of the data (magnitude for 'Magnitude')
+ *   dataImag    nV x N imaginary part, or [] for real data
+ *   tVec        N inversion times, in the order of the data columns.
+ *               Must be sorted ascending for 'Magnitude'.
+ *   T1Vec       coarse T1 grid
+ *   method      'Complex' (rdNls.m) or 'Magnitude' (rdNlsPr.m)
+ *   nbrOfZoom   number of grid passes (1: no zoom)
+ *   T1LenZ      length of the zoomed grids
+ *   numThreads  0: all cores
+ *
+ * All outputs are nV x 1. idx is empty for 'Complex'; bi and ai are empty
+ * unless dataImag is given.
+ *
+ * The dictionary is kept between calls and rebuilt only when tVec, T1Vec
+ * or the zoom settings change.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "ir_grid.hh"
+
+static const char *kName = "rdNls_mex";
+
+static std::unique_ptr<qmr::ir::IRGrid> gGrid;
+
+static const qmr::ir::IRGrid &grid(const std::vector<double> &t, const std::vector<double> &T1,
+                                   int zoom, int lenZ)
+{
+    if (!gGrid || gGrid->tVec != t || gGrid->T1Vec != T1 ||
+        gGrid->nbrOfZoom != zoom || gGrid->T1LenZ != lenZ)
+        gGrid.reset(new qmr::ir::IRGrid(t.data(), (int)t.size(), T1.data(), (int)T1.size(),
+                                        zoom, lenZ));
+    return *gGrid;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs != 8)
+        qmr::mex::fail(kName, "wrongNumInputs", "rdNls_mex expects 8 input arguments.");
+
+    qmr::mex::requireDouble(kName, prhs[0], "data");
+    const std::size_t nV = mxGetM(prhs[0]);
+    const int N = (int)mxGetN(prhs[0]);
+    const bool hasImag = !mxIsEmpty(prhs[1]);
+    if (hasImag) {
+        qmr::mex::requireDouble(kName, prhs[1], "dataImag");
+        if (mxGetM(prhs[1]) != nV || (int)mxGetN(prhs[1]) != N)
+            qmr::mex::fail(kName, "invalidInputSize", "dataImag must have the size of data.");
+    }
+    std::vector<double> tVec = qmr::mex::toVector(prhs[2]);
+    std::vector<double> T1Vec = qmr::mex::toVector(prhs[3]);
+    std::string method = qmr::mex::string(kName, prhs[4], "method");
+    int zoom = (int)qmr::mex::scalar(kName, prhs[5], "nbrOfZoom");
+    int lenZ = (int)qmr::mex::scalar(kName, prhs[6], "T1LenZ");
+    int nthreads = (int)qmr::mex::scalar(kName, prhs[7], "numThreads");
+
+    if ((int)tVec.size() != N)
+        qmr::mex::fail(kName, "invalidInputSize", "nlsS.N and data must be of equal length!");
+    if (T1Vec.size() < 3 || (zoom > 1 && lenZ < 2))
+        qmr::mex::fail(kName, "invalidGrid", "The T1 grid must have at least 3 points and T1LenZ at least 2.");
+
+    const bool magnitude = method == "Magnitude";
+    if (!magnitude && method != "Complex")
+        qmr::mex::fail(kName, "unknownMethod", "Unknown method '" + method + "'.");
+    if (magnitude) {
+        if (hasImag)
+            qmr::mex::fail(kName, "invalidInputType", "Magnitude fitting expects real data.");
+        for (int n = 1; n < N; ++n)
+            if (tVec[n] < tVec[n - 1])
+                qmr::mex::fail(kName, "unsortedTI", "tVec must be sorted for Magnitude fitting.");
+    }
+
+    const qmr::ir::IRGrid &g = grid(tVec, T1Vec, zoom, lenZ);
+
+    mxArray *T1 = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *br = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *ar = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *res = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *idx = mxCreateDoubleMatrix(magnitude ? nV : 0, magnitude ? 1 : 0, mxREAL);
+    mxArray *bi = mxCreateDoubleMatrix(hasImag ? nV : 0, hasImag ? 1 : 0, mxREAL);
+    mxArray *ai = mxCreateDoubleMatrix(hasImag ? nV : 0, hasImag ? 1 : 0, mxREAL);
+
+    qmr::ir::Output out;
+    out.T1 = mxGetPr(T1);
+    out.br = mxGetPr(br);
+    out.ar = mxGetPr(ar);
+    out.res = mxGetPr(res);
+    out.idx = magnitude ? mxGetPr(idx) : NULL;
+    out.bi = hasImag ? mxGetPr(bi) : NULL;
+    out.ai = hasImag ? mxGetPr(ai) : NULL;
+
+    if (magnitude)
+        qmr::ir::fitMagnitude(g, nV, mxGetPr(prhs[0]), out, nthreads);
+    else
+        qmr::ir::fitComplex(g, nV, mxGetPr(prhs[0]), hasImag ? mxGetPr(prhs[1]) : NULL,
+                            out, nthreads);
+
+    mxArray *all[7] = {T1, br, ar, res, idx, bi, ai};
+    for (int k = 0; k < 7; ++k) {
+        if (k < nlhs || k == 0) plhs[k] = all[k];
+        else mxDestroyArray(all[k]);
+    }
+}
@@ -0,0 +1,81 @@
+function [T1, MP2RAGEcor, M0] = MP2RAGE_lookupT1(UNI, MP2RAGE, invEFF, B1, INV2)
+% usage
+% [T1, MP2RAGEcor, M0] = MP2RAGE_lookupT1(UNI, MP2RAGE, invEFF, B1, INV2)
+%
+% T1 map from an MP2RAGE UNI image, with optional B1 correction, computed
+% in a single pass with the compiled lookup engine mp2rage_lut_mex.
+%
+% UNI     MP2RAGE image (0 to 4095, or -0.5 to 0.5 without B1)
+% MP2RAGE sequence structure, as for T1estimateMP2RAGE
+% invEFF  inversion efficiency
+% B1      relative B1 map, or [] (no B1 correction)
+% INV2    second inversion image, or [] (no M0)
+%
+% outputs are, with B1, those of T1B1correctpackageTFL (T1 and the
+% B1-corrected MP2RAGE image) and, without B1, those of
+% T1estimateMP2RAGE / T1M0estimateMP2RAGE (T1 and M0). T1 is in seconds.
+%
+% The (T1, B1) lookup table is built once per protocol and cached in
+% tempdir/qMRLab. Falls back to the MATLAB implementation when
+% mp2rage_lut_mex is not compiled.
+
+if nargin < 4, B1 = []; end
+if nargin < 5, INV2 = []; end
+MP2RAGEcor = [];
+M0 = [];
+
+if exist('mp2rage_lut_mex','file')~=3
+    if ~isempty(B1)
+        [T1map, MP2RAGEcorr] = T1B1correctpackageTFL(B1, struct('img',UNI), [], MP2RAGE, [], invEFF);
+        T1 = T1map.img;
+        MP2RAGEcor = MP2RAGEcorr.img;
+    elseif ~isempty(INV2)
+        [T1map, M0map] = T1M0estimateMP2RAGE(struct('img',UNI), struct('img',INV2), MP2RAGE, invEFF);
+        T1 = T1map.img;
+        M0 = M0map.img;
+    else
+        T1map = T1estimateMP2RAGE(struct('img',UNI), MP2RAGE, invEFF);
+        T1 = T1map.img;
+    end
+    return;
+end
+
+opts.CacheDir = fullfile(tempdir, 'qMRLab');
+if ~exist(opts.CacheDir, 'dir')
+    [ok, ~] = mkdir(opts.CacheDir);
+    if ~ok, opts.CacheDir = ''; end
+end
+
+if ~isempty(B1)
+    % Same B1 range checks as T1B1correctpackageTFL
+    b1med = median(prctile(B1(:),90));
+    if b1med > 5
+        warning(sprintf(['=============== mp2rage::b1correction ==========='...
+            '\n B1 data is not in [0-2] range. B1map magnitude will be scaled down.'  ...
+            '\n ===========================================================' ...
+            ]));
+        if b1med > 10 &&  b1med < 500
+            B1 = double(B1)./100;
+        elseif b1med>500 && b1med<1500
+            B1 = double(B1)./1000;
+        end
+    end
+    b1med = median(prctile(B1(:),90));
+    if ~(b1med > 0.5) && ~(b1med < 1.5)
+        warning(sprintf(['=============== mp2rage::b1correction ==========='...
+            '\n B1 data may not be in the required [0-2] range'  ...
+            '\n ===========================================================' ...
+            ]));
+    end
+    if ~isa(B1,'single'), B1 = double(B1); end
+    [T1, MP2RAGEcor] = mp2rage_lut_mex(double(UNI)/4095-0.5, B1, [], MP2RAGE, invEFF, opts);
+else
+    if max(abs(UNI(:)))>1
+        UNI = -0.5+1/4095*double(UNI);
+    elseif ~isa(UNI,'single')
+        UNI = double(UNI);
+    end
+    if ~isempty(INV2), INV2 = cast(INV2, class(UNI)); end
+    [T1, ~, M0] = mp2rage_lut_mex(UNI, [], INV2, MP2RAGE, invEFF, opts);
+end
+end
@@ -0,0 +1,358 @@
+/*
+ * mp2rage_lut.hh: MP2RAGE (T1, B1) lookup engine.
+ *
+ * Native counterpart of MPRAGEfunc.m, MP2RAGE_lookuptable.m,
+ * T1estimateMP2RAGE.m, T1M0estimateMP2RAGE.m and T1B1correctpackageTFL.m
+ * ('normal' sequence, two readouts):
+ *
+ *   - Curve: the UNI signal as a function of T1 (0.05:0.05:5 s) for one B1,
+ *     restricted to its monotone part (from the maximum to the minimum,
+ *     end points padded to +-0.5), as returned by MP2RAGE_lookuptable.
+ *   - LookupTable: the T1(B1, UNI) matrix of T1B1correctpackageTFL, built
+ *     once per protocol with the B1 rows computed in parallel. It is a
+ *     plain array of doubles so it can be kept in the qmr_cache disk cache
+ *     under Protocol::key().
+ *   - mapT1 / mapT1B1: one multithreaded pass over a volume, inverting the
+ *     monotone curve (T1estimateMP2RAGE) or interpolating the table
+ *     bilinearly (T1B1correctpackageTFL), with the same NaN and
+ *     out-of-range conventions as the MATLAB code.
+ *
+ * Grids and interpolation reproduce MATLAB's colon, linspace and linear
+ * interp1/interp2 (including interp1 sorting unsorted sample points), so
+ * results agree with the MATLAB implementation to rounding.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef MP2RAGE_LUT_HH
+#define MP2RAGE_LUT_HH
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <stdint.h>
+
+#include "qmr_cache.hh"
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace mp2rage {
+
+// Sequence parameters, in the units of the MP2RAGE structure used by
+// mp2rage.m (seconds, degrees).
+struct Protocol {
+    double TR;          // MP2RAGE TR
+    double TRFLASH;     // TR of the GRE readout
+    double TI[2];       // inversion times
+    double nZbef;       // excitations before the k-space centre
+    double nZaft;       // excitations after the k-space centre
+    double FA[2];       // flip angles of the two readouts
+    double invEff;      // inversion efficiency
+
+    uint64_t key() const
+    {
+        const double v[] = {TR, TRFLASH, TI[0], TI[1], nZbef, nZaft, FA[0], FA[1], invEff};
+        return cache::Hash().text("mp2rage_lut v1").values(v, sizeof v / sizeof v[0]).key();
+    }
+
+    // Timing check of MP2RAGE_lookuptable (otherwise the signal is 0).
+    bool validTiming() const
+    {
+        const double nZ = nZbef + nZaft;
+        return TI[1] - TI[0] >= nZ * TRFLASH && TI[0] >= nZbef * TRFLASH &&
+               TI[1] <= TR - nZaft * TRFLASH;
+    }
+};
+
+namespace detail {
+
+// MATLAB a:d:b (d > 0).
+inline std::vector<double> colon(double a, double d, double b)
+{
+    const double tol = 2.0 * DBL_EPSILON * std::max(std::fabs(a), std::fabs(b));
+    double nd = std::floor((b - a) / d + 0.5);
+    if (a + nd * d - b > tol) nd -= 1;
+    const std::size_t n = static_cast<std::size_t>(nd);
+    double c = a + nd * d;
+    if (c - b > -tol) c = b;
+    std::vector<double> v(n + 1);
+    for (std::size_t k = 0; k <= n / 2; ++k) {
+        v[k] = a + k * d;
+        v[n - k] = c - k * d;
+    }
+    if (n % 2 == 0) v[n / 2] = (a + c) / 2;
+    return v;
+}
+
+// MATLAB linspace(d1, d2, n).
+inline std::vector<double> linspace(double d1, double d2, std::size_t n)
+{
+    std::vector<double> v(n);
+    if (n == 1) { v[0] = d2; return v; }
+    for (std::size_t k = 0; k < n; ++k) v[k] = d1 + k * ((d2 - d1) / (n - 1));
+    if (n) { v[0] = d1; v[n - 1] = d2; }
+    return v;
+}
+
+// Linear interp1 on ascending x: NaN outside [x(1), x(end)].
+inline double interp1(const double *x, const double *v, std::size_t n, double xq)
+{
+    if (n < 2 || !(xq >= x[0] && xq <= x[n - 1]))
+        return (n == 1 && xq == x[0]) ? v[0] : std::numeric_limits<double>::quiet_NaN();
+    std::size_t i = std::upper_bound(x, x + n, xq) - x;
+    i = i == 0 ? 0 : std::min(i - 1, n - 2);
+    const double t = (xq - x[i]) / (x[i + 1] - x[i]);
+    return v[i] + t * (v[i + 1] - v[i]);
+}
+
+// Index of the interval of an ascending grid containing q, or -1.
+inline int interval(const std::vector<double> &g, double q)
+{
+    if (!(q >= g.front() && q <= g.back())) return -1;
+    std::size_t i = std::upper_bound(g.begin(), g.end(), q) - g.begin();
+    return static_cast<int>(i == 0 ? 0 : std::min(i - 1, g.size() - 2));
+}
+
+} // namespace detail
+
+// MPRAGEfunc for two readouts, 'normal' sequence, flip angles scaled by B1.
+inline void signal(const Protocol &p, double T1, double B1, double s[2])
+{
+    const double nZ = p.nZbef + p.nZaft;
+    const double E1 = std::exp(-p.TRFLASH / T1);
+    double ETD[3];
+    ETD[0] = std::exp(-(p.TI[0] - p.nZbef * p.TRFLASH) / T1);
+    ETD[1] = std::exp(-(p.TI[1] - p.TI[0] - nZ * p.TRFLASH) / T1);
+    ETD[2] = std::exp(-(p.TR - p.TI[1] - p.nZaft * p.TRFLASH) / T1);
+    double cosE1[2], sina[2];
+    for (int k = 0; k < 2; ++k) {
+        const double a = B1 * p.FA[k] / 180 * 3.14159265358979323846;
+        cosE1[k] = std::cos(a) * E1;
+        sina[k] = std::sin(a);
+    }
+
+    // Steady state longitudinal magnetization before the inversion.
+    double mz = 1 / (1 + p.invEff * std::pow(cosE1[0] * cosE1[1], nZ) * ETD[0] * ETD[1] * ETD[2]);
+    double num = 1 - ETD[0];
+    for (int k = 0; k < 2; ++k) {
+        const double c = std::pow(cosE1[k], nZ);
+        num = num * c + (1 - E1) * (1 - c) / (1 - cosE1[k]);
+        num = num * ETD[k + 1] + (1 - ETD[k + 1]);
+    }
+    mz *= num;
+
+    double c = std::pow(cosE1[0], p.nZbef);
+    double temp = (-p.invEff * mz * ETD[0] + (1 - ETD[0])) * c + (1 - E1) * (1 - c) / (1 - cosE1[0]);
+    s[0] = sina[0] * temp;
+    c = std::pow(cosE1[0], p.nZaft);
+    temp = temp * c + (1 - E1) * (1 - c) / (1 - cosE1[0]);
+    c = std::pow(cosE1[1], p.nZbef);
+    temp = (temp * ETD[1] + (1 - ETD[1])) * c + (1 - E1) * (1 - c) / (1 - cosE1[1]);
+    s[1] = sina[1] * temp;
+}
+
+// Monotone part of the UNI(T1) curve for one B1 (MP2RAGE_lookuptable).
+struct Curve {
+    std::vector<double> T1;   // ascending
+    std::vector<double> UNI;  // descending, padded to [0.5 ... -0.5]
+    std::vector<double> S1;   // uncombined readouts (IntensityBeforeComb)
+    std::vector<double> S2;
+
+    bool valid() const { return T1.size() >= 2; }
+};
+
+inline Curve curve(const Protocol &p, double B1)
+{
+    const std::vector<double> T1 = detail::colon(0.05, 0.05, 5);
+    const std::size_t n = T1.size();
+    std::vector<double> uni(n), s1(n), s2(n);
+    const bool timing = p.validTiming();
+    for (std::size_t j = 0; j < n; ++j) {
+        double s[2] = {0, 0};
+        if (timing) signal(p, T1[j], B1, s);
+        s1[j] = s[0];
+        s2[j] = s[1];
+        uni[j] = s[0] * s[1] / (s[0] * s[0] + s[1] * s[1]);
+    }
+    // First maximum and first minimum, ignoring NaN (MATLAB max/min).
+    std::size_t iMax = 0, iMin = 0;
+    bool any = false;
+    for (std::size_t j = 0; j < n; ++j) {
+        if (std::isnan(uni[j])) continue;
+        if (!any) { iMax = iMin = j; any = true; continue; }
+        if (uni[j] > uni[iMax]) iMax = j;
+        if (uni[j] < uni[iMin]) iMin = j;
+    }
+    Curve c;
+    if (!any || iMin <= iMax) return c;
+    c.T1.assign(T1.begin() + iMax, T1.begin() + iMin + 1);
+    c.UNI.assign(uni.begin() + iMax, uni.begin() + iMin + 1);
+    c.S1.assign(s1.begin() + iMax, s1.begin() + iMin + 1);
+    c.S2.assign(s2.begin() + iMax, s2.begin() + iMin + 1);
+    c.UNI.front() = 0.5;
+    c.UNI.back() = -0.5;
+    return c;
+}
+
+class LookupTable {
+public:
+    // Grids of T1B1correctpackageTFL.
+    LookupTable()
+        : B1(detail::colon(0.005, 0.05, 1.9)), T1(detail::colon(0.5, 0.05, 5.2)),
+          UNI(detail::linspace(-0.5, 0.5, 40)) {}
+
+    // Builds the table for protocol p (B1 rows in parallel).
+    void build(const Protocol &p, int nthreads = 0)
+    {
+        base = curve(p, 1);
+        T1matrix.assign(B1.size() * UNI.size(), 0);
+        parallel_for(B1.size(), 1, [&](std::size_t k0, std::size_t k1, int) {
+            std::vector<double> row(T1.size());
+            for (std::size_t k = k0; k < k1; ++k) buildRow(curve(p, B1[k]), row, k);
+        }, nthreads);
+    }
+
+    // T1 at (uni, b1) by bilinear interpolation (interp2), NaN outside.
+    double T1B1(double uni, double b1) const
+    {
+        const int i = detail::interval(UNI, uni), k = detail::interval(B1, b1);
+        if (i < 0 || k < 0) return std::numeric_limits<double>::quiet_NaN();
+        const std::size_t nU = UNI.size();
+        const double tx = (uni - UNI[i]) / (UNI[i + 1] - UNI[i]);
+        const double ty = (b1 - B1[k]) / (B1[k + 1] - B1[k]);
+        const double *r0 = &T1matrix[k * nU], *r1 = &T1matrix[(k + 1) * nU];
+        return (1 - ty) * ((1 - tx) * r0[i] + tx * r0[i + 1]) +
+               ty * ((1 - tx) * r1[i] + tx * r1[i + 1]);
+    }
+
+    // T1 from the B1 = 1 curve (T1estimateMP2RAGE), NaN outside.
+    double T1fromUNI(double uni) const
+    {
+        // interp1 sorts the descending curve: search it reversed.
+        const std::vector<double> &u = base.UNI;
+        const std::size_t n = u.size();
+        if (n < 2 || !(uni >= u[n - 1] && uni <= u[0]))
+            return std::numeric_limits<double>::quiet_NaN();
+        std::size_t i = std::upper_bound(u.rbegin(), u.rend(), uni) - u.rbegin();
+        i = std::min(i - 1, n - 2);
+        const std::size_t j0 = n - 1 - i, j1 = j0 - 1;   // u[j0] <= uni <= u[j1]
+        const double t = (uni - u[j0]) / (u[j1] - u[j0]);
+        return base.T1[j0] + t * (base.T1[j1] - base.T1[j0]);
+    }
+
+    // UNI and second readout of the B1 = 1 curve at T1 (NaN outside).
+    double UNIfromT1(double t1) const
+    {
+        return detail::interp1(base.T1.data(), base.UNI.data(), base.T1.size(), t1);
+    }
+    double S2fromT1(double t1) const
+    {
+        return detail::interp1(base.T1.data(), base.S2.data(), base.T1.size(), t1);
+    }
+
+    // Flat representation for the disk cache.
+    std::vector<double> serialize() const
+    {
+        std::vector<double> d(1, static_cast<double>(base.T1.size()));
+        d.insert(d.end(), base.T1.begin(), base.T1.end());
+        d.insert(d.end(), base.UNI.begin(), base.UNI.end());
+        d.insert(d.end(), base.S1.begin(), base.S1.end());
+        d.insert(d.end(), base.S2.begin(), base.S2.end());
+        d.insert(d.end(), T1matrix.begin(), T1matrix.end());
+        return d;
+    }
+    bool deserialize(const std::vector<double> &d)
+    {
+        if (d.empty()) return false;
+        const std::size_t n = static_cast<std::size_t>(d[0]);
+        if (d.size() != 1 + 4 * n + B1.size() * UNI.size()) return false;
+        const double *p = &d[1];
+        base.T1.assign(p, p + n); p += n;
+        base.UNI.assign(p, p + n); p += n;
+        base.S1.assign(p, p + n); p += n;
+        base.S2.assign(p, p + n); p += n;
+        T1matrix.assign(p, p + B1.size() * UNI.size());
+        return true;
+    }
+
+    std::vector<double> B1, T1, UNI;
+    Curve base;
+    std::vector<double> T1matrix;   // B1.size() x UNI.size(), row-major
+
+private:
+    void buildRow(const Curve &c, std::vector<double> &row, std::size_t k)
+    {
+        // MP2RAGEmatrix(k,:) = interp1(T1vector, Intensity, T1_vector)
+        std::size_t nNaN = 0;
+        for (std::size_t t = 0; t < T1.size(); ++t) {
+            row[t] = c.valid() ? detail::interp1(c.T1.data(), c.UNI.data(), c.T1.size(), T1[t])
+                               : std::numeric_limits<double>::quiet_NaN();
+            if (std::isnan(row[t])) ++nNaN;
+        }
+        // T1matrix(k,:): NaN entries replaced by linspace(-0.5-eps,-1,nNaN),
+        // then interp1(row, T1_vector, MP2RAGE_vector) with sorted samples.
+        std::vector<double> fill = detail::linspace(-0.5 - DBL_EPSILON, -1, nNaN);
+        for (std::size_t t = 0, f = 0; t < T1.size(); ++t)
+            if (std::isnan(row[t])) row[t] = fill[f++];
+        std::vector<std::size_t> order(T1.size());
+        std::iota(order.begin(), order.end(), std::size_t(0));
+        std::stable_sort(order.begin(), order.end(),
+                         [&](std::size_t a, std::size_t b) { return row[a] < row[b]; });
+        std::vector<double> x(T1.size()), v(T1.size());
+        for (std::size_t t = 0; t < T1.size(); ++t) { x[t] = row[order[t]]; v[t] = T1[order[t]]; }
+        double *out = &T1matrix[k * UNI.size()];
+        for (std::size_t q = 0; q < UNI.size(); ++q)
+            out[q] = detail::interp1(x.data(), v.data(), x.size(), UNI[q]);
+    }
+};
+
+// T1estimateMP2RAGE / T1M0estimateMP2RAGE on n voxels. uni in [-0.5 0.5];
+// inv2 and M0 may be NULL. T1 outside the curve is 0.
+template <class In>
+void mapT1(const LookupTable &lut, std::size_t n, const In *uni, const In *inv2,
+           double *T1, double *M0, int nthreads = 0)
+{
+    parallel_for(n, 4096, [&](std::size_t v0, std::size_t v1, int) {
+        for (std::size_t v = v0; v < v1; ++v) {
+            double t1 = lut.T1fromUNI(static_cast<double>(uni[v]));
+            if (std::isnan(t1)) t1 = 0;
+            T1[v] = t1;
+            if (M0 && inv2) M0[v] = static_cast<double>(inv2[v]) / lut.S2fromT1(t1);
+        }
+    }, nthreads);
+}
+
+// T1B1correctpackageTFL on n voxels. uni in [-0.5 0.5], b1 relative.
+// Voxels with b1 == 0 or uni == 0 get T1 = 0; values outside the table get
+// T1 = 4 s. UNIcor (may be NULL) is the B1-corrected UNI image (0..4095).
+template <class InU, class InB>
+void mapT1B1(const LookupTable &lut, std::size_t n, const InU *uni, const InB *b1,
+             double *T1, double *UNIcor, int nthreads = 0)
+{
+    parallel_for(n, 4096, [&](std::size_t v0, std::size_t v1, int) {
+        for (std::size_t v = v0; v < v1; ++v) {
+            const double u = static_cast<double>(uni[v]), b = static_cast<double>(b1[v]);
+            double t1 = 0;
+            if (b != 0 && u != 0) {
+                t1 = lut.T1B1(u, b);
+                if (std::isnan(t1)) t1 = 4;
+            }
+            T1[v] = t1;
+            if (UNIcor) {
+                double c = lut.UNIfromT1(t1);
+                if (std::isnan(c)) c = -0.5;
+                UNIcor[v] = std::round(4095 * (c + 0.5));
+            }
+        }
+    }, nthreads);
+}
+
+} // namespace mp2rage
+} // namespace qmr
+
+#endif
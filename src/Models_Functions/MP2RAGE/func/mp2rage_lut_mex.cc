@@ -0,0 +1,165 @@
+/*
+ * [T1, MP2RAGEcor, M0] = mp2rage_lut_mex(UNI, B1, INV2, MP2RAGE, invEFF, opts)
+ *
+ * Whole-volume MP2RAGE T1 mapping from lookup tables (see mp2rage_lut.hh).
+ * Use through MP2RAGE_lookupT1.m.
+ *
+ *   UNI      MP2RAGE image scaled to [-0.5 0.5] (double or single)
+ *   B1       relative B1 map of the size of UNI, or [] for no correction
+ *   INV2     second inversion image for M0, or []
+ *   MP2RAGE  sequence structure (TR, TRFLASH, TIs, NZslices, FlipDegrees)
+ *   invEFF   inversion efficiency
+ *   opts     optional struct: CacheDir (folder for the table cache, '' to
+ *            disable), NumThreads (0: all cores)
+ *
+ * With B1, T1 and MP2RAGEcor follow T1B1correctpackageTFL; otherwise T1
+ * and M0 follow T1estimateMP2RAGE / T1M0estimateMP2RAGE. Outputs have the
+ * size of UNI; MP2RAGEcor is empty without B1 and M0 is empty without INV2.
+ *
+ * The (T1, B1) table is kept between calls and, when CacheDir is set,
+ * stored on disk under a hash of the protocol.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "mp2rage_lut.hh"
+
+static const char *kName = "mp2rage_lut_mex";
+
+static std::unique_ptr<qmr::mp2rage::LookupTable> gTable;
+static uint64_t gKey = 0;
+
+static double field(const mxArray *s, const char *name, std::vector<double> &v, std::size_t n)
+{
+    const mxArray *f = mxGetField(s, 0, name);
+    if (!f) qmr::mex::fail(kName, "invalidProtocol", std::string("MP2RAGE.") + name + " is missing.");
+    v = qmr::mex::toVector(f);
+    if (v.size() < 1 || v.size() > n)
+        qmr::mex::fail(kName, "invalidProtocol", std::string("MP2RAGE.") + name + " has the wrong size.");
+    return v[0];
+}
+
+static qmr::mp2rage::Protocol protocol(const mxArray *s, double invEff)
+{
+    if (!mxIsStruct(s)) qmr::mex::fail(kName, "invalidProtocol", "MP2RAGE must be a structure.");
+    qmr::mp2rage::Protocol p;
+    std::vector<double> v;
+    p.TR = field(s, "TR", v, 1);
+    p.TRFLASH = field(s, "TRFLASH", v, 1);
+    field(s, "TIs", v, 2);
+    if (v.size() != 2) qmr::mex::fail(kName, "invalidProtocol", "MP2RAGE.TIs must have 2 elements.");
+    p.TI[0] = v[0]; p.TI[1] = v[1];
+    field(s, "FlipDegrees", v, 2);
+    if (v.size() != 2) qmr::mex::fail(kName, "invalidProtocol", "MP2RAGE.FlipDegrees must have 2 elements.");
+    p.FA[0] = v[0]; p.FA[1] = v[1];
+    field(s, "NZslices", v, 2);
+    if (v.size() == 2) { p.nZbef = v[0]; p.nZaft = v[1]; }
+    else { p.nZbef = p.nZaft = v[0] / 2; }
+    p.invEff = invEff;
+    return p;
+}
+
+static const qmr::mp2rage::LookupTable &table(const qmr::mp2rage::Protocol &p,
+                                              const std::string &cacheDir, int nthreads)
+{
+    const uint64_t key = p.key();
+    if (gTable && gKey == key) return *gTable;
+
+    std::unique_ptr<qmr::mp2rage::LookupTable> t(new qmr::mp2rage::LookupTable);
+    std::vector<double> blob;
+    if (!(qmr::cache::load(cacheDir, "mp2rage_lut", key, blob) && t->deserialize(blob))) {
+        t->build(p, nthreads);
+        if (!t->base.valid())
+            qmr::mex::fail(kName, "invalidProtocol",
+                           "The MP2RAGE protocol gives no monotonic signal curve (check TIs, TR and NZslices).");
+        qmr::cache::store(cacheDir, "mp2rage_lut", key, t->serialize());
+    }
+    gTable.swap(t);
+    gKey = key;
+    return *gTable;
+}
+
+static void requireReal(const mxArray *a, const char *argName)
+{
+    if (!(mxIsDouble(a) || mxIsSingle(a)) || mxIsComplex(a) || mxIsSparse(a))
+        qmr::mex::fail(kName, "invalidInputType",
+                       std::string(argName) + " must be a real double or single array.");
+}
+
+template <class T>
+static const T *data(const mxArray *a) { return static_cast<const T *>(mxGetData(a)); }
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 5 || nrhs > 6)
+        qmr::mex::fail(kName, "wrongNumInputs", "mp2rage_lut_mex expects 5 or 6 input arguments.");
+
+    const mxArray *uni = prhs[0], *b1 = prhs[1], *inv2 = prhs[2];
+    requireReal(uni, "UNI");
+    const std::size_t n = mxGetNumberOfElements(uni);
+    const bool hasB1 = !mxIsEmpty(b1), hasInv2 = !mxIsEmpty(inv2);
+    if (hasB1) {
+        requireReal(b1, "B1");
+        if (mxGetNumberOfElements(b1) != n)
+            qmr::mex::fail(kName, "invalidInputSize", "B1 must have the size of UNI.");
+    }
+    if (hasInv2) {
+        requireReal(inv2, "INV2");
+        if (mxGetNumberOfElements(inv2) != n)
+            qmr::mex::fail(kName, "invalidInputSize", "INV2 must have the size of UNI.");
+    }
+    const double invEff = qmr::mex::scalar(kName, prhs[4], "invEFF");
+    const qmr::mp2rage::Protocol p = protocol(prhs[3], invEff);
+
+    const mxArray *opts = nrhs > 5 ? prhs[5] : NULL;
+    const std::string cacheDir = qmr::mex::option(opts, "CacheDir", std::string());
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    const qmr::mp2rage::LookupTable &lut = table(p, cacheDir, nthreads);
+
+    const mwSize nd = mxGetNumberOfDimensions(uni);
+    const mwSize *dims = mxGetDimensions(uni);
+    mxArray *T1 = mxCreateNumericArray(nd, dims, mxDOUBLE_CLASS, mxREAL);
+    mxArray *UNIcor = hasB1 && nlhs > 1 ? mxCreateNumericArray(nd, dims, mxDOUBLE_CLASS, mxREAL)
+                                        : mxCreateDoubleMatrix(0, 0, mxREAL);
+    mxArray *M0 = !hasB1 && hasInv2 && nlhs > 2
+                      ? mxCreateNumericArray(nd, dims, mxDOUBLE_CLASS, mxREAL)
+                      : mxCreateDoubleMatrix(0, 0, mxREAL);
+    double *pT1 = mxGetPr(T1);
+    double *pCor = mxIsEmpty(UNIcor) ? NULL : mxGetPr(UNIcor);
+    double *pM0 = mxIsEmpty(M0) ? NULL : mxGetPr(M0);
+
+    const bool uniSingle = mxIsSingle(uni);
+    if (hasB1) {
+        const bool b1Single = mxIsSingle(b1);
+        if (uniSingle && b1Single)
+            qmr::mp2rage::mapT1B1(lut, n, data<float>(uni), data<float>(b1), pT1, pCor, nthreads);
+        else if (uniSingle)
+            qmr::mp2rage::mapT1B1(lut, n, data<float>(uni), data<double>(b1), pT1, pCor, nthreads);
+        else if (b1Single)
+            qmr::mp2rage::mapT1B1(lut, n, data<double>(uni), data<float>(b1), pT1, pCor, nthreads);
+        else
+            qmr::mp2rage::mapT1B1(lut, n, data<double>(uni), data<double>(b1), pT1, pCor, nthreads);
+    } else {
+        if (pM0 && mxIsSingle(inv2) != uniSingle)
+            qmr::mex::fail(kName, "invalidInputType", "UNI and INV2 must have the same class.");
+        if (uniSingle)
+            qmr::mp2rage::mapT1(lut, n, data<float>(uni), pM0 ? data<float>(inv2) : (const float *)NULL,
+                                pT1, pM0, nthreads);
+        else
+            qmr::mp2rage::mapT1(lut, n, data<double>(uni), pM0 ? data<double>(inv2) : (const double *)NULL,
+                                pT1, pM0, nthreads);
+    }
+
+    mxArray *all[3] = {T1, UNIcor, M0};
+    for (int k = 0; k < 3; ++k) {
+        if (k < nlhs || k == 0) plhs[k] = all[k];
+        else mxDestroyArray(all[k]);
+    }
+}
@@ -5,6 +5,22 @@ function [MTsat, R1] = MTSAT_exec(data, MTParams, PDParams, T1Params, B1Params)
 % according to Helms et al., MRM, 60:1396?1407 (2008) and equation erratum in MRM, 64:1856 (2010).
 %   This function computes R1 maps and includes it in the MT saturation map calculation.
 
+% Compiled closed-form kernel (qmr_maps_mex): single pass over the volume,
+% single-precision data stays single
+if exist('qmr_maps_mex','file')==3
+    B1 = []; Mask = [];
+    if isfield(data,'B1map') && ~isempty(data.B1map)
+        if any(size(data.B1map) ~= size(data.MTw)), error('\nError in MTSAT_exec.m: B1 map dimension different from volume dimension.\n'); end
+        B1 = data.B1map;
+    end
+    if isfield(data,'Mask') && ~isempty(data.Mask)
+        if any(size(data.Mask) ~= size(data.MTw)), error('\nError in MTSAT_exec.m: Mask dimension different from volume dimension.\n'); end
+        Mask = data.Mask;
+    end
+    [MTsat, R1] = qmr_maps_mex('mtsat', data.MTw, data.T1w, data.PDw, B1, Mask, MTParams, PDParams, T1Params, B1Params(1));
+    return;
+end
+
 % Load nii
 PDw_data = double(data.PDw); % convert data coding to double
 T1w_data = double(data.T1w); % convert data coding to double
@@ -32,6 +32,12 @@ end
 if length(b1Map) ~= length(data(:,:,:,1)), error('B1 size is different from data size'); end
 if ~islogical(roi), roi = logical(roi); end
 
+% Compiled closed-form kernel (qmr_maps_mex): same fit in a single pass
+if exist('qmr_maps_mex','file')==3
+    [T1, M0] = qmr_maps_mex('vfa', data, flipAngles, TR, b1Map, roi);
+    return;
+end
+
 % Reshape data into 2D array so that future steps are simpler
 data = reshape(data,[nVox nFlip])'; % Transpose because MATLAB is column-major
 data = data(:, roi(:));
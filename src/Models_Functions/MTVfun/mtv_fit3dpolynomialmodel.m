@@ -2,6 +2,12 @@ function data_smooth = mtv_fit3dpolynomialmodel(data,mask,order)
 % data_smooth = mtv_fit3dpolynomialmodel(data,mask,order)
 % EXAMPLE: b1Map_smooth = mtv_fit3dpolynomialmodel(load_nii_data('b1_reslice.nii'),~~load_nii_data('b1_reslice.nii'),5)
 mask = mask & ~isinf(data) & ~isnan(data);
+% Compiled engine (qMRbuildMex): no design matrix, any order
+if exist('polyfit3d_mex','file')==3 && ndims(data)<=3
+    data_smooth = polyfit3d_mex(double(data),mask,0:order,'total');
+    if isa(data,'single'), data_smooth = single(data_smooth); end
+    return
+end
 if length(size(data))==3
     [params,~,~,basis] = fit3dpolynomialmodel(data,mask,order);
     basis = constructpolynomialmatrix3d(size(data),find(ones(size(data))),order);
@@ -0,0 +1,221 @@
+/*
+ * ordfilt3D.hh: 3-D order-statistic filtering over an arbitrary kernel
+ * (ordfilt3D.m generalized beyond the 3 x 3 x 3 neighbourhood).
+ *
+ * The kernel is a mask with odd sizes centred on the voxel (a box, a
+ * sphere...). Values outside the volume follow padarray: 'replicate',
+ * 'symmetric', 'circular' or a constant. Padding goes through per-axis
+ * index maps, so no padded copy of the volume is made, and a thread only
+ * holds one neighbourhood or one histogram.
+ *
+ * 8- and 16-bit integer data (and logical) use Huang's sliding histogram
+ * along the first dimension: moving one voxel removes the values leaving
+ * each kernel row and adds those entering it, and the order statistic is
+ * read from a two-level histogram (coarse buckets, then bins). Other data
+ * gather the neighbourhood and select with nth_element; NaNs sort last,
+ * as with sort. Rows (j, k) are spread over threads.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef ORDFILT3D_HH
+#define ORDFILT3D_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace ordfilt {
+
+enum PadMode { kReplicate, kSymmetric, kCircular, kConstant };
+
+// Kernel offsets, from a column-major m1 x m2 x m3 mask with odd sizes.
+struct Kernel {
+    int r[3];                        // half sizes
+    std::vector<int> di, dj, dk;     // offsets of the voxels of the mask
+    // Runs of consecutive di at fixed (dj, dk), for the sliding histogram.
+    struct Run { int dj, dk, lo, hi; };
+    std::vector<Run> runs;
+
+    Kernel(const unsigned char *mask, const std::size_t m[3])
+    {
+        for (int a = 0; a < 3; ++a) r[a] = (int)(m[a] - 1) / 2;
+        for (std::size_t k = 0; k < m[2]; ++k)
+            for (std::size_t j = 0; j < m[1]; ++j) {
+                int start = -1;
+                for (std::size_t i = 0; i <= m[0]; ++i) {
+                    const bool in = i < m[0] && mask[i + m[0] * (j + m[1] * k)];
+                    if (in) {
+                        di.push_back((int)i - r[0]);
+                        dj.push_back((int)j - r[1]);
+                        dk.push_back((int)k - r[2]);
+                        if (start < 0) start = (int)i;
+                    } else if (start >= 0) {
+                        Run run = {(int)j - r[1], (int)k - r[2], start - r[0], (int)i - 1 - r[0]};
+                        runs.push_back(run);
+                        start = -1;
+                    }
+                }
+            }
+    }
+
+    std::size_t size() const { return di.size(); }
+};
+
+namespace detail {
+
+// Source index of i in [0, n) after padding, -1 for the constant.
+inline long padIndex(long i, long n, PadMode mode)
+{
+    if (i >= 0 && i < n) return i;
+    switch (mode) {
+    case kReplicate: return i < 0 ? 0 : n - 1;
+    case kCircular: return ((i % n) + n) % n;
+    case kSymmetric: {
+        const long m = ((i % (2 * n)) + 2 * n) % (2 * n);
+        return m < n ? m : 2 * n - 1 - m;
+    }
+    default: return -1;
+    }
+}
+
+template <typename T>
+inline bool isNan(T v) { return v != v; }
+
+// Counts of the 2^8 or 2^16 values of an 8- or 16-bit type.
+template <typename T>
+struct Histogram {
+    static const unsigned kBits = sizeof(T) <= 2 ? sizeof(T) * 8 : 8, kFineBits = kBits / 2;
+    std::vector<unsigned> bins, coarse;
+
+    Histogram() : bins(std::size_t(1) << kBits), coarse(std::size_t(1) << (kBits - kFineBits)) {}
+
+    static unsigned bin(T v) { return (unsigned)((long)v - (long)std::numeric_limits<T>::min()); }
+
+    void add(T v)
+    {
+        const unsigned b = bin(v);
+        ++bins[b];
+        ++coarse[b >> kFineBits];
+    }
+
+    void remove(T v)
+    {
+        const unsigned b = bin(v);
+        --bins[b];
+        --coarse[b >> kFineBits];
+    }
+
+    // k-th smallest value (1-based) of the n values held.
+    T select(std::size_t k) const
+    {
+        std::size_t c = 0, b = 0;
+        while (c + coarse[b] < k) c += coarse[b++];
+        b <<= kFineBits;
+        while (c + bins[b] < k) c += bins[b++];
+        return (T)((long)b + (long)std::numeric_limits<T>::min());
+    }
+};
+
+} // namespace detail
+
+// out (n1 x n2 x n3 x numel(ord)) = ord-th smallest value over the kernel
+// around each voxel of V. ord is 1-based, in [1, kernel.size()].
+template <typename T>
+void filter(const T *V, const std::size_t n[3], const Kernel &kernel, const std::vector<std::size_t> &ord,
+            PadMode mode, T padValue, T *out, int nthreads = 0)
+{
+    const long n1 = (long)n[0], n2 = (long)n[1], n3 = (long)n[2];
+    const std::size_t nvox = n[0] * n[1] * n[2], K = kernel.size();
+    const long r0 = kernel.r[0], r1 = kernel.r[1], r2 = kernel.r[2];
+
+    // Index maps over [-r, n + r) of each axis
+    std::vector<long> map0(n1 + 2 * r0), map1(n2 + 2 * r1), map2(n3 + 2 * r2);
+    for (long i = -r0; i < n1 + r0; ++i) map0[i + r0] = detail::padIndex(i, n1, mode);
+    for (long j = -r1; j < n2 + r1; ++j) map1[j + r1] = detail::padIndex(j, n2, mode);
+    for (long k = -r2; k < n3 + r2; ++k) map2[k + r2] = detail::padIndex(k, n3, mode);
+
+    // Orders processed in ascending order (successive nth_element ranges)
+    std::vector<std::size_t> rank(ord.size());
+    for (std::size_t o = 0; o < ord.size(); ++o) rank[o] = o;
+    std::sort(rank.begin(), rank.end(), [&](std::size_t a, std::size_t b) { return ord[a] < ord[b]; });
+
+    const bool integer = std::numeric_limits<T>::is_integer && sizeof(T) <= 2;
+    const bool sliding = integer && (sizeof(T) == 1 || K >= 64);
+    std::vector<long> lin(K);
+    for (std::size_t q = 0; q < K; ++q) lin[q] = kernel.di[q] + n1 * (kernel.dj[q] + n2 * kernel.dk[q]);
+
+    const std::size_t rows = (std::size_t)(n2 * n3);
+    parallel_for(rows, std::max<std::size_t>(1, (std::size_t)n2), [&](std::size_t b, std::size_t e, int) {
+        std::vector<T> vals(sliding ? 0 : K);
+        std::vector<long> rowBase(kernel.runs.size());
+        std::vector<detail::Histogram<T> > hist(sliding ? 1 : 0);
+        for (std::size_t row = b; row < e; ++row) {
+            const long j = (long)row % n2, k = (long)row / n2;
+            T *o = out + row * n1;
+            if (sliding) {
+                // Linear index of each kernel row, -1 when it lies in the constant padding
+                for (std::size_t q = 0; q < kernel.runs.size(); ++q) {
+                    const long mj = map1[j + kernel.runs[q].dj + r1], mk = map2[k + kernel.runs[q].dk + r2];
+                    rowBase[q] = mj < 0 || mk < 0 ? -1 : n1 * (mj + n2 * mk);
+                }
+                auto get = [&](std::size_t q, long i) {
+                    const long mi = map0[i + r0];
+                    return rowBase[q] < 0 || mi < 0 ? padValue : V[rowBase[q] + mi];
+                };
+                for (std::size_t q = 0; q < kernel.runs.size(); ++q)
+                    for (long i = kernel.runs[q].lo; i <= kernel.runs[q].hi; ++i) hist[0].add(get(q, i));
+                for (long x = 0;; ++x) {
+                    for (std::size_t t = 0; t < ord.size(); ++t) o[x + nvox * t] = hist[0].select(ord[t]);
+                    if (x + 1 == n1) break;
+                    for (std::size_t q = 0; q < kernel.runs.size(); ++q) {
+                        hist[0].remove(get(q, x + kernel.runs[q].lo));
+                        hist[0].add(get(q, x + 1 + kernel.runs[q].hi));
+                    }
+                }
+                for (std::size_t q = 0; q < kernel.runs.size(); ++q)
+                    for (long i = kernel.runs[q].lo; i <= kernel.runs[q].hi; ++i) hist[0].remove(get(q, n1 - 1 + i));
+                continue;
+            }
+            const bool innerRow = j >= r1 && j < n2 - r1 && k >= r2 && k < n3 - r2;
+            for (long x = 0; x < n1; ++x) {
+                std::size_t nv = 0;
+                if (innerRow && x >= r0 && x < n1 - r0) {
+                    const T *c = V + (x + n1 * (j + n2 * k));
+                    for (std::size_t q = 0; q < K; ++q) {
+                        const T v = c[lin[q]];
+                        if (!detail::isNan(v)) vals[nv++] = v;
+                    }
+                } else {
+                    for (std::size_t q = 0; q < K; ++q) {
+                        const long mi = map0[x + kernel.di[q] + r0], mj = map1[j + kernel.dj[q] + r1],
+                                   mk = map2[k + kernel.dk[q] + r2];
+                        const T v = mi < 0 || mj < 0 || mk < 0 ? padValue : V[mi + n1 * (mj + n2 * mk)];
+                        if (!detail::isNan(v)) vals[nv++] = v;
+                    }
+                }
+                std::size_t from = 0;
+                for (std::size_t t = 0; t < rank.size(); ++t) {
+                    const std::size_t p = ord[rank[t]] - 1;
+                    T v = std::numeric_limits<T>::quiet_NaN();
+                    if (p < nv) {
+                        if (p >= from) std::nth_element(vals.begin() + from, vals.begin() + p, vals.begin() + nv);
+                        v = vals[p];
+                        from = p + 1;
+                    }
+                    o[x + nvox * rank[t]] = v;
+                }
+            }
+        }
+    }, nthreads);
+}
+
+} // namespace ordfilt
+} // namespace qmr
+
+#endif
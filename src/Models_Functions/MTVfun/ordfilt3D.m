@@ -1,4 +1,4 @@
-function [Vr] = ordfilt3D(V0,ord,padoption)
+function [Vr] = ordfilt3D(V0,ord,padoption,kernel)
 % Perform 3-D order-statistic filtering on 26 neighbors
 %
 %   [Vr] = ordfilt3D(V0,ord,padoption)
@@ -8,10 +8,27 @@ function [Vr] = ordfilt3D(V0,ord,padoption)
 %       ord = [1 27] <=> [min max]
 %       padoption: same as in padarray
 %
+%   [Vr] = ordfilt3D(V0,ord,padoption,kernel)
+%          use the voxels of a mask with odd sizes centred on each voxel
+%          (requires ordfilt3D_mex), e.g. a sphere of radius 2:
+%       [x,y,z] = ndgrid(-2:2); kernel = x.^2+y.^2+z.^2<=4;
+%       ord = (nnz(kernel)+1)/2 <=> median filtering
+%
 % Olivier Salvado, Case Western Reserve University, 16Aug04
 
 %% Input argument
 if ~exist('padoption','var'), padoption = 'replicate'; end
+if ~exist('kernel','var'), kernel = []; end
+
+% Compiled engine (qMRbuildMex): no 4-D neighbourhood array
+if exist('ordfilt3D_mex','file')==3
+    Vr = ordfilt3D_mex(V0,ord,kernel,padoption);
+    if ~isa(V0,'uint8'), Vr = single(Vr); end
+    return
+end
+if ~isempty(kernel)
+    error('ordfilt3D:noMex','A custom kernel requires ordfilt3D_mex (run qMRbuildMex).');
+end
 
 %%
 % special care for uint8
@@ -0,0 +1,137 @@
+/*
+ * Vr = ordfilt3D_mex(V, ord, kernel, pad, opts)
+ *
+ * 3-D order-statistic filter (see ordfilt3D.hh). Use through ordfilt3D.m.
+ *
+ *   V       real numeric or logical volume (2D or 3D)
+ *   ord     order(s) to return, 1 = min, numel(kernel) = max
+ *   kernel  mask with odd sizes (box, sphere...), or [] for the 3 x 3 x 3
+ *           neighbourhood of ordfilt3D
+ *   pad     'replicate', 'symmetric', 'circular' or a scalar, as padarray
+ *   opts    optional struct: NumThreads (0: all cores)
+ *
+ * Vr has the class of V, and one volume per order along dim 4.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "ordfilt3D.hh"
+
+static const char *kName = "ordfilt3D_mex";
+
+namespace {
+
+// padarray's conversion of the padding value to the class of V
+template <typename T>
+T padValue(double v)
+{
+    if (!std::numeric_limits<T>::is_integer) return (T)v;
+    if (std::isnan(v)) return 0;
+    v = v < 0 ? std::ceil(v - 0.5) : std::floor(v + 0.5);
+    const double lo = (double)std::numeric_limits<T>::min(), hi = (double)std::numeric_limits<T>::max();
+    return (T)std::min(hi, std::max(lo, v));
+}
+
+template <>
+bool padValue<bool>(double v)
+{
+    return v != 0;
+}
+
+template <typename T>
+void run(const mxArray *V, const std::size_t n[3], const qmr::ordfilt::Kernel &kernel,
+         const std::vector<std::size_t> &ord, qmr::ordfilt::PadMode mode, double pad, mxArray *out, int nthreads)
+{
+    qmr::ordfilt::filter<T>((const T *)mxGetData(V), n, kernel, ord, mode, padValue<T>(pad), (T *)mxGetData(out),
+                            nthreads);
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    (void)nlhs;
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "ordfilt3D_mex(V, ord, kernel, pad, opts).");
+    const mxArray *V = prhs[0];
+    if ((!mxIsNumeric(V) && !mxIsLogical(V)) || mxIsComplex(V) || mxIsSparse(V))
+        qmr::mex::fail(kName, "invalidInputType", "V must be a real numeric or logical array.");
+    if (mxGetNumberOfDimensions(V) > 3)
+        qmr::mex::fail(kName, "invalidInputSize", "V must be 2D or 3D.");
+    const std::vector<std::size_t> d = qmr::mex::dims(V, 3);
+    const std::size_t n[3] = {d[0], d[1], d[2]};
+
+    // Kernel
+    std::size_t m[3] = {3, 3, 3};
+    std::vector<unsigned char> mask(27, 1);
+    if (!mxIsEmpty(prhs[2])) {
+        if (mxGetNumberOfDimensions(prhs[2]) > 3)
+            qmr::mex::fail(kName, "invalidInputSize", "kernel must be 2D or 3D.");
+        const std::vector<std::size_t> dm = qmr::mex::dims(prhs[2], 3);
+        for (int a = 0; a < 3; ++a) {
+            m[a] = dm[a];
+            if (m[a] % 2 == 0) qmr::mex::fail(kName, "invalidKernel", "kernel sizes must be odd.");
+        }
+        const std::vector<double> k = qmr::mex::toVector(prhs[2]);
+        mask.resize(k.size());
+        for (std::size_t i = 0; i < k.size(); ++i) mask[i] = k[i] != 0;
+    }
+    const qmr::ordfilt::Kernel kernel(mask.data(), m);
+    if (kernel.size() == 0) qmr::mex::fail(kName, "invalidKernel", "kernel must select at least one voxel.");
+
+    const std::vector<double> o = qmr::mex::toVector(prhs[1]);
+    if (o.empty()) qmr::mex::fail(kName, "invalidInput", "ord must not be empty.");
+    std::vector<std::size_t> ord(o.size());
+    for (std::size_t i = 0; i < o.size(); ++i) {
+        if (!(o[i] >= 1 && o[i] <= (double)kernel.size() && o[i] == std::floor(o[i])))
+            qmr::mex::fail(kName, "invalidInput", "ord must be integers between 1 and the number of kernel voxels.");
+        ord[i] = (std::size_t)o[i];
+    }
+
+    qmr::ordfilt::PadMode mode = qmr::ordfilt::kConstant;
+    double pad = 0;
+    if (mxIsChar(prhs[3])) {
+        const std::string p = qmr::mex::string(kName, prhs[3], "pad");
+        if (p == "replicate") mode = qmr::ordfilt::kReplicate;
+        else if (p == "symmetric") mode = qmr::ordfilt::kSymmetric;
+        else if (p == "circular") mode = qmr::ordfilt::kCircular;
+        else qmr::mex::fail(kName, "invalidInput", "pad must be 'replicate', 'symmetric', 'circular' or a scalar.");
+    } else {
+        pad = qmr::mex::scalar(kName, prhs[3], "pad");
+    }
+    const mxArray *opts = nrhs > 4 ? prhs[4] : NULL;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    mxArray *out;
+    if (ord.size() == 1) {
+        out = mxCreateNumericArray(mxGetNumberOfDimensions(V), mxGetDimensions(V), mxGetClassID(V), mxREAL);
+    } else {
+        mwSize dout[4] = {(mwSize)n[0], (mwSize)n[1], (mwSize)n[2], (mwSize)ord.size()};
+        out = mxCreateNumericArray(4, dout, mxGetClassID(V), mxREAL);
+    }
+    if (mxGetNumberOfElements(V) > 0) {
+        switch (mxGetClassID(V)) {
+        case mxDOUBLE_CLASS: run<double>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxSINGLE_CLASS: run<float>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxLOGICAL_CLASS: run<bool>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxINT8_CLASS: run<signed char>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxUINT8_CLASS: run<unsigned char>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxINT16_CLASS: run<short>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxUINT16_CLASS: run<unsigned short>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxINT32_CLASS: run<int>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        case mxUINT32_CLASS: run<unsigned int>(V, n, kernel, ord, mode, pad, out, nthreads); break;
+        default:
+            mxDestroyArray(out);
+            qmr::mex::fail(kName, "invalidInputType", "V must be double, single, logical or an integer class up to 32 bits.");
+        }
+    }
+    plhs[0] = out;
+}
@@ -0,0 +1,43 @@
+function [FitResult,Spectrum] = multi_comp_fit_batch(data, EchoTimes, DecayMatrix, T2, Opt)
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Vectorized multi_comp_fit_v2: regularized NNLS T2 spectra of many voxels.
+%
+% INPUT VARIABLES :
+%     -data:        [nVoxels x nEchoes] echo amplitudes, one voxel per row
+%     -EchoTimes:   echo times [ms]
+%     -DecayMatrix: from getDecayMatrix(EchoTimes,T2.vals)
+%     -T2:          from getT2
+%     -Opt:         struct with fields Sigma, lower_cutoff_MW,
+%                   upper_cutoff_MW and upper_cutoff_IEW, as for
+%                   multi_comp_fit_v2
+%
+% OUTPUT VARIABLES :
+%     -FitResult: struct with [nVoxels x 1] fields MWF (%), T2MW and T2IEW
+%     -Spectrum:  [nVoxels x T2.num] regularized spectra
+%
+% Uses the compiled solver mwf_nnls_mex when available (same mu search
+% and lsqnonneg tolerances as iterate_NNLS, all voxels on all cores).
+% Otherwise falls back to calling multi_comp_fit_v2 voxel by voxel.
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+nV = size(data,1);
+cutoffs = [find_cutoff_index(Opt.lower_cutoff_MW, T2.vals) ...
+           find_cutoff_index(Opt.upper_cutoff_MW, T2.vals) ...
+           find_cutoff_index(Opt.upper_cutoff_IEW, T2.vals)];
+
+if exist('mwf_nnls_mex','file')==3
+    [FitResult.MWF, FitResult.T2MW, FitResult.T2IEW, Spectrum] = ...
+        mwf_nnls_mex(double(data), DecayMatrix, T2.vals, Opt.Sigma(1), cutoffs);
+    return;
+end
+
+FitResult = struct('MWF',zeros(nV,1),'T2MW',zeros(nV,1),'T2IEW',zeros(nV,1));
+Spectrum = zeros(nV,length(T2.vals));
+for ii = 1:nV
+    [fr,sp] = multi_comp_fit_v2(reshape(data(ii,:),[1 1 1 size(data,2)]), EchoTimes, DecayMatrix, T2, Opt, 'tissue', 1);
+    FitResult.MWF(ii)   = fr.MWF;
+    FitResult.T2MW(ii)  = fr.T2MW;
+    FitResult.T2IEW(ii) = fr.T2IEW;
+    Spectrum(ii,:) = sp(:)';
+end
+end
@@ -0,0 +1,327 @@
+/*
+ * mwf_nnls.hh: regularized NNLS T2-spectrum engine for the mwf model.
+ *
+ * Native counterpart of do_NNLS.m, do_regNNLS.m and iterate_NNLS.m as used
+ * by multi_comp_fit_v2.m:
+ *
+ *   1. spectrum_NNLS = lsqnonneg(A, y),          chi2_NNLS = ||A x - y||^2/sigma^2
+ *   2. minimum-energy regularization  min ||A x - y||^2 + mu^2 ||x||^2, x >= 0,
+ *      with mu halved / multiplied by 1.9 until the chi2 increase
+ *      100*(chi2_reg - chi2_NNLS)/chi2_NNLS lies in [chi2min, chi2max]
+ *   3. MWF and geometric-mean T2 of the myelin / intra-extracellular pools.
+ *
+ * The non-negative problems are solved with the Lawson-Hanson active-set
+ * algorithm, with lsqnonneg's tolerance, iteration limit and retry policy
+ * (tolerance x10 whenever the iteration limit is hit). The Gram matrix A'A
+ * is built once per protocol (DecayBasis), so the dual vector
+ * w = A'y - (A'A + mu^2 I) x costs O(n^2) per iteration; the passive-set
+ * least-squares subproblems are solved by Householder QR of the few active
+ * columns of [A; mu I], which keeps the accuracy of lsqnonneg's backslash.
+ *
+ * Active sets are warm-started: every mu step starts from the passive set
+ * of the previous one, and each voxel's first solve starts from the
+ * passive set of the previous voxel in its chunk (FitData orders voxels so
+ * that consecutive ones are spatial neighbours). A warm start only changes
+ * the path to the solution, not the solution.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef MWF_NNLS_HH
+#define MWF_NNLS_HH
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace mwf {
+
+// Decay matrix A (m echoes x n T2 values) and its Gram matrix, shared by
+// every voxel of a protocol.
+struct DecayBasis {
+    int m, n;
+    std::vector<double> A;      // m x n, column-major (as getDecayMatrix)
+    std::vector<double> AtA;    // n x n
+    std::vector<double> logT2;  // n
+    double norm1;               // norm(A,1)
+
+    DecayBasis(const double *A_, int m_, int n_, const double *T2)
+        : m(m_), n(n_), A(A_, A_ + (std::size_t)m_ * n_), AtA((std::size_t)n_ * n_),
+          logT2(n_), norm1(0)
+    {
+        for (int j = 0; j < n; ++j) {
+            double c = 0;
+            for (int i = 0; i < m; ++i) c += std::fabs(A[i + (std::size_t)j * m]);
+            norm1 = std::max(norm1, c);
+            logT2[j] = std::log(T2[j]);
+            for (int k = 0; k <= j; ++k) {
+                double s = 0;
+                for (int i = 0; i < m; ++i)
+                    s += A[i + (std::size_t)j * m] * A[i + (std::size_t)k * m];
+                AtA[j + (std::size_t)k * n] = AtA[k + (std::size_t)j * n] = s;
+            }
+        }
+    }
+};
+
+struct Options {
+    double mu0;         // initial regularization weight (0.25)
+    double chi2min;     // accepted chi2 increase range, in % ([2 2.5])
+    double chi2max;
+    int maxMuSteps;     // guard against non-terminating mu searches
+    int lowerMW;        // 0-based cutoff indices (find_cutoff_index - 1)
+    int upperMW;
+    int upperIEW;
+    bool warmStart;
+
+    Options() : mu0(0.25), chi2min(2), chi2max(2.5), maxMuSteps(200),
+                lowerMW(0), upperMW(0), upperIEW(0), warmStart(true) {}
+};
+
+// Per-thread Lawson-Hanson solver.
+class NNLS {
+public:
+    explicit NNLS(const DecayBasis &b)
+        : b_(b), x_(b.n), z_(b.n), w_(b.n), Aty_(b.n), passive_(b.n),
+          M_((std::size_t)(b.m + b.n) * b.n), rhs_(b.m + b.n) {}
+
+    // Sets the data vector y (m values, stride `stride`).
+    void setData(const double *y, std::size_t stride)
+    {
+        y_.resize(b_.m);
+        for (int i = 0; i < b_.m; ++i) y_[i] = y[i * stride];
+        for (int j = 0; j < b_.n; ++j) {
+            const double *a = &b_.A[(std::size_t)j * b_.m];
+            double s = 0;
+            for (int i = 0; i < b_.m; ++i) s += a[i] * y_[i];
+            Aty_[j] = s;
+        }
+    }
+
+    // min ||A x - y||^2 + mu^2 ||x||^2, x >= 0, starting from the passive
+    // set in `warm` (may be empty). Returns ||A x - y||^2 + mu^2 ||x||^2.
+    double solve(double mu, std::vector<int> &warm)
+    {
+        const int n = b_.n;
+        const int mRows = b_.m + (mu > 0 ? n : 0);
+        // lsqnonneg: tol = 10*eps*norm(C,1)*length(C), C = [A; mu I]
+        double tol = 10 * DBL_EPSILON * (b_.norm1 + std::fabs(mu)) * std::max(mRows, n);
+        for (;;) {
+            if (lawsonHanson(mu, tol, warm)) break;
+            tol *= 10;   // do_NNLS / do_regNNLS retry policy
+        }
+        warm.clear();
+        for (int j = 0; j < n; ++j) if (passive_[j]) warm.push_back(j);
+
+        double r2 = 0;
+        for (int i = 0; i < b_.m; ++i) {
+            double s = -y_[i];
+            for (std::size_t k = 0; k < warm.size(); ++k)
+                s += b_.A[i + (std::size_t)warm[k] * b_.m] * x_[warm[k]];
+            r2 += s * s;
+        }
+        double x2 = 0;
+        for (int j = 0; j < n; ++j) x2 += x_[j] * x_[j];
+        return r2 + mu * mu * x2;
+    }
+
+    const std::vector<double> &x() const { return x_; }
+
+private:
+    // Least squares on the passive columns: z(P) = [A(:,P); mu I] \ [y; 0].
+    void subproblem(double mu)
+    {
+        const int m = b_.m, n = b_.n;
+        idx_.clear();
+        for (int j = 0; j < n; ++j) { z_[j] = 0; if (passive_[j]) idx_.push_back(j); }
+        const int p = static_cast<int>(idx_.size());
+        if (!p) return;
+        const int rows = m + (mu > 0 ? p : 0);
+        for (int c = 0; c < p; ++c) {
+            double *col = &M_[(std::size_t)c * rows];
+            const double *a = &b_.A[(std::size_t)idx_[c] * m];
+            for (int i = 0; i < m; ++i) col[i] = a[i];
+            for (int i = m; i < rows; ++i) col[i] = (i - m == c) ? mu : 0;
+        }
+        for (int i = 0; i < m; ++i) rhs_[i] = y_[i];
+        for (int i = m; i < rows; ++i) rhs_[i] = 0;
+
+        // Householder QR, applied to the right-hand side on the fly.
+        for (int c = 0; c < p; ++c) {
+            double *col = &M_[(std::size_t)c * rows];
+            double nrm = 0;
+            for (int i = c; i < rows; ++i) nrm += col[i] * col[i];
+            nrm = std::sqrt(nrm);
+            if (nrm == 0) continue;
+            double alpha = col[c] > 0 ? -nrm : nrm;
+            col[c] -= alpha;
+            double vnorm2 = 0;
+            for (int i = c; i < rows; ++i) vnorm2 += col[i] * col[i];
+            for (int k = c + 1; k < p; ++k) {
+                double *ck = &M_[(std::size_t)k * rows];
+                double s = 0;
+                for (int i = c; i < rows; ++i) s += col[i] * ck[i];
+                s = 2 * s / vnorm2;
+                for (int i = c; i < rows; ++i) ck[i] -= s * col[i];
+            }
+            double s = 0;
+            for (int i = c; i < rows; ++i) s += col[i] * rhs_[i];
+            s = 2 * s / vnorm2;
+            for (int i = c; i < rows; ++i) rhs_[i] -= s * col[i];
+            col[c] = alpha;   // R(c,c); below-diagonal entries are not reused
+        }
+        // R z = Q'y
+        const double rtol = DBL_EPSILON * std::max(rows, p) *
+                            std::fabs(M_[0]);
+        for (int c = p - 1; c >= 0; --c) {
+            double s = rhs_[c];
+            for (int k = c + 1; k < p; ++k) s -= M_[c + (std::size_t)k * rows] * z_[idx_[k]];
+            double r = M_[c + (std::size_t)c * rows];
+            z_[idx_[c]] = std::fabs(r) > rtol ? s / r : 0;   // rank deficient: basic solution
+        }
+    }
+
+    // Dual vector w = A'y - (A'A + mu^2 I) x.
+    void dual(double mu)
+    {
+        const int n = b_.n;
+        for (int j = 0; j < n; ++j) w_[j] = Aty_[j] - mu * mu * x_[j];
+        for (int k = 0; k < n; ++k) {
+            if (x_[k] == 0) continue;
+            const double *g = &b_.AtA[(std::size_t)k * n];
+            const double xk = x_[k];
+            for (int j = 0; j < n; ++j) w_[j] -= g[j] * xk;
+        }
+    }
+
+    // One lsqnonneg run. Returns false when the iteration limit is hit.
+    bool lawsonHanson(double mu, double tol, const std::vector<int> &warm)
+    {
+        const int n = b_.n;
+        std::fill(x_.begin(), x_.end(), 0.0);
+        std::fill(passive_.begin(), passive_.end(), 0);
+
+        // Warm start: prune the previous passive set until its
+        // least-squares solution is strictly positive.
+        for (std::size_t k = 0; k < warm.size(); ++k) passive_[warm[k]] = 1;
+        while (!warm.empty()) {
+            subproblem(mu);
+            bool feasible = true;
+            for (int j = 0; j < n; ++j)
+                if (passive_[j] && z_[j] <= tol) { passive_[j] = 0; feasible = false; }
+            if (feasible) break;
+        }
+        for (int j = 0; j < n; ++j) x_[j] = passive_[j] ? z_[j] : 0;
+        dual(mu);
+
+        const int itmax = 3 * n;
+        int iter = 0;
+        for (;;) {
+            int t = -1;
+            double wmax = tol;
+            for (int j = 0; j < n; ++j)
+                if (!passive_[j] && w_[j] > wmax) { wmax = w_[j]; t = j; }
+            if (t < 0) return true;
+            passive_[t] = 1;
+            subproblem(mu);
+
+            for (;;) {
+                bool negative = false;
+                for (int j = 0; j < n; ++j) if (passive_[j] && z_[j] <= 0) { negative = true; break; }
+                if (!negative) break;
+                if (++iter > itmax) return false;
+                double alpha = std::numeric_limits<double>::infinity();
+                for (int j = 0; j < n; ++j)
+                    if (passive_[j] && z_[j] <= 0)
+                        alpha = std::min(alpha, x_[j] / (x_[j] - z_[j]));
+                for (int j = 0; j < n; ++j) {
+                    x_[j] += alpha * (z_[j] - x_[j]);
+                    if (passive_[j] && std::fabs(x_[j]) < tol) passive_[j] = 0;
+                }
+                subproblem(mu);
+            }
+            for (int j = 0; j < n; ++j) x_[j] = z_[j];
+            dual(mu);
+        }
+    }
+
+    const DecayBasis &b_;
+    std::vector<double> x_, z_, w_, Aty_, y_;
+    std::vector<int> passive_, idx_;
+    std::vector<double> M_, rhs_;
+};
+
+// Output arrays (nV elements, spectrum nV x n, any may be NULL).
+struct Output {
+    double *MWF, *T2MW, *T2IEW, *chi2NNLS, *chi2reg, *mu, *spectrum;
+};
+
+namespace detail {
+
+inline double geometricMean(const std::vector<double> &s, const std::vector<double> &logT2,
+                            int i0, int i1)
+{
+    double num = 0, den = 0;
+    for (int j = i0; j <= i1; ++j) { num += s[j] * logT2[j]; den += s[j]; }
+    double g = std::exp(num / den);
+    return std::isnan(g) ? 0 : g;
+}
+
+} // namespace detail
+
+// Fits nV voxels, Y is nV x m (voxels along rows).
+inline void fit(const DecayBasis &basis, std::size_t nV, const double *Y, double sigma,
+                const Options &opt, const Output &out, int nthreads = 0)
+{
+    const int n = basis.n;
+    parallel_for(nV, 256, [&](std::size_t v0, std::size_t v1, int) {
+        NNLS solver(basis);
+        std::vector<int> neighbour, active;
+        std::vector<double> s(n);
+        for (std::size_t v = v0; v < v1; ++v) {
+            solver.setData(Y + v, nV);
+
+            if (!opt.warmStart) neighbour.clear();
+            double chi2NNLS = solver.solve(0, neighbour) / (sigma * sigma);
+            active = neighbour;
+
+            double mu = opt.mu0;
+            double chi2reg = solver.solve(mu, active) / (sigma * sigma);
+            double diff = 100 * (chi2reg - chi2NNLS) / chi2NNLS;
+            for (int step = 0; step < opt.maxMuSteps &&
+                               (diff > opt.chi2max || diff < opt.chi2min); ++step) {
+                if (diff > opt.chi2max) mu = mu / 2;
+                else mu = 1.9 * mu;
+                chi2reg = solver.solve(mu, active) / (sigma * sigma);
+                diff = 100 * (chi2reg - chi2NNLS) / chi2NNLS;
+            }
+            s = solver.x();
+
+            double s0 = 0, sMW = 0;
+            for (int j = 0; j < n; ++j) {
+                s0 += s[j];
+                if (j <= opt.upperMW) sMW += s[j];
+            }
+            double mwf = sMW / s0;
+            if (out.MWF) out.MWF[v] = 100 * (std::isnan(mwf) ? 0 : mwf);
+            if (out.T2IEW) out.T2IEW[v] = detail::geometricMean(s, basis.logT2, opt.upperMW, opt.upperIEW);
+            if (out.T2MW) out.T2MW[v] = detail::geometricMean(s, basis.logT2, opt.lowerMW, opt.upperMW);
+            if (out.chi2NNLS) out.chi2NNLS[v] = chi2NNLS;
+            if (out.chi2reg) out.chi2reg[v] = chi2reg;
+            if (out.mu) out.mu[v] = mu;
+            if (out.spectrum)
+                for (int j = 0; j < n; ++j) out.spectrum[v + j * nV] = s[j];
+        }
+    }, nthreads);
+}
+
+} // namespace mwf
+} // namespace qmr
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * [MWF, T2MW, T2IEW, Spectrum, chi2, mu] = mwf_nnls_mex(data, DecayMatrix, T2vals, Sigma, cutoffIdx, opts)
+ *
+ * Whole-volume regularized NNLS fit of the mwf model (see mwf_nnls.hh).
+ * Use through multi_comp_fit_batch.m.
+ *
+ *   data         nV x nE echo amplitudes, one voxel per row
+ *   DecayMatrix  nE x nT2 matrix from getDecayMatrix
+ *   T2vals       nT2 T2 values of the spectrum
+ *   Sigma        noise standard deviation
+ *   cutoffIdx    [lower_MW upper_MW upper_IEW] indices into T2vals
+ *                (1-based, from find_cutoff_index)
+ *   opts         optional struct: Mu (0.25), Chi2Range ([2 2.5]),
+ *                NumThreads (0: all cores), WarmStart (true)
+ *
+ * MWF (in %), T2MW and T2IEW are nV x 1, Spectrum is nV x nT2 and chi2 is
+ * nV x 2 ([chi2_NNLS chi2_regNNLS]). mu is the final regularization weight.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "mwf_nnls.hh"
+
+static const char *kName = "mwf_nnls_mex";
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 5 || nrhs > 6)
+        qmr::mex::fail(kName, "wrongNumInputs", "mwf_nnls_mex expects 5 or 6 input arguments.");
+
+    qmr::mex::requireDouble(kName, prhs[0], "data");
+    qmr::mex::requireDouble(kName, prhs[1], "DecayMatrix");
+    const std::size_t nV = mxGetM(prhs[0]);
+    const int nE = (int)mxGetN(prhs[0]);
+    const int nT2 = (int)mxGetN(prhs[1]);
+    if ((int)mxGetM(prhs[1]) != nE)
+        qmr::mex::fail(kName, "invalidInputSize", "DecayMatrix must have one row per echo.");
+    std::vector<double> T2 = qmr::mex::toVector(prhs[2]);
+    if ((int)T2.size() != nT2)
+        qmr::mex::fail(kName, "invalidInputSize", "T2vals must have one value per DecayMatrix column.");
+    const double sigma = qmr::mex::scalar(kName, prhs[3], "Sigma");
+    std::vector<double> cut = qmr::mex::toVector(prhs[4]);
+    if (cut.size() != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "cutoffIdx must be [lower_MW upper_MW upper_IEW].");
+    for (int k = 0; k < 3; ++k)
+        if (!(cut[k] >= 1 && cut[k] <= nT2))
+            qmr::mex::fail(kName, "invalidCutoff", "Cutoff value not in range.");
+
+    const mxArray *opts = nrhs > 5 ? prhs[5] : NULL;
+    qmr::mwf::Options opt;
+    opt.mu0 = qmr::mex::option(opts, "Mu", 0.25);
+    if (opts && mxIsStruct(opts) && mxGetField(opts, 0, "Chi2Range")) {
+        std::vector<double> r = qmr::mex::toVector(mxGetField(opts, 0, "Chi2Range"));
+        if (r.size() != 2)
+            qmr::mex::fail(kName, "invalidOption", "Chi2Range must have 2 elements.");
+        opt.chi2min = r[0];
+        opt.chi2max = r[1];
+    }
+    opt.warmStart = qmr::mex::option(opts, "WarmStart", 1.0) != 0;
+    opt.lowerMW = (int)cut[0] - 1;
+    opt.upperMW = (int)cut[1] - 1;
+    opt.upperIEW = (int)cut[2] - 1;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+
+    qmr::mwf::DecayBasis basis(mxGetPr(prhs[1]), nE, nT2, T2.data());
+
+    mxArray *MWF = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *T2MW = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *T2IEW = mxCreateDoubleMatrix(nV, 1, mxREAL);
+    mxArray *spectrum = nlhs > 3 ? mxCreateDoubleMatrix(nV, nT2, mxREAL) : NULL;
+    mxArray *chi2 = nlhs > 4 ? mxCreateDoubleMatrix(nV, 2, mxREAL) : NULL;
+    mxArray *mu = nlhs > 5 ? mxCreateDoubleMatrix(nV, 1, mxREAL) : NULL;
+
+    qmr::mwf::Output out;
+    out.MWF = mxGetPr(MWF);
+    out.T2MW = mxGetPr(T2MW);
+    out.T2IEW = mxGetPr(T2IEW);
+    out.spectrum = spectrum ? mxGetPr(spectrum) : NULL;
+    out.chi2NNLS = chi2 ? mxGetPr(chi2) : NULL;
+    out.chi2reg = chi2 ? mxGetPr(chi2) + nV : NULL;
+    out.mu = mu ? mxGetPr(mu) : NULL;
+
+    qmr::mwf::fit(basis, nV, mxGetPr(prhs[0]), sigma, opt, out, nthreads);
+
+    mxArray *all[6] = {MWF, T2MW, T2IEW, spectrum, chi2, mu};
+    for (int k = 0; k < 6; ++k) {
+        if (k < nlhs || k == 0) plhs[k] = all[k];
+        else if (all[k]) mxDestroyArray(all[k]);
+    }
+}
@@ -0,0 +1,53 @@
+function [Signal, Sigma] = MPdenoising_batch(data, mask, kernel, sampling)
+% usage
+% [Signal, Sigma] = MPdenoising_batch(data, mask, kernel, sampling)
+%
+% MP-PCA denoising and noise map estimation, as MPdenoising (same inputs,
+% outputs and patch sampling), computed by the compiled engine mppca_mex:
+% the patches are decomposed through the eigenvalues of their small Gram
+% matrix, sliding windows update it incrementally and slabs of slices are
+% processed on all cores.
+%
+% Falls back to MPdenoising when mppca_mex is not compiled.
+
+if ~exist('mask','var'), mask = []; end
+if ~exist('kernel','var'), kernel = []; end
+if ~exist('sampling','var'), sampling = []; end
+
+if exist('mppca_mex','file')~=3
+    if nargout > 1
+        [Signal, Sigma] = MPdenoising(data, mask, kernel, sampling);
+    else
+        Signal = MPdenoising(data, mask, kernel, sampling);
+    end
+    return;
+end
+
+% Same preprocessing as MPdenoising
+if isa(data,'integer')
+    data = single(data);
+end
+[sx, sy, sz, ~] = size(data);
+
+if isempty(mask)
+    mask = true([sx, sy, sz]);
+end
+mask = mask>0;
+
+if isempty(sampling)
+    if nargout > 1
+        sampling = 'full';
+    else
+        sampling = 'fast';
+    end
+end
+if strcmp(sampling, 'fast') && nargout>1
+    warning('undersampled noise map will be returned')
+end
+if strcmp(sampling, 'full')
+    warning('image boundaries are not processed.')
+end
+
+[x, y, z, kernel] = MPdenoising_centres(mask, kernel, sampling);
+[Signal, Sigma] = mppca_mex(data, double([x(:) y(:) z(:)]), kernel, sampling);
+end
@@ -0,0 +1,45 @@
+function [x, y, z, kernel] = MPdenoising_centres(mask, kernel, sampling)
+% usage
+% [x, y, z, kernel] = MPdenoising_centres(mask, kernel, sampling)
+%
+% Patch centres visited by MPdenoising for a [sx sy sz] mask, in the same
+% order (x fastest, then y, then z), and the kernel made odd.
+%
+% mask      logical region-of-interest
+% kernel    window size ([5 5 5] when empty, scalar for isotropic)
+% sampling  'full' (sliding window) or 'fast' (block processing)
+
+if isempty(kernel)
+    kernel = [5 5 5];
+end
+if isscalar(kernel)
+    kernel = [kernel, kernel, kernel];
+end
+kernel = kernel + (mod(kernel, 2)-1);   % needs to be odd.
+k = (kernel-1)/2;
+[sx, sy, sz] = size(mask);
+
+switch sampling
+    case 'fast'
+        stats = regionprops(mask, 'BoundingBox');
+        n = ceil(stats.BoundingBox(4:6) ./ kernel);
+
+        x = linspace(ceil(stats.BoundingBox(1))+k(1), floor(stats.BoundingBox(1))-k(1) + stats.BoundingBox(4), n(1)); x = round(x);
+        y = linspace(ceil(stats.BoundingBox(2))+k(2), floor(stats.BoundingBox(2))-k(2) + stats.BoundingBox(5), n(2)); y = round(y);
+        z = linspace(ceil(stats.BoundingBox(3))+k(3), floor(stats.BoundingBox(3))-k(3) + stats.BoundingBox(6), n(3)); z = round(z);
+
+        [y, x, z] = meshgrid(x, y, z); x = x(:); y = y(:); z = z(:);
+    case 'full'
+        mask(1:k(1), :, :) = 0;
+        mask(sx-k(1):sx, :, :) = 0;
+        mask(:, 1:k(2), :) = 0;
+        mask(:, sy-k(2):sy, :, :) = 0;
+        mask(:,:,1:k(3)) = 0;
+        mask(:,:,sz-k(3)) = 0;
+        mask(:,:,sz-k(3)+1:end) = 0; % slices MPdenoising does not visit
+
+        [x, y, z] = ind2sub([sx sy sz], find(mask));
+    otherwise
+        error('sampling must be ''full'' or ''fast''.');
+end
+end
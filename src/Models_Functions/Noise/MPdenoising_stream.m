@@ -0,0 +1,145 @@
+function MPdenoising_stream(dataFile, outFile, sigmaFile, mask, kernel, sampling, slabSize)
+% usage
+% MPdenoising_stream(dataFile, outFile, sigmaFile, mask, kernel, sampling, slabSize)
+%
+% Out-of-core MP-PCA denoising of a 4D NIfTI file: same result as
+% MPdenoising_batch(data, mask, kernel, sampling), but the data are read
+% and denoised in slabs of slabSize slices of patch centres (plus the kz
+% halo on each side) and the result is written slab by slab, so memory
+% is bounded by the slab size rather than by the volume.
+%
+% dataFile   4D NIfTI (.nii or .nii.gz)
+% outFile    denoised data (.nii or .nii.gz)
+% sigmaFile  noise map (.nii or .nii.gz), or [] (not saved)
+% mask       3D logical array, NIfTI file name, or [] (whole volume)
+% kernel     window size (default [5 5 5])
+% sampling   'full' (default) or 'fast', as in MPdenoising
+% slabSize   number of slices of patch centres per slab (default 8)
+%
+% Data are scaled with scl_slope/scl_inter. Outputs are float32 (float64
+% if the input is float64). Needs the compiled mppca_mex (qMRbuildMex).
+
+if exist('mppca_mex','file')~=3
+    error('qMRLab:MPdenoising_stream:noMex','MPdenoising_stream needs mppca_mex. Compile it with qMRbuildMex(''mppca_mex'').');
+end
+if ~exist('sigmaFile','var'), sigmaFile = []; end
+if ~exist('mask','var'), mask = []; end
+if ~exist('kernel','var'), kernel = []; end
+if ~exist('sampling','var') || isempty(sampling), sampling = 'full'; end
+if ~exist('slabSize','var') || isempty(slabSize), slabSize = 8; end
+
+tmpDir = tempname;
+mkdir(tmpDir);
+cleanup = onCleanup(@() rmdir(tmpDir,'s'));
+
+% Decompress once; slabs are then read from the .nii
+if length(dataFile) > 3 && strcmp(dataFile(end-2:end),'.gz')
+    dataFile = char(gunzip(dataFile, tmpDir));
+end
+hdr = load_untouch_header_only(dataFile);
+dim = hdr.dime.dim(2:5);
+sx = dim(1); sy = dim(2); sz = dim(3); M = max(dim(4),1);
+if hdr.dime.datatype == 64, cls = 'double'; else, cls = 'single'; end
+
+if isempty(mask)
+    mask = true([sx, sy, sz]);
+elseif ischar(mask)
+    mask = load_untouch_nii(mask);
+    mask = mask.img;
+end
+mask = mask>0;
+
+if strcmp(sampling, 'fast') && ~isempty(sigmaFile)
+    warning('undersampled noise map will be returned')
+end
+if strcmp(sampling, 'full')
+    warning('image boundaries are not processed.')
+end
+[x, y, z, kernel] = MPdenoising_centres(mask, kernel, sampling);
+kz = (kernel(3)-1)/2;
+if any(diff(z) < 0)
+    error('qMRLab:MPdenoising_stream:unsortedCentres','Patch centres must be ordered by slice.');
+end
+
+% Output files, filled with zeros (voxels that no patch writes)
+outHdr = hdr;
+outHdr.dime.datatype = 16 + 48*strcmp(cls,'double');
+outHdr.dime.bitpix = 32 + 32*strcmp(cls,'double');
+outHdr.dime.scl_slope = 1;
+outHdr.dime.scl_inter = 0;
+outHdr.dime.vox_offset = 352;
+outHdr.hist.magic = 'n+1';
+outNii = createNii(outFile, outHdr, sx*sy, sz*M, cls, tmpDir);
+if ~isempty(sigmaFile)
+    sigmaHdr = outHdr;
+    sigmaHdr.dime.dim(1) = 3;
+    sigmaHdr.dime.dim(5) = 1;
+    sigmaNii = createNii(sigmaFile, sigmaHdr, sx*sy, sz, cls, tmpDir);
+end
+
+planes = unique(z);
+nSlabs = ceil(numel(planes)/slabSize);
+carry = []; carrySigma = [];
+for s = 1:nSlabs
+    zc = planes((s-1)*slabSize+1 : min(s*slabSize, end));
+    lo = zc(1) - kz; hi = zc(end) + kz;
+    if s < nSlabs, nextLo = planes(s*slabSize+1) - kz; else, nextLo = hi + 1; end
+
+    % Planes shared with the previous slab start from its result
+    opts.InitSignal = zeros([sx sy hi-lo+1 M], cls);
+    opts.InitSigma = zeros([sx sy hi-lo+1], cls);
+    if ~isempty(carry)
+        opts.InitSignal(:,:,1:size(carry,3),:) = carry;
+        opts.InitSigma(:,:,1:size(carry,3)) = carrySigma;
+    end
+    sel = z >= zc(1) & z <= zc(end);
+    [Signal, Sigma] = mppca_mex(readSlab(dataFile, hdr, lo:hi, cls), ...
+        double([x(sel) y(sel) z(sel)-lo+1]), kernel, sampling, opts);
+
+    % Write the planes no later slab touches, keep the others
+    done = 1:min(hi, nextLo-1)-lo+1;
+    save_untouch_slice(Signal(:,:,done,:), outNii, lo-1+done, 1:M);
+    if ~isempty(sigmaFile)
+        save_untouch_slice(Sigma(:,:,done), sigmaNii, lo-1+done);
+    end
+    carry = Signal(:,:,done(end)+1:end,:);
+    carrySigma = Sigma(:,:,done(end)+1:end);
+end
+
+finishNii(outNii, outFile);
+if ~isempty(sigmaFile), finishNii(sigmaNii, sigmaFile); end
+end
+
+function img = readSlab(fname, hdr, slices, cls)
+img = cast(qMRniiRead(fname, 'slab', slices), cls);
+if hdr.dime.scl_slope ~= 0 && (hdr.dime.scl_slope ~= 1 || hdr.dime.scl_inter ~= 0)
+    img = img*hdr.dime.scl_slope + hdr.dime.scl_inter;
+end
+end
+
+function fname = createNii(target, hdr, planeSize, nPlanes, cls, tmpDir)
+% Writes the header and nPlanes zero planes. Compressed targets are built
+% uncompressed in tmpDir and gzipped by finishNii.
+fname = target;
+if length(target) > 3 && strcmp(target(end-2:end),'.gz')
+    [~, name] = fileparts(target);
+    fname = fullfile(tmpDir, name);
+end
+fid = fopen(fname, 'w');
+if fid < 0, error('qMRLab:MPdenoising_stream:cannotWrite','Cannot write %s.', fname); end
+save_untouch_nii_hdr(hdr, fid);
+fwrite(fid, zeros(1, hdr.dime.vox_offset - 348), 'uint8');
+zero = zeros(planeSize, 1, cls);
+for p = 1:nPlanes
+    fwrite(fid, zero, class(zero));
+end
+fclose(fid);
+end
+
+function finishNii(fname, target)
+if ~strcmp(fname, target)
+    outDir = fileparts(target);
+    if isempty(outDir), outDir = pwd; end
+    gzip(fname, outDir);
+end
+end
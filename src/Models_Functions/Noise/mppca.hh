@@ -0,0 +1,509 @@
+/*
+ * mppca.hh: Marchenko-Pastur PCA denoising engine (MPdenoising.m).
+ *
+ * For every patch centre the M x N patch matrix X (M volumes, N = kx*ky*kz
+ * voxels) is decomposed, the Marchenko-Pastur threshold picks the number
+ * of signal components and the patch is rebuilt from them. Instead of
+ * svd(X,'econ') the engine diagonalizes the small min(M,N) Gram matrix
+ * (X X' when M <= N, X' X otherwise):
+ *
+ *   - the eigenvalues alone (Householder tridiagonalization + implicit QL)
+ *     decide the threshold, so no singular vectors are formed for noise
+ *     components;
+ *   - the kept eigenvectors are computed by inverse iteration on the
+ *     tridiagonal matrix and the denoised patch is U_k U_k' X (or
+ *     X V_k V_k'), which equals u*diag(...)*v' with the noise values zeroed;
+ *   - along a sliding-window line (consecutive centres one voxel apart in
+ *     x) X X' is updated by removing the plane that leaves the window and
+ *     adding the one that enters, instead of being rebuilt.
+ *
+ * Centres are split into slabs of whole z planes, processed in parallel.
+ * Each slab gathers the voxels it needs into a voxel-major buffer (one
+ * contiguous M-vector per voxel). Sliding-window ('full') centres only
+ * write their own voxel. Block ('fast') patches overlap; as in the MATLAB
+ * loop the patch processed last wins, so planes that more than one slab
+ * writes go to per-slab overlap buffers that are merged in centre order.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef MPPCA_HH
+#define MPPCA_HH
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace mppca {
+
+struct Centre {
+    int x, y, z;     // 0-based
+};
+
+struct Volume {
+    std::size_t nx, ny, nz;
+    int M;
+    std::size_t nVox() const { return nx * ny * nz; }
+};
+
+namespace detail {
+
+// Householder reduction of the symmetric n x n matrix A (row-major, full)
+// to tridiagonal form T = Q' A Q. d/e receive the diagonal and the
+// superdiagonal, A keeps the Householder vectors and beta their scales.
+inline void tridiagonalize(int n, double *A, double *d, double *e, double *beta, double *work)
+{
+    for (int k = 0; k < n - 2; ++k) {
+        double *v = work, *p = work + n;
+        const int m = n - k - 1;              // length of x = A(k+1:n, k)
+        double sigma = 0;
+        for (int i = 1; i < m; ++i) sigma += A[(k + 1 + i) * n + k] * A[(k + 1 + i) * n + k];
+        const double x0 = A[(k + 1) * n + k];
+        d[k] = A[k * n + k];
+        if (sigma == 0) {
+            e[k] = x0;
+            beta[k] = 0;
+            continue;
+        }
+        const double norm = std::sqrt(x0 * x0 + sigma);
+        const double alpha = x0 > 0 ? -norm : norm;
+        v[0] = x0 - alpha;
+        for (int i = 1; i < m; ++i) v[i] = A[(k + 1 + i) * n + k];
+        const double b = 2 / (v[0] * v[0] + sigma);
+        beta[k] = b;
+        e[k] = alpha;
+        // p = b A22 v, w = p - (b/2)(p'v) v, A22 -= v w' + w v'
+        double pv = 0;
+        for (int i = 0; i < m; ++i) {
+            const double *row = A + (k + 1 + i) * n + k + 1;
+            double s = 0;
+            for (int j = 0; j < m; ++j) s += row[j] * v[j];
+            p[i] = b * s;
+            pv += p[i] * v[i];
+        }
+        const double c = 0.5 * b * pv;
+        for (int i = 0; i < m; ++i) p[i] -= c * v[i];
+        for (int i = 0; i < m; ++i) {
+            double *row = A + (k + 1 + i) * n + k + 1;
+            const double vi = v[i], wi = p[i];
+            for (int j = 0; j < m; ++j) row[j] -= vi * p[j] + wi * v[j];
+        }
+        for (int i = 0; i < m; ++i) A[(k + 1 + i) * n + k] = v[i];
+    }
+    if (n >= 2) {
+        d[n - 2] = A[(n - 2) * n + n - 2];
+        e[n - 2] = A[(n - 1) * n + n - 2];
+        beta[n - 2] = 0;
+    }
+    d[n - 1] = A[(n - 1) * n + n - 1];
+    e[n - 1] = 0;
+    if (n >= 1) beta[n - 1] = 0;
+}
+
+// Eigenvalues of the symmetric tridiagonal matrix (d, e) by implicit QL;
+// d is overwritten, e destroyed.
+inline void tridiagonalEigenvalues(int n, double *d, double *e)
+{
+    for (int l = 0; l < n; ++l) {
+        int iter = 0, m;
+        do {
+            for (m = l; m < n - 1; ++m) {
+                const double dd = std::fabs(d[m]) + std::fabs(d[m + 1]);
+                if (std::fabs(e[m]) <= DBL_EPSILON * dd) break;
+            }
+            if (m != l) {
+                if (iter++ == 60) break;
+                double g = (d[l + 1] - d[l]) / (2 * e[l]);
+                double r = std::sqrt(g * g + 1);
+                g = d[m] - d[l] + e[l] / (g + (g >= 0 ? r : -r));
+                double s = 1, c = 1, p = 0;
+                int i;
+                for (i = m - 1; i >= l; --i) {
+                    double f = s * e[i], b = c * e[i];
+                    e[i + 1] = (r = std::sqrt(f * f + g * g));
+                    if (r == 0) {
+                        d[i + 1] -= p;
+                        e[m] = 0;
+                        break;
+                    }
+                    s = f / r;
+                    c = g / r;
+                    g = d[i + 1] - p;
+                    r = (d[i] - g) * s + 2 * c * b;
+                    d[i + 1] = g + (p = s * r);
+                    g = c * r - b;
+                }
+                if (r == 0 && i >= l) continue;
+                d[l] -= p;
+                e[l] = g;
+                e[m] = 0;
+            }
+        } while (m != l);
+    }
+}
+
+// Eigenvectors of the tridiagonal matrix (d, e) for the k largest
+// eigenvalues lambda[0] >= ... >= lambda[k-1], by inverse iteration with
+// reorthogonalization inside clusters. Y is k x n (one vector per row).
+inline void inverseIteration(int n, const double *d, const double *e, const double *lambda, int k,
+                             double *Y, double *work)
+{
+    double *u0 = work, *u1 = work + n, *u2 = work + 2 * n, *mult = work + 3 * n;
+    double *piv = work + 4 * n, *x = work + 5 * n;
+    double tnorm = 0;
+    for (int i = 0; i < n; ++i)
+        tnorm = std::max(tnorm, std::fabs(d[i]) + std::fabs(e[i]) + (i ? std::fabs(e[i - 1]) : 0));
+    if (tnorm == 0) tnorm = 1;
+    const double tiny = DBL_EPSILON * tnorm, clusterTol = 1e-3 * tnorm;
+    unsigned seed = 12345u;
+
+    double prevShift = 0;
+    for (int j = 0; j < k; ++j) {
+        double shift = lambda[j];
+        if (j > 0 && prevShift - shift < 10 * tiny) shift = prevShift - 10 * tiny;
+        prevShift = shift;
+        int first = j;
+        while (first > 0 && lambda[first - 1] - lambda[j] < clusterTol) --first;
+
+        // LU with partial pivoting of T - shift I
+        double w0 = d[0] - shift, w1 = n > 1 ? e[0] : 0;
+        for (int i = 0; i < n - 1; ++i) {
+            const double c = e[i], dn = d[i + 1] - shift, en = i + 2 < n ? e[i + 1] : 0;
+            if (std::fabs(w0) >= std::fabs(c)) {
+                if (w0 == 0) w0 = tiny;
+                const double m = c / w0;
+                u0[i] = w0; u1[i] = w1; u2[i] = 0; piv[i] = 0; mult[i] = m;
+                w0 = dn - m * w1;
+                w1 = en;
+            } else {
+                const double m = w0 / c;
+                u0[i] = c; u1[i] = dn; u2[i] = en; piv[i] = 1; mult[i] = m;
+                w0 = w1 - m * dn;
+                w1 = -m * en;
+            }
+        }
+        u0[n - 1] = w0 == 0 ? tiny : w0;
+
+        double *y = Y + (std::size_t)j * n;
+        for (int i = 0; i < n; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            y[i] = ((seed >> 8) & 0xffff) / 65536.0 - 0.5;
+        }
+        for (int it = 0; it < 4; ++it) {
+            std::copy(y, y + n, x);
+            for (int i = 0; i < n - 1; ++i) {
+                if (piv[i] != 0) std::swap(x[i], x[i + 1]);
+                x[i + 1] -= mult[i] * x[i];
+            }
+            for (int i = n - 1; i >= 0; --i) {
+                double s = x[i];
+                if (i + 1 < n) s -= u1[i] * x[i + 1];
+                if (i + 2 < n) s -= u2[i] * x[i + 2];
+                x[i] = s / u0[i];
+            }
+            for (int q = first; q < j; ++q) {
+                const double *yq = Y + (std::size_t)q * n;
+                double dot = 0;
+                for (int i = 0; i < n; ++i) dot += yq[i] * x[i];
+                for (int i = 0; i < n; ++i) x[i] -= dot * yq[i];
+            }
+            double nrm = 0;
+            for (int i = 0; i < n; ++i) nrm += x[i] * x[i];
+            nrm = std::sqrt(nrm);
+            if (nrm == 0) { x[j % n] = 1; nrm = 1; }
+            for (int i = 0; i < n; ++i) y[i] = x[i] / nrm;
+        }
+    }
+}
+
+// y <- Q y with Q = H_0 H_1 ... H_{n-3} from tridiagonalize.
+inline void backTransform(int n, const double *A, const double *beta, double *y)
+{
+    for (int k = n - 3; k >= 0; --k) {
+        if (beta[k] == 0) continue;
+        const int m = n - k - 1;
+        double s = 0;
+        for (int i = 0; i < m; ++i) s += A[(k + 1 + i) * n + k] * y[k + 1 + i];
+        s *= beta[k];
+        for (int i = 0; i < m; ++i) y[k + 1 + i] -= s * A[(k + 1 + i) * n + k];
+    }
+}
+
+} // namespace detail
+
+// Marchenko-Pastur threshold of MPdenoising.m (centering = false). vals are
+// the R = min(M,N) eigenvalues of X X'/N in decreasing order. Returns the
+// number of signal components (t-1), or -1 when no threshold is found, and
+// sets sigma2 to the noise variance sigmasq_1(t).
+inline int threshold(const double *vals, int R, int M, int N, double &sigma2)
+{
+    const double big = std::max(M, N);
+    double csum = 0;
+    std::vector<double> cmean(R);
+    for (int i = R - 1; i >= 0; --i) {
+        csum += vals[i];
+        cmean[i] = csum / (R - i);
+    }
+    for (int i = 0; i < R; ++i) {
+        const double s1 = cmean[i] / ((big - i) / N);
+        const double s2 = (vals[i] - vals[R - 1]) / (4 * std::sqrt((M - i) / static_cast<double>(N)));
+        if (s2 < s1) {
+            sigma2 = s1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Per-thread scratch of the patch decomposition.
+struct Workspace {
+    std::vector<double> G, A, d, e, beta, vals, Y, work;
+    void resize(int n, int M, int N)
+    {
+        const std::size_t nn = (std::size_t)n * n;
+        G.resize((std::size_t)M * M);
+        A.resize(nn);
+        d.resize(n); e.resize(n); beta.resize(n); vals.resize(n);
+        Y.resize(nn);
+        work.resize(6 * (std::size_t)n + 2 * (std::size_t)std::max(M, N));
+    }
+};
+
+// Denoises data (nx x ny x nz x M, column-major) at the given patch centres
+// (ordered as in MPdenoising.m) with a (2k+1)^3 window. Patches must lie
+// inside the volume. full: sliding window (only the centre voxel of each
+// patch is written), otherwise block processing (the whole patch is
+// written). Signal (same size as data) and Sigma (nx x ny x nz) hold
+// initial values (usually zeros); voxels that are not written keep them.
+template <class T>
+void denoise(const Volume &vol, const T *data, const int k[3], const std::vector<Centre> &centres,
+             bool full, T *Signal, T *Sigma, int nthreads = 0)
+{
+    const int M = vol.M;
+    const std::size_t nx = vol.nx, ny = vol.ny, nVox = vol.nVox();
+    const int wx = 2 * k[0] + 1, wy = 2 * k[1] + 1, wz = 2 * k[2] + 1;
+    const int N = wx * wy * wz, R = std::min(M, N), cIdx = (N - 1) / 2;
+    const bool small = M <= N;   // diagonalize X X' (else X' X)
+    if (centres.empty()) return;
+
+    // Slabs: runs of whole z planes of centres, about 4 per thread.
+    const int nt = num_threads(nthreads);
+    const std::size_t target = std::max<std::size_t>(1, centres.size() / (4 * (std::size_t)nt));
+    std::vector<std::size_t> start(1, 0);
+    for (std::size_t c = 1; c < centres.size(); ++c)
+        if (centres[c].z != centres[c - 1].z && c - start.back() >= target) start.push_back(c);
+    const std::size_t nSlabs = start.size();
+    start.push_back(centres.size());
+
+    // z range written by each slab; planes written by more than one slab
+    // go through the overlap buffers (block sampling only).
+    std::vector<int> zlo(nSlabs), zhi(nSlabs);
+    for (std::size_t s = 0; s < nSlabs; ++s) {
+        zlo[s] = zhi[s] = centres[start[s]].z;
+        for (std::size_t c = start[s]; c < start[s + 1]; ++c) {
+            zlo[s] = std::min(zlo[s], centres[c].z);
+            zhi[s] = std::max(zhi[s], centres[c].z);
+        }
+        zlo[s] -= k[2];
+        zhi[s] += k[2];
+    }
+    std::vector<int> writers(vol.nz, 0);
+    if (!full)
+        for (std::size_t s = 0; s < nSlabs; ++s)
+            for (int z = zlo[s]; z <= zhi[s]; ++z) ++writers[z];
+    const std::size_t plane = nx * ny;
+    // Buffers hold the shared planes of the slab only; slot[s][z - zlo[s]]
+    // is the index of plane z among them, -1 when z is not shared.
+    std::vector<std::vector<int> > slot(nSlabs);
+    std::vector<std::vector<T> > overlap(nSlabs);
+    std::vector<std::vector<unsigned char> > written(nSlabs);
+    if (!full)
+        for (std::size_t s = 0; s < nSlabs; ++s) {
+            slot[s].assign(zhi[s] - zlo[s] + 1, -1);
+            int shared = 0;
+            for (int z = zlo[s]; z <= zhi[s]; ++z)
+                if (writers[z] > 1) slot[s][z - zlo[s]] = shared++;
+        }
+
+    const int width = parallel_width(nSlabs, 1, nthreads);
+    std::vector<Workspace> ws(width);
+    for (int t = 0; t < width; ++t) ws[t].resize(R, M, N);
+
+    parallel_for(nSlabs, 1, [&](std::size_t s0, std::size_t s1, int tid) {
+        Workspace &w = ws[tid];
+        std::vector<T> buf;
+        std::vector<const T *> X(N);
+        std::vector<double> eTmp(R), lambda(R);
+        for (std::size_t s = s0; s < s1; ++s) {
+            // Gather the slab into a voxel-major buffer (box around its patches).
+            int bx0 = centres[start[s]].x, bx1 = bx0, by0 = centres[start[s]].y, by1 = by0;
+            for (std::size_t c = start[s]; c < start[s + 1]; ++c) {
+                bx0 = std::min(bx0, centres[c].x); bx1 = std::max(bx1, centres[c].x);
+                by0 = std::min(by0, centres[c].y); by1 = std::max(by1, centres[c].y);
+            }
+            bx0 -= k[0]; bx1 += k[0]; by0 -= k[1]; by1 += k[1];
+            const std::size_t bnx = bx1 - bx0 + 1, bny = by1 - by0 + 1, bnz = zhi[s] - zlo[s] + 1;
+            buf.resize(bnx * bny * bnz * M);
+            for (int m = 0; m < M; ++m)
+                for (std::size_t z = 0; z < bnz; ++z)
+                    for (std::size_t y = 0; y < bny; ++y) {
+                        const T *src = data + m * nVox + ((zlo[s] + z) * ny + by0 + y) * nx + bx0;
+                        T *dst = &buf[((z * bny + y) * bnx) * M + m];
+                        for (std::size_t x = 0; x < bnx; ++x) dst[x * M] = src[x];
+                    }
+            auto voxel = [&](int x, int y, int z) -> const T * {
+                return &buf[(((std::size_t)(z - zlo[s]) * bny + (y - by0)) * bnx + (x - bx0)) * M];
+            };
+            auto rank1 = [&](const T *v, double sign) {
+                for (int i = 0; i < M; ++i) {
+                    const double vi = sign * v[i];
+                    double *g = &w.G[(std::size_t)i * M];
+                    for (int j = i; j < M; ++j) g[j] += vi * v[j];
+                }
+            };
+
+            if (!full) {
+                int shared = 0;
+                for (int z = zlo[s]; z <= zhi[s]; ++z) shared += writers[z] > 1;
+                if (shared) {
+                    overlap[s].assign((std::size_t)shared * plane * M, T(0));
+                    written[s].assign((std::size_t)shared * plane, 0);
+                }
+            }
+
+            bool haveGram = false;
+            for (std::size_t c = start[s]; c < start[s + 1]; ++c) {
+                const Centre &p = centres[c];
+
+                // Patch matrix: X(:, j) is the j-th voxel of the window in
+                // MATLAB (column-major) order.
+                {
+                    int j = 0;
+                    for (int dz = -k[2]; dz <= k[2]; ++dz)
+                        for (int dy = -k[1]; dy <= k[1]; ++dy)
+                            for (int dx = -k[0]; dx <= k[0]; ++dx) X[j++] = voxel(p.x + dx, p.y + dy, p.z + dz);
+                }
+
+                int n = R;
+                double *A = &w.A[0];
+                if (small) {
+                    const Centre *q = c > start[s] ? &centres[c - 1] : NULL;
+                    if (full && haveGram && q->x + 1 == p.x && q->y == p.y && q->z == p.z) {
+                        for (int dz = -k[2]; dz <= k[2]; ++dz)
+                            for (int dy = -k[1]; dy <= k[1]; ++dy) {
+                                rank1(voxel(q->x - k[0], p.y + dy, p.z + dz), -1);
+                                rank1(voxel(p.x + k[0], p.y + dy, p.z + dz), 1);
+                            }
+                    } else {
+                        std::fill(w.G.begin(), w.G.end(), 0.0);
+                        for (int j = 0; j < N; ++j) rank1(X[j], 1);
+                        haveGram = true;
+                    }
+                    for (int i = 0; i < M; ++i)
+                        for (int j = i; j < M; ++j)
+                            A[i * M + j] = A[j * M + i] = w.G[(std::size_t)i * M + j];
+                } else {
+                    for (int a = 0; a < N; ++a)
+                        for (int b = 0; b <= a; ++b) {
+                            double sum = 0;
+                            for (int i = 0; i < M; ++i) sum += static_cast<double>(X[a][i]) * X[b][i];
+                            A[a * N + b] = A[b * N + a] = sum;
+                        }
+                }
+
+                detail::tridiagonalize(n, A, &w.d[0], &w.e[0], &w.beta[0], &w.work[0]);
+                std::copy(w.d.begin(), w.d.begin() + n, w.vals.begin());
+                std::copy(w.e.begin(), w.e.begin() + n, eTmp.begin());
+                detail::tridiagonalEigenvalues(n, &w.vals[0], &eTmp[0]);
+                std::sort(w.vals.begin(), w.vals.begin() + n, std::greater<double>());
+                for (int i = 0; i < n; ++i) w.vals[i] = std::max(w.vals[i], 0.0) / N;
+
+                double sigma2 = 0;
+                const int kept = threshold(&w.vals[0], R, M, N, sigma2);
+                const std::size_t centreVox = ((std::size_t)p.z * ny + p.y) * nx + p.x;
+                Sigma[centreVox] = static_cast<T>(kept < 0 ? std::numeric_limits<double>::quiet_NaN()
+                                                           : std::sqrt(sigma2));
+
+                // Eigenvectors of the kept components (rows of Y, length n).
+                if (kept > 0) {
+                    for (int i = 0; i < kept; ++i) lambda[i] = w.vals[i] * N;
+                    detail::inverseIteration(n, &w.d[0], &w.e[0], &lambda[0], kept, &w.Y[0], &w.work[0]);
+                    for (int i = 0; i < kept; ++i) detail::backTransform(n, A, &w.beta[0], &w.Y[(std::size_t)i * n]);
+                }
+
+                // Denoised patch column j.
+                double *out = &w.work[6 * (std::size_t)n];
+                auto rebuild = [&](int j) {
+                    if (kept < 0) {
+                        for (int i = 0; i < M; ++i) out[i] = X[j][i];
+                    } else if (small) {
+                        // U_k (U_k' x_j)
+                        std::fill(out, out + M, 0.0);
+                        for (int q = 0; q < kept; ++q) {
+                            const double *u = &w.Y[(std::size_t)q * n];
+                            double cq = 0;
+                            for (int i = 0; i < M; ++i) cq += u[i] * X[j][i];
+                            for (int i = 0; i < M; ++i) out[i] += cq * u[i];
+                        }
+                    } else {
+                        // X (V_k V_k' e_j)
+                        std::fill(out, out + M, 0.0);
+                        for (int a = 0; a < N; ++a) {
+                            double wa = 0;
+                            for (int q = 0; q < kept; ++q) wa += w.Y[(std::size_t)q * n + a] * w.Y[(std::size_t)q * n + j];
+                            if (wa != 0)
+                                for (int i = 0; i < M; ++i) out[i] += wa * X[a][i];
+                        }
+                    }
+                };
+
+                if (full) {
+                    rebuild(cIdx);
+                    for (int i = 0; i < M; ++i) Signal[centreVox + i * nVox] = static_cast<T>(out[i]);
+                    continue;
+                }
+                int j = 0;
+                for (int dz = -k[2]; dz <= k[2]; ++dz)
+                    for (int dy = -k[1]; dy <= k[1]; ++dy)
+                        for (int dx = -k[0]; dx <= k[0]; ++dx, ++j) {
+                            rebuild(j);
+                            const int z = p.z + dz;
+                            const std::size_t inPlane = (std::size_t)(p.y + dy) * nx + p.x + dx;
+                            if (writers[z] > 1) {
+                                const std::size_t o = (std::size_t)slot[s][z - zlo[s]] * plane + inPlane;
+                                for (int i = 0; i < M; ++i) overlap[s][o * M + i] = static_cast<T>(out[i]);
+                                written[s][o] = 1;
+                            } else {
+                                const std::size_t v = z * plane + inPlane;
+                                for (int i = 0; i < M; ++i) Signal[v + i * nVox] = static_cast<T>(out[i]);
+                            }
+                        }
+            }
+        }
+    }, nthreads);
+
+    // Merge the shared planes in slab (= centre) order: the last writer wins.
+    for (std::size_t s = 0; s < nSlabs; ++s) {
+        if (written[s].empty()) continue;
+        for (int z = zlo[s]; z <= zhi[s]; ++z) {
+            if (writers[z] <= 1) continue;
+            for (std::size_t q = 0; q < plane; ++q) {
+                const std::size_t o = (std::size_t)slot[s][z - zlo[s]] * plane + q;
+                if (!written[s][o]) continue;
+                for (int i = 0; i < M; ++i) Signal[z * plane + q + i * nVox] = overlap[s][o * M + i];
+            }
+        }
+    }
+}
+
+} // namespace mppca
+} // namespace qmr
+
+#endif
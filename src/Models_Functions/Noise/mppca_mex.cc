@@ -0,0 +1,115 @@
+/*
+ * [Signal, Sigma] = mppca_mex(data, centres, kernel, sampling, opts)
+ *
+ * Marchenko-Pastur PCA denoising of data at the given patch centres (see
+ * mppca.hh). Use through MPdenoising_batch.m, which computes the centres
+ * as MPdenoising.m does.
+ *
+ *   data      nx x ny x nz x M, double or single
+ *   centres   nC x 3 patch centres [x y z] (1-based), in MPdenoising order
+ *   kernel    odd window size [kx ky kz]
+ *   sampling  'full' (sliding window) or 'fast' (block processing)
+ *   opts      optional struct: NumThreads (0: all cores), InitSignal and
+ *             InitSigma (initial Signal and Sigma, default zeros)
+ *
+ * Signal has the size and class of data, Sigma is nx x ny x nz. Voxels
+ * that are not written by any patch keep their initial value; Sigma is NaN
+ * at centres where no Marchenko-Pastur threshold is found (the patch is
+ * then kept as is). MPdenoising_stream passes the planes shared with the
+ * previous slab as InitSignal/InitSigma.
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "mppca.hh"
+
+static const char *kName = "mppca_mex";
+
+template <class T>
+static void run(const qmr::mppca::Volume &vol, const mxArray *data, const int k[3],
+                const std::vector<qmr::mppca::Centre> &centres, bool full, mxArray *Signal,
+                mxArray *Sigma, int nthreads)
+{
+    qmr::mppca::denoise(vol, static_cast<const T *>(mxGetData(data)), k, centres, full,
+                        static_cast<T *>(mxGetData(Signal)), static_cast<T *>(mxGetData(Sigma)), nthreads);
+}
+
+// Output array: a copy of opts.(field) when given (same class and number
+// of elements as the output), zeros otherwise.
+static mxArray *initial(const mxArray *opts, const char *field, mwSize nd, const mwSize *dims, mxClassID cls)
+{
+    const mxArray *init = opts && mxIsStruct(opts) ? mxGetField(opts, 0, field) : NULL;
+    if (!init || mxIsEmpty(init)) return mxCreateNumericArray(nd, dims, cls, mxREAL);
+    std::size_t n = 1;
+    for (mwSize i = 0; i < nd; ++i) n *= dims[i];
+    if (mxGetClassID(init) != cls || mxIsComplex(init) || mxGetNumberOfElements(init) != n)
+        qmr::mex::fail(kName, "invalidOption", std::string(field) + " must match the output size and class.");
+    mxArray *out = mxCreateNumericArray(nd, dims, cls, mxREAL);
+    std::memcpy(mxGetData(out), mxGetData(init), n * mxGetElementSize(init));
+    return out;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "mppca_mex expects 4 or 5 input arguments.");
+
+    const mxArray *data = prhs[0];
+    if (!(mxIsDouble(data) || mxIsSingle(data)) || mxIsComplex(data) || mxIsSparse(data))
+        qmr::mex::fail(kName, "invalidInputType", "data must be a real double or single array.");
+    std::vector<std::size_t> d = qmr::mex::dims(data, 4);
+    if (d.size() > 4)
+        qmr::mex::fail(kName, "invalidInputSize", "data must be nx x ny x nz x M.");
+    qmr::mppca::Volume vol;
+    vol.nx = d[0]; vol.ny = d[1]; vol.nz = d[2]; vol.M = (int)d[3];
+
+    qmr::mex::requireDouble(kName, prhs[1], "centres");
+    const std::size_t nC = mxGetM(prhs[1]);
+    if (nC && mxGetN(prhs[1]) != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "centres must be nC x 3.");
+
+    std::vector<double> kernel = qmr::mex::toVector(prhs[2]);
+    if (kernel.size() != 3)
+        qmr::mex::fail(kName, "invalidInputSize", "kernel must be [kx ky kz].");
+    int k[3];
+    for (int i = 0; i < 3; ++i) {
+        if (!(kernel[i] >= 1) || static_cast<int>(kernel[i]) % 2 == 0)
+            qmr::mex::fail(kName, "invalidKernel", "kernel sizes must be odd and positive.");
+        k[i] = static_cast<int>(kernel[i]) / 2;
+    }
+
+    const std::string sampling = qmr::mex::string(kName, prhs[3], "sampling");
+    if (sampling != "full" && sampling != "fast")
+        qmr::mex::fail(kName, "invalidSampling", "sampling must be 'full' or 'fast'.");
+    const int nthreads = (int)qmr::mex::option(nrhs > 4 ? prhs[4] : NULL, "NumThreads", 0.0);
+
+    const double *c = mxGetPr(prhs[1]);
+    const long n[3] = {(long)vol.nx, (long)vol.ny, (long)vol.nz};
+    std::vector<qmr::mppca::Centre> centres(nC);
+    for (std::size_t i = 0; i < nC; ++i) {
+        long v[3];
+        for (int a = 0; a < 3; ++a) {
+            v[a] = static_cast<long>(c[i + a * nC]) - 1;
+            if (v[a] - k[a] < 0 || v[a] + k[a] >= n[a])
+                qmr::mex::fail(kName, "patchOutOfBounds", "Patch exceeds the data dimensions.");
+        }
+        centres[i].x = (int)v[0]; centres[i].y = (int)v[1]; centres[i].z = (int)v[2];
+    }
+
+    const mxClassID cls = mxIsSingle(data) ? mxSINGLE_CLASS : mxDOUBLE_CLASS;
+    mwSize dimsOut[4] = {d[0], d[1], d[2], d[3]};
+    const mxArray *opts = nrhs > 4 ? prhs[4] : NULL;
+    plhs[0] = initial(opts, "InitSignal", 4, dimsOut, cls);
+    mxArray *Sigma = initial(opts, "InitSigma", 3, dimsOut, cls);
+
+    if (cls == mxSINGLE_CLASS) run<float>(vol, data, k, centres, sampling == "full", plhs[0], Sigma, nthreads);
+    else run<double>(vol, data, k, centres, sampling == "full", plhs[0], Sigma, nthreads);
+
+    if (nlhs > 1) plhs[1] = Sigma; else mxDestroyArray(Sigma);
+}
@@ -21,9 +21,7 @@ function freqEstimate = averageEchoesWithWeights(imPhase, imMagnitude, TE)
 
 % Spatially unwrap phase
 disp('Started   : Laplacian phase unwrapping ...');
-for iEcho = numel(TE):-1:1
-    imPhaseUw(:,:,:,iEcho) = unwrapPhaseLaplacian(imPhase(:,:,:,iEcho));
-end
+imPhaseUw = unwrapPhaseLaplacian(imPhase(:,:,:,1:numel(TE)));
 disp('Completed : Laplacian phase unwrapping');
 disp('-----------------------------------------------');
 
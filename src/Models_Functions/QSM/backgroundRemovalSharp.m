@@ -24,6 +24,13 @@ function [nfm_Sharp_lunwrap, mask_sharp] = backgroundRemovalSharp(phase_lunwrap,
     if nargin < 4
         filterMode = 'once';
     end
+
+    % Compiled engine (qMRbuildMex): same filter with real-to-complex FFTs
+    if exist('qsm_mex','file')==3 && ndims(phase_lunwrap)==3 && ~any(mod(size(phase_lunwrap),2))
+        [nfm_Sharp_lunwrap, mask_sharp] = qsm_mex('sharp', double(phase_lunwrap), mask_pad, filterMode);
+        return
+    end
+
     switch filterMode
         case 'once'
             [nfm_Sharp_lunwrap, mask_sharp] = sharp_once(phase_lunwrap, mask_pad);
@@ -1,6 +1,35 @@
 function [lambdaL2] = calcLambdaL2(phaseUnwrapped,rangeLambda, imageResolution, directionFlag)
 
 
+  if exist('qsm_mex','file')==3 && ndims(phaseUnwrapped)==3 && ~any(mod(size(phaseUnwrapped),2))
+    % Compiled engine (qMRbuildMex): one FFT, all lambdas from k-space
+    tic
+    [consistency, regularization] = qsm_mex('lcurvel2', double(phaseUnwrapped), rangeLambda, imageResolution, directionFlag);
+    consistency = reshape(consistency, size(rangeLambda));
+    regularization = reshape(regularization, size(rangeLambda));
+    toc
+  else
+    [consistency, regularization] = sweepLambda(phaseUnwrapped, rangeLambda, imageResolution, directionFlag);
+  end
+
+  % figure(), subplot(1,2,1), plot(consistency, regularization, 'marker', '*')
+
+  % cubic spline differentiation to find Kappa (largest curvature)
+
+  [index_opt, ~] = findOptimalKappa(rangeLambda, regularization, consistency, [true true]);
+
+  disp(['Optimal lambda, consistency, regularization: ', num2str([rangeLambda(index_opt), consistency(index_opt), regularization(index_opt)])])
+
+  %figure(get(gcf,'Number')), subplot(1,2,2), semilogx(rangeLambda, Kappa, 'marker', '*')
+
+  %% closed form solution with optimal lambda
+
+  lambdaL2 = rangeLambda(index_opt);
+
+end
+
+function [consistency, regularization] = sweepLambda(phaseUnwrapped, rangeLambda, imageResolution, directionFlag)
+
   N = size(phaseUnwrapped);
 
   [fdx, fdy, fdz] = calcFdr(N, directionFlag);
@@ -36,21 +65,7 @@ function [lambdaL2] = calcLambdaL2(phaseUnwrapped,rangeLambda, imageResolution,
   end
   toc
 
-  % figure(), subplot(1,2,1), plot(consistency, regularization, 'marker', '*')
-
   % Memory cleanup
   clear nfm_forward Nfm_pad
 
-  % cubic spline differentiation to find Kappa (largest curvature)
-
-  [index_opt, ~] = findOptimalKappa(rangeLambda, regularization, consistency, [true true]);
-
-  disp(['Optimal lambda, consistency, regularization: ', num2str([rangeLambda(index_opt), consistency(index_opt), regularization(index_opt)])])
-
-  %figure(get(gcf,'Number')), subplot(1,2,2), semilogx(rangeLambda, Kappa, 'marker', '*')
-
-  %% closed form solution with optimal lambda
-
-  lambdaL2 = rangeLambda(index_opt);
-
 end
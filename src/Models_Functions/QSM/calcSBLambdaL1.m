@@ -16,6 +16,42 @@ function lambda_L1 = calcSBLambdaL1(nfm_Sharp_lunwrap, Lambda, lambda_L2, imageR
 %   72: 1444-1459. doi:10.1002/mrm.25029
 %
 
+    if exist('qsm_mex','file')==3 && ndims(nfm_Sharp_lunwrap)==3 && ~any(mod(size(nfm_Sharp_lunwrap),2))
+        % Compiled engine (qMRbuildMex). An ascending Lambda is solved as a
+        % warm-started path from its largest value, stopping 3 lambdas past
+        % the L-curve corner; otherwise all lambdas are solved concurrently.
+        tic
+        opts = struct('WarmStart', all(diff(Lambda(:)) > 0), 'Bracket', 3);
+        [SB_consistency, SB_regularization] = qsm_mex('lcurvel1', double(nfm_Sharp_lunwrap), Lambda, lambda_L2, imageResolution, directionFlag, opts);
+        SB_consistency = reshape(SB_consistency, size(Lambda));
+        SB_regularization = reshape(SB_regularization, size(Lambda));
+        for h = find(~isnan(SB_consistency(:)'))
+            disp([num2str(h), ' ->   Lambda: ', num2str(Lambda(h)), '   Consistency: ', num2str(SB_consistency(h)), '   Regularization: ', num2str(SB_regularization(h))])
+        end
+        toc
+    else
+        [SB_consistency, SB_regularization] = sweepLambda(nfm_Sharp_lunwrap, Lambda, lambda_L2, imageResolution, directionFlag);
+    end
+
+    %figure(), subplot(1,2,1), plot(SB_consistency, SB_regularization, 'marker', '*'), axis square
+
+    % cubic spline differentiation to find Kappa (largest curvature) over
+    % the lambdas evaluated (all of them, unless the path stopped early)
+
+    solved = find(~isnan(SB_consistency));
+    [index_opt, ~] = findOptimalKappa(Lambda(solved), SB_regularization(solved), SB_consistency(solved), [false true]);
+    index_opt = solved(index_opt);
+    
+    disp(['Optimal lambda, consistency, regularization: ', num2str([Lambda(index_opt), SB_consistency(index_opt), SB_regularization(index_opt)])])
+
+%    figure(get(gcf,'Number')), subplot(1,2,2), semilogx(Lambda, Kappa, 'marker', '*'), axis tight
+
+    lambda_L1 = Lambda(index_opt);
+
+end
+
+function [SB_consistency, SB_regularization] = sweepLambda(nfm_Sharp_lunwrap, Lambda, lambda_L2, imageResolution, directionFlag)
+
     N = size(nfm_Sharp_lunwrap);
     FOV = N .* imageResolution;  % (in milimeters)
 
@@ -84,16 +120,4 @@ function lambda_L1 = calcSBLambdaL1(nfm_Sharp_lunwrap, Lambda, lambda_L2, imageR
     % Memory cleanup
     clear D DFy Fu nfm_Sharp_lunwrap nx ny nz residual rox roy roz vx vy vz
 
-    %figure(), subplot(1,2,1), plot(SB_consistency, SB_regularization, 'marker', '*'), axis square
-
-    % cubic spline differentiation to find Kappa (largest curvature) 
-
-    [index_opt, ~] = findOptimalKappa(Lambda, SB_regularization, SB_consistency, [false true]);
-    
-    disp(['Optimal lambda, consistency, regularization: ', num2str([Lambda(index_opt), SB_consistency(index_opt), SB_regularization(index_opt)])])
-
-%    figure(get(gcf,'Number')), subplot(1,2,2), semilogx(Lambda, Kappa, 'marker', '*'), axis tight
-
-    lambda_L1 = Lambda(index_opt);
-
 end
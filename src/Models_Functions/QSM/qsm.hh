@@ -0,0 +1,618 @@
+/*
+ * qsm.hh: Laplacian unwrapping, SHARP background removal and
+ * Split-Bregman susceptibility mapping of qsm_sb (backgroundRemovalSharp.m, qsmSplitBregman.m and the
+ * L-curve sweeps of calcSBLambdaL1.m and calcLambdaL2.m).
+ *
+ * Every volume handled here is real and every k-space kernel (dipole,
+ * finite differences, SHARP spheres) is the spectrum of a real operator,
+ * so the transforms are real-to-complex: volumes are kept in image space
+ * as doubles and spectra as the first n1/2+1 rows of the fftn (see
+ * qmr_fft.hh), which halves the FLOPs and the memory of the complex fftn
+ * chain of the MATLAB code. The dipole kernel, the difference operators
+ * and the SB_reg denominator are evaluated on the fly from 1D tables, and
+ * each kernel multiply is fused with the accumulation that consumes it.
+ *
+ * A Split-Bregman solve holds a fixed set of work arrays (SBState): the
+ * three v and the three n volumes of the iteration, the current spectrum
+ * Fu, an accumulator and one transform buffer. The L-curve runs several
+ * lambdas at once, one SBState each, bounded by a memory budget; the
+ * threads left over go to the FFTs of each solve. The regularization path
+ * instead warm-starts each lambda from its neighbour and stops once the
+ * L-curve corner is bracketed. L-curve terms are evaluated in k-space, so
+ * the closed-form L2 sweep needs a single transform for all lambdas.
+ *
+ * Laplacian unwrapping (unwrapPhaseLaplacian.m, laplacianUnwrap.m) takes
+ * the Laplacian of the wrapped phase with the 7-point stencil in image
+ * space, which is what the fftn products with del_op compute, so only the
+ * inversion goes through k-space: one forward and one inverse transform
+ * per echo.
+ *
+ * Volume dimensions must be even, as in the MATLAB code (kspaceKernel and
+ * the SHARP kernel are centred on N/2+1).
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#ifndef QSM_HH
+#define QSM_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "qmr_fft.hh"
+#include "qmr_parallel.hh"
+
+namespace qmr {
+namespace qsm {
+
+typedef fft::cplx cplx;
+
+static const double kPi = 3.14159265358979323846;
+static const double kEps = 2.220446049250313e-16;   // MATLAB eps
+
+struct Dims {
+    std::size_t n[3];
+    std::size_t numel() const { return n[0] * n[1] * n[2]; }
+};
+
+// Frequency of fftshift(kspaceKernel) index p along an axis of length n.
+inline double shiftedFrequency(std::size_t p, std::size_t n)
+{
+    return p < n / 2 ? (double)p : (double)p - (double)n;
+}
+
+// Spectra shared by the SHARP and Split-Bregman steps: the per-axis
+// difference operators of calcFdr and the dipole kernel of kspaceKernel.
+class Operators {
+public:
+    Operators(const Dims &d, const double res[3], bool forward)
+    {
+        for (int a = 0; a < 3; ++a) {
+            const std::size_t n = d.n[a];
+            fd_[a].resize(n);
+            e_[a].resize(n);
+            kv_[a].resize(n);
+            const double dk = 1.0 / (n * res[a]);
+            for (std::size_t k = 0; k < n; ++k) {
+                const double t = 2 * kPi * (double)k / (double)n;
+                // forward: 1 - exp(-2*pi*i*k/N), backward: -1 + exp(2*pi*i*k/N)
+                fd_[a][k] = forward ? cplx(1 - std::cos(t), std::sin(t)) : cplx(-1 + std::cos(t), std::sin(t));
+                e_[a][k] = std::norm(fd_[a][k]);
+                kv_[a][k] = shiftedFrequency(k, n) * dk;
+            }
+        }
+    }
+
+    // fftshift(kspaceKernel(FOV, N)) at (k1, k2, k3).
+    double dipole(std::size_t k1, std::size_t k2, std::size_t k3) const
+    {
+        const double kx = kv_[0][k1], ky = kv_[1][k2], kz = kv_[2][k3];
+        if (kx == 0 && ky == 0 && kz == 0) return 0;
+        return 1.0 / 3 - kz * kz / (kx * kx + ky * ky + kz * kz);
+    }
+
+    const cplx &fd(int axis, std::size_t k) const { return fd_[axis][k]; }
+    // |fdx|^2 + |fdy|^2 + |fdz|^2
+    double e2(std::size_t k1, std::size_t k2, std::size_t k3) const { return e_[0][k1] + e_[1][k2] + e_[2][k3]; }
+
+private:
+    std::vector<cplx> fd_[3];
+    std::vector<double> e_[3], kv_[3];
+};
+
+// Calls f(k1, k2, k3, i) for every value i of the half spectrum of `t`,
+// (k2, k3) lines split among threads.
+template <class F>
+void forSpectrum(const fft::RealFft3d &t, F f)
+{
+    const std::size_t h = t.rows(), n2 = t.n2(), lines = n2 * t.n3();
+    parallel_for(lines, std::max<std::size_t>(1, lines / (8 * (std::size_t)num_threads(t.threads()))),
+                 [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t l = b; l < e; ++l)
+            for (std::size_t k1 = 0; k1 < h; ++k1) f(k1, l % n2, l / n2, l * h + k1);
+    }, t.threads());
+}
+
+// Calls f(i) for every voxel of the volume of `t`, split among threads.
+template <class F>
+void forVoxels(const fft::RealFft3d &t, F f)
+{
+    const std::size_t n = t.realSize();
+    parallel_for(n, std::max<std::size_t>(4096, n / (8 * (std::size_t)num_threads(t.threads()))),
+                 [&](std::size_t b, std::size_t e, int) {
+        for (std::size_t i = b; i < e; ++i) f(i);
+    }, t.threads());
+}
+
+// Weight of half-spectrum row k1 in a full-spectrum sum of squares.
+inline double hermitianWeight(std::size_t k1, std::size_t n1)
+{
+    return (k1 == 0 || 2 * k1 == n1) ? 1.0 : 2.0;
+}
+
+// ---------------------------------------------------------------- SHARP
+
+// Binary erosion along `axis` by a line of 2*hw+1 voxels; voxels outside
+// the volume count as set (imerode of a logical image).
+inline void erodeAxis(std::vector<unsigned char> &m, const Dims &d, int axis, std::size_t hw)
+{
+    const std::size_t n = d.n[axis];
+    const std::size_t stride = axis == 0 ? 1 : axis == 1 ? d.n[0] : d.n[0] * d.n[1];
+    const std::size_t lines = d.numel() / n;
+    std::vector<std::size_t> zeros(n + 1);
+    std::vector<unsigned char> line(n);
+    for (std::size_t l = 0; l < lines; ++l) {
+        const std::size_t base = axis == 0 ? l * n : axis == 1 ? (l % d.n[0]) + (l / d.n[0]) * d.n[0] * d.n[1] : l;
+        for (std::size_t i = 0; i < n; ++i) {
+            line[i] = m[base + i * stride];
+            zeros[i + 1] = zeros[i] + (line[i] ? 0 : 1);
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::size_t lo = i > hw ? i - hw : 0, hi = std::min(n, i + hw + 1);
+            m[base + i * stride] = zeros[hi] == zeros[lo];
+        }
+    }
+}
+
+// erode_mask of backgroundRemovalSharp: strel('line', ksize+1, ...) spans
+// 2*round(ksize/2)+1 voxels, applied along dims 2, 1 and 3.
+inline std::vector<unsigned char> erodeMask(const std::vector<unsigned char> &mask, const Dims &d, const int ksize[3])
+{
+    std::vector<unsigned char> m(mask);
+    const int axes[3] = {1, 0, 2};
+    for (int i = 0; i < 3; ++i) erodeAxis(m, d, axes[i], (std::size_t)std::floor(ksize[i] / 2.0 + 0.5));
+    return m;
+}
+
+// calc_del_kernel: spectrum (real, half) of delta minus the normalized
+// ellipsoid of semi-axes (ksize-1)/2 centred on voxel 1.
+inline std::vector<double> sharpKernel(const fft::RealFft3d &t, const Dims &d, const int ksize[3])
+{
+    const int kh[3] = {(ksize[0] - 1) / 2, (ksize[1] - 1) / 2, (ksize[2] - 1) / 2};
+    std::vector<double> img(d.numel(), 0.0);
+    double count = 0;
+    // meshgrid(a, b, c): a runs along dim 2 with kh(2), b along dim 1 with
+    // kh(1), and the ellipsoid test pairs a with kh(1), b with kh(2)
+    for (int pass = 0; pass < 2; ++pass)
+        for (int o3 = -kh[2]; o3 <= kh[2]; ++o3)
+            for (int o2 = -kh[1]; o2 <= kh[1]; ++o2)
+                for (int o1 = -kh[0]; o1 <= kh[0]; ++o1) {
+                    const double r = (double)o2 * o2 / ((double)kh[0] * kh[0]) +
+                                     (double)o1 * o1 / ((double)kh[1] * kh[1]) +
+                                     (double)o3 * o3 / ((double)kh[2] * kh[2]);
+                    if (r > 1) continue;
+                    if (pass == 0) { count += 1; continue; }
+                    const std::size_t i1 = (o1 + d.n[0]) % d.n[0], i2 = (o2 + d.n[1]) % d.n[1], i3 = (o3 + d.n[2]) % d.n[2];
+                    img[i1 + d.n[0] * (i2 + d.n[1] * i3)] = 1 / count;
+                }
+    img[0] -= 1;
+    std::vector<cplx> spec(t.complexSize());
+    t.forward(&img[0], &spec[0]);
+    std::vector<double> del(spec.size());
+    for (std::size_t i = 0; i < spec.size(); ++i) del[i] = spec[i].real();
+    return del;
+}
+
+// backgroundRemovalSharp: phase (n volume) and mask in, out receives the
+// SHARP-filtered phase and maskOut the eroded mask.
+inline void sharp(const double *phase, const std::vector<unsigned char> &mask, const Dims &d, bool iterative,
+                  double *out, std::vector<unsigned char> &maskOut, int nthreads = 0)
+{
+    const double threshold = 0.05;
+    const std::size_t N = d.numel();
+    const fft::RealFft3d t(d.n[0], d.n[1], d.n[2], nthreads);
+
+    std::vector<cplx> F(t.complexSize()), C(t.complexSize());
+    t.forward(phase, &F[0]);
+    std::vector<double> phaseDel(N, 0.0), tmp(N), delInv;
+    std::vector<unsigned char> prev(N, 0);
+
+    const int first = 9, last = iterative ? 3 : 9;
+    for (int k = first; k >= last; k -= 2) {
+        const int ksize[3] = {k, k, k};
+        const std::vector<double> del = sharpKernel(t, d, ksize);
+        if (k == first) {
+            delInv.assign(del.size(), 0.0);
+            for (std::size_t i = 0; i < del.size(); ++i)
+                if (std::fabs(del[i]) > threshold) delInv[i] = 1 / del[i];
+        }
+        maskOut = erodeMask(mask, d, ksize);
+        for (std::size_t i = 0; i < C.size(); ++i) C[i] = F[i] * del[i];
+        t.inverse(&C[0], &tmp[0]);
+        for (std::size_t i = 0; i < N; ++i) phaseDel[i] += tmp[i] * ((double)maskOut[i] - prev[i]);
+        prev = maskOut;
+    }
+
+    t.forward(&phaseDel[0], &C[0]);
+    for (std::size_t i = 0; i < C.size(); ++i) C[i] *= delInv[i];
+    t.inverse(&C[0], out);
+    for (std::size_t i = 0; i < N; ++i) out[i] *= maskOut[i];
+}
+
+// --------------------------------------------------------- Split-Bregman
+
+// Curvature of the L-curve (log(regularization), log(consistency^2)) at
+// point i, by central differences over the point index (the curvature
+// does not depend on the parametrization), signed as in findOptimalKappa.
+inline double lcurveCurvature(const std::vector<double> &reg, const std::vector<double> &cons, std::size_t i)
+{
+    double eta[3], rho[3];
+    for (int k = 0; k < 3; ++k) {
+        eta[k] = std::log(reg[i - 1 + k]);
+        rho[k] = std::log(cons[i - 1 + k] * cons[i - 1 + k]);
+    }
+    const double e1 = (eta[2] - eta[0]) / 2, e2 = eta[2] - 2 * eta[1] + eta[0];
+    const double r1 = (rho[2] - rho[0]) / 2, r2 = rho[2] - 2 * rho[1] + rho[0];
+    return 2 * (r2 * e1 - e2 * r1) / std::pow(r1 * r1 + e1 * e1, 1.5);
+}
+
+// True when the points first..end of the L-curve (evaluated so far, in
+// ascending lambda) hold a curvature maximum with at least two points on
+// its large-lambda side and `bracket` points on its small-lambda side.
+inline bool cornerBracketed(const std::vector<double> &reg, const std::vector<double> &cons, std::size_t first,
+                            int bracket)
+{
+    const std::size_t n = reg.size();
+    if (n - first < (std::size_t)bracket + 4) return false;
+    std::size_t best = 0;
+    double kmax = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = first + 1; i + 1 < n; ++i) {
+        const double k = lcurveCurvature(reg, cons, i);
+        if (k > kmax) {
+            kmax = k;
+            best = i;
+        }
+    }
+    return best > 0 && best - first >= (std::size_t)bracket && n - 1 - best >= 2;
+}
+
+// Work arrays of one Split-Bregman solve.
+struct SBState {
+    std::vector<double> v[3], nu[3];
+    std::vector<cplx> fu, acc, c;
+    bool zero;   // v and n are zero (fresh state)
+
+    void reset(const fft::RealFft3d &t)
+    {
+        zero = true;
+        for (int a = 0; a < 3; ++a) {
+            v[a].assign(t.realSize(), 0.0);
+            nu[a].assign(t.realSize(), 0.0);
+        }
+        fu.assign(t.complexSize(), cplx(0, 0));
+        acc.resize(t.complexSize());
+        c.resize(t.complexSize());
+    }
+
+    // Bytes held by one state of volume t.
+    static double bytes(const fft::RealFft3d &t)
+    {
+        return 6.0 * sizeof(double) * t.realSize() + 3.0 * sizeof(cplx) * t.complexSize();
+    }
+};
+
+class SplitBregman {
+public:
+    // phase: (SHARP-filtered) phase of size d, res: voxel size [mm],
+    // forward: direction of the finite differences.
+    SplitBregman(const double *phase, const Dims &d, const double res[3], bool forward, int nthreads = 0)
+        : d_(d), ops_(d, res, forward), t_(d.n[0], d.n[1], d.n[2], nthreads)
+    {
+        // fftn(phase); DFy = conj(D) .* fftn(phase) is formed on the fly (D real)
+        y_.resize(t_.complexSize());
+        t_.forward(phase, &y_[0]);
+    }
+
+    const fft::RealFft3d &transform() const { return t_; }
+
+    // Runs at most maxIter iterations of qsmSplitBregman (no magnitude
+    // weighting) from s (zeroed by s.reset, or the state of a previous
+    // solve to warm-start), stopping once the change of Fu falls below tol
+    // percent. Returns the change of every iteration. t is the transform
+    // of the caller's thread budget (same volume).
+    std::vector<double> solve(double lambda, double mu, int maxIter, double tol, SBState &s,
+                              const fft::RealFft3d &t, int minIter = 1) const
+    {
+        const double threshold = lambda / mu;
+        const std::size_t lines = t.n2() * t.n3();
+        std::vector<double> diff(lines), norm(lines), change;
+        for (int it = 0; it < maxIter; ++it) {
+            const bool zero = s.zero && it == 0;
+            // Fu = (DFy + mu * sum_a conj(fd_a) .* fftn(v_a - n_a)) .* SB_reg
+            for (int a = 0; a < 3; ++a) {
+                const bool last = a == 2;
+                if (!zero) {
+                    double *v = &s.v[a][0];
+                    const double *nu = &s.nu[a][0];
+                    forVoxels(t, [&](std::size_t i) { v[i] -= nu[i]; });
+                    t.forward(v, &s.c[0]);
+                }
+                std::fill(diff.begin(), diff.end(), 0.0);
+                std::fill(norm.begin(), norm.end(), 0.0);
+                forSpectrum(t, [&](std::size_t k1, std::size_t k2, std::size_t k3, std::size_t i) {
+                    cplx x = a == 0 ? y_[i] * ops_.dipole(k1, k2, k3) : s.acc[i];
+                    if (!zero) {
+                        const std::size_t k = a == 0 ? k1 : a == 1 ? k2 : k3;
+                        x += mu * fft::mul(std::conj(ops_.fd(a, k)), s.c[i]);
+                    }
+                    if (!last) {
+                        s.acc[i] = x;
+                        return;
+                    }
+                    const double D = ops_.dipole(k1, k2, k3);
+                    x *= 1 / (kEps + D * D + mu * ops_.e2(k1, k2, k3));
+                    const double w = hermitianWeight(k1, t.n1());
+                    const std::size_t l = i / t.rows();
+                    diff[l] += w * std::norm(x - s.fu[i]);
+                    norm[l] += w * std::norm(x);
+                    s.fu[i] = x;
+                });
+            }
+            double dsum = 0, nsum = 0;
+            for (std::size_t l = 0; l < lines; ++l) {
+                dsum += diff[l];
+                nsum += norm[l];
+            }
+
+            // rox = ifftn(fd_a .* Fu) + n_a, v_a = shrink(rox), n_a = rox - v_a
+            for (int a = 0; a < 3; ++a) {
+                forSpectrum(t, [&](std::size_t k1, std::size_t k2, std::size_t k3, std::size_t i) {
+                    const std::size_t k = a == 0 ? k1 : a == 1 ? k2 : k3;
+                    s.c[i] = fft::mul(ops_.fd(a, k), s.fu[i]);
+                });
+                t.inverse(&s.c[0], &s.v[a][0]);
+                double *v = &s.v[a][0], *nu = &s.nu[a][0];
+                forVoxels(t, [&](std::size_t i) {
+                    const double rox = v[i] + nu[i];
+                    const double mag = std::max(std::fabs(rox) - threshold, 0.0);
+                    v[i] = rox > 0 ? mag : rox < 0 ? -mag : 0;
+                    nu[i] = rox - v[i];
+                });
+            }
+
+            s.zero = false;
+            change.push_back(100 * std::sqrt(dsum) / std::sqrt(nsum));
+            if (change.back() < tol && it + 1 >= minIter) break;
+        }
+        return change;
+    }
+
+    // chi = real(ifftn(Fu)) into out (n volume); overwrites s.c.
+    void susceptibility(SBState &s, const fft::RealFft3d &t, double *out) const
+    {
+        s.c = s.fu;
+        t.inverse(&s.c[0], out);
+    }
+
+    // L-curve terms of calcSBLambdaL1 after a solve: sum(abs(v)) and
+    // norm(ifftn(D .* Fu) - phase), the latter through Parseval on the half
+    // spectrum (no inverse transform).
+    void lcurveTerms(const SBState &s, const fft::RealFft3d &t, double &consistency, double &regularization) const
+    {
+        const std::size_t N = t.realSize(), lines = t.n2() * t.n3();
+        regularization = 0;
+        for (int a = 0; a < 3; ++a)
+            for (std::size_t i = 0; i < N; ++i) regularization += std::fabs(s.v[a][i]);
+        std::vector<double> sum(lines, 0.0);
+        forSpectrum(t, [&](std::size_t k1, std::size_t k2, std::size_t k3, std::size_t i) {
+            sum[i / t.rows()] += hermitianWeight(k1, t.n1()) * std::norm(s.fu[i] * ops_.dipole(k1, k2, k3) - y_[i]);
+        });
+        double total = 0;
+        for (std::size_t l = 0; l < lines; ++l) total += sum[l];
+        consistency = std::sqrt(total / N);
+    }
+
+    // Solves every lambda of the L-curve (maxIter iterations from zero,
+    // mu fixed), several at once within memoryBytes of work arrays.
+    void lcurve(const std::vector<double> &lambda, double mu, int maxIter, double tol, double memoryBytes,
+                std::vector<double> &consistency, std::vector<double> &regularization, std::vector<int> &iterations,
+                int nthreads = 0) const
+    {
+        const std::size_t n = lambda.size();
+        consistency.assign(n, 0.0);
+        regularization.assign(n, 0.0);
+        iterations.assign(n, 0);
+        const int threads = num_threads(nthreads);
+        const int fit = (int)std::max(1.0, std::floor(memoryBytes / SBState::bytes(t_)));
+        const int width = std::min(parallel_width(n, 1, threads), fit);
+        const int inner = std::max(1, threads / width);
+        parallel_for(n, 1, [&](std::size_t b, std::size_t e, int) {
+            const fft::RealFft3d t(d_.n[0], d_.n[1], d_.n[2], inner);
+            SBState s;
+            for (std::size_t h = b; h < e; ++h) {
+                s.reset(t);
+                iterations[h] = (int)solve(lambda[h], mu, maxIter, tol, s, t).size();
+                lcurveTerms(s, t, consistency[h], regularization[h]);
+            }
+        }, width);
+    }
+
+    // Regularization path over the L-curve: lambdas solved from the largest
+    // to the smallest (lambda sorted ascending), each warm-started from the
+    // v, n and Fu of the previous one, with all threads on the FFTs. With
+    // bracket > 0 the path stops once the L-curve corner is bracketed:
+    // `bracket` lambdas past the curvature maximum (see cornerBracketed).
+    // Lambdas left out get NaN terms and 0 iterations.
+    void path(const std::vector<double> &lambda, double mu, int maxIter, double tol, int bracket, int minIter,
+              std::vector<double> &consistency, std::vector<double> &regularization, std::vector<int> &iterations) const
+    {
+        const std::size_t n = lambda.size();
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        consistency.assign(n, nan);
+        regularization.assign(n, nan);
+        iterations.assign(n, 0);
+        SBState s;
+        s.reset(t_);
+        for (std::size_t h = n; h-- > 0;) {
+            iterations[h] = (int)solve(lambda[h], mu, maxIter, tol, s, t_, minIter).size();
+            lcurveTerms(s, t_, consistency[h], regularization[h]);
+            if (bracket > 0 && cornerBracketed(regularization, consistency, h, bracket)) break;
+        }
+    }
+
+private:
+    Dims d_;
+    Operators ops_;
+    fft::RealFft3d t_;
+    std::vector<cplx> y_;
+};
+
+// ------------------------------------------------------ L2 closed form
+
+// L-curve terms of calcLambdaL2 for every lambda: with Chi = D ./ (eps +
+// D.^2 + lambda*E2) .* fftn(phase), the regularization
+// norm([fdx fdy fdz] .* Chi) / sqrt(N) and the consistency
+// norm(phase - ifftn(D .* Chi)). Both are sums over the spectrum
+// (Parseval), so all lambdas share one forward transform and one pass.
+inline void lcurveL2(const double *phase, const Dims &d, const double res[3], bool forward,
+                     const std::vector<double> &lambda, std::vector<double> &consistency,
+                     std::vector<double> &regularization, int nthreads = 0)
+{
+    const std::size_t nl = lambda.size();
+    const Operators ops(d, res, forward);
+    const fft::RealFft3d t(d.n[0], d.n[1], d.n[2], nthreads);
+    std::vector<cplx> y(t.complexSize());
+    t.forward(phase, &y[0]);
+
+    // Per-line partial sums keep the result independent of the threads
+    const std::size_t lines = t.n2() * t.n3();
+    std::vector<double> cons(lines * nl, 0.0), reg(lines * nl, 0.0);
+    forSpectrum(t, [&](std::size_t k1, std::size_t k2, std::size_t k3, std::size_t i) {
+        const double w = hermitianWeight(k1, t.n1()) * std::norm(y[i]);
+        const double D = ops.dipole(k1, k2, k3), E2 = ops.e2(k1, k2, k3);
+        const std::size_t l = i / t.rows();
+        for (std::size_t h = 0; h < nl; ++h) {
+            const double den = kEps + D * D + lambda[h] * E2;
+            const double g = D / den, r = 1 - D * g;
+            cons[l * nl + h] += w * r * r;
+            reg[l * nl + h] += w * E2 * g * g;
+        }
+    });
+    const double N = (double)t.realSize();
+    consistency.assign(nl, 0.0);
+    regularization.assign(nl, 0.0);
+    for (std::size_t l = 0; l < lines; ++l)
+        for (std::size_t h = 0; h < nl; ++h) {
+            consistency[h] += cons[l * nl + h];
+            regularization[h] += reg[l * nl + h];
+        }
+    for (std::size_t h = 0; h < nl; ++h) {
+        consistency[h] = std::sqrt(consistency[h] / N);
+        regularization[h] = std::sqrt(regularization[h] / N);
+    }
+}
+
+// ------------------------------------------------- Laplacian unwrapping
+
+// Laplacian phase unwrapping (unwrapPhaseLaplacian.m and laplacianUnwrap.m)
+// of volumes of one size: the Laplacian of the wrapped phase is computed
+// in image space with the periodic 7-point stencil, then inverted through
+// the half spectrum. The transform and the inverse of the stencil
+// spectrum, sum over axes of 2 - 2 cos(2 pi k / n) (0 at DC), are built
+// once and reused for every echo.
+class LaplacianUnwrap {
+public:
+    LaplacianUnwrap(const Dims &d, int nthreads)
+        : d_(d), t_(d.n[0], d.n[1], d.n[2], nthreads), inv_(t_.complexSize())
+    {
+        std::vector<double> e[3];
+        for (int a = 0; a < 3; ++a) {
+            e[a].resize(d.n[a]);
+            for (std::size_t k = 0; k < d.n[a]; ++k) e[a][k] = 2 - 2 * std::cos(2 * kPi * k / d.n[a]);
+        }
+        forSpectrum(t_, [&](std::size_t k1, std::size_t k2, std::size_t k3, std::size_t i) {
+            const double s = e[0][k1] + e[1][k2] + e[2][k3];
+            inv_[i] = s != 0 ? 1 / s : 0;
+        });
+    }
+
+    bool matches(const Dims &d, int nthreads) const
+    {
+        return d.n[0] == d_.n[0] && d.n[1] == d_.n[1] && d.n[2] == d_.n[2] && nthreads == t_.threads();
+    }
+
+    // lap = cos(phase) L(sin(phase)) - sin(phase) L(cos(phase)), with L
+    // the stencil 6 u(x) - sum of the 6 neighbours (del_op of
+    // unwrapPhaseLaplacian).
+    void sinCos(const double *phase, double *lap) const
+    {
+        std::vector<double> s(d_.numel()), c(d_.numel());
+        forVoxels(t_, [&](std::size_t i) {
+            s[i] = std::sin(phase[i]);
+            c[i] = std::cos(phase[i]);
+        });
+        forNeighbours([&](std::size_t i, const std::size_t nb[6]) {
+            double ss = 0, sc = 0;
+            for (int k = 0; k < 6; ++k) {
+                ss += s[nb[k]];
+                sc += c[nb[k]];
+            }
+            lap[i] = s[i] * sc - c[i] * ss;
+        });
+    }
+
+    // lap = sum over axes of wrap(phase(x) - phase(x-1)) - wrap(phase(x+1)
+    // - phase(x)), divided by 7 (phaseLaplacianFiltered of laplacianUnwrap).
+    void gradient(const double *phase, double *lap) const
+    {
+        forNeighbours([&](std::size_t i, const std::size_t nb[6]) {
+            double l = 0;
+            for (int a = 0; a < 3; ++a)
+                l += wrap(phase[i] - phase[nb[2 * a]]) - wrap(phase[nb[2 * a + 1]] - phase[i]);
+            lap[i] = l / 7;
+        });
+    }
+
+    // out = scale * the inverse stencil applied to lap (real(ifftn(fftn(lap)
+    // .* del_inv))).
+    void invert(const double *lap, double *out, double scale) const
+    {
+        std::vector<cplx> spec(t_.complexSize());
+        t_.forward(lap, &spec[0]);
+        forSpectrum(t_, [&](std::size_t, std::size_t, std::size_t, std::size_t i) { spec[i] *= scale * inv_[i]; });
+        t_.inverse(&spec[0], out);
+    }
+
+private:
+    // Phase difference wrapped to [-pi, pi) (angle of P ./ circshift(P)).
+    static double wrap(double x) { return x - 2 * kPi * std::floor(x / (2 * kPi) + 0.5); }
+
+    // Calls f(i, nb) for every voxel i, nb holding its periodic neighbours
+    // (previous and next along axes 1, 2 and 3); (n2, n3) lines split among
+    // threads.
+    template <class F>
+    void forNeighbours(F f) const
+    {
+        const std::size_t n1 = d_.n[0], n2 = d_.n[1], n3 = d_.n[2], lines = n2 * n3;
+        parallel_for(lines, std::max<std::size_t>(1, lines / (8 * (std::size_t)num_threads(t_.threads()))),
+                     [&](std::size_t b, std::size_t e, int) {
+            std::size_t nb[6];
+            for (std::size_t l = b; l < e; ++l) {
+                const std::size_t j = l % n2, k = l / n2;
+                const std::size_t jm = (j + n2 - 1) % n2, jp = (j + 1) % n2;
+                const std::size_t km = (k + n3 - 1) % n3, kp = (k + 1) % n3;
+                for (std::size_t i = 0; i < n1; ++i) {
+                    nb[0] = l * n1 + (i + n1 - 1) % n1;
+                    nb[1] = l * n1 + (i + 1) % n1;
+                    nb[2] = (jm + n2 * k) * n1 + i;
+                    nb[3] = (jp + n2 * k) * n1 + i;
+                    nb[4] = (j + n2 * km) * n1 + i;
+                    nb[5] = (j + n2 * kp) * n1 + i;
+                    f(l * n1 + i, nb);
+                }
+            }
+        }, t_.threads());
+    }
+
+    Dims d_;
+    fft::RealFft3d t_;
+    std::vector<double> inv_;
+};
+
+} // namespace qsm
+} // namespace qmr
+
+#endif
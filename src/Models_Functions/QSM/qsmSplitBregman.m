@@ -21,6 +21,18 @@ function chi_SB = qsmSplitBregman(nfm_Sharp_lunwrap, mask_sharp, lambda_L1, lamb
        preconMagWeightFlag = 0; 
     end
 
+    % Compiled engine (qMRbuildMex), without magnitude weighting: same
+    % iterations with real-to-complex FFTs and a fixed set of work arrays
+    if ~preconMagWeightFlag && exist('qsm_mex','file')==3 && ndims(nfm_Sharp_lunwrap)==3 && ~any(mod(size(nfm_Sharp_lunwrap),2))
+        tic
+        [chi_SB, res_change] = qsm_mex('splitbregman', double(nfm_Sharp_lunwrap), mask_sharp, lambda_L1, lambda_L2, directionFlag, imageResolution, pad_size);
+        for t = 1:numel(res_change)
+            disp(['Iteration  ', num2str(t), '  ->  Change in Chi: ', num2str(res_change(t)), ' %'])
+        end
+        toc
+        return
+    end
+
         
     lambda = lambda_L1;     % L1 penalty
 
@@ -0,0 +1,287 @@
+/*
+ * SHARP background removal and Split-Bregman QSM of qsm_sb (see qsm.hh).
+ *
+ *   [phaseSharp, maskSharp] = qsm_mex('sharp', phase, mask, mode, opts)
+ *   [chi, resChange] = qsm_mex('splitbregman', phase, mask, lambdaL1, lambdaL2,
+ *                              direction, resolution, padSize, opts)
+ *   [consistency, regularization, iterations] =
+ *       qsm_mex('lcurvel1', phase, Lambda, lambdaL2, resolution, direction, opts)
+ *   [consistency, regularization] =
+ *       qsm_mex('lcurvel2', phase, Lambda, resolution, direction, opts)
+ *   [phaseUnwrapped, phaseLaplacian] = qsm_mex('laplacian', phase, method, opts)
+ *
+ * phase is a real double volume with even dimensions, mask a volume of the
+ * same size (logical or numeric), mode 'once' or 'iterative', direction
+ * 'forward' or 'backward', resolution the voxel size [mm] and padSize the
+ * padding removed from chi, as in backgroundRemovalSharp, qsmSplitBregman
+ * (without magnitude weighting), calcSBLambdaL1 and calcLambdaL2. resChange
+ * holds the change in chi [%] of every Split-Bregman iteration. For the
+ * L-curves, consistency and regularization have one value per lambda.
+ *
+ * 'laplacian' unwraps every echo of phase (n1 x n2 x n3 x nEcho) as
+ * unwrapPhaseLaplacian (method 'sincos') or laplacianUnwrap before its
+ * re-embedding (method 'gradient'); phaseLaplacian is the Laplacian of
+ * the wrapped phase it inverts. The transform plan and the inverse
+ * Laplacian kernel are kept between calls for the last volume size.
+ *
+ * opts is an optional struct with NumThreads (0: all cores), MaxIter
+ * (20 for 'splitbregman', 10 for 'lcurvel1'), Tol (stop when the change
+ * in chi falls below Tol %, 1) and, for 'lcurvel1':
+ *   MaxMemory  MB of work arrays shared by the lambdas solved at once (4096)
+ *   WarmStart  solve Lambda (ascending) as a regularization path from the
+ *              largest value, each lambda starting from the solution of the
+ *              previous one (false: every lambda from zero, concurrently)
+ *   Bracket    with WarmStart, stop once this many lambdas lie past the
+ *              L-curve corner (0: solve all). Skipped lambdas get NaN
+ *              terms and 0 iterations.
+ *   MinIter    with WarmStart, least iterations per lambda (3)
+ *
+ * Written by: qMRLab contributors, 2026
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mex.h"
+#include "qmr_mex.hh"
+#include "qsm.hh"
+
+static const char *kName = "qsm_mex";
+
+static std::unique_ptr<qmr::qsm::LaplacianUnwrap> gLaplacian;
+
+namespace {
+
+qmr::qsm::Dims volumeDims(const mxArray *a, const char *argName)
+{
+    qmr::mex::requireDouble(kName, a, argName);
+    const std::vector<std::size_t> d = qmr::mex::dims(a, 3);
+    if (d.size() > 3)
+        qmr::mex::fail(kName, "invalidInputSize", std::string(argName) + " must be a 3D volume.");
+    for (int k = 0; k < 3; ++k)
+        if (d[k] == 0 || d[k] % 2)
+            qmr::mex::fail(kName, "invalidInputSize", std::string(argName) + " must have even dimensions.");
+    qmr::qsm::Dims out = {{d[0], d[1], d[2]}};
+    return out;
+}
+
+std::vector<unsigned char> maskOf(const mxArray *a, const qmr::qsm::Dims &d)
+{
+    if (mxGetNumberOfElements(a) != d.numel())
+        qmr::mex::fail(kName, "invalidInputSize", "mask must have the size of phase.");
+    std::vector<unsigned char> m(d.numel());
+    if (mxIsLogical(a)) {
+        const mxLogical *p = mxGetLogicals(a);
+        for (std::size_t i = 0; i < m.size(); ++i) m[i] = p[i] ? 1 : 0;
+    } else {
+        const std::vector<double> v = qmr::mex::toVector(a);
+        for (std::size_t i = 0; i < m.size(); ++i) m[i] = v[i] != 0;
+    }
+    return m;
+}
+
+void resolutionOf(const mxArray *a, double res[3])
+{
+    const std::vector<double> r = qmr::mex::toVector(a);
+    if (r.size() != 3 || !(r[0] > 0 && r[1] > 0 && r[2] > 0))
+        qmr::mex::fail(kName, "invalidInput", "resolution must hold 3 positive voxel sizes.");
+    for (int k = 0; k < 3; ++k) res[k] = r[k];
+}
+
+bool forwardOf(const mxArray *a)
+{
+    const std::string dir = qmr::mex::string(kName, a, "direction");
+    if (dir != "forward" && dir != "backward")
+        qmr::mex::fail(kName, "invalidInput", "direction must be 'forward' or 'backward'.");
+    return dir == "forward";
+}
+
+mxArray *createVolume(const qmr::qsm::Dims &d, mxClassID cls)
+{
+    mwSize dims[3] = {d.n[0], d.n[1], d.n[2]};
+    return mxCreateNumericArray(3, dims, cls, mxREAL);
+}
+
+mxArray *rowVector(const std::vector<double> &v)
+{
+    mxArray *a = mxCreateDoubleMatrix(1, v.size(), mxREAL);
+    std::copy(v.begin(), v.end(), mxGetPr(a));
+    return a;
+}
+
+void sharp(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 4 || nrhs > 5)
+        qmr::mex::fail(kName, "wrongNumInputs", "qsm_mex('sharp', phase, mask, mode, opts).");
+    const qmr::qsm::Dims d = volumeDims(prhs[1], "phase");
+    const std::vector<unsigned char> mask = maskOf(prhs[2], d);
+    const std::string mode = qmr::mex::string(kName, prhs[3], "mode");
+    if (mode != "once" && mode != "iterative")
+        qmr::mex::fail(kName, "invalidInput", "mode must be 'once' or 'iterative'.");
+    const int nthreads = (int)qmr::mex::option(nrhs > 4 ? prhs[4] : NULL, "NumThreads", 0.0);
+
+    plhs[0] = createVolume(d, mxDOUBLE_CLASS);
+    std::vector<unsigned char> maskOut;
+    qmr::qsm::sharp(mxGetPr(prhs[1]), mask, d, mode == "iterative", mxGetPr(plhs[0]), maskOut, nthreads);
+    if (nlhs > 1) {
+        plhs[1] = createVolume(d, mxLOGICAL_CLASS);
+        mxLogical *m = mxGetLogicals(plhs[1]);
+        for (std::size_t i = 0; i < maskOut.size(); ++i) m[i] = maskOut[i] != 0;
+    }
+}
+
+void splitBregman(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 8 || nrhs > 9)
+        qmr::mex::fail(kName, "wrongNumInputs",
+                       "qsm_mex('splitbregman', phase, mask, lambdaL1, lambdaL2, direction, resolution, padSize, opts).");
+    const qmr::qsm::Dims d = volumeDims(prhs[1], "phase");
+    const std::vector<unsigned char> mask = maskOf(prhs[2], d);
+    const double lambdaL1 = qmr::mex::scalar(kName, prhs[3], "lambdaL1");
+    const double lambdaL2 = qmr::mex::scalar(kName, prhs[4], "lambdaL2");
+    const bool forward = forwardOf(prhs[5]);
+    double res[3];
+    resolutionOf(prhs[6], res);
+    const std::vector<double> pad = qmr::mex::toVector(prhs[7]);
+    if (pad.size() != 3)
+        qmr::mex::fail(kName, "invalidInput", "padSize must hold 3 values.");
+    std::size_t p[3];
+    for (int k = 0; k < 3; ++k) {
+        if (!(pad[k] >= 0) || 2 * pad[k] > d.n[k])
+            qmr::mex::fail(kName, "invalidInput", "padSize must be >= 0 and at most half of the volume.");
+        p[k] = (std::size_t)pad[k];
+    }
+    const mxArray *opts = nrhs > 8 ? prhs[8] : NULL;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+    const int maxIter = (int)qmr::mex::option(opts, "MaxIter", 20.0);
+    const double tol = qmr::mex::option(opts, "Tol", 1.0);
+
+    const qmr::qsm::SplitBregman sb(mxGetPr(prhs[1]), d, res, forward, nthreads);
+    qmr::qsm::SBState s;
+    s.reset(sb.transform());
+    const std::vector<double> change = sb.solve(lambdaL1, lambdaL2, maxIter, tol, s, sb.transform());
+
+    // chi_sb = ifftn(Fu) .* mask_sharp, then the padding is removed
+    std::vector<double> chi(d.numel());
+    sb.susceptibility(s, sb.transform(), &chi[0]);
+    const qmr::qsm::Dims c = {{d.n[0] - 2 * p[0], d.n[1] - 2 * p[1], d.n[2] - 2 * p[2]}};
+    mwSize cd[3] = {c.n[0], c.n[1], c.n[2]};
+    plhs[0] = mxCreateNumericArray(3, cd, mxDOUBLE_CLASS, mxREAL);
+    double *out = mxGetPr(plhs[0]);
+    for (std::size_t k = 0; k < c.n[2]; ++k)
+        for (std::size_t j = 0; j < c.n[1]; ++j)
+            for (std::size_t i = 0; i < c.n[0]; ++i) {
+                const std::size_t src = (i + p[0]) + d.n[0] * ((j + p[1]) + d.n[1] * (k + p[2]));
+                out[i + c.n[0] * (j + c.n[1] * k)] = chi[src] * mask[src];
+            }
+    if (nlhs > 1) plhs[1] = rowVector(change);
+}
+
+void lcurveL1(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 6 || nrhs > 7)
+        qmr::mex::fail(kName, "wrongNumInputs",
+                       "qsm_mex('lcurvel1', phase, Lambda, lambdaL2, resolution, direction, opts).");
+    const qmr::qsm::Dims d = volumeDims(prhs[1], "phase");
+    const std::vector<double> lambda = qmr::mex::toVector(prhs[2]);
+    const double lambdaL2 = qmr::mex::scalar(kName, prhs[3], "lambdaL2");
+    double res[3];
+    resolutionOf(prhs[4], res);
+    const bool forward = forwardOf(prhs[5]);
+    const mxArray *opts = nrhs > 6 ? prhs[6] : NULL;
+    const int nthreads = (int)qmr::mex::option(opts, "NumThreads", 0.0);
+    const int maxIter = (int)qmr::mex::option(opts, "MaxIter", 10.0);
+    const double tol = qmr::mex::option(opts, "Tol", 1.0);
+    const double memory = qmr::mex::option(opts, "MaxMemory", 4096.0) * 1024 * 1024;
+    const bool warmStart = qmr::mex::option(opts, "WarmStart", 0.0) != 0;
+    const int bracket = (int)qmr::mex::option(opts, "Bracket", 0.0);
+    const int minIter = (int)qmr::mex::option(opts, "MinIter", 3.0);
+    if (warmStart)
+        for (std::size_t h = 1; h < lambda.size(); ++h)
+            if (!(lambda[h] > lambda[h - 1]))
+                qmr::mex::fail(kName, "invalidInput", "Lambda must be ascending with WarmStart.");
+
+    const qmr::qsm::SplitBregman sb(mxGetPr(prhs[1]), d, res, forward, nthreads);
+    std::vector<double> consistency, regularization;
+    std::vector<int> iterations;
+    if (warmStart)
+        sb.path(lambda, lambdaL2, maxIter, tol, bracket, minIter, consistency, regularization, iterations);
+    else
+        sb.lcurve(lambda, lambdaL2, maxIter, tol, memory, consistency, regularization, iterations, nthreads);
+
+    plhs[0] = rowVector(consistency);
+    if (nlhs > 1) plhs[1] = rowVector(regularization);
+    if (nlhs > 2) plhs[2] = rowVector(std::vector<double>(iterations.begin(), iterations.end()));
+}
+
+void lcurveL2(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 5 || nrhs > 6)
+        qmr::mex::fail(kName, "wrongNumInputs", "qsm_mex('lcurvel2', phase, Lambda, resolution, direction, opts).");
+    const qmr::qsm::Dims d = volumeDims(prhs[1], "phase");
+    const std::vector<double> lambda = qmr::mex::toVector(prhs[2]);
+    double res[3];
+    resolutionOf(prhs[3], res);
+    const bool forward = forwardOf(prhs[4]);
+    const int nthreads = (int)qmr::mex::option(nrhs > 5 ? prhs[5] : NULL, "NumThreads", 0.0);
+
+    std::vector<double> consistency, regularization;
+    qmr::qsm::lcurveL2(mxGetPr(prhs[1]), d, res, forward, lambda, consistency, regularization, nthreads);
+    plhs[0] = rowVector(consistency);
+    if (nlhs > 1) plhs[1] = rowVector(regularization);
+}
+
+void laplacian(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 3 || nrhs > 4)
+        qmr::mex::fail(kName, "wrongNumInputs", "qsm_mex('laplacian', phase, method, opts).");
+    qmr::mex::requireDouble(kName, prhs[1], "phase");
+    const std::vector<std::size_t> n = qmr::mex::dims(prhs[1], 4);
+    if (n.size() > 4)
+        qmr::mex::fail(kName, "invalidInputSize", "phase must be a 3D volume or a 4D stack of echoes.");
+    for (int k = 0; k < 3; ++k)
+        if (n[k] == 0 || n[k] % 2)
+            qmr::mex::fail(kName, "invalidInputSize", "phase must have even dimensions.");
+    const qmr::qsm::Dims d = {{n[0], n[1], n[2]}};
+    const std::string method = qmr::mex::string(kName, prhs[2], "method");
+    if (method != "sincos" && method != "gradient")
+        qmr::mex::fail(kName, "invalidInput", "method must be 'sincos' or 'gradient'.");
+    const int nthreads = (int)qmr::mex::option(nrhs > 3 ? prhs[3] : NULL, "NumThreads", 0.0);
+
+    if (!gLaplacian || !gLaplacian->matches(d, nthreads)) {
+        gLaplacian.reset();
+        gLaplacian.reset(new qmr::qsm::LaplacianUnwrap(d, nthreads));
+    }
+    const qmr::qsm::LaplacianUnwrap &lu = *gLaplacian;
+
+    mwSize dims[4] = {n[0], n[1], n[2], n[3]};
+    plhs[0] = mxCreateNumericArray(4, dims, mxDOUBLE_CLASS, mxREAL);
+    mxArray *lapOut = mxCreateNumericArray(4, dims, mxDOUBLE_CLASS, mxREAL);
+    const double *phase = mxGetPr(prhs[1]);
+    double *out = mxGetPr(plhs[0]), *lap = mxGetPr(lapOut);
+    for (std::size_t e = 0; e < n[3]; ++e) {
+        const std::size_t o = e * d.numel();
+        if (method == "sincos") lu.sinCos(phase + o, lap + o);
+        else lu.gradient(phase + o, lap + o);
+        lu.invert(lap + o, out + o, method == "sincos" ? 1.0 : 7.0);
+    }
+    if (nlhs > 1) plhs[1] = lapOut;
+    else mxDestroyArray(lapOut);
+}
+
+} // namespace
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs < 1)
+        qmr::mex::fail(kName, "wrongNumInputs", "qsm_mex expects a command as first input.");
+    const std::string cmd = qmr::mex::string(kName, prhs[0], "command");
+    if (cmd == "sharp") sharp(nlhs, plhs, nrhs, prhs);
+    else if (cmd == "splitbregman") splitBregman(nlhs, plhs, nrhs, prhs);
+    else if (cmd == "lcurvel1") lcurveL1(nlhs, plhs, nrhs, prhs);
+    else if (cmd == "lcurvel2") lcurveL2(nlhs, plhs, nrhs, prhs);
+    else if (cmd == "laplacian") laplacian(nlhs, plhs, nrhs, prhs);
+    else qmr::mex::fail(kName, "unknownCommand", "Unknown command '" + cmd + "'.");
+}
@@ -30,8 +30,26 @@ function unwrappedPhase = unwrapPhaseLaplacian(wrappedPhase)
 %
 %   Schofield and Zhu (2003), Fast phase unwrapping algorithm for 
 %   interferometric applications, Opt. Lett.,  28:1194-1196. 
+%
+%   wrappedPhase may hold several echoes along the 4th dimension; each is
+%   unwrapped separately.
 
     N = size(wrappedPhase);
+
+    if exist('qsm_mex','file')==3 && numel(N)>=3 && numel(N)<=4 && ~any(mod(N(1:3),2))
+        % Compiled engine (qMRbuildMex): Laplacian in image space, real
+        % transforms for the inversion, plan and kernel shared by the echoes
+        unwrappedPhase = qsm_mex('laplacian', double(wrappedPhase), 'sincos');
+        return
+    end
+
+    if numel(N) == 4
+        unwrappedPhase = zeros(N);
+        for iEcho = 1:N(4)
+            unwrappedPhase(:,:,:,iEcho) = unwrapPhaseLaplacian(wrappedPhase(:,:,:,iEcho));
+        end
+        return
+    end
     
     % Kernel size (and difference "h" size)
     ksize = [3, 3, 3];               